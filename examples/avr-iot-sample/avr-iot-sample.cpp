@@ -14,8 +14,11 @@
 #include "led_ctrl.h"
 #include "veml3328.h"
 #include "iotconnect.h"
+#include "iotcl_heap_stats.h"
+#include "iotc_ota.h"
 #include "iotc_ecc608.h"
 #include "iotc_provisioning.h"
+#include "avriot_binding.h"
 
 #define APP_VERSION "03.00.00"
 
@@ -45,12 +48,26 @@ static void on_connection_status(IotConnectConnectionStatus status) {
         case IOTC_CS_MQTT_DISCONNECTED:
             Log.info(F("IoTConnect Client Disconnected"));
             break;
+        case IOTC_CS_MQTT_TLS:
+        case IOTC_CS_MQTT_CONNECTING:
+        case IOTC_CS_MQTT_SUBSCRIBING:
+            Log.info(F("IoTConnect Client Connecting..."));
+            break;
+        case IOTC_CS_MQTT_BACKOFF:
+            Log.info(F("IoTConnect Client will retry the connection"));
+            break;
         default:
             Log.error(F("IoTConnect Client ERROR"));
             break;
     }
 }
 
+static void on_delivery(uint16_t publish_id, IotConnectDeliveryStatus status) {
+    if (IOTC_DS_DELIVERED != status) {
+        Log.warnf(F("Message %u was not delivered (%d)\n"), publish_id, (int) status);
+    }
+}
+
 static void command_status(const char* ack_id, bool command_success, const char *command_name, const char *message) {
     Log.infof(F("command: %s status=%s: %s\n"), command_name, command_success ? "OK" : "Failed", message);
     if (ack_id) {
@@ -65,58 +82,130 @@ static void command_status(const char* ack_id, bool command_success, const char
     }
 }
 
+// Command handlers declared by avriot_binding.h, which is generated from files/avriot-template.json
+void avriot_on_led_user(IotclC2dEventData data, const char *args) {
+    if (0 == strcmp(args, "on")) {
+        LedCtrl.on(Led::USER);
+    } else {
+        LedCtrl.off(Led::USER);
+    }
+    command_status(iotcl_c2d_get_ack_id(data), true, iotcl_c2d_get_command(data), "OK");
+}
+
+void avriot_on_led_error(IotclC2dEventData data, const char *args) {
+    if (0 == strcmp(args, "on")) {
+        LedCtrl.on(Led::ERROR);
+    } else {
+        LedCtrl.off(Led::ERROR);
+    }
+    command_status(iotcl_c2d_get_ack_id(data), true, iotcl_c2d_get_command(data), "OK");
+}
+
 static void on_command(IotclC2dEventData data) {
     const char *command = iotcl_c2d_get_command(data);
     const char *ack_id = iotcl_c2d_get_ack_id(data);
-    if (NULL != command) {
-        if(NULL != strstr(command, "led-user") ) {
-            if (NULL != strstr(command, " on")) {
-              LedCtrl.on(Led::USER);
-            } else {
-              LedCtrl.off(Led::USER);
-            }
-            command_status(ack_id, true, command, "OK");
-        } else if(NULL != strstr(command, "led-error") ) {
-            if (NULL != strstr(command, " on")) {
-              LedCtrl.on(Led::ERROR);
-            } else {
-              LedCtrl.off(Led::ERROR);
-            }
-            command_status(ack_id, true, command, "OK");
-        } else {
-            Log.errorf(F("Unknown command:%s\r\n"), command);
-            command_status(ack_id, false, command, "Not implemented");
-        }
-    } else {
+    if (NULL == command) {
         command_status(ack_id, false, "?", "Internal error");
+    } else if (IOTCL_SUCCESS != avriot_dispatch_command(data)) {
+        Log.errorf(F("Unknown command:%s\r\n"), command);
+        command_status(ack_id, false, command, "Not implemented");
     }
 }
 
+// The board has no storage for a second image, so this sink only counts the data. A real sink would
+// write it to an external flash, and implement save_state() and load_state() to resume downloads after a reset.
+static uint32_t ota_bytes_received = 0;
+
+static int ota_sink_open(void *context, uint32_t offset) {
+    (void) context;
+    ota_bytes_received = offset;
+    return IOTCL_SUCCESS;
+}
+
+static int ota_sink_write(void *context, uint32_t offset, const uint8_t *data, size_t data_length) {
+    (void) context;
+    (void) offset;
+    (void) data;
+    ota_bytes_received += data_length;
+    return IOTCL_SUCCESS;
+}
+
+static int ota_sink_close(void *context, bool is_complete, uint32_t image_size, const uint8_t *digest) {
+    (void) context;
+    (void) digest;
+    if (is_complete) {
+        Log.infof(F("OTA image of %lu bytes received. Installing it is not implemented.\n"), (unsigned long) image_size);
+    }
+    return IOTCL_SUCCESS;
+}
+
+static const IotConnectOtaSink ota_sink = {ota_sink_open, ota_sink_write, ota_sink_close, NULL, NULL};
+static IotConnectOta ota;
+
 static void on_ota(IotclC2dEventData data) {
-    const char *url = iotcl_c2d_get_ota_url(data, 0);
-    if (url == NULL) {
+    IotConnectOtaConfig c = {0};
+    c.host = iotcl_c2d_get_ota_url_hostname(data, 0);
+    c.resource = iotcl_c2d_get_ota_url_resource(data, 0);
+    c.ack_id = iotcl_c2d_get_ack_id(data);
+    c.sink = &ota_sink;
+    if (!c.host || !c.resource) {
       Log.error(F("OTA URL is missing?"));
       return;
     }
-    Log.infof(F("OTA download request received for https://%s, but it is not implemented.\n"), url);
+    // A new update replaces a download that is still in progress. This closes the sink of that download first,
+    // and does nothing if there is none.
+    iotconnect_ota_abort(&ota);
+    iotconnect_ota_start(&ota, &c); // the download runs in the main loop
+}
+
+#if IOTCL_HEAP_STATS
+// Define IOTCL_HEAP_STATS as 1 in iotcl_cfg.h to see how much heap the SDK uses.
+// The counters can also be sent to IoTConnect with iotcl_heap_stats_add_to_telemetry(),
+// if the device template has the matching attributes.
+static void log_heap_stats(void) {
+  IotclHeapStats s;
+  iotcl_heap_stats_get(&s);
+  Log.infof(F("Heap: current=%u peak=%u blocks=%u failed=%lu largest free=%u\r\n"),
+    (unsigned int) s.current_bytes,
+    (unsigned int) s.peak_bytes,
+    (unsigned int) s.current_blocks,
+    (unsigned long) s.num_failed,
+    (unsigned int) s.largest_free_block
+  );
+  Log.infof(F("Heap peak by subsystem: core=%u telemetry=%u c2d=%u dra=%u http=%u\r\n"),
+    (unsigned int) s.tag_peak_bytes[IOTCL_HEAP_TAG_CORE],
+    (unsigned int) s.tag_peak_bytes[IOTCL_HEAP_TAG_TELEMETRY],
+    (unsigned int) s.tag_peak_bytes[IOTCL_HEAP_TAG_C2D],
+    (unsigned int) s.tag_peak_bytes[IOTCL_HEAP_TAG_DRA],
+    (unsigned int) s.tag_peak_bytes[IOTCL_HEAP_TAG_HTTP]
+  );
 }
+#endif
 
 static void publish_telemetry() {
-    IotclMessageHandle msg = iotcl_telemetry_create();
-
-    // Optional. The first time you create a data point, the current timestamp will be automatically added
-    // TelemetryAddWith* calls are only required if sending multiple data points in one packet.
-    iotcl_telemetry_set_string(msg, "version", APP_VERSION);
-    iotcl_telemetry_set_number(msg, "random", rand() % 100);
-    iotcl_telemetry_set_number(msg, "temperature", Mcp9808.readTempC());
-    iotcl_telemetry_set_number(msg, "light.red", Veml3328.getRed());
-    iotcl_telemetry_set_number(msg, "light.green", Veml3328.getGreen());
-    iotcl_telemetry_set_number(msg, "light.blue", Veml3328.getBlue());
-    iotcl_telemetry_set_number(msg, "light.ir", Veml3328.getIR());
-    iotcl_telemetry_set_number(msg, "button_counter", button_press_count);
+    // The message is written directly into this buffer, so no heap is used while publishing telemetry.
+    static char telemetry_buffer[IOTCL_TELEMETRY_IN_BUFFER_OVERHEAD + 256];
+    IotclMessageHandle msg = iotcl_telemetry_create_in_buffer(telemetry_buffer, sizeof(telemetry_buffer));
+
+    AvriotTelemetry t;
+    t.version = APP_VERSION;
+    t.random = rand() % 100;
+    t.temperature = Mcp9808.readTempC();
+    t.light.r = Veml3328.getRed();
+    t.light.g = Veml3328.getGreen();
+    t.light.b = Veml3328.getBlue();
+    t.light.ir = Veml3328.getIR();
+    t.button_counter = button_press_count;
+
+    // The current timestamp will be automatically added to the data set
+    avriot_telemetry_serialize(&t, msg);
 
     iotcl_mqtt_send_telemetry(msg, false);
     iotcl_telemetry_destroy(msg);
+
+#if IOTCL_HEAP_STATS
+    log_heap_stats();
+#endif
 }
 
 static void on_lte_disconnect(void) {
@@ -150,47 +239,6 @@ static bool load_provisioned_data(IotConnectClientConfig *config) {
   return true;
 }
 
-#define MEMORY_TEST
-#ifdef MEMORY_TEST
-#define TEST_BLOCK_SIZE  1 * 128
-#define TEST_BLOCK_COUNT 30
-void memory_test() {
-    void *blocks[TEST_BLOCK_COUNT];
-    int i = 0;
-    for (; i < TEST_BLOCK_COUNT; i++) {
-        void *ptr = malloc(TEST_BLOCK_SIZE);
-        Log.infof(F("0x%x\r\n"), (unsigned long) ptr);
-        blocks[i] = ptr;
-        if (!ptr) {
-            break;
-        }
-    }
-    Log.infof(F("====Allocated %d blocks of size %d (of max %d)===\r\n"), i, TEST_BLOCK_SIZE, TEST_BLOCK_COUNT);
-    for (int j = 0; j < i; j++) {
-        free(blocks[j]);
-    }
-}
-#endif /* MEMORY_TEST */
-
-#define RESERVE_BLOCK_SIZE  128
-#define RESERVE_BLOCK_COUNT 30
-#define RESERVE_LEAK_COUNT 5 // Leak the last X blocks
-void reserve_stack_with_heap_leak() {
-    void *blocks[RESERVE_BLOCK_COUNT];
-    int i = 0;
-    for (; i < RESERVE_BLOCK_COUNT; i++) {
-        void *ptr = malloc(RESERVE_BLOCK_SIZE);
-        blocks[i] = ptr;
-        if (!ptr) {
-            break;
-        }
-    }
-    Log.infof(F("====Allocated %d blocks of size %d (of max %d)===\r\n"), i, RESERVE_BLOCK_SIZE, RESERVE_BLOCK_COUNT);
-    for (int j = 0; j < (i - RESERVE_LEAK_COUNT); j++) {
-        free(blocks[j]);
-    }
-}
-
 void demo_setup(void)
 {
   Log.begin(115200);
@@ -251,7 +299,9 @@ void demo_setup(void)
   config.ota_cb = on_ota;
   config.status_cb = on_connection_status;
   config.cmd_cb = on_command;
+  config.delivery_cb = on_delivery;
   config.verbose = true;
+  config.identity_cache_ttl = 7UL * 24 * 3600; // skip discovery and identity at boot for a week
 
   if (iotconnect_sdk_init(&config)) {
     Lte.onDisconnect(on_lte_disconnect);
@@ -270,6 +320,10 @@ void demo_setup(void)
           break;
         }
        iotconnect_sdk_loop(); // loop will take 2 seconds to complete (related to the modem polling most likely)
+        if (IOTC_OTA_DOWNLOADING == iotconnect_ota_loop(&ota)) {
+          j--; // keep running while the download runs, one range at a time
+          continue;
+        }
        delay(2000);
         if (button_pressed) {
           button_pressed = false;
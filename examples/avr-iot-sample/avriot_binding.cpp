@@ -0,0 +1,81 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ *
+ * Generated by scripts/generate-template-binding.py from avriot-template.json. Do not edit.
+ */
+
+#include <string.h>
+#include "iotcl_cfg.h"
+#include "iotcl_pgmspace.h"
+#include "iotcl_json_writer.h"
+#include "avriot_binding.h"
+
+static const char AVRIOT_KEY_VERSION[] PROGMEM = "\"version\":";
+static const char AVRIOT_KEY_RANDOM[] PROGMEM = ",\"random\":";
+static const char AVRIOT_KEY_TEMPERATURE[] PROGMEM = ",\"temperature\":";
+static const char AVRIOT_KEY_LIGHT_R[] PROGMEM = ",\"light\":{\"r\":";
+static const char AVRIOT_KEY_LIGHT_B[] PROGMEM = ",\"b\":";
+static const char AVRIOT_KEY_LIGHT_G[] PROGMEM = ",\"g\":";
+static const char AVRIOT_KEY_LIGHT_IR[] PROGMEM = ",\"ir\":";
+static const char AVRIOT_KEY_BUTTON_COUNTER[] PROGMEM = ",\"button_counter\":";
+
+static void avriot_telemetry_write(IotclJsonWriter *w, void *context) {
+    const AvriotTelemetry *t = (const AvriotTelemetry *) context;
+    iotcl_json_writer_raw_P(w, AVRIOT_KEY_VERSION);
+    iotcl_json_writer_string(w, t->version);
+    iotcl_json_writer_raw_P(w, AVRIOT_KEY_RANDOM);
+    iotcl_json_writer_int32(w, t->random);
+    iotcl_json_writer_raw_P(w, AVRIOT_KEY_TEMPERATURE);
+    iotcl_json_writer_decimal(w, t->temperature, AVRIOT_DECIMAL_PRECISION);
+    iotcl_json_writer_raw_P(w, AVRIOT_KEY_LIGHT_R);
+    iotcl_json_writer_int32(w, t->light.r);
+    iotcl_json_writer_raw_P(w, AVRIOT_KEY_LIGHT_B);
+    iotcl_json_writer_int32(w, t->light.b);
+    iotcl_json_writer_raw_P(w, AVRIOT_KEY_LIGHT_G);
+    iotcl_json_writer_int32(w, t->light.g);
+    iotcl_json_writer_raw_P(w, AVRIOT_KEY_LIGHT_IR);
+    iotcl_json_writer_int32(w, t->light.ir);
+    iotcl_json_writer_char(w, '}');
+    iotcl_json_writer_raw_P(w, AVRIOT_KEY_BUTTON_COUNTER);
+    iotcl_json_writer_int32(w, t->button_counter);
+}
+
+int avriot_telemetry_serialize(const AvriotTelemetry *t, IotclMessageHandle message) {
+    if (!t) {
+        return IOTCL_ERR_MISSING_VALUE;
+    }
+    return iotcl_telemetry_write_raw_values(message, avriot_telemetry_write, (void *) t);
+}
+
+typedef void (*AvriotCommandHandler)(IotclC2dEventData data, const char *args);
+
+typedef struct {
+    const char *name; // PROGMEM
+    AvriotCommandHandler handler;
+} AvriotCommandEntry;
+
+static const char AVRIOT_COMMAND_LED_USER[] PROGMEM = "led-user";
+static const char AVRIOT_COMMAND_LED_ERROR[] PROGMEM = "led-error";
+
+static const AvriotCommandEntry avriot_commands[] PROGMEM = {
+    {AVRIOT_COMMAND_LED_USER, avriot_on_led_user},
+    {AVRIOT_COMMAND_LED_ERROR, avriot_on_led_error},
+};
+
+int avriot_dispatch_command(IotclC2dEventData data) {
+    const char *command = iotcl_c2d_get_command(data);
+    if (!command) {
+        return IOTCL_ERR_MISSING_VALUE;
+    }
+    for (size_t i = 0; i < sizeof(avriot_commands) / sizeof(avriot_commands[0]); i++) {
+        const char *name = (const char *) pgm_read_ptr(&avriot_commands[i].name);
+        size_t name_len = strlen_P(name);
+        if (0 == strncmp_P(command, name, name_len) && (command[name_len] == '\0' || command[name_len] == ' ')) {
+            AvriotCommandHandler handler = (AvriotCommandHandler) pgm_read_ptr(&avriot_commands[i].handler);
+            handler(data, command[name_len] == ' ' ? &command[name_len + 1] : &command[name_len]);
+            return IOTCL_SUCCESS;
+        }
+    }
+    return IOTCL_ERR_BAD_VALUE;
+}
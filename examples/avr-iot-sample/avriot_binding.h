@@ -0,0 +1,59 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ *
+ * Generated by scripts/generate-template-binding.py from avriot-template.json. Do not edit.
+ */
+
+#ifndef AVRIOT_BINDING_H
+#define AVRIOT_BINDING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "iotcl_telemetry.h"
+#include "iotcl_c2d.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AVRIOT_TEMPLATE_CODE "avriot"
+
+// Number of decimal places for DECIMAL attributes
+#ifndef AVRIOT_DECIMAL_PRECISION
+#define AVRIOT_DECIMAL_PRECISION 4
+#endif
+
+typedef struct __attribute__((packed)) {
+    int32_t r;
+    int32_t b;
+    int32_t g;
+    int32_t ir;
+} AvriotTelemetryLight;
+
+typedef struct __attribute__((packed)) {
+    const char *version;
+    int32_t random;
+    double temperature;
+    AvriotTelemetryLight light;
+    int32_t button_counter;
+} AvriotTelemetry;
+
+// Writes all attributes into the current data set of a message created with iotcl_telemetry_create_in_buffer().
+// String attributes that are NULL will be sent as null.
+int avriot_telemetry_serialize(const AvriotTelemetry *t, IotclMessageHandle message);
+
+// Command handlers that need to be implemented by the application.
+// args points to the command arguments (the text after the command name and a space) or an empty string.
+void avriot_on_led_user(IotclC2dEventData data, const char *args);
+void avriot_on_led_error(IotclC2dEventData data, const char *args);
+
+// Calls the handler of the received command.
+// Returns IOTCL_ERR_BAD_VALUE if the command is not a part of the template.
+int avriot_dispatch_command(IotclC2dEventData data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // AVRIOT_BINDING_H
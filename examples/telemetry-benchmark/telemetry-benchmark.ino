@@ -0,0 +1,108 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * Measures how long it takes to build and serialize a telemetry message with 20 number fields
+ * using the different telemetry number setters. This sketch does not need network connectivity.
+ */
+
+#include <Arduino.h>
+#include "log.h"
+#include "iotcl.h"
+#include "iotcl_telemetry.h"
+
+#define NUM_FIELDS 20
+#define NUM_ITERATIONS 50
+
+static const char *const FIELD_NAMES[NUM_FIELDS] = {
+    "f00", "f01", "f02", "f03", "f04", "f05", "f06", "f07", "f08", "f09",
+    "obj.f10", "obj.f11", "obj.f12", "obj.f13", "obj.f14", "obj.f15", "obj.f16", "obj.f17", "obj.f18", "obj.f19"
+};
+
+static char message_buffer[IOTCL_TELEMETRY_IN_BUFFER_OVERHEAD + 400];
+
+// sensor-like values with 4 decimal places, like 23.4375
+static int32_t fixed_value(int i) {
+    return 234375L + i * 1234L;
+}
+
+static double double_value(int i) {
+    return fixed_value(i) / 10000.0;
+}
+
+static void set_numbers(IotclMessageHandle msg) {
+    for (int i = 0; i < NUM_FIELDS; i++) {
+        iotcl_telemetry_set_number(msg, FIELD_NAMES[i], double_value(i));
+    }
+}
+
+static void set_fixed(IotclMessageHandle msg) {
+    for (int i = 0; i < NUM_FIELDS; i++) {
+        iotcl_telemetry_set_fixed(msg, FIELD_NAMES[i], fixed_value(i), 4);
+    }
+}
+
+static void report(const __FlashStringHelper *name, unsigned long elapsed_us, size_t length) {
+    Log.infof(F("%S: %lu us per message, %u bytes\r\n"), name, elapsed_us / NUM_ITERATIONS, (unsigned int) length);
+}
+
+static unsigned long benchmark_tree(void (*set_fn)(IotclMessageHandle), const __FlashStringHelper *name) {
+    size_t length = 0;
+    unsigned long start = micros();
+    for (int i = 0; i < NUM_ITERATIONS; i++) {
+        IotclMessageHandle msg = iotcl_telemetry_create();
+        set_fn(msg);
+        char *json = iotcl_telemetry_create_serialized_string(msg, false);
+        length = json ? strlen(json) : 0;
+        iotcl_telemetry_destroy_serialized_string(json);
+        iotcl_telemetry_destroy(msg);
+    }
+    unsigned long elapsed = micros() - start;
+    report(name, elapsed, length);
+    return elapsed;
+}
+
+static unsigned long benchmark_in_buffer(void (*set_fn)(IotclMessageHandle), const __FlashStringHelper *name) {
+    size_t length = 0;
+    unsigned long start = micros();
+    for (int i = 0; i < NUM_ITERATIONS; i++) {
+        IotclMessageHandle msg = iotcl_telemetry_create_in_buffer(message_buffer, sizeof(message_buffer));
+        set_fn(msg);
+        const char *json = iotcl_telemetry_get_serialized_string(msg);
+        length = json ? strlen(json) : 0;
+        iotcl_telemetry_destroy(msg);
+    }
+    unsigned long elapsed = micros() - start;
+    report(name, elapsed, length);
+    return elapsed;
+}
+
+void setup() {
+    Log.begin(115200);
+    Log.setLogLevel(LogLevel::INFO);
+
+    IotclClientConfig config;
+    iotcl_init_client_config(&config);
+    config.device.instance_type = IOTCL_DCT_AWS_DEDICATED;
+    config.device.duid = "benchmark";
+    if (iotcl_init(&config)) {
+        Log.error(F("Failed to initialize the library!"));
+        return;
+    }
+
+    Log.infof(F("Building and serializing %d messages with %d number fields each...\r\n"), NUM_ITERATIONS, NUM_FIELDS);
+    unsigned long baseline = benchmark_tree(set_numbers, F("cJSON tree, set_number"));
+    benchmark_tree(set_fixed, F("cJSON tree, set_fixed"));
+    benchmark_in_buffer(set_numbers, F("In buffer, set_number"));
+    unsigned long fastest = benchmark_in_buffer(set_fixed, F("In buffer, set_fixed"));
+    if (fastest) {
+        Log.infof(F("In buffer set_fixed is %lu.%02lu times faster than the cJSON tree with set_number\r\n"),
+                  baseline / fastest, (baseline * 100 / fastest) % 100);
+    }
+    iotcl_deinit();
+}
+
+void loop() {
+}
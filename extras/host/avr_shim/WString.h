@@ -0,0 +1,15 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * The Sequans controller header only needs __FlashStringHelper from WString.h, which the Arduino shim declares.
+ */
+
+#ifndef IOTC_HOST_WSTRING_H
+#define IOTC_HOST_WSTRING_H
+
+#include <Arduino.h>
+
+#endif // IOTC_HOST_WSTRING_H
@@ -0,0 +1,39 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * The EEPROM of the AVR128DB48 in RAM, erased (0xFF) at start. EEPROM addresses are passed as pointers.
+ * Bytes that eeprom_update_block() actually changes are counted, as each of them is an erase/write cycle.
+ */
+
+#ifndef IOTC_HOST_AVR_EEPROM_H
+#define IOTC_HOST_AVR_EEPROM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define E2END 0x1FF
+
+extern uint8_t iotc_avr_eeprom[E2END + 1];
+extern uint32_t iotc_avr_eeprom_num_writes;
+
+inline void eeprom_read_block(void *dst, const void *src, size_t n) {
+    const uint8_t *from = &iotc_avr_eeprom[(uintptr_t) src];
+    for (size_t i = 0; i < n; i++) {
+        ((uint8_t *) dst)[i] = from[i];
+    }
+}
+
+inline void eeprom_update_block(const void *src, void *dst, size_t n) {
+    uint8_t *to = &iotc_avr_eeprom[(uintptr_t) dst];
+    for (size_t i = 0; i < n; i++) {
+        if (to[i] != ((const uint8_t *) src)[i]) {
+            to[i] = ((const uint8_t *) src)[i];
+            iotc_avr_eeprom_num_writes++;
+        }
+    }
+}
+
+#endif // IOTC_HOST_AVR_EEPROM_H
@@ -0,0 +1,24 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * Interrupt service routines are plain functions that the modem emulator calls.
+ * The emulator only runs them from clock reads and delays, and the Sequans controller never reads
+ * the clock between cli() and sei(), so those do not need to do anything.
+ */
+
+#ifndef IOTC_HOST_AVR_INTERRUPT_H
+#define IOTC_HOST_AVR_INTERRUPT_H
+
+#define ISR(vector) extern "C" void vector(void)
+
+inline void cli(void) {}
+
+inline void sei(void) {}
+
+extern "C" void USART1_RXC_vect(void);
+extern "C" void USART1_DRE_vect(void);
+
+#endif // IOTC_HOST_AVR_INTERRUPT_H
@@ -0,0 +1,102 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * The AVR128DB48 registers that the Sequans controller uses: port C, which carries the flow control lines,
+ * and USART1, which is connected to the modem. The modem emulator drives the other side of them.
+ */
+
+#ifndef IOTC_HOST_AVR_IO_H
+#define IOTC_HOST_AVR_IO_H
+
+#include <stdint.h>
+
+typedef struct {
+    volatile uint8_t DIR;
+    volatile uint8_t OUT;
+    volatile uint8_t IN;
+    volatile uint8_t INTFLAGS;
+} VPORT_t;
+
+// OUTSET and OUTCLR are write-only strobes that set or clear bits of OUT
+class IotcAvrOutStrobe {
+public:
+    IotcAvrOutStrobe(volatile uint8_t *out, bool is_set) : out(out), is_set(is_set) {}
+
+    IotcAvrOutStrobe &operator=(uint8_t mask) {
+        if (is_set) {
+            *out |= mask;
+        } else {
+            *out &= (uint8_t) ~mask;
+        }
+        return *this;
+    }
+
+    // Reads as 0, so a compound OR writes just the mask
+    IotcAvrOutStrobe &operator|=(uint8_t mask) {
+        return *this = mask;
+    }
+
+private:
+    volatile uint8_t *out;
+    bool is_set;
+};
+
+typedef struct {
+    IotcAvrOutStrobe OUTSET;
+    IotcAvrOutStrobe OUTCLR;
+} PORT_t;
+
+// Writing TXDATAL puts the byte on the line to the modem. See iotc_avr_usart1_transmit().
+class IotcAvrTxData {
+public:
+    IotcAvrTxData &operator=(uint8_t data);
+};
+
+typedef struct {
+    volatile uint8_t RXDATAL;
+    IotcAvrTxData TXDATAL;
+    volatile uint8_t CTRLA;
+    volatile uint8_t CTRLB;
+    volatile uint8_t CTRLC;
+    volatile uint16_t BAUD;
+} USART_t;
+
+extern VPORT_t VPORTC;
+extern PORT_t PORTC;
+extern USART_t USART1;
+
+// Implemented by the modem emulator
+void iotc_avr_usart1_transmit(uint8_t data);
+
+inline IotcAvrTxData &IotcAvrTxData::operator=(uint8_t data) {
+    iotc_avr_usart1_transmit(data);
+    return *this;
+}
+
+#define PIN0_bm 0x01
+#define PIN1_bm 0x02
+#define PIN2_bm 0x04
+#define PIN3_bm 0x08
+#define PIN4_bm 0x10
+#define PIN5_bm 0x20
+#define PIN6_bm 0x40
+#define PIN7_bm 0x80
+
+#define PORT_INT4_bm 0x10
+#define PORT_INT6_bm 0x40
+
+#define USART_RXCIE_bm 0x80
+#define USART_TXCIE_bm 0x40
+#define USART_DREIE_bm 0x20
+
+#define USART_RXEN_bm 0x80
+#define USART_TXEN_bm 0x40
+
+#define USART_CMODE_ASYNCHRONOUS_gc (0x00 << 6)
+#define USART_SBMODE_1BIT_gc (0x00 << 3)
+#define USART_CHSIZE_8BIT_gc (0x03 << 0)
+
+#endif // IOTC_HOST_AVR_IO_H
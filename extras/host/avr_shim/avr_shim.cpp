@@ -0,0 +1,66 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <avr/eeprom.h>
+#include <avr/io.h>
+#include "iotc_avr_compat.h"
+
+VPORT_t VPORTC;
+PORT_t PORTC = {IotcAvrOutStrobe(&VPORTC.OUT, true), IotcAvrOutStrobe(&VPORTC.OUT, false)};
+USART_t USART1;
+
+IotcAvrSerial Serial3;
+
+uint8_t iotc_avr_eeprom[E2END + 1];
+uint32_t iotc_avr_eeprom_num_writes = 0;
+
+// erased, as the EEPROM of a new device
+static struct IotcAvrEepromEraser {
+    IotcAvrEepromEraser() {
+        memset(iotc_avr_eeprom, 0xFF, sizeof(iotc_avr_eeprom));
+    }
+} iotc_avr_eeprom_eraser;
+
+void IotcAvrSerial::print(const char *str) {
+    fputs(str, stdout);
+}
+
+int iotc_avr_vfprintf(IotcAvrFile *stream, const char *format, va_list args) {
+    char local_buffer[256];
+    char *buffer = local_buffer;
+    va_list args_copy;
+
+    va_copy(args_copy, args);
+    int length = vsnprintf(local_buffer, sizeof(local_buffer), format, args_copy);
+    va_end(args_copy);
+    if (length < 0) {
+        return length;
+    }
+    if ((size_t) length >= sizeof(local_buffer)) {
+        buffer = (char *) malloc((size_t) length + 1);
+        if (!buffer) {
+            return -1;
+        }
+        va_copy(args_copy, args);
+        vsnprintf(buffer, (size_t) length + 1, format, args_copy);
+        va_end(args_copy);
+    }
+
+    int ret = length;
+    for (int i = 0; i < length; i++) {
+        if (stream->put(buffer[i], stream)) {
+            ret = -1;
+            break;
+        }
+    }
+    if (buffer != local_buffer) {
+        free(buffer);
+    }
+    return ret;
+}
@@ -0,0 +1,27 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * Stand-in for the AVR-IoT Cellular library ECC608. There is no secure element on the host.
+ */
+
+#ifndef IOTC_HOST_ECC608_H
+#define IOTC_HOST_ECC608_H
+
+#include <Arduino.h>
+
+typedef int ATCA_STATUS;
+
+#define ATCA_SUCCESS 0
+#define ATCACERT_E_SUCCESS 0
+
+class ECC608Class {
+public:
+    ATCA_STATUS begin(void);
+};
+
+extern ECC608Class ECC608;
+
+#endif // IOTC_HOST_ECC608_H
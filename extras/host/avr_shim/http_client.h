@@ -0,0 +1,48 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * Stand-in for the AVR-IoT Cellular library HttpClient, with the parts that the SDK uses.
+ * See library_shim.cpp, which sends the same AT commands through the Sequans controller.
+ */
+
+#ifndef IOTC_HOST_HTTP_CLIENT_H
+#define IOTC_HOST_HTTP_CLIENT_H
+
+#include <Arduino.h>
+
+#define HTTP_DEFAULT_TIMEOUT_MS (20000)
+
+typedef struct {
+    uint16_t status_code;
+    uint32_t data_size;
+} HttpResponse;
+
+class HttpClientClass {
+public:
+    enum ContentType {
+        CONTENT_TYPE_APPLICATION_X_WWW_FORM_URLENCODED = 0,
+        CONTENT_TYPE_TEXT_PLAIN,
+        CONTENT_TYPE_APPLICATION_OCTET_STREAM,
+        CONTENT_TYPE_MULTIPART_FORM_DATA,
+        CONTENT_TYPE_APPLICATION_JSON
+    };
+
+    static const uint16_t STATUS_OK = 200;
+
+    bool configure(const char *host, const uint16_t port, const bool enable_tls);
+
+    HttpResponse get(const char *endpoint, const char *header = "");
+
+    HttpResponse post(const char *endpoint,
+                      const char *data,
+                      const char *header = "",
+                      const ContentType content_type = CONTENT_TYPE_TEXT_PLAIN,
+                      const uint32_t timeout_ms = HTTP_DEFAULT_TIMEOUT_MS);
+};
+
+extern HttpClientClass HttpClient;
+
+#endif // IOTC_HOST_HTTP_CLIENT_H
@@ -0,0 +1,60 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * The avr-libc and DxCore APIs that the Sequans controller uses beyond the Arduino shim: program memory strings,
+ * stdio streams with a put function, the CPU clock and Serial3. CMakeLists.txt includes this header ahead of
+ * sequans_controller.cpp only, because it replaces FILE and vfprintf, so that the file can be built unchanged.
+ */
+
+#ifndef IOTC_HOST_AVR_COMPAT_H
+#define IOTC_HOST_AVR_COMPAT_H
+
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#define F_CPU 24000000UL
+
+// Program memory is regular memory on the host
+#define PROGMEM
+#define PSTR(string_literal) (string_literal)
+#define strstr_P strstr
+#define strcpy_P strcpy
+#define strlen_P strlen
+#define strcmp_P strcmp
+#define memcmp_P memcmp
+
+// avr-libc streams that pass every character to a put function
+typedef struct IotcAvrFile {
+    int (*put)(char c, struct IotcAvrFile *stream);
+} IotcAvrFile;
+
+#define FILE IotcAvrFile
+#define _FDEV_SETUP_WRITE 0x02
+#define fdev_setup_stream(stream, put_fn, get_fn, rwflag) \
+    do { \
+        (void) (get_fn); \
+        (void) (rwflag); \
+        (stream)->put = (put_fn); \
+    } while (0)
+#define fdev_close() do {} while (0)
+
+// Unlike vfprintf(), leaves args as it was, because the controller formats the same arguments more than once
+int iotc_avr_vfprintf(IotcAvrFile *stream, const char *format, va_list args);
+
+#define vfprintf iotc_avr_vfprintf
+#define vfprintf_P iotc_avr_vfprintf
+
+// The debug port. Prints to stdout.
+class IotcAvrSerial {
+public:
+    void print(const char *str);
+};
+
+extern IotcAvrSerial Serial3;
+
+#endif // IOTC_HOST_AVR_COMPAT_H
@@ -0,0 +1,354 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * Stand-ins for the AVR-IoT Cellular library classes that the SDK uses on top of the Sequans controller.
+ * Their sources are not part of this repository, so these send the same AT commands and wait for the same URCs
+ * as the library does, to make the emulated round trips match the ones on the board.
+ * The ECC608 signature for the TLS handshake is not computed, but the signing round trip is done.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "log.h"
+#include "sequans_controller.h"
+#include "ecc608.h"
+#include "lte.h"
+#include "http_client.h"
+#include "mqtt_client.h"
+
+#define MQTT_TLS_SECURITY_PROFILE_ID (2)
+#define MQTT_TLS_ECC_SECURITY_PROFILE_ID (1)
+#define MQTT_URC_STATUS_CODE_INDEX (2)
+#define MQTT_SUBSCRIBE_URC_LENGTH (164)
+#define MQTT_MSG_LENGTH_BUFFER_SIZE (4)
+#define MQTT_DISCONNECT "AT+SQNSMQTTDISCONNECT=0"
+#define HCESIGN_DIGEST_LENGTH (64)
+
+#define HTTP_SECURITY_PROFILE_ID (3)
+#define HTTP_RING_URC_LENGTH (64)
+#define HTTP_RESPONSE_STATUS_CODE_INDEX (1)
+#define HTTP_RESPONSE_DATA_SIZE_INDEX (3)
+#define HTTP_POST_METHOD (0)
+#define HTTP_GET_METHOD (0)
+
+LteClass Lte;
+ECC608Class ECC608;
+MqttClientClass MqttClient;
+HttpClientClass HttpClient;
+
+static volatile bool connected_to_broker = false;
+static volatile bool is_disconnected_early = false;
+// One more than the controller copies, so that the URC data stays terminated
+static char urc_buffer[URC_DATA_BUFFER_SIZE + 1];
+static char topic_buffer[MQTT_TOPIC_MAX_LENGTH + 3];
+static void (*disconnected_callback)(void) = NULL;
+static void (*receive_callback)(const char *topic, const uint16_t message_length, const int32_t message_id) = NULL;
+
+bool LteClass::begin(const uint32_t timeout_ms, const bool print_messages) {
+    (void) timeout_ms;
+    (void) print_messages;
+    return true;
+}
+
+void LteClass::end(void) {
+}
+
+bool LteClass::isConnected(void) {
+    return true;
+}
+
+ATCA_STATUS ECC608Class::begin(void) {
+    return ATCA_SUCCESS;
+}
+
+static void internalDisconnectCallback(char *urc_data) {
+    (void) urc_data;
+    connected_to_broker = false;
+    if (disconnected_callback != NULL) {
+        disconnected_callback();
+    }
+}
+
+static void internalOnEarlyDisconnectCallback(char *urc_data) {
+    char value_buffer[5] = {0};
+    strncpy(urc_buffer, urc_data, URC_DATA_BUFFER_SIZE);
+    urc_buffer[URC_DATA_BUFFER_SIZE] = '\0';
+    if (SequansController.extractValueFromCommandResponse(urc_buffer, 2, value_buffer, sizeof(value_buffer), 0)
+        && abs(atoi(value_buffer)) > 0) {
+        is_disconnected_early = true;
+    }
+}
+
+static void internalOnReceiveCallback(char *urc_data) {
+    char message_length_buffer[MQTT_MSG_LENGTH_BUFFER_SIZE + 1];
+    char message_id_buffer[16];
+    int32_t message_id = -1;
+
+    strncpy(urc_buffer, urc_data, URC_DATA_BUFFER_SIZE);
+    urc_buffer[URC_DATA_BUFFER_SIZE] = '\0';
+    if (!SequansController.extractValueFromCommandResponse(urc_buffer, 1, topic_buffer, sizeof(topic_buffer), 0)) {
+        return;
+    }
+    // Remove the quotes
+    char *topic = topic_buffer + 1;
+    topic[strlen(topic) - 1] = 0;
+
+    if (!SequansController.extractValueFromCommandResponse(
+            urc_buffer, 2, message_length_buffer, sizeof(message_length_buffer), 0)) {
+        return;
+    }
+    if (SequansController.extractValueFromCommandResponse(
+            urc_buffer, 4, message_id_buffer, sizeof(message_id_buffer), 0)) {
+        message_id = (int32_t) atoi(message_id_buffer);
+    }
+    if (receive_callback != NULL) {
+        receive_callback(topic, (uint16_t) atoi(message_length_buffer), message_id);
+    }
+}
+
+// Answers the signing request of the modem. The digest is not signed, but the command has the length of a signature.
+static bool sendSigningCommand(char *data) {
+    char ctx_id_buffer[6];
+    char digest[HCESIGN_DIGEST_LENGTH + 1];
+    char signature[HCESIGN_DIGEST_LENGTH * 2 + 1];
+
+    if (!SequansController.extractValueFromCommandResponse(data, 0, ctx_id_buffer, sizeof(ctx_id_buffer), 0)
+        || !SequansController.extractValueFromCommandResponse(data, 3, digest, sizeof(digest), 0)) {
+        Log.error(F("Failed to generate signing command"));
+        return false;
+    }
+    memset(signature, '0', HCESIGN_DIGEST_LENGTH * 2);
+    signature[HCESIGN_DIGEST_LENGTH * 2] = '\0';
+
+    SequansController.startCriticalSection();
+    SequansController.writeString(F("AT+SQNHCESIGN=%u,0,64,\"%s\""), true, (unsigned int) atoi(ctx_id_buffer), signature);
+    SequansController.stopCriticalSection();
+    return true;
+}
+
+bool MqttClientClass::begin(
+        const char *client_id,
+        const char *host,
+        const uint16_t port,
+        const bool use_tls,
+        const uint16_t keep_alive,
+        const bool use_ecc,
+        const char *username,
+        const char *password,
+        const uint32_t timeout_ms,
+        const bool print_messages
+) {
+    (void) print_messages;
+    if (!Lte.isConnected()) {
+        return false;
+    }
+    connected_to_broker = false;
+
+    // Terminates an existing configuration. Fails if there is none.
+    SequansController.writeString(F(MQTT_DISCONNECT), true);
+    SequansController.readResponse();
+    SequansController.clearReceiveBuffer();
+
+    ResponseResult configure_response;
+    if (use_tls) {
+        configure_response = SequansController.writeCommand(
+            F("AT+SQNSMQTTCFG=0,\"%s\",\"%s\",\"%s\",%u"), NULL, 0,
+            client_id, username, password,
+            use_ecc ? MQTT_TLS_ECC_SECURITY_PROFILE_ID : MQTT_TLS_SECURITY_PROFILE_ID);
+    } else {
+        configure_response = SequansController.writeCommand(
+            F("AT+SQNSMQTTCFG=0,\"%s\",\"%s\",\"%s\""), NULL, 0, client_id, username, password);
+    }
+    if (configure_response != ResponseResult::OK) {
+        Log.errorf(F("Failed to configure MQTT, error code: %X\r\n"), static_cast<uint8_t>(configure_response));
+        return false;
+    }
+
+    is_disconnected_early = false;
+    SequansController.registerCallback(F("SQNSMQTTONCONNECT"), internalOnEarlyDisconnectCallback);
+
+    const ResponseResult connect_response = SequansController.writeCommand(
+        F("AT+SQNSMQTTCONNECT=0,\"%s\",%u,%u"), NULL, 0, host, port, keep_alive);
+    if (connect_response != ResponseResult::OK || is_disconnected_early) {
+        SequansController.unregisterCallback(F("SQNSMQTTONCONNECT"));
+        Log.error(F("Failed to request connection to MQTT broker"));
+        return false;
+    }
+
+    if (use_tls && use_ecc) {
+        if (!SequansController.waitForURC(F("SQNHCESIGN"), urc_buffer, URC_DATA_BUFFER_SIZE, timeout_ms)
+            || is_disconnected_early) {
+            SequansController.unregisterCallback(F("SQNSMQTTONCONNECT"));
+            Log.error(F("Timed out whilst waiting for TLS signing"));
+            return false;
+        }
+        if (!sendSigningCommand(urc_buffer)) {
+            SequansController.unregisterCallback(F("SQNSMQTTONCONNECT"));
+            return false;
+        }
+    }
+
+    SequansController.unregisterCallback(F("SQNSMQTTONCONNECT"));
+    if (!SequansController.waitForURC(F("SQNSMQTTONCONNECT"), urc_buffer, URC_DATA_BUFFER_SIZE, timeout_ms)) {
+        Log.error(F("Timed out waiting for connection response"));
+        SequansController.writeString(F(MQTT_DISCONNECT), true);
+        SequansController.readResponse();
+        return false;
+    }
+
+    char status_code_buffer[3] = "";
+    if (!SequansController.extractValueFromCommandResponse(
+            urc_buffer, MQTT_URC_STATUS_CODE_INDEX, status_code_buffer, sizeof(status_code_buffer), 0)) {
+        Log.error(F("Failed to extract status code for connection"));
+        return false;
+    }
+    if (0 == abs(atoi(status_code_buffer))) {
+        connected_to_broker = true;
+        SequansController.registerCallback(F("SQNSMQTTONDISCONNECT"), internalDisconnectCallback);
+    } else {
+        Log.errorf(F("Unable to connect to broker: %s\r\n"), status_code_buffer);
+    }
+    return connected_to_broker;
+}
+
+bool MqttClientClass::end(void) {
+    SequansController.unregisterCallback(F("SQNSMQTTONMESSAGE"));
+    SequansController.unregisterCallback(F("SQNSMQTTONDISCONNECT"));
+
+    if (Lte.isConnected() && isConnected()) {
+        SequansController.writeString(F(MQTT_DISCONNECT), true);
+        SequansController.readResponse();
+        SequansController.clearReceiveBuffer();
+    }
+    connected_to_broker = false;
+    if (disconnected_callback != NULL) {
+        disconnected_callback();
+    }
+    return true;
+}
+
+void MqttClientClass::onDisconnect(void (*disconnected)(void)) {
+    if (disconnected != NULL) {
+        disconnected_callback = disconnected;
+    }
+}
+
+bool MqttClientClass::isConnected(void) {
+    return connected_to_broker;
+}
+
+bool MqttClientClass::subscribe(const char *topic, const MqttQoS quality_of_service) {
+    if (!isConnected()) {
+        Log.error(F("Attempted MQTT Subscribe without being connected to a broker"));
+        return false;
+    }
+    const ResponseResult subscribe_result = SequansController.writeCommand(
+        F("AT+SQNSMQTTSUBSCRIBE=0,\"%s\",%u"), NULL, 0, topic, quality_of_service);
+    if (subscribe_result != ResponseResult::OK) {
+        Log.errorf(F("Failed to send subscribe command, error code: %x"), static_cast<uint8_t>(subscribe_result));
+        return false;
+    }
+
+    char urc[MQTT_SUBSCRIBE_URC_LENGTH] = "";
+    char status_code_buffer[3] = "";
+    if (!SequansController.waitForURC(F("SQNSMQTTONSUBSCRIBE"), urc, sizeof(urc))) {
+        Log.error(F("Timed out waiting for subscribe confirmation\r\n"));
+        return false;
+    }
+    if (!SequansController.extractValueFromCommandResponse(
+            urc, MQTT_URC_STATUS_CODE_INDEX, status_code_buffer, sizeof(status_code_buffer), 0)) {
+        Log.error(F("Failed to retrieve status code from subscribe notification"));
+        return false;
+    }
+    return 0 == abs(atoi(status_code_buffer));
+}
+
+void MqttClientClass::onReceive(
+        void (*callback)(const char *topic, const uint16_t message_length, const int32_t message_id)
+) {
+    if (callback != NULL) {
+        receive_callback = callback;
+        SequansController.registerCallback(F("SQNSMQTTONMESSAGE"), internalOnReceiveCallback);
+    }
+}
+
+bool HttpClientClass::configure(const char *host, const uint16_t port, const bool enable_tls) {
+    const ResponseResult response = SequansController.writeCommand(
+        F("AT+SQNHTTPCFG=0,\"%s\",%u,%u,\"\",\"\",0,120,1,%u"), NULL, 0,
+        host, port, enable_tls ? 1 : 0, HTTP_SECURITY_PROFILE_ID);
+    return response == ResponseResult::OK;
+}
+
+// Waits for the response URC and parses the status code and the content length
+static HttpResponse wait_for_http_response(const uint32_t timeout_ms) {
+    HttpResponse http_response = {0, 0};
+    char urc[HTTP_RING_URC_LENGTH] = "";
+    char value_buffer[16] = "";
+
+    if (!SequansController.waitForURC(F("SQNHTTPRING"), urc, sizeof(urc), timeout_ms)) {
+        Log.error(F("Timed out waiting for the HTTP response"));
+        return http_response;
+    }
+    if (SequansController.extractValueFromCommandResponse(
+            urc, HTTP_RESPONSE_STATUS_CODE_INDEX, value_buffer, sizeof(value_buffer), 0)) {
+        http_response.status_code = (uint16_t) atoi(value_buffer);
+    }
+    if (SequansController.extractValueFromCommandResponse(
+            urc, HTTP_RESPONSE_DATA_SIZE_INDEX, value_buffer, sizeof(value_buffer), 0)) {
+        http_response.data_size = (uint32_t) atol(value_buffer);
+    }
+    return http_response;
+}
+
+// The library formats the header with "%s" and takes its length, so a NULL header crashes on the device
+static bool is_header_valid(const char *header) {
+    if (!header) {
+        Log.error(F("HttpClient: The header must not be NULL"));
+        return false;
+    }
+    return true;
+}
+
+HttpResponse HttpClientClass::get(const char *endpoint, const char *header) {
+    HttpResponse http_response = {0, 0};
+    if (!is_header_valid(header)) {
+        return http_response;
+    }
+    const ResponseResult response = SequansController.writeCommand(
+        F("AT+SQNHTTPQRY=0,%u,\"%s\",\"%s\""), NULL, 0, HTTP_GET_METHOD, endpoint, header);
+    if (response != ResponseResult::OK) {
+        Log.error(F("Failed to send the HTTP request"));
+        return http_response;
+    }
+    return wait_for_http_response(HTTP_DEFAULT_TIMEOUT_MS);
+}
+
+HttpResponse HttpClientClass::post(
+        const char *endpoint,
+        const char *data,
+        const char *header,
+        const ContentType content_type,
+        const uint32_t timeout_ms
+) {
+    HttpResponse http_response = {0, 0};
+    if (!is_header_valid(header)) {
+        return http_response;
+    }
+    const size_t data_length = strlen(data);
+
+    SequansController.writeString(F("AT+SQNHTTPSND=0,%u,\"%s\",%lu,\"%u\",\"%s\""), true,
+        HTTP_POST_METHOD, endpoint, (unsigned long) data_length, (unsigned int) content_type, header);
+    if (!SequansController.waitForByte('>', timeout_ms)) {
+        Log.error(F("Timed out waiting to deliver the HTTP payload"));
+        return http_response;
+    }
+    SequansController.writeBytes((const uint8_t *) data, data_length);
+    if (SequansController.readResponse() != ResponseResult::OK) {
+        Log.error(F("Failed to send the HTTP payload"));
+        return http_response;
+    }
+    return wait_for_http_response(timeout_ms);
+}
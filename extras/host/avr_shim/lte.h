@@ -0,0 +1,24 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * Stand-in for the AVR-IoT Cellular library Lte. The emulated modem is always attached to the network.
+ */
+
+#ifndef IOTC_HOST_LTE_H
+#define IOTC_HOST_LTE_H
+
+#include <Arduino.h>
+
+class LteClass {
+public:
+    bool begin(const uint32_t timeout_ms = 60000, const bool print_messages = true);
+    void end(void);
+    bool isConnected(void);
+};
+
+extern LteClass Lte;
+
+#endif // IOTC_HOST_LTE_H
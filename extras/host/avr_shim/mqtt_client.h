@@ -0,0 +1,46 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * Stand-in for the AVR-IoT Cellular library MqttClient, with the parts that the SDK uses.
+ * See library_shim.cpp, which sends the same AT commands through the Sequans controller.
+ */
+
+#ifndef IOTC_HOST_MQTT_CLIENT_H
+#define IOTC_HOST_MQTT_CLIENT_H
+
+#include <Arduino.h>
+
+#define MQTT_TOPIC_MAX_LENGTH (128)
+
+enum MqttQoS { AT_MOST_ONCE = 0, AT_LEAST_ONCE, EXACTLY_ONCE };
+
+class MqttClientClass {
+public:
+    bool begin(const char *client_id,
+               const char *host,
+               const uint16_t port,
+               const bool use_tls,
+               const uint16_t keep_alive = 60,
+               const bool use_ecc = true,
+               const char *username = "",
+               const char *password = "",
+               const uint32_t timeout_ms = 30000,
+               const bool print_messages = true);
+
+    bool end(void);
+
+    void onDisconnect(void (*disconnected)(void));
+
+    bool isConnected(void);
+
+    bool subscribe(const char *topic, const MqttQoS quality_of_service = AT_MOST_ONCE);
+
+    void onReceive(void (*callback)(const char *topic, const uint16_t message_length, const int32_t message_id));
+};
+
+extern MqttClientClass MqttClient;
+
+#endif // IOTC_HOST_MQTT_CLIENT_H
@@ -0,0 +1,64 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * The AVR128DB48 port C pins as DxCore numbers them, and the DxCore pin functions that the Sequans controller uses.
+ * Writes to port C pins go to VPORTC.OUT, where the modem emulator sees the RTS line. The rest is not emulated.
+ */
+
+#ifndef IOTC_HOST_PINS_ARDUINO_H
+#define IOTC_HOST_PINS_ARDUINO_H
+
+#include <stdint.h>
+#include <avr/io.h>
+
+#define PIN_PC0 16
+#define PIN_PC1 17
+#define PIN_PC2 18
+#define PIN_PC3 19
+#define PIN_PC4 20
+#define PIN_PC5 21
+#define PIN_PC6 22
+#define PIN_PC7 23
+
+#define LOW 0
+#define HIGH 1
+#define CHANGE 1
+
+#define PIN_DIR_INPUT 0x0000
+#define PIN_DIR_OUTPUT 0x0001
+#define PIN_PULLUP_ON 0x0100
+#define PIN_INT_CHANGE 0x0080
+#define PIN_INPUT_ENABLE 0x0800
+#define PIN_INPUT_DISABLE 0x0008
+
+inline void pinConfigure(uint8_t pin, uint16_t configuration) {
+    (void) pin;
+    (void) configuration;
+}
+
+inline void digitalWrite(uint8_t pin, uint8_t value) {
+    if (pin < PIN_PC0 || pin > PIN_PC7) {
+        return;
+    }
+    uint8_t mask = (uint8_t) (1 << (pin - PIN_PC0));
+    if (value) {
+        VPORTC.OUT |= mask;
+    } else {
+        VPORTC.OUT &= (uint8_t) ~mask;
+    }
+}
+
+inline void attachInterrupt(uint8_t pin, void (*callback)(void), uint8_t mode) {
+    (void) pin;
+    (void) callback;
+    (void) mode;
+}
+
+inline void detachInterrupt(uint8_t pin) {
+    (void) pin;
+}
+
+#endif // IOTC_HOST_PINS_ARDUINO_H
@@ -0,0 +1,32 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * Host version of the AVR-IoT Cellular library TimeoutTimer
+ */
+
+#ifndef IOTC_HOST_TIMEOUT_TIMER_H
+#define IOTC_HOST_TIMEOUT_TIMER_H
+
+#include <Arduino.h>
+
+class TimeoutTimer {
+public:
+    explicit TimeoutTimer(const uint32_t timeout_ms) : timeout_ms(timeout_ms), start_ms(millis()) {}
+
+    bool hasTimedOut(void) const {
+        return millis() - start_ms >= timeout_ms;
+    }
+
+    void reset(void) {
+        start_ms = millis();
+    }
+
+private:
+    uint32_t timeout_ms;
+    unsigned long start_ms;
+};
+
+#endif // IOTC_HOST_TIMEOUT_TIMER_H
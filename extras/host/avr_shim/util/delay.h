@@ -0,0 +1,12 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+#ifndef IOTC_HOST_UTIL_DELAY_H
+#define IOTC_HOST_UTIL_DELAY_H
+
+// Advances the virtual clock of the modem emulator, like delay()
+void _delay_ms(double ms);
+
+#endif // IOTC_HOST_UTIL_DELAY_H
@@ -0,0 +1,372 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * Runs the SDK end to end on the host: discovery and identity against the fake cloud, the MQTT connection,
+ * telemetry with broker acknowledgements, a C2D command with its ack, and a reconnect after the broker drops
+ * the connection, an ack that waits in the publish queue while the arena of its C2D message is reused,
+ * and a second boot that connects with the MQTT settings from the identity cache without
+ * discovery and identity. Each phase is timed.
+ *
+ * By default, the in-process fake broker is used. With --broker host:port, the SDK connects to a local
+ * Mosquitto (or any MQTT 3.1.1 broker without TLS and authentication) instead, and the C2D command is
+ * published by the device itself to its own C2D topic. The reconnect phase needs the fake broker.
+ *
+ * Usage: iotc_host_e2e [--broker host:port] [--messages N] [--ack-delay ms] [--verbose]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <Arduino.h>
+#include "log.h"
+
+#include "iotcl.h"
+#include "iotcl_arena.h"
+#include "iotcl_c2d.h"
+#include "iotcl_telemetry.h"
+#include "iotconnect.h"
+#include "iotc_transport.h"
+#include "iotc_transport_posix.h"
+#include "iotc_fake_broker.h"
+#include "iotc_fake_cloud.h"
+
+#define E2E_DUID "host-e2e"
+#define E2E_CPID "HOSTCPID"
+#define E2E_ENV "poc"
+#define E2E_TIMEOUT_MS 20000UL
+#define E2E_IDENTITY_CACHE_TTL 3600
+#define E2E_MAX_TRACKED_IDS 65536
+#define E2E_ARENA_SIZE 2048
+#define E2E_QUEUED_ACK_ID "e2e-ack-queued"
+
+static struct {
+    uint32_t num_delivered;
+    uint32_t num_not_delivered;
+    uint64_t latency_sum_us;
+    uint64_t latency_max_us;
+    bool is_command_received;
+    uint16_t ack_publish_id;
+    bool is_ack_delivered;
+    uint32_t num_connected;
+    bool is_ack_queued;             // on_command() fills the publish window before the ack
+    bool is_queued_ack_received;    // by the fake broker, with its ack ID intact
+} results;
+
+static uint8_t arena_buffer[E2E_ARENA_SIZE];
+
+static uint64_t sent_at_us[E2E_MAX_TRACKED_IDS];
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000ULL + (uint64_t) ts.tv_nsec / 1000ULL;
+}
+
+static void on_status(IotConnectConnectionStatus status) {
+    if (IOTC_CS_MQTT_CONNECTED == status) {
+        results.num_connected++;
+    }
+}
+
+static void on_delivery(uint16_t publish_id, IotConnectDeliveryStatus status) {
+    if (IOTC_DS_DELIVERED != status) {
+        results.num_not_delivered++;
+        return;
+    }
+    results.num_delivered++;
+    if (publish_id == results.ack_publish_id) {
+        results.is_ack_delivered = true;
+    }
+    if (sent_at_us[publish_id]) {
+        uint64_t latency = now_us() - sent_at_us[publish_id];
+        sent_at_us[publish_id] = 0;
+        results.latency_sum_us += latency;
+        if (latency > results.latency_max_us) {
+            results.latency_max_us = latency;
+        }
+    }
+}
+
+static void on_command(IotclC2dEventData data) {
+    const char *ack_id = iotcl_c2d_get_ack_id(data);
+    results.is_command_received = true;
+    if (ack_id && results.is_ack_queued) {
+        // the ack can only be sent when these are acknowledged, which is after the arena scope of this message ends
+        for (int i = 0; i < IOTC_MQTT_PUBLISH_WINDOW; i++) {
+            iotc_default_transport.mqtt_publish("e2e/window", "{}", IOTCL_DC_AT_LEAST_ONCE);
+        }
+    }
+    if (ack_id) {
+        iotcl_mqtt_send_cmd_ack(ack_id, IOTCL_C2D_EVT_CMD_SUCCESS_WITH_ACK, "OK");
+        results.ack_publish_id = iotconnect_sdk_get_last_publish_id();
+    }
+}
+
+// Called from the broker thread
+static void on_broker_publish(void *context, const char *topic, const char *payload, size_t payload_length) {
+    (void) context;
+    (void) topic;
+    size_t id_length = strlen(E2E_QUEUED_ACK_ID);
+    for (size_t i = 0; i + id_length <= payload_length; i++) {
+        if (0 == memcmp(&payload[i], E2E_QUEUED_ACK_ID, id_length)) {
+            __atomic_store_n(&results.is_queued_ack_received, true, __ATOMIC_RELEASE);
+            return;
+        }
+    }
+}
+
+static bool loop_until_queued_ack_received(void) {
+    unsigned long start = millis();
+    while (!__atomic_load_n(&results.is_queued_ack_received, __ATOMIC_ACQUIRE)) {
+        if (millis() - start > E2E_TIMEOUT_MS) {
+            return false;
+        }
+        iotconnect_sdk_loop();
+        delay(1);
+    }
+    return true;
+}
+
+static void on_ota(IotclC2dEventData data) {
+    (void) data;
+}
+
+// Runs the SDK loop until the flag is set. Returns false on timeout.
+static bool loop_until(const volatile bool *flag) {
+    unsigned long start = millis();
+    while (!*flag) {
+        if (millis() - start > E2E_TIMEOUT_MS) {
+            return false;
+        }
+        iotconnect_sdk_loop();
+        delay(1);
+    }
+    return true;
+}
+
+static bool send_telemetry(uint32_t num_messages) {
+    uint32_t num_sent = 0;
+    unsigned long start = millis();
+    while (num_sent < num_messages || results.num_delivered + results.num_not_delivered < num_messages) {
+        if (millis() - start > E2E_TIMEOUT_MS) {
+            return false;
+        }
+        // keep the queue short, so that the measured latency is the round trip and not time spent in the queue
+        if (num_sent < num_messages
+            && num_sent - results.num_delivered - results.num_not_delivered < IOTC_MQTT_PUBLISH_WINDOW) {
+            IotclMessageHandle msg = iotcl_telemetry_create();
+            iotcl_telemetry_set_number(msg, "temperature", 20.0 + num_sent % 10);
+            iotcl_telemetry_set_number(msg, "humidity", 40.0 + num_sent % 20);
+            iotcl_telemetry_set_string(msg, "status", "ok");
+            uint16_t previous_id = iotconnect_sdk_get_last_publish_id();
+            uint64_t sent_us = now_us();
+            iotcl_mqtt_send_telemetry(msg, false);
+            iotcl_telemetry_destroy(msg);
+            uint16_t publish_id = iotconnect_sdk_get_last_publish_id();
+            if (publish_id == previous_id) {
+                return false; // not accepted
+            }
+            if (0 == sent_at_us[publish_id]) {
+                // the delivery can already have been reported for a QoS 0 message
+                sent_at_us[publish_id] = sent_us;
+            }
+            num_sent++;
+            continue;
+        }
+        iotconnect_sdk_loop();
+    }
+    return 0 == results.num_not_delivered;
+}
+
+static void print_phase(const char *name, uint64_t elapsed_us) {
+    printf("%-28s %10.3f ms\n", name, (double) elapsed_us / 1000.0);
+}
+
+int main(int argc, char *argv[]) {
+    const char *broker = NULL;
+    uint32_t num_messages = 1000;
+    unsigned long ack_delay_ms = 0;
+    bool is_verbose = false;
+    char broker_host[128] = IOTC_POSIX_DEFAULT_MQTT_HOST;
+    uint16_t broker_port = IOTC_POSIX_DEFAULT_MQTT_PORT;
+    char c2d_topic[128];
+    IotcFakeCloudStats cloud_stats = {0};
+
+    for (int i = 1; i < argc; i++) {
+        if (0 == strcmp(argv[i], "--broker") && i + 1 < argc) {
+            broker = argv[++i];
+        } else if (0 == strcmp(argv[i], "--messages") && i + 1 < argc) {
+            num_messages = (uint32_t) strtoul(argv[++i], NULL, 10);
+        } else if (0 == strcmp(argv[i], "--ack-delay") && i + 1 < argc) {
+            ack_delay_ms = strtoul(argv[++i], NULL, 10);
+        } else if (0 == strcmp(argv[i], "--verbose")) {
+            is_verbose = true;
+        } else {
+            fprintf(stderr, "Usage: %s [--broker host:port] [--messages N] [--ack-delay ms] [--verbose]\n", argv[0]);
+            return 2;
+        }
+    }
+    Log.setLogLevel(is_verbose ? LogLevel::DEBUG : LogLevel::WARN);
+
+    if (broker) {
+        const char *colon = strrchr(broker, ':');
+        size_t host_length = colon ? (size_t) (colon - broker) : strlen(broker);
+        if (host_length >= sizeof(broker_host)) {
+            fprintf(stderr, "The broker host name is too long\n");
+            return 2;
+        }
+        memcpy(broker_host, broker, host_length);
+        broker_host[host_length] = 0;
+        if (colon) {
+            broker_port = (uint16_t) atoi(colon + 1);
+        }
+    } else {
+        IotcFakeBrokerConfig broker_config = {0};
+        broker_config.puback_delay_ms = ack_delay_ms;
+        broker_config.publish_cb = on_broker_publish;
+        if (!iotc_fake_broker_start(&broker_config)) {
+            fprintf(stderr, "Unable to start the fake broker\n");
+            return 1;
+        }
+        broker_port = iotc_fake_broker_get_port();
+    }
+    printf("Broker: %s %s:%u\n", broker ? "external" : "fake", broker_host, broker_port);
+
+    IotcPosixTransportConfig transport_config = {0};
+    transport_config.mqtt_host = broker_host;
+    transport_config.mqtt_port = broker_port;
+    transport_config.https_handler = iotc_fake_cloud_https_handler;
+    transport_config.https_context = &cloud_stats;
+    iotc_posix_transport_configure(&transport_config);
+
+    IotConnectClientConfig config = {0};
+    config.cpid = (char *) E2E_CPID;
+    config.env = (char *) E2E_ENV;
+    config.duid = (char *) E2E_DUID;
+    config.connection_type = IOTC_CT_AWS;
+    config.cmd_cb = on_command;
+    config.ota_cb = on_ota;
+    config.status_cb = on_status;
+    config.delivery_cb = on_delivery;
+    config.auto_reconnect = true;
+    config.verbose = is_verbose;
+    config.identity_cache_ttl = E2E_IDENTITY_CACHE_TTL;
+
+    int exit_code = 1;
+    uint64_t start = now_us();
+    if (!iotconnect_sdk_init(&config)) {
+        fprintf(stderr, "FAIL: iotconnect_sdk_init()\n");
+        goto cleanup;
+    }
+    print_phase("discovery+identity+connect", now_us() - start);
+
+    start = now_us();
+    if (!send_telemetry(num_messages)) {
+        fprintf(stderr, "FAIL: telemetry. Delivered %u, not delivered %u\n", results.num_delivered, results.num_not_delivered);
+        goto cleanup;
+    }
+    {
+        uint64_t elapsed = now_us() - start;
+        print_phase("telemetry", elapsed);
+        printf("  %u messages, %.0f msg/s, latency mean %.1f us, max %llu us\n",
+            num_messages,
+            elapsed ? num_messages * 1000000.0 / (double) elapsed : 0.0,
+            num_messages ? (double) results.latency_sum_us / num_messages : 0.0,
+            (unsigned long long) results.latency_max_us
+        );
+    }
+
+    iotc_fake_cloud_get_c2d_topic(c2d_topic, sizeof(c2d_topic), E2E_DUID);
+    start = now_us();
+    {
+        static const char *command = "{\"v\":\"2.1\",\"ct\":0,\"cmd\":\"set-led on\",\"ack\":\"e2e-ack-1\"}";
+        if (broker) {
+            // the broker sends it back, as the device is subscribed to its C2D topic
+            iotc_default_transport.mqtt_publish(c2d_topic, command, IOTCL_DC_AT_LEAST_ONCE);
+        } else if (1 != iotc_fake_broker_inject(c2d_topic, command)) {
+            fprintf(stderr, "FAIL: the device is not subscribed to %s\n", c2d_topic);
+            goto cleanup;
+        }
+    }
+    if (!loop_until(&results.is_command_received) || !loop_until(&results.is_ack_delivered)) {
+        fprintf(stderr, "FAIL: C2D command round trip\n");
+        goto cleanup;
+    }
+    print_phase("c2d command+ack", now_us() - start);
+
+    if (!broker) {
+        uint32_t num_connected = results.num_connected;
+        start = now_us();
+        iotc_fake_broker_drop_clients();
+        unsigned long wait_start = millis();
+        while (results.num_connected == num_connected) {
+            if (millis() - wait_start > E2E_TIMEOUT_MS) {
+                fprintf(stderr, "FAIL: reconnect\n");
+                goto cleanup;
+            }
+            iotconnect_sdk_loop();
+            delay(1);
+        }
+        print_phase("reconnect (with backoff)", now_us() - start);
+
+        static const char *command = "{\"v\":\"2.1\",\"ct\":0,\"cmd\":\"set-led off\",\"ack\":\"" E2E_QUEUED_ACK_ID "\"}";
+        start = now_us();
+        iotcl_arena_configure(arena_buffer, sizeof(arena_buffer));
+        results.is_command_received = false;
+        results.is_ack_queued = true;
+        if (1 != iotc_fake_broker_inject(c2d_topic, command) || !loop_until(&results.is_command_received)) {
+            fprintf(stderr, "FAIL: C2D command with the arena\n");
+            goto cleanup;
+        }
+        // like the next C2D message would
+        memset(arena_buffer, 'x', sizeof(arena_buffer));
+        if (!loop_until_queued_ack_received()) {
+            fprintf(stderr, "FAIL: the queued ack was not sent intact after its arena scope ended\n");
+            goto cleanup;
+        }
+        results.is_ack_queued = false;
+        iotcl_arena_configure(NULL, 0);
+        print_phase("c2d ack queued past arena", now_us() - start);
+    }
+
+    {
+        uint32_t num_requests = cloud_stats.num_discovery_requests + cloud_stats.num_identity_requests;
+        iotconnect_sdk_disconnect();
+        iotcl_deinit();
+        start = now_us();
+        if (!iotconnect_sdk_init(&config)) {
+            fprintf(stderr, "FAIL: iotconnect_sdk_init() with the identity cache\n");
+            goto cleanup;
+        }
+        if (num_requests != cloud_stats.num_discovery_requests + cloud_stats.num_identity_requests) {
+            fprintf(stderr, "FAIL: discovery and identity were not skipped with the identity cache\n");
+            goto cleanup;
+        }
+        print_phase("boot from the identity cache", now_us() - start);
+    }
+
+    {
+        IotcPosixTransportStats s;
+        iotc_posix_transport_get_stats(&s);
+        printf("Transport: %u connects, %u published, %u acked, %u received, %u https requests, %llu bytes sent, %llu bytes received\n",
+            s.num_connects, s.num_published, s.num_acked, s.num_received, s.num_https_requests,
+            (unsigned long long) s.bytes_sent, (unsigned long long) s.bytes_received
+        );
+        printf("Fake cloud: %u discovery, %u identity requests\n",
+            cloud_stats.num_discovery_requests, cloud_stats.num_identity_requests);
+    }
+    printf("PASS\n");
+    exit_code = 0;
+
+    cleanup:
+    iotconnect_sdk_disconnect();
+    iotcl_deinit();
+    if (!broker) {
+        iotc_fake_broker_stop();
+    }
+    return exit_code;
+}
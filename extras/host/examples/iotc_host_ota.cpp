@@ -0,0 +1,586 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * Downloads an OTA image on the host with the download engine of src/iotc_ota.h, from the in-process HTTP server
+ * into a file, and checks the file and its SHA-256 against the served image. The download is started by
+ * an OTA C2D message through the fake broker, as a device would start it, and the progress acks that
+ * the device sends are counted.
+ *
+ * The phases are a clean download, one with responses cut short as if the LTE link dropped, one that is
+ * interrupted as if the device was reset and resumes with a newly signed URL, a resume from a server that ignores
+ * Range headers, an image that ends exactly at the end of a range, and one with the wrong expected SHA-256.
+ * Then a delta package (see src/iotc_ota_delta.h) of a firmware-like image, whose new version has a function
+ * inserted and the calls after it moved, is downloaded and applied to the image, interrupted and resumed,
+ * and offered to a device that runs another firmware. The package needs to be less than a tenth of the new image.
+ *
+ * With --server host:port --resource path, the image is downloaded once from a local HTTP server instead,
+ * for example "python3 -m http.server", which does not support ranges, or nginx, which does.
+ *
+ * Usage: iotc_host_ota [--size bytes] [--file path] [--server host:port --resource path] [--verbose]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <Arduino.h>
+#include "log.h"
+
+#include "iotcl.h"
+#include "iotcl_c2d.h"
+#include "iotcl_sha256.h"
+#include "iotconnect.h"
+#include "iotc_ota.h"
+#include "iotc_ota_delta.h"
+#include "iotc_ota_delta_encoder.h"
+#include "iotc_transport_posix.h"
+#include "iotc_fake_broker.h"
+#include "iotc_fake_cloud.h"
+#include "iotc_fake_http_server.h"
+#include "iotc_ota_file_sink.h"
+
+#define OTA_DUID "host-ota"
+#define OTA_CPID "HOSTCPID"
+#define OTA_ENV "poc"
+#define OTA_TIMEOUT_MS 60000UL
+#define OTA_HOST "ota.example.com"
+#define OTA_PATH "/firmware/app.bin"
+#define OTA_DEFAULT_FILE "/tmp/iotc_host_ota.bin"
+#define OTA_DELTA_PATH "/firmware/app-1.1.0-1.2.0" IOTC_OTA_DELTA_FILE_EXTENSION
+#define OTA_DEFAULT_SIZE (100 * 1024 + 123)
+// All of the image can be called with the 16 bit word addresses of the AVR
+#define OTA_DELTA_SOURCE_SIZE (128 * 1024)
+#define OTA_DELTA_INSERTED_SIZE 300
+#define OTA_C2D_FORMAT "{\"v\":\"2.1\",\"ct\":1,\"cmd\":\"ota\",\"ack\":\"ota-ack-%u\",\"sw\":\"1.2.0\",\"hw\":\"1\"," \
+    "\"urls\":[{\"url\":\"https://%s%s\",\"fileName\":\"app.bin\",\"tg\":\"\"}," \
+    "{\"url\":\"https://%s" OTA_DELTA_PATH "?sig=%u\",\"fileName\":\"app-1.1.0-1.2.0" IOTC_OTA_DELTA_FILE_EXTENSION "\",\"tg\":\"\"}]}"
+
+static IotConnectOta ota;
+static IotConnectOtaDelta delta;
+static IotcOtaFileSink file_sink;
+static char c2d_topic[128];
+static const uint8_t *served_image;
+static size_t served_size;
+
+static struct {
+    bool is_ota_started;
+    int start_status;
+    const uint8_t *expected_sha256;
+    // the running firmware, if the delta should be downloaded
+    const uint8_t *delta_source;
+    size_t delta_source_size;
+    // counted in the broker thread
+    volatile uint32_t num_downloading_acks;
+    volatile uint32_t num_failed_acks;
+} results;
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000ULL + (uint64_t) ts.tv_nsec / 1000ULL;
+}
+
+static void on_publish(void *context, const char *topic, const char *payload, size_t payload_length) {
+    (void) context;
+    (void) topic;
+    (void) payload_length;
+    if (!strstr(payload, "\"ack\":\"ota-ack-")) {
+        return;
+    }
+    if (strstr(payload, "\"st\":2")) {
+        results.num_downloading_acks++;
+    } else if (strstr(payload, "\"st\":4")) {
+        results.num_failed_acks++;
+    }
+}
+
+static int read_source(void *context, uint32_t offset, uint8_t *data, size_t data_length) {
+    (void) context;
+    if (offset + data_length > results.delta_source_size) {
+        return IOTCL_ERR_OVERFLOW;
+    }
+    memcpy(data, &results.delta_source[offset], data_length);
+    return IOTCL_SUCCESS;
+}
+
+static void on_ota(IotclC2dEventData data) {
+    IotConnectOtaConfig c = {0};
+    int index = results.delta_source ? iotconnect_ota_delta_find_url(data, true) : -1;
+    if (index >= 0) {
+        IotConnectOtaDeltaConfig dc = {0};
+        dc.read_source = read_source;
+        dc.source_size = (uint32_t) results.delta_source_size;
+        dc.target_sink = &iotc_ota_file_sink;
+        dc.target_context = &file_sink;
+        iotconnect_ota_delta_init(&delta, &dc);
+        c.sink = &iotconnect_ota_delta_sink;
+        c.sink_context = &delta;
+    } else {
+        index = iotconnect_ota_delta_find_url(data, false);
+        c.sink = &iotc_ota_file_sink;
+        c.sink_context = &file_sink;
+    }
+    c.host = iotcl_c2d_get_ota_url_hostname(data, index);
+    c.resource = iotcl_c2d_get_ota_url_resource(data, index);
+    c.ack_id = iotcl_c2d_get_ack_id(data);
+    c.expected_sha256 = results.expected_sha256;
+    results.start_status = iotconnect_ota_start(&ota, &c);
+    results.is_ota_started = true;
+}
+
+static void on_command(IotclC2dEventData data) {
+    (void) data;
+}
+
+// Sends the OTA C2D message with a URL signed with sig, and waits for the download to start
+static bool start_ota(const char *path, unsigned int sig) {
+    char message[512];
+    char resource[256];
+    snprintf(resource, sizeof(resource), "%s?sig=%u", path, sig);
+    snprintf(message, sizeof(message), OTA_C2D_FORMAT, sig, OTA_HOST, resource, OTA_HOST, sig);
+    results.is_ota_started = false;
+    if (1 != iotc_fake_broker_inject(c2d_topic, message)) {
+        fprintf(stderr, "The device is not subscribed to %s\n", c2d_topic);
+        return false;
+    }
+    unsigned long start = millis();
+    while (!results.is_ota_started) {
+        if (millis() - start > OTA_TIMEOUT_MS) {
+            return false;
+        }
+        iotconnect_sdk_loop();
+        delay(1);
+    }
+    return IOTCL_SUCCESS == results.start_status;
+}
+
+// Runs the download, with the SDK loop in between the ranges, until it ends or reaches stop_at bytes
+static IotConnectOtaState run_ota(uint32_t stop_at) {
+    unsigned long start = millis();
+    IotConnectOtaState state = IOTC_OTA_DOWNLOADING;
+    while (IOTC_OTA_DOWNLOADING == state) {
+        if (millis() - start > OTA_TIMEOUT_MS) {
+            fprintf(stderr, "The download timed out\n");
+            break;
+        }
+        state = iotconnect_ota_loop(&ota);
+        iotconnect_sdk_loop();
+        if (stop_at && ota.progress.offset >= stop_at) {
+            break;
+        }
+    }
+    // let the acks go out
+    for (int i = 0; i < 20; i++) {
+        iotconnect_sdk_loop();
+        delay(1);
+    }
+    return state;
+}
+
+static bool check_file(const uint8_t *image, size_t image_size) {
+    bool is_same = false;
+    FILE *f = fopen(file_sink.path, "rb");
+    uint8_t *data = (uint8_t *) malloc(image_size + 1);
+    if (f && data) {
+        is_same = (fread(data, 1, image_size + 1, f) == image_size) && 0 == memcmp(data, image, image_size);
+    }
+    free(data);
+    if (f) {
+        fclose(f);
+    }
+    return is_same;
+}
+
+static void print_progress(const char *name, uint64_t elapsed_us) {
+    IotConnectOtaProgress p;
+    iotconnect_ota_get_progress(&ota, &p);
+    printf("%-28s %10.3f ms  %6lu bytes, %3u requests, %u retries, %u saves, resumed from %lu\n",
+        name, (double) elapsed_us / 1000.0, (unsigned long) p.offset, p.num_requests, p.num_retries,
+        p.num_saves, (unsigned long) p.resumed_from);
+}
+
+static bool serve(const char *path, const uint8_t *image, size_t image_size, bool is_range_ignored) {
+    IotcFakeHttpServerConfig c = {0};
+    served_image = image;
+    served_size = image_size;
+    c.file_path = path;
+    c.file = image;
+    c.file_size = image_size;
+    c.is_range_ignored = is_range_ignored;
+    iotc_fake_http_server_stop();
+    if (!iotc_fake_http_server_start(&c)) {
+        return false;
+    }
+    IotcPosixTransportConfig t = {0};
+    t.mqtt_port = iotc_fake_broker_get_port();
+    t.https_handler = iotc_fake_cloud_https_handler;
+    t.http_port = iotc_fake_http_server_get_port();
+    iotc_posix_transport_configure(&t);
+    return true;
+}
+
+static void get_sha256(const uint8_t *data, size_t size, uint8_t *digest) {
+    IotclSha256 sha;
+    iotcl_sha256_init(&sha);
+    iotcl_sha256_update(&sha, data, size);
+    iotcl_sha256_finish(&sha, digest);
+}
+
+// Downloads what is served, which should succeed and leave the image in the file
+static bool download(const char *name, const uint8_t *image, size_t image_size, unsigned int sig, uint32_t stop_at) {
+    uint8_t digest[IOTCL_SHA256_DIGEST_SIZE];
+    uint8_t served_digest[IOTCL_SHA256_DIGEST_SIZE];
+    get_sha256(image, image_size, digest);
+    get_sha256(served_image, served_size, served_digest);
+
+    uint64_t start = now_us();
+    if (!start_ota(OTA_PATH, sig)) {
+        fprintf(stderr, "FAIL: %s: the download did not start\n", name);
+        return false;
+    }
+    IotConnectOtaState state = run_ota(stop_at);
+    if (stop_at) {
+        iotconnect_ota_abort(&ota);
+        print_progress(name, now_us() - start);
+        return IOTC_OTA_DOWNLOADING == state && ota.progress.offset < served_size;
+    }
+    print_progress(name, now_us() - start);
+    if (IOTC_OTA_COMPLETE != state) {
+        fprintf(stderr, "FAIL: %s: the download ended in state %d\n", name, (int) state);
+        return false;
+    }
+    if (!file_sink.is_complete || file_sink.image_size != image_size || !check_file(image, image_size)) {
+        fprintf(stderr, "FAIL: %s: the file does not match the image\n", name);
+        return false;
+    }
+    if (0 != memcmp(iotconnect_ota_get_digest(&ota), served_digest, sizeof(served_digest))
+        || 0 != memcmp(file_sink.digest, digest, sizeof(digest))) {
+        fprintf(stderr, "FAIL: %s: wrong SHA-256\n", name);
+        return false;
+    }
+    return true;
+}
+
+// The SHA-256 of "abc" from FIPS 180-2
+static bool check_sha256(void) {
+    static const uint8_t expected[IOTCL_SHA256_DIGEST_SIZE] = {
+        0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea, 0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+        0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c, 0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad
+    };
+    uint8_t digest[IOTCL_SHA256_DIGEST_SIZE];
+    IotclSha256 sha;
+    iotcl_sha256_init(&sha);
+    iotcl_sha256_update(&sha, "a", 1);
+    iotcl_sha256_update(&sha, "bc", 2);
+    iotcl_sha256_finish(&sha, digest);
+    return 0 == memcmp(digest, expected, sizeof(digest));
+}
+
+static uint32_t next_random(uint32_t *seed) {
+    *seed = *seed * 1103515245 + 12345;
+    return *seed >> 16;
+}
+
+// Random bytes with a call instruction of the AVR, with a word address, every 10 to 60 bytes
+static void make_firmware(uint8_t *image, size_t size) {
+    uint32_t seed = 54321;
+    size_t i = 0;
+    while (i + 4 <= size) {
+        size_t gap = (10 + next_random(&seed) % 51) & ~(size_t) 1;
+        for (size_t j = 0; j < gap && i < size; j++, i++) {
+            image[i] = (uint8_t) next_random(&seed);
+        }
+        if (i + 4 <= size) {
+            uint16_t address = (uint16_t) (next_random(&seed) % (size / 2));
+            image[i++] = 0x0E;
+            image[i++] = 0x94;
+            image[i++] = (uint8_t) address;
+            image[i++] = (uint8_t) (address >> 8);
+        }
+    }
+    for (; i < size; i++) {
+        image[i] = 0xFF;
+    }
+}
+
+// The next version has a new function in the middle, which moves what follows, so the calls to it change.
+// A constant and the version string change as well.
+static void make_next_firmware(const uint8_t *source, size_t source_size, uint8_t *target) {
+    size_t insert_at = source_size * 2 / 5;
+    uint32_t seed = 777;
+    memcpy(target, source, insert_at);
+    for (size_t i = 0; i < OTA_DELTA_INSERTED_SIZE; i++) {
+        target[insert_at + i] = (uint8_t) next_random(&seed);
+    }
+    memcpy(&target[insert_at + OTA_DELTA_INSERTED_SIZE], &source[insert_at], source_size - insert_at);
+    size_t target_size = source_size + OTA_DELTA_INSERTED_SIZE;
+    for (size_t i = 0; i + 4 <= target_size; i++) {
+        if (0x0E == target[i] && 0x94 == target[i + 1]) {
+            uint16_t address = (uint16_t) (target[i + 2] | target[i + 3] << 8);
+            if ((size_t) address * 2 >= insert_at) {
+                address += OTA_DELTA_INSERTED_SIZE / 2;
+                target[i + 2] = (uint8_t) address;
+                target[i + 3] = (uint8_t) (address >> 8);
+            }
+            i += 3;
+        }
+    }
+    memset(&target[source_size / 10], 0x42, 20);
+    memcpy(&target[target_size - 16], "version 1.2.0   ", 16);
+}
+
+static bool run_delta_phases(void) {
+    const size_t target_size = OTA_DELTA_SOURCE_SIZE + OTA_DELTA_INSERTED_SIZE;
+    uint8_t *source = (uint8_t *) malloc(OTA_DELTA_SOURCE_SIZE);
+    uint8_t *target = (uint8_t *) malloc(target_size);
+    uint8_t *package = NULL;
+    size_t package_size = 0;
+    uint32_t num_acks;
+    bool is_passed = false;
+
+    make_firmware(source, OTA_DELTA_SOURCE_SIZE);
+    make_next_firmware(source, OTA_DELTA_SOURCE_SIZE, target);
+    package = iotc_ota_delta_encode(source, OTA_DELTA_SOURCE_SIZE, target, target_size, &package_size, NULL);
+    if (!package || package_size * 10 > target_size) {
+        fprintf(stderr, "FAIL: the delta package has %lu bytes for an image of %lu bytes\n",
+            (unsigned long) package_size, (unsigned long) target_size);
+        goto cleanup;
+    }
+    printf("Delta package: %lu bytes for an image of %lu bytes\n", (unsigned long) package_size, (unsigned long) target_size);
+    results.delta_source = source;
+    results.delta_source_size = OTA_DELTA_SOURCE_SIZE;
+
+    iotc_ota_file_sink_remove(&file_sink);
+    if (!serve(OTA_DELTA_PATH, package, package_size, false)
+        || !download("delta", target, target_size, 9, 0)) {
+        goto cleanup;
+    }
+
+    iotc_ota_file_sink_remove(&file_sink);
+    if (!download("delta interrupted", target, target_size, 10, (uint32_t) package_size / 2)
+        || !download("delta resumed", target, target_size, 11, 0)) {
+        goto cleanup;
+    }
+    if (0 == ota.progress.resumed_from) {
+        fprintf(stderr, "FAIL: the delta download did not resume\n");
+        goto cleanup;
+    }
+
+    iotc_ota_file_sink_remove(&file_sink);
+    results.delta_source_size = OTA_DELTA_SOURCE_SIZE - 2;
+    num_acks = results.num_failed_acks;
+    if (!start_ota(OTA_PATH, 12) || IOTC_OTA_FAILED != run_ota(0) || file_sink.is_complete
+        || results.num_failed_acks == num_acks) {
+        fprintf(stderr, "FAIL: a delta package for another firmware was accepted\n");
+        goto cleanup;
+    }
+    print_progress("delta for another firmware", 0);
+    is_passed = true;
+
+    cleanup:
+    results.delta_source = NULL;
+    free(package);
+    free(source);
+    free(target);
+    return is_passed;
+}
+
+static int run_phases(size_t image_size) {
+    uint8_t *image = (uint8_t *) malloc(image_size);
+    uint32_t seed = 12345;
+    uint32_t num_acks;
+    IotcFakeHttpServerStats s;
+    int exit_code = 1;
+    for (size_t i = 0; i < image_size; i++) {
+        seed = seed * 1103515245 + 12345;
+        image[i] = (uint8_t) (seed >> 16);
+    }
+
+    iotc_ota_file_sink_remove(&file_sink);
+    if (!serve(OTA_PATH, image, image_size, false) || !download("clean", image, image_size, 1, 0)) {
+        goto cleanup;
+    }
+    if (results.num_downloading_acks < 2) {
+        fprintf(stderr, "FAIL: %u progress acks\n", results.num_downloading_acks);
+        goto cleanup;
+    }
+
+    iotc_ota_file_sink_remove(&file_sink);
+    iotc_fake_http_server_drop_after(IOTC_OTA_RANGE_SIZE / 3, 3);
+    if (!download("dropped responses", image, image_size, 2, 0)) {
+        goto cleanup;
+    }
+    iotc_fake_http_server_get_stats(&s);
+    if (3 != s.num_dropped || ota.progress.num_retries < 3) {
+        fprintf(stderr, "FAIL: %u responses were dropped and %u retried\n", s.num_dropped, ota.progress.num_retries);
+        goto cleanup;
+    }
+
+    iotc_ota_file_sink_remove(&file_sink);
+    if (!download("interrupted", image, image_size, 3, (uint32_t) image_size / 2)
+        || !download("resumed", image, image_size, 4, 0)) {
+        goto cleanup;
+    }
+    if (0 == ota.progress.resumed_from) {
+        fprintf(stderr, "FAIL: the download did not resume\n");
+        goto cleanup;
+    }
+
+    iotc_ota_file_sink_remove(&file_sink);
+    if (!download("interrupted", image, image_size, 5, (uint32_t) image_size / 2)
+        || !serve(OTA_PATH, image, image_size, true)
+        || !download("resumed without ranges", image, image_size, 6, 0)) {
+        goto cleanup;
+    }
+    if (0 == ota.progress.resumed_from || 1 != ota.progress.num_requests) {
+        fprintf(stderr, "FAIL: the download did not resume with one request\n");
+        goto cleanup;
+    }
+
+    iotc_ota_file_sink_remove(&file_sink);
+    if (!serve(OTA_PATH, image, IOTC_OTA_RANGE_SIZE * 4, false)
+        || !download("whole ranges", image, IOTC_OTA_RANGE_SIZE * 4, 7, 0)) {
+        goto cleanup;
+    }
+
+    {
+        static const uint8_t wrong_sha256[IOTCL_SHA256_DIGEST_SIZE] = {0};
+        iotc_ota_file_sink_remove(&file_sink);
+        results.expected_sha256 = wrong_sha256;
+        num_acks = results.num_failed_acks;
+        bool is_started = start_ota(OTA_PATH, 8);
+        results.expected_sha256 = NULL;
+        if (!is_started || IOTC_OTA_FAILED != run_ota(0) || file_sink.is_complete || results.num_failed_acks == num_acks) {
+            fprintf(stderr, "FAIL: an image with the wrong SHA-256 was accepted\n");
+            goto cleanup;
+        }
+        print_progress("wrong SHA-256", 0);
+    }
+
+    if (!run_delta_phases()) {
+        goto cleanup;
+    }
+
+    iotc_fake_http_server_get_stats(&s);
+    printf("HTTP server: %u requests, %u with ranges, %llu bytes\n",
+        s.num_requests, s.num_range_requests, (unsigned long long) s.bytes_sent);
+    printf("Acks: %u downloading, %u failed\n", results.num_downloading_acks, results.num_failed_acks);
+    exit_code = 0;
+
+    cleanup:
+    iotc_fake_http_server_stop();
+    iotc_ota_file_sink_remove(&file_sink);
+    free(image);
+    return exit_code;
+}
+
+// Downloads the resource from an external server once
+static int run_external(const char *server, const char *resource) {
+    char host[128];
+    const char *colon = strrchr(server, ':');
+    size_t host_length = colon ? (size_t) (colon - server) : strlen(server);
+    if (!colon || host_length >= sizeof(host)) {
+        fprintf(stderr, "The server needs to be host:port\n");
+        return 2;
+    }
+    memcpy(host, server, host_length);
+    host[host_length] = 0;
+
+    IotcPosixTransportConfig t = {0};
+    t.mqtt_port = iotc_fake_broker_get_port();
+    t.https_handler = iotc_fake_cloud_https_handler;
+    t.http_host = host;
+    t.http_port = (uint16_t) atoi(colon + 1);
+    iotc_posix_transport_configure(&t);
+
+    uint64_t start = now_us();
+    if (!start_ota(resource, 1)) {
+        fprintf(stderr, "FAIL: the download did not start\n");
+        return 1;
+    }
+    IotConnectOtaState state = run_ota(0);
+    print_progress("download", now_us() - start);
+    if (IOTC_OTA_COMPLETE != state) {
+        fprintf(stderr, "FAIL: the download ended in state %d\n", (int) state);
+        return 1;
+    }
+    printf("SHA-256 of %s: ", file_sink.path);
+    for (int i = 0; i < IOTCL_SHA256_DIGEST_SIZE; i++) {
+        printf("%02x", file_sink.digest[i]);
+    }
+    printf("\n");
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    size_t image_size = OTA_DEFAULT_SIZE;
+    const char *file_path = OTA_DEFAULT_FILE;
+    const char *server = NULL;
+    const char *resource = NULL;
+    bool is_verbose = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (0 == strcmp(argv[i], "--size") && i + 1 < argc) {
+            image_size = (size_t) strtoul(argv[++i], NULL, 10);
+        } else if (0 == strcmp(argv[i], "--file") && i + 1 < argc) {
+            file_path = argv[++i];
+        } else if (0 == strcmp(argv[i], "--server") && i + 1 < argc) {
+            server = argv[++i];
+        } else if (0 == strcmp(argv[i], "--resource") && i + 1 < argc) {
+            resource = argv[++i];
+        } else if (0 == strcmp(argv[i], "--verbose")) {
+            is_verbose = true;
+        } else {
+            fprintf(stderr, "Usage: %s [--size bytes] [--file path] [--server host:port --resource path] [--verbose]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (!server != !resource || image_size < 2 || !iotc_ota_file_sink_init(&file_sink, file_path)) {
+        fprintf(stderr, "--server and --resource go together, the image needs two bytes or more, and the path needs to fit\n");
+        return 2;
+    }
+    Log.setLogLevel(is_verbose ? LogLevel::DEBUG : LogLevel::ERROR);
+
+    if (!check_sha256()) {
+        fprintf(stderr, "FAIL: SHA-256 of \"abc\"\n");
+        return 1;
+    }
+
+    IotcFakeBrokerConfig broker_config = {0};
+    broker_config.publish_cb = on_publish;
+    if (!iotc_fake_broker_start(&broker_config)) {
+        fprintf(stderr, "Unable to start the fake broker\n");
+        return 1;
+    }
+    IotcPosixTransportConfig transport_config = {0};
+    transport_config.mqtt_port = iotc_fake_broker_get_port();
+    transport_config.https_handler = iotc_fake_cloud_https_handler;
+    iotc_posix_transport_configure(&transport_config);
+
+    IotConnectClientConfig config = {0};
+    config.cpid = (char *) OTA_CPID;
+    config.env = (char *) OTA_ENV;
+    config.duid = (char *) OTA_DUID;
+    config.connection_type = IOTC_CT_AWS;
+    config.cmd_cb = on_command;
+    config.ota_cb = on_ota;
+    config.verbose = is_verbose;
+
+    int exit_code = 1;
+    if (!iotconnect_sdk_init(&config)) {
+        fprintf(stderr, "FAIL: iotconnect_sdk_init()\n");
+    } else {
+        iotc_fake_cloud_get_c2d_topic(c2d_topic, sizeof(c2d_topic), OTA_DUID);
+        exit_code = server ? run_external(server, resource) : run_phases(image_size);
+    }
+    if (0 == exit_code) {
+        printf("PASS\n");
+    }
+    iotconnect_sdk_disconnect();
+    iotcl_deinit();
+    iotc_fake_broker_stop();
+    return exit_code;
+}
@@ -0,0 +1,518 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * Runs the AVR code path of the SDK (iotc_mqtt_client.cpp, iotc_http_request.cpp and the Sequans controller
+ * from reference-files/updated) against the modem emulator, and reports how many AT round trips, bytes and
+ * milliseconds of virtual time each SDK operation costs: booting the modem, discovery, identity, the MQTT
+ * connection, a telemetry message, a C2D command with its ack, a reconnect after the broker drops the connection,
+ * a second iotconnect_sdk_init() that connects with the MQTT settings from the identity cache in the EEPROM,
+ * and an OTA download (see iotc_ota.h) of an image that the emulator serves, with a range request per operation.
+ *
+ * The numbers are the same from run to run, so they can be compared between builds to catch regressions.
+ * --check fails the run if an operation needs more AT commands than it does now.
+ *
+ * Usage: iotc_modem_bench [--messages N] [--baud B] [--latency us] [--broker-latency ms] [--http-latency ms]
+ *                         [--chunk bytes] [--chunk-gap us] [--http-chunked] [--fail command_prefix[:count]]
+ *                         [--check] [--verbose]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <Arduino.h>
+#include <avr/eeprom.h>
+#include "log.h"
+#include "sequans_controller.h"
+
+#include "iotcl.h"
+#include "iotcl_c2d.h"
+#include "iotcl_dra_identity.h"
+#include "iotcl_telemetry.h"
+#include "iotconnect.h"
+#include "iotc_http_request.h"
+#include "iotc_mqtt_client.h"
+#include "iotc_ota.h"
+#include "iotc_transport.h"
+#include "iotc_fake_cloud.h"
+#include "iotc_modem_emulator.h"
+
+#define BENCH_DUID "modem-bench"
+#define BENCH_CPID "HOSTCPID"
+#define BENCH_ENV "poc"
+#define BENCH_TIMEOUT_MS 120000UL
+#define BENCH_IDENTITY_CACHE_TTL 86400
+#define BENCH_OTA_HOST "ota.example.com"
+#define BENCH_OTA_PATH "/firmware/app.bin"
+#define BENCH_OTA_IMAGE_SIZE (32 * 1024 + 100)
+
+typedef enum {
+    BENCH_OP_BOOT = 0,
+    BENCH_OP_DISCOVERY,
+    BENCH_OP_IDENTITY,
+    BENCH_OP_MQTT_CONNECT,
+    BENCH_OP_TELEMETRY,
+    BENCH_OP_C2D_COMMAND,
+    BENCH_OP_RECONNECT,
+    BENCH_OP_CACHED_INIT,
+    BENCH_OP_OTA_RANGE,
+    BENCH_OP_COUNT
+} BenchOpType;
+
+typedef struct {
+    const char *name;
+    uint32_t max_commands; // per operation, for --check. Includes the retries of the controller.
+    uint32_t count;
+    IotcModemEmulatorStats total;
+    uint64_t total_ns;
+    // where the current operation started
+    IotcModemEmulatorStats start;
+    uint64_t start_ns;
+} BenchOp;
+
+static BenchOp ops[BENCH_OP_COUNT] = {
+    {"modem boot", 0},
+    {"discovery (https get)", 4},
+    {"identity (https get)", 4},
+    {"mqtt connect+subscribe", 5},
+    {"telemetry message", 1},
+    {"c2d command+ack", 2},
+    {"reconnect", 5},
+    {"init from identity cache", 5},
+    {"ota range (https get)", 6},
+};
+
+// of the last request of the HTTPS operations
+static IotConnectHttpStats http_stats[BENCH_OP_COUNT];
+
+static struct {
+    uint32_t num_delivered;
+    uint32_t num_not_delivered;
+    bool is_command_received;
+    uint16_t ack_publish_id;
+    bool is_ack_delivered;
+    uint32_t num_connected;
+} results;
+
+static uint8_t ota_image[BENCH_OTA_IMAGE_SIZE];
+static uint8_t ota_copy[BENCH_OTA_IMAGE_SIZE];
+
+static void op_begin(BenchOpType type) {
+    iotc_modem_emulator_get_stats(&ops[type].start);
+    ops[type].start_ns = iotc_modem_emulator_get_time_ns();
+}
+
+static void op_end(BenchOpType type, uint32_t count) {
+    BenchOp *op = &ops[type];
+    IotcModemEmulatorStats now;
+    iotc_modem_emulator_get_stats(&now);
+    op->count += count;
+    op->total.num_commands += now.num_commands - op->start.num_commands;
+    op->total.num_prompts += now.num_prompts - op->start.num_prompts;
+    op->total.num_urcs += now.num_urcs - op->start.num_urcs;
+    op->total.num_errors += now.num_errors - op->start.num_errors;
+    op->total.bytes_to_modem += now.bytes_to_modem - op->start.bytes_to_modem;
+    op->total.bytes_from_modem += now.bytes_from_modem - op->start.bytes_from_modem;
+    op->total_ns += iotc_modem_emulator_get_time_ns() - op->start_ns;
+}
+
+// The AVR transport, with the HTTPS requests and the MQTT connection measured.
+// The clock is not synced, as the emulated modem has no network time.
+static int bench_https_request(IotConnectHttpResponse *response, const char *host, const char *path, const char *send_str) {
+    BenchOpType type = strstr(path, IOTCL_DRA_IDENTITY_PREFIX) ? BENCH_OP_IDENTITY : BENCH_OP_DISCOVERY;
+    op_begin(type);
+    int status = iotconnect_https_request(response, host, path, send_str);
+    op_end(type, 1);
+    return status;
+}
+
+static int bench_https_request_streamed(
+        const char *host,
+        const char *path,
+        const char *send_str,
+        IotConnectHttpBodySink sink_fn,
+        void *context
+) {
+    BenchOpType type = strstr(path, IOTCL_DRA_IDENTITY_PREFIX) ? BENCH_OP_IDENTITY : BENCH_OP_DISCOVERY;
+    op_begin(type);
+    int status = iotconnect_https_request_streamed(host, path, send_str, sink_fn, context);
+    op_end(type, 1);
+    iotconnect_https_get_last_stats(&http_stats[type]);
+    return status;
+}
+
+static int bench_https_get_range(
+        const char *host,
+        const char *path,
+        uint32_t offset,
+        uint32_t length,
+        IotConnectHttpBodySink sink_fn,
+        void *context,
+        IotConnectHttpRangeResponse *response
+) {
+    op_begin(BENCH_OP_OTA_RANGE);
+    int status = iotconnect_https_get_range(host, path, offset, length, sink_fn, context, response);
+    op_end(BENCH_OP_OTA_RANGE, 1);
+    iotconnect_https_get_last_stats(&http_stats[BENCH_OP_OTA_RANGE]);
+    return status;
+}
+
+static bool bench_mqtt_init(IotConnectMqttClientConfig *c) {
+    op_begin(BENCH_OP_MQTT_CONNECT);
+    bool is_connected = iotc_mqtt_client_init(c);
+    op_end(BENCH_OP_MQTT_CONNECT, 1);
+    return is_connected;
+}
+
+const IotConnectTransport iotc_default_transport = {
+    NULL,
+    bench_https_request,
+    iotconnect_free_https_response,
+    bench_https_request_streamed,
+    bench_https_get_range,
+    iotc_mqtt_client_start,
+    bench_mqtt_init,
+    iotc_mqtt_client_disconnect,
+    iotc_mqtt_client_is_connected,
+    iotc_mqtt_client_get_status,
+    iotc_mqtt_client_loop,
+    iotc_mqtt_client_publish,
+    iotc_mqtt_client_publish_streamed,
+    iotc_mqtt_client_get_last_publish_id
+};
+
+static void on_status(IotConnectConnectionStatus status) {
+    if (IOTC_CS_MQTT_CONNECTED == status) {
+        results.num_connected++;
+    }
+}
+
+static void on_delivery(uint16_t publish_id, IotConnectDeliveryStatus status) {
+    if (IOTC_DS_DELIVERED != status) {
+        results.num_not_delivered++;
+        return;
+    }
+    results.num_delivered++;
+    if (publish_id == results.ack_publish_id) {
+        results.is_ack_delivered = true;
+    }
+}
+
+static void on_command(IotclC2dEventData data) {
+    const char *ack_id = iotcl_c2d_get_ack_id(data);
+    results.is_command_received = true;
+    if (ack_id) {
+        iotcl_mqtt_send_cmd_ack(ack_id, IOTCL_C2D_EVT_CMD_SUCCESS_WITH_ACK, "OK");
+        results.ack_publish_id = iotconnect_sdk_get_last_publish_id();
+    }
+}
+
+static void on_ota(IotclC2dEventData data) {
+    (void) data;
+}
+
+// Runs the SDK loop until the flag is set. Returns false on timeout.
+static bool loop_until(const volatile bool *flag) {
+    unsigned long start = millis();
+    while (!*flag) {
+        if (millis() - start > BENCH_TIMEOUT_MS) {
+            return false;
+        }
+        iotconnect_sdk_loop();
+        delay(1);
+    }
+    return true;
+}
+
+// Sends the messages one at a time, so that each one is measured from the call until its delivery is reported
+static bool send_telemetry(uint32_t num_messages) {
+    for (uint32_t i = 0; i < num_messages; i++) {
+        uint32_t num_reported = results.num_delivered + results.num_not_delivered;
+        unsigned long start = millis();
+        op_begin(BENCH_OP_TELEMETRY);
+        IotclMessageHandle msg = iotcl_telemetry_create();
+        iotcl_telemetry_set_number(msg, "temperature", 20.0 + i % 10);
+        iotcl_telemetry_set_number(msg, "humidity", 40.0 + i % 20);
+        iotcl_telemetry_set_string(msg, "status", "ok");
+        iotcl_mqtt_send_telemetry(msg, false);
+        iotcl_telemetry_destroy(msg);
+        while (results.num_delivered + results.num_not_delivered == num_reported) {
+            if (millis() - start > BENCH_TIMEOUT_MS) {
+                return false;
+            }
+            iotconnect_sdk_loop();
+            delay(1);
+        }
+        op_end(BENCH_OP_TELEMETRY, 1);
+    }
+    return true;
+}
+
+static bool reconnect(void) {
+    uint32_t num_connected = results.num_connected;
+    op_begin(BENCH_OP_RECONNECT);
+    iotc_modem_emulator_drop_connection();
+    unsigned long start = millis();
+    while (results.num_connected == num_connected) {
+        if (millis() - start > BENCH_TIMEOUT_MS) {
+            return false;
+        }
+        iotconnect_sdk_loop();
+        delay(1);
+    }
+    op_end(BENCH_OP_RECONNECT, 1);
+    return true;
+}
+
+// Starts the SDK again, which should connect without discovery and identity
+static bool init_from_cache(IotConnectClientConfig *config) {
+    IotcModemEmulatorStats before;
+    IotcModemEmulatorStats after;
+    iotconnect_sdk_disconnect();
+    iotcl_deinit();
+    iotc_modem_emulator_get_stats(&before);
+    op_begin(BENCH_OP_CACHED_INIT);
+    if (!iotconnect_sdk_init(config)) {
+        return false;
+    }
+    op_end(BENCH_OP_CACHED_INIT, 1);
+    iotc_modem_emulator_get_stats(&after);
+    return before.num_http_requests == after.num_http_requests;
+}
+
+// The OTA image goes to RAM, without a saved state
+static int ota_sink_open(void *context, uint32_t offset) {
+    (void) context;
+    return offset ? IOTCL_ERR_FAILED : IOTCL_SUCCESS;
+}
+
+static int ota_sink_write(void *context, uint32_t offset, const uint8_t *data, size_t data_length) {
+    (void) context;
+    if (offset + data_length > sizeof(ota_copy)) {
+        return IOTCL_ERR_OVERFLOW;
+    }
+    memcpy(&ota_copy[offset], data, data_length);
+    return IOTCL_SUCCESS;
+}
+
+static int ota_sink_close(void *context, bool is_complete, uint32_t image_size, const uint8_t *digest) {
+    (void) context;
+    (void) digest;
+    return (!is_complete || image_size == sizeof(ota_image)) ? IOTCL_SUCCESS : IOTCL_ERR_BAD_VALUE;
+}
+
+static const IotConnectOtaSink ota_sink = {ota_sink_open, ota_sink_write, ota_sink_close, NULL, NULL};
+
+// Downloads the image that the emulator serves, with the SDK loop in between the ranges as an application would
+static bool download_ota(void) {
+    static IotConnectOta ota;
+    IotConnectOtaConfig c = {0};
+    c.host = BENCH_OTA_HOST;
+    c.resource = BENCH_OTA_PATH "?sig=1";
+    c.ack_id = "bench-ota-1";
+    c.sink = &ota_sink;
+    if (iotconnect_ota_start(&ota, &c)) {
+        return false;
+    }
+    unsigned long start = millis();
+    while (IOTC_OTA_DOWNLOADING == iotconnect_ota_loop(&ota)) {
+        if (millis() - start > BENCH_TIMEOUT_MS) {
+            return false;
+        }
+        iotconnect_sdk_loop();
+    }
+    return IOTC_OTA_COMPLETE == ota.state && 0 == memcmp(ota_image, ota_copy, sizeof(ota_image));
+}
+
+static bool print_report(bool is_checking) {
+    bool is_within_budget = true;
+    printf("%-24s %6s %9s %9s %9s %11s %11s\n",
+        "operation", "count", "AT/op", "URCs/op", "to modem", "from modem", "ms/op");
+    for (int i = 0; i < BENCH_OP_COUNT; i++) {
+        const BenchOp *op = &ops[i];
+        if (!op->count) {
+            continue;
+        }
+        double n = (double) op->count;
+        printf("%-24s %6u %9.1f %9.1f %9.1f %11.1f %11.1f\n",
+            op->name,
+            op->count,
+            op->total.num_commands / n,
+            op->total.num_urcs / n,
+            (double) op->total.bytes_to_modem / n,
+            (double) op->total.bytes_from_modem / n,
+            (double) op->total_ns / n / 1000000.0
+        );
+        if (is_checking && op->max_commands && op->total.num_commands > op->max_commands * op->count) {
+            fprintf(stderr, "CHECK: %s needs %.1f AT commands, which is more than %u\n",
+                op->name, op->total.num_commands / n, op->max_commands);
+            is_within_budget = false;
+        }
+    }
+    for (int i = 0; i < BENCH_OP_COUNT; i++) {
+        const IotConnectHttpStats *h = &http_stats[i];
+        if (!h->num_reads) {
+            continue;
+        }
+        printf("%-24s %u bytes in %u reads, %u round trips, %u ms for the response, %u ms reading (%u ms waiting), %u B/s\n",
+            ops[i].name, h->body_bytes, h->num_reads, h->num_round_trips, h->request_ms, h->read_ms, h->wait_ms, h->bytes_per_s);
+    }
+    return is_within_budget;
+}
+
+int main(int argc, char *argv[]) {
+    uint32_t num_messages = 20;
+    bool is_verbose = false;
+    bool is_checking = false;
+    char c2d_topic[128];
+    IotcFakeCloudStats cloud_stats = {0};
+    IotcModemEmulatorConfig modem_config = {0};
+
+    modem_config.response_latency_us = 2000;
+    modem_config.boot_ms = 100;
+    modem_config.connect_latency_ms = 1500;
+    modem_config.broker_latency_ms = 150;
+    modem_config.http_latency_ms = 800;
+    modem_config.http_handler = iotc_fake_cloud_https_handler;
+    modem_config.http_context = &cloud_stats;
+    modem_config.http_file_path = BENCH_OTA_PATH;
+    modem_config.http_file = ota_image;
+    modem_config.http_file_size = sizeof(ota_image);
+    for (size_t i = 0; i < sizeof(ota_image); i++) {
+        ota_image[i] = (uint8_t) (i * 7 + (i >> 8));
+    }
+
+    for (int i = 1; i < argc; i++) {
+        if (0 == strcmp(argv[i], "--messages") && i + 1 < argc) {
+            num_messages = (uint32_t) strtoul(argv[++i], NULL, 10);
+        } else if (0 == strcmp(argv[i], "--baud") && i + 1 < argc) {
+            modem_config.baud_rate = (uint32_t) strtoul(argv[++i], NULL, 10);
+        } else if (0 == strcmp(argv[i], "--latency") && i + 1 < argc) {
+            modem_config.response_latency_us = (uint32_t) strtoul(argv[++i], NULL, 10);
+        } else if (0 == strcmp(argv[i], "--broker-latency") && i + 1 < argc) {
+            modem_config.broker_latency_ms = (uint32_t) strtoul(argv[++i], NULL, 10);
+        } else if (0 == strcmp(argv[i], "--http-latency") && i + 1 < argc) {
+            modem_config.http_latency_ms = (uint32_t) strtoul(argv[++i], NULL, 10);
+        } else if (0 == strcmp(argv[i], "--chunk") && i + 1 < argc) {
+            modem_config.chunk_size = (uint32_t) strtoul(argv[++i], NULL, 10);
+        } else if (0 == strcmp(argv[i], "--chunk-gap") && i + 1 < argc) {
+            modem_config.chunk_gap_us = (uint32_t) strtoul(argv[++i], NULL, 10);
+        } else if (0 == strcmp(argv[i], "--http-chunked")) {
+            modem_config.http_chunked = true;
+        } else if (0 == strcmp(argv[i], "--fail") && i + 1 < argc) {
+            i++; // applied after the modem is started
+        } else if (0 == strcmp(argv[i], "--check")) {
+            is_checking = true;
+        } else if (0 == strcmp(argv[i], "--verbose")) {
+            is_verbose = true;
+        } else {
+            fprintf(stderr, "Usage: %s [--messages N] [--baud B] [--latency us] [--broker-latency ms] [--http-latency ms]"
+                " [--chunk bytes] [--chunk-gap us] [--http-chunked] [--fail command_prefix[:count]] [--check] [--verbose]\n", argv[0]);
+            return 2;
+        }
+    }
+    Log.setLogLevel(is_verbose ? LogLevel::DEBUG : LogLevel::WARN);
+
+    iotc_modem_emulator_start(&modem_config);
+    for (int i = 1; i < argc; i++) {
+        if (0 == strcmp(argv[i], "--fail") && i + 1 < argc) {
+            char prefix[48];
+            const char *colon = strrchr(argv[i + 1], ':');
+            size_t prefix_length = colon ? (size_t) (colon - argv[i + 1]) : strlen(argv[i + 1]);
+            if (prefix_length >= sizeof(prefix)) {
+                fprintf(stderr, "The command prefix is too long\n");
+                return 2;
+            }
+            memcpy(prefix, argv[i + 1], prefix_length);
+            prefix[prefix_length] = '\0';
+            iotc_modem_emulator_inject_fault(prefix, IOTC_MODEM_FAULT_ERROR, colon ? (uint32_t) atoi(colon + 1) : 1);
+        }
+    }
+    printf("Modem: %u baud, %u us response latency, chunks of %u bytes with %u us gaps\n",
+        modem_config.baud_rate ? modem_config.baud_rate : IOTC_MODEM_DEFAULT_BAUD_RATE,
+        modem_config.response_latency_us, modem_config.chunk_size, modem_config.chunk_gap_us);
+
+    op_begin(BENCH_OP_BOOT);
+    if (!SequansController.begin()) {
+        fprintf(stderr, "FAIL: SequansController.begin()\n");
+        return 1;
+    }
+    op_end(BENCH_OP_BOOT, 1);
+
+    IotConnectClientConfig config = {0};
+    config.cpid = (char *) BENCH_CPID;
+    config.env = (char *) BENCH_ENV;
+    config.duid = (char *) BENCH_DUID;
+    config.connection_type = IOTC_CT_AWS;
+    config.cmd_cb = on_command;
+    config.ota_cb = on_ota;
+    config.status_cb = on_status;
+    config.delivery_cb = on_delivery;
+    config.auto_reconnect = true;
+    config.verbose = is_verbose;
+    config.identity_cache_ttl = BENCH_IDENTITY_CACHE_TTL;
+
+    int exit_code = 1;
+    if (!iotconnect_sdk_init(&config)) {
+        fprintf(stderr, "FAIL: iotconnect_sdk_init()\n");
+        goto cleanup;
+    }
+
+    if (!send_telemetry(num_messages)) {
+        fprintf(stderr, "FAIL: telemetry. Delivered %u, not delivered %u\n", results.num_delivered, results.num_not_delivered);
+        goto cleanup;
+    }
+
+    iotc_fake_cloud_get_c2d_topic(c2d_topic, sizeof(c2d_topic), BENCH_DUID);
+    op_begin(BENCH_OP_C2D_COMMAND);
+    if (!iotc_modem_emulator_inject_message(c2d_topic, "{\"v\":\"2.1\",\"ct\":0,\"cmd\":\"set-led on\",\"ack\":\"bench-ack-1\"}")) {
+        fprintf(stderr, "FAIL: the device is not subscribed to %s\n", c2d_topic);
+        goto cleanup;
+    }
+    if (!loop_until(&results.is_command_received) || !loop_until(&results.is_ack_delivered)) {
+        fprintf(stderr, "FAIL: C2D command round trip\n");
+        goto cleanup;
+    }
+    op_end(BENCH_OP_C2D_COMMAND, 1);
+
+    if (!reconnect()) {
+        fprintf(stderr, "FAIL: reconnect\n");
+        goto cleanup;
+    }
+
+    if (!init_from_cache(&config)) {
+        fprintf(stderr, "FAIL: init from the identity cache\n");
+        goto cleanup;
+    }
+
+    if (!download_ota()) {
+        fprintf(stderr, "FAIL: OTA download\n");
+        goto cleanup;
+    }
+
+    if (!print_report(is_checking)) {
+        goto cleanup;
+    }
+    {
+        IotcModemEmulatorStats s;
+        iotc_modem_emulator_get_stats(&s);
+        printf("Modem: %u commands, %u prompts, %u URCs, %u errors, %u published, %u http requests, "
+            "%llu bytes to modem, %llu bytes from modem, %.1f ms\n",
+            s.num_commands, s.num_prompts, s.num_urcs, s.num_errors, s.num_published, s.num_http_requests,
+            (unsigned long long) s.bytes_to_modem, (unsigned long long) s.bytes_from_modem,
+            (double) iotc_modem_emulator_get_time_ns() / 1000000.0);
+        printf("EEPROM: %u bytes written\n", iotc_avr_eeprom_num_writes);
+        if (results.num_not_delivered) {
+            printf("%u messages were not delivered\n", results.num_not_delivered);
+        }
+    }
+    printf("PASS\n");
+    exit_code = 0;
+
+    cleanup:
+    iotconnect_sdk_disconnect();
+    iotcl_deinit();
+    return exit_code;
+}
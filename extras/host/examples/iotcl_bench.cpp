@@ -0,0 +1,311 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * Micro-benchmarks for the platform-independent library: building and serializing telemetry,
+ * parsing C2D commands and OTA events, and parsing the discovery and identity responses.
+ * The payloads are the ones that the device gets from IoTConnect (see iotc_fake_cloud.cpp for the responses).
+ *
+ * For each operation, prints the wall time, and the number of allocations, the allocated bytes and the peak heap
+ * that it takes. The heap is measured with a counting allocator passed to iotcl_configure_dynamic_memory(),
+ * so it covers iotcl_malloc() and cJSON. Its bookkeeping is included in the times.
+ * The heap numbers are the same from run to run. The times are not, so compare the best of a few runs.
+ *
+ * The C2D rows are labeled with the parser that the library was built with. iotcl_bench uses cJSON,
+ * and iotcl_bench_tokenizer is the same benchmark against the library built with IOTCL_C2D_MAX_TOKENS,
+ * which adds the row of iotcl_c2d_process_event_in_place() without any allocations.
+ *
+ * Usage: iotcl_bench [--iterations N] [--filter name_substring]
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "iotcl.h"
+#include "iotcl_cfg.h"
+#include "iotcl_c2d.h"
+#include "iotcl_dra_discovery.h"
+#include "iotcl_dra_identity.h"
+#include "iotcl_telemetry.h"
+#include "iotc_fake_cloud.h"
+
+#define BENCH_DUID "bench-device"
+#define BENCH_DEFAULT_ITERATIONS 20000
+#define BENCH_TELEMETRY_BUFFER_SIZE 512
+#if IOTCL_C2D_MAX_TOKENS > 0
+#define BENCH_C2D_PARSER " (tokens)"
+#else
+#define BENCH_C2D_PARSER " (cJSON)"
+#endif
+
+#define BENCH_C2D_COMMAND \
+    "{\"v\":\"2.1\",\"ct\":0,\"cmd\":\"set-user-led on\",\"ack\":\"7c7a6e3b-5a1f-4c59-9c3e-0f2d8f7b1a42\"}"
+
+#define BENCH_C2D_OTA \
+    "{\"v\":\"2.1\",\"ct\":1,\"cmd\":\"ota\",\"ack\":\"2f1b0c9e-8d3a-4e7b-a6c5-91d0e4f3b2a8\",\"sw\":\"1.2.0\",\"hw\":\"1\"," \
+    "\"urls\":[{\"url\":\"https://saleuwdev.blob.core.windows.net/firmware/avr-iot-cellular/1.2.0/app.bin" \
+    "?sv=2020-10-02&st=2024-05-01T10%3A00%3A00Z&se=2024-05-02T10%3A00%3A00Z&sr=b&sp=r" \
+    "&sig=3kYl1Qf0sN9b5qvXo8pZ2rT7aWcE4dGh6iJjKkLmNnO%3D\",\"fileName\":\"app.bin\",\"tg\":\"\"}]}"
+
+typedef struct {
+    size_t size;
+    max_align_t alignment; // keeps the user part aligned
+} BenchBlockHeader;
+
+static struct {
+    uint32_t num_allocations;
+    size_t allocated_bytes;
+    size_t current_bytes;
+    size_t peak_bytes;
+} heap;
+
+static void *bench_malloc(size_t size) {
+    BenchBlockHeader *header = (BenchBlockHeader *) malloc(offsetof(BenchBlockHeader, alignment) + size);
+    if (!header) {
+        return NULL;
+    }
+    header->size = size;
+    heap.num_allocations++;
+    heap.allocated_bytes += size;
+    heap.current_bytes += size;
+    if (heap.current_bytes > heap.peak_bytes) {
+        heap.peak_bytes = heap.current_bytes;
+    }
+    return &header->alignment;
+}
+
+static void bench_free(void *ptr) {
+    if (!ptr) {
+        return;
+    }
+    BenchBlockHeader *header = (BenchBlockHeader *) ((char *) ptr - offsetof(BenchBlockHeader, alignment));
+    heap.current_bytes -= header->size;
+    free(header);
+}
+
+static char *discovery_response;
+static char *identity_response;
+static const char *last_command; // keeps the callbacks from being optimized away
+static const char *last_ota_url;
+
+static void on_command(IotclC2dEventData data) {
+    last_command = iotcl_c2d_get_command(data);
+    if (!last_command || !iotcl_c2d_get_ack_id(data)) {
+        fprintf(stderr, "Failed to read the C2D command\n");
+        exit(1);
+    }
+}
+
+static void on_ota(IotclC2dEventData data) {
+    last_ota_url = iotcl_c2d_get_ota_url(data, 0);
+    if (!last_ota_url || !iotcl_c2d_get_ota_sw_version(data) || !iotcl_c2d_get_ack_id(data)) {
+        fprintf(stderr, "Failed to read the OTA event\n");
+        exit(1);
+    }
+}
+
+static void check(int status, const char *what) {
+    if (IOTCL_SUCCESS != status) {
+        fprintf(stderr, "%s failed with %d\n", what, status);
+        exit(1);
+    }
+}
+
+// The values that the AVR-IoT Cellular board reports
+static void set_telemetry_values(IotclMessageHandle msg, int i) {
+    check(iotcl_telemetry_set_number(msg, "temperature", 23.5 + (i & 7)), "set_number");
+    check(iotcl_telemetry_set_number(msg, "humidity", 41.25), "set_number");
+    check(iotcl_telemetry_set_int32(msg, "light", 312 + i % 100), "set_int32");
+    check(iotcl_telemetry_set_fixed(msg, "pressure", 101325, 2), "set_fixed");
+    check(iotcl_telemetry_set_fixed(msg, "accel.x", -12, 3), "set_fixed");
+    check(iotcl_telemetry_set_fixed(msg, "accel.y", 4, 3), "set_fixed");
+    check(iotcl_telemetry_set_fixed(msg, "accel.z", 998, 3), "set_fixed");
+    check(iotcl_telemetry_set_string(msg, "version", "1.2.0"), "set_string");
+    check(iotcl_telemetry_set_bool(msg, "button", (i & 1) != 0), "set_bool");
+}
+
+static void bench_telemetry(int i) {
+    IotclMessageHandle msg = iotcl_telemetry_create();
+    if (!msg) {
+        check(IOTCL_ERR_OUT_OF_MEMORY, "iotcl_telemetry_create");
+    }
+    set_telemetry_values(msg, i);
+    char *json = iotcl_telemetry_create_serialized_string(msg, false);
+    if (!json) {
+        check(IOTCL_ERR_OUT_OF_MEMORY, "iotcl_telemetry_create_serialized_string");
+    }
+    iotcl_telemetry_destroy_serialized_string(json);
+    iotcl_telemetry_destroy(msg);
+}
+
+static void bench_telemetry_in_buffer(int i) {
+    static char buffer[BENCH_TELEMETRY_BUFFER_SIZE];
+    IotclMessageHandle msg = iotcl_telemetry_create_in_buffer(buffer, sizeof(buffer));
+    if (!msg) {
+        check(IOTCL_ERR_OVERFLOW, "iotcl_telemetry_create_in_buffer");
+    }
+    set_telemetry_values(msg, i);
+    if (!iotcl_telemetry_get_serialized_string(msg)) {
+        check(IOTCL_ERR_FAILED, "iotcl_telemetry_get_serialized_string");
+    }
+    iotcl_telemetry_destroy(msg);
+}
+
+static void bench_c2d_command(int i) {
+    (void) i;
+    check(iotcl_c2d_process_event(BENCH_C2D_COMMAND), "iotcl_c2d_process_event");
+}
+
+#if IOTCL_C2D_MAX_TOKENS > 0
+static void bench_c2d_command_in_place(int i) {
+    static char buffer[sizeof(BENCH_C2D_COMMAND)];
+    (void) i;
+    memcpy(buffer, BENCH_C2D_COMMAND, sizeof(buffer));
+    check(iotcl_c2d_process_event_in_place(buffer, sizeof(buffer) - 1), "iotcl_c2d_process_event_in_place");
+}
+#endif
+
+static void bench_c2d_ota(int i) {
+    (void) i;
+    check(iotcl_c2d_process_event(BENCH_C2D_OTA), "iotcl_c2d_process_event");
+}
+
+static void bench_discovery(int i) {
+    IotclDraUrlContext base_url = {0};
+    (void) i;
+    check(iotcl_dra_discovery_parse(&base_url, 0, discovery_response), "iotcl_dra_discovery_parse");
+    iotcl_dra_url_deinit(&base_url);
+}
+
+// Frees what the identity response configured, so that the next response can be parsed.
+// This is what iotcl_deinit() would free.
+static void release_identity_config(void) {
+    IotclMqttConfig *c = iotcl_mqtt_get_config();
+    iotcl_free(c->username);
+    iotcl_free(c->host);
+    iotcl_free(c->client_id);
+    iotcl_free(c->pub_rpt);
+    iotcl_free(c->pub_ack);
+    iotcl_free(c->sub_c2d);
+    iotcl_free(c->cd);
+    iotcl_free(c->version);
+    memset(c, 0, sizeof(*c));
+}
+
+static void bench_identity(int i) {
+    (void) i;
+    check(iotcl_dra_identity_configure_library_mqtt(identity_response), "iotcl_dra_identity_configure_library_mqtt");
+    release_identity_config();
+}
+
+typedef struct {
+    const char *name;
+    void (*fn)(int i);
+} BenchCase;
+
+static const BenchCase cases[] = {
+    {"telemetry build+serialize", bench_telemetry},
+    {"telemetry in buffer", bench_telemetry_in_buffer},
+    {"c2d command" BENCH_C2D_PARSER, bench_c2d_command},
+#if IOTCL_C2D_MAX_TOKENS > 0
+    {"c2d command in place" BENCH_C2D_PARSER, bench_c2d_command_in_place},
+#endif
+    {"c2d ota" BENCH_C2D_PARSER, bench_c2d_ota},
+    {"discovery parse", bench_discovery},
+    {"identity parse", bench_identity},
+};
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+// Returns false if the operation leaks
+static bool run_case(const BenchCase *bc, int iterations) {
+    // warm up the caches and anything allocated once
+    for (int i = 0; i < iterations / 10 + 1; i++) {
+        bc->fn(i);
+    }
+
+    size_t start_bytes = heap.current_bytes;
+    uint32_t start_allocations = heap.num_allocations;
+    size_t start_allocated = heap.allocated_bytes;
+    heap.peak_bytes = heap.current_bytes;
+
+    uint64_t start_ns = now_ns();
+    for (int i = 0; i < iterations; i++) {
+        bc->fn(i);
+    }
+    uint64_t elapsed_ns = now_ns() - start_ns;
+
+    printf("%-28s %10.1f %10.2f %12.1f %10zu\n",
+        bc->name,
+        (double) elapsed_ns / iterations,
+        (double) (heap.num_allocations - start_allocations) / iterations,
+        (double) (heap.allocated_bytes - start_allocated) / iterations,
+        heap.peak_bytes - start_bytes
+    );
+    if (heap.current_bytes != start_bytes) {
+        fprintf(stderr, "%s leaks %zu bytes\n", bc->name, heap.current_bytes - start_bytes);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    int iterations = BENCH_DEFAULT_ITERATIONS;
+    const char *filter = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (0 == strcmp(argv[i], "--iterations") && i + 1 < argc) {
+            iterations = atoi(argv[++i]);
+        } else if (0 == strcmp(argv[i], "--filter") && i + 1 < argc) {
+            filter = argv[++i];
+        } else {
+            fprintf(stderr, "Usage: %s [--iterations N] [--filter name_substring]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (iterations <= 0) {
+        fprintf(stderr, "The number of iterations must be positive\n");
+        return 1;
+    }
+
+    iotcl_configure_dynamic_memory(bench_malloc, bench_free);
+
+    // identity and discovery parsing need the library in custom mode, like the SDK configures it
+    IotclClientConfig config;
+    iotcl_init_client_config(&config);
+    config.device.instance_type = IOTCL_DCT_CUSTOM;
+    config.events.cmd_cb = on_command;
+    config.events.ota_cb = on_ota;
+    check(iotcl_init(&config), "iotcl_init");
+
+    check(iotc_fake_cloud_https_handler(NULL, "", "/api/2.1/dsdk/cpId/CPID/env/poc", NULL, &discovery_response),
+        "discovery response");
+    check(iotc_fake_cloud_https_handler(NULL, "", "/api/2.1/agent/device" IOTCL_DRA_IDENTITY_PREFIX BENCH_DUID, NULL,
+        &identity_response), "identity response");
+
+    printf("%d iterations\n", iterations);
+    printf("%-28s %10s %10s %12s %10s\n", "operation", "ns/op", "allocs/op", "bytes/op", "peak heap");
+    bool is_leaking = false;
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        if (filter && !strstr(cases[i].name, filter)) {
+            continue;
+        }
+        if (!run_case(&cases[i], iterations)) {
+            is_leaking = true;
+        }
+    }
+
+    iotcl_free(discovery_response);
+    iotcl_free(identity_response);
+    iotcl_deinit();
+    return is_leaking ? 1 : 0;
+}
@@ -0,0 +1,453 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * Checks the behavior of the platform-independent library that the end-to-end examples do not reach.
+ * Each section prints "ok" or the failed checks, and the example prints PASS and exits with 0 if all pass.
+ *
+ * batch    Telemetry batching (iotcl_telemetry_batch.h): a batch is sent when the next sample would not fit
+ *          the payload size, when the oldest sample reaches the maximum age, a sample that is larger than
+ *          the payload size on its own is sent right away, and one that overflows a batch starts the next one.
+ * schema   Telemetry schema (iotcl_telemetry_schema.h): the same set values serialize into the expected JSON
+ *          with both message kinds, unset values are omitted, and values cannot be set into object slots.
+ * reset    Resetting a message of either kind leaves {"d":[]}, and (when built with IOTCL_TELEMETRY_POOL_SIZE,
+ *          like iotcl_host_check_pool) destroyed pooled handles go back to the pool.
+ * arena    Arena allocation (iotcl_arena.h): "used" returns to 0 when the scope ends while "peak" is kept,
+ *          and allocations that do not fit or are made outside of a scope come from the heap.
+ * json_stream  Streaming JSON parsing (iotcl_json_stream.h): path keys match regardless of their case,
+ *          and data after the document is ignored, as they are with cJSON.
+ *
+ * Usage: iotcl_host_check [--verbose]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "iotcl.h"
+#include "iotcl_arena.h"
+#include "iotcl_json_stream.h"
+#include "iotcl_telemetry.h"
+#include "iotcl_telemetry_batch.h"
+#include "iotcl_telemetry_schema.h"
+
+#define CHECK_DUID "check-device"
+#define CHECK_TIMESTAMP "2024-05-01T10:00:00.000Z"
+#define CHECK_MAX_SENT 8
+#define CHECK_BUFFER_SIZE 512
+#define CHECK_ARENA_SIZE 256
+
+static bool is_verbose = false;
+static unsigned int num_failed;
+
+#define CHECK(condition) check_that((condition), #condition, __LINE__)
+
+static void check_that(bool is_true, const char *condition, int line) {
+    if (!is_true) {
+        fprintf(stderr, "FAIL at line %d: %s\n", line, condition);
+        num_failed++;
+    }
+}
+
+// What the library published with mqtt_send_cb
+static struct {
+    char *payloads[CHECK_MAX_SENT];
+    unsigned int count;
+} sent;
+
+static void on_send(const char *topic, const char *json_str, IotclDeliveryClass delivery_class) {
+    (void) topic;
+    (void) delivery_class;
+    if (is_verbose) {
+        printf("  sent %s\n", json_str);
+    }
+    if (sent.count < CHECK_MAX_SENT) {
+        sent.payloads[sent.count] = strdup(json_str);
+    }
+    sent.count++;
+}
+
+static void clear_sent(void) {
+    for (unsigned int i = 0; i < sent.count && i < CHECK_MAX_SENT; i++) {
+        free(sent.payloads[i]);
+    }
+    memset(&sent, 0, sizeof(sent));
+}
+
+static unsigned int count_occurrences(const char *s, const char *what) {
+    unsigned int count = 0;
+    for (const char *p = strstr(s, what); p; p = strstr(p + 1, what)) {
+        count++;
+    }
+    return count;
+}
+
+// The samples in a sent batch are its data sets, each with the same timestamp
+static unsigned int count_samples(unsigned int index) {
+    return index < sent.count ? count_occurrences(sent.payloads[index], CHECK_TIMESTAMP) : 0;
+}
+
+static unsigned long clock_ms;
+
+static unsigned long check_clock(void) {
+    return clock_ms;
+}
+
+static void add_sample(IotclTelemetryBatch *batch, const char *name, const char *value) {
+    IotclMessageHandle msg = iotcl_telemetry_batch_begin_sample(batch, CHECK_TIMESTAMP);
+    CHECK(NULL != msg);
+    CHECK(IOTCL_SUCCESS == iotcl_telemetry_set_string(msg, name, value));
+    CHECK(IOTCL_SUCCESS == iotcl_telemetry_batch_end_sample(batch));
+}
+
+static void check_batch(void) {
+    IotclTelemetryBatch batch;
+    IotclTelemetryBatchConfig config = {0};
+    char large_value[201];
+    memset(large_value, 'x', sizeof(large_value) - 1);
+    large_value[sizeof(large_value) - 1] = '\0';
+
+    // sent when the next sample of the same size would not fit
+    config.max_payload_size = 300;
+    CHECK(IOTCL_SUCCESS == iotcl_telemetry_batch_init(&batch, &config));
+    unsigned int num_added = 0;
+    while (0 == sent.count && num_added < 20) {
+        add_sample(&batch, "status", "ok");
+        num_added++;
+    }
+    CHECK(1 == sent.count);
+    CHECK(num_added > 1);
+    CHECK(count_samples(0) == num_added);
+    CHECK(strlen(sent.payloads[0]) <= config.max_payload_size);
+    CHECK(0 == iotcl_telemetry_batch_get_sample_count(&batch));
+    iotcl_telemetry_batch_deinit(&batch);
+    clear_sent();
+
+    // sent when the oldest sample reaches the maximum age, even though more would fit
+    config.max_payload_size = 1000;
+    config.max_age_ms = 1000;
+    config.clock_fn = check_clock;
+    clock_ms = 5000;
+    CHECK(IOTCL_SUCCESS == iotcl_telemetry_batch_init(&batch, &config));
+    add_sample(&batch, "status", "first");
+    clock_ms += 600;
+    add_sample(&batch, "status", "second");
+    CHECK(IOTCL_SUCCESS == iotcl_telemetry_batch_poll(&batch));
+    CHECK(0 == sent.count);
+    CHECK(2 == iotcl_telemetry_batch_get_sample_count(&batch));
+    clock_ms += 400;
+    CHECK(IOTCL_SUCCESS == iotcl_telemetry_batch_poll(&batch));
+    CHECK(1 == sent.count);
+    CHECK(2 == count_samples(0));
+    CHECK(0 == iotcl_telemetry_batch_get_sample_count(&batch));
+    iotcl_telemetry_batch_deinit(&batch);
+    clear_sent();
+
+    // a sample that is larger than the payload size on its own is sent right away
+    config.max_payload_size = 100;
+    config.max_age_ms = 0;
+    config.clock_fn = NULL;
+    CHECK(IOTCL_SUCCESS == iotcl_telemetry_batch_init(&batch, &config));
+    add_sample(&batch, "large", large_value);
+    CHECK(1 == sent.count);
+    CHECK(1 == count_samples(0));
+    CHECK(NULL != strstr(sent.payloads[0], large_value));
+    iotcl_telemetry_batch_deinit(&batch);
+    clear_sent();
+
+    // a sample that overflows a batch with samples is split off: the batch is sent without it,
+    // and it starts the next batch, which is sent right away as it is too large as well
+    config.max_payload_size = 250;
+    CHECK(IOTCL_SUCCESS == iotcl_telemetry_batch_init(&batch, &config));
+    add_sample(&batch, "small", "ok");
+    CHECK(0 == sent.count);
+    add_sample(&batch, "large", large_value);
+    CHECK(2 == sent.count);
+    CHECK(1 == count_samples(0) && 1 == count_samples(1));
+    CHECK(NULL != strstr(sent.payloads[0], "\"small\"") && NULL == strstr(sent.payloads[0], large_value));
+    CHECK(NULL != strstr(sent.payloads[1], large_value) && NULL == strstr(sent.payloads[1], "\"small\""));
+    CHECK(0 == iotcl_telemetry_batch_get_sample_count(&batch));
+    iotcl_telemetry_batch_deinit(&batch);
+    clear_sent();
+}
+
+// Compares the JSON of a message created either way to the expected JSON
+static bool is_serialized_as(IotclMessageHandle msg, const char *expected_json) {
+    const char *in_buffer_json = iotcl_telemetry_get_serialized_string(msg);
+    char *json = in_buffer_json ? NULL : iotcl_telemetry_create_serialized_string(msg, false);
+    const char *actual = in_buffer_json ? in_buffer_json : json;
+    if (is_verbose) {
+        printf("  %s %s\n", in_buffer_json ? "in-buffer" : "tree", actual ? actual : "(null)");
+    }
+    bool is_equal = (NULL != actual && 0 == strcmp(actual, expected_json));
+    if (json) {
+        iotcl_telemetry_destroy_serialized_string(json);
+    }
+    return is_equal;
+}
+
+static const char SCHEMA_NAME_TEMPERATURE[] PROGMEM = "temperature";
+static const char SCHEMA_NAME_LIGHT[] PROGMEM = "light";
+static const char SCHEMA_NAME_RED[] PROGMEM = "red";
+static const char SCHEMA_NAME_GREEN[] PROGMEM = "green";
+static const char SCHEMA_NAME_STATUS[] PROGMEM = "status";
+static const char SCHEMA_NAME_ONLINE[] PROGMEM = "online";
+static const char SCHEMA_NAME_ERROR[] PROGMEM = "error";
+
+enum {
+    SCHEMA_SLOT_TEMPERATURE,
+    SCHEMA_SLOT_LIGHT,
+    SCHEMA_SLOT_LIGHT_RED,
+    SCHEMA_SLOT_LIGHT_GREEN,
+    SCHEMA_SLOT_STATUS,
+    SCHEMA_SLOT_ONLINE,
+    SCHEMA_SLOT_ERROR,
+    SCHEMA_SLOT_COUNT
+};
+
+static const IotclTelemetryField schema_fields[SCHEMA_SLOT_COUNT] PROGMEM = {
+    {SCHEMA_NAME_TEMPERATURE, IOTCL_TELEMETRY_FIELD_NUMBER, IOTCL_TELEMETRY_NO_PARENT},
+    {SCHEMA_NAME_LIGHT, IOTCL_TELEMETRY_FIELD_OBJECT, IOTCL_TELEMETRY_NO_PARENT},
+    {SCHEMA_NAME_RED, IOTCL_TELEMETRY_FIELD_NUMBER, SCHEMA_SLOT_LIGHT},
+    {SCHEMA_NAME_GREEN, IOTCL_TELEMETRY_FIELD_NUMBER, SCHEMA_SLOT_LIGHT},
+    {SCHEMA_NAME_STATUS, IOTCL_TELEMETRY_FIELD_STRING, IOTCL_TELEMETRY_NO_PARENT},
+    {SCHEMA_NAME_ONLINE, IOTCL_TELEMETRY_FIELD_BOOL, IOTCL_TELEMETRY_NO_PARENT},
+    {SCHEMA_NAME_ERROR, IOTCL_TELEMETRY_FIELD_STRING, IOTCL_TELEMETRY_NO_PARENT},
+};
+
+// "light.green" is left unset, so it is omitted, and "error" is sent as null
+static const char SCHEMA_EXPECTED_JSON[] = "{\"d\":[{\"dt\":\"" CHECK_TIMESTAMP "\",\"d\":{"
+        "\"temperature\":21.5,\"light\":{\"red\":12},\"status\":\"ok\",\"online\":true,\"error\":null}}]}";
+
+static void check_schema_message(IotclTelemetrySchema *schema, IotclMessageHandle msg) {
+    CHECK(NULL != msg);
+    if (!msg) {
+        return;
+    }
+    CHECK(IOTCL_SUCCESS == iotcl_telemetry_add_new_data_set(msg, CHECK_TIMESTAMP));
+    CHECK(IOTCL_SUCCESS == iotcl_telemetry_schema_serialize(schema, msg));
+    CHECK(is_serialized_as(msg, SCHEMA_EXPECTED_JSON));
+    iotcl_telemetry_destroy(msg);
+}
+
+static void check_schema(void) {
+    IotclTelemetryValue values[SCHEMA_SLOT_COUNT];
+    IotclTelemetrySchema schema;
+    static char buffer[CHECK_BUFFER_SIZE];
+
+    CHECK(IOTCL_SUCCESS == iotcl_telemetry_schema_init(&schema, schema_fields, SCHEMA_SLOT_COUNT, values));
+    CHECK(IOTCL_SUCCESS == iotcl_telemetry_schema_set_number(&schema, SCHEMA_SLOT_TEMPERATURE, 21.5));
+    CHECK(IOTCL_SUCCESS == iotcl_telemetry_schema_set_number(&schema, SCHEMA_SLOT_LIGHT_RED, 12));
+    CHECK(IOTCL_SUCCESS == iotcl_telemetry_schema_set_string(&schema, SCHEMA_SLOT_STATUS, "ok"));
+    CHECK(IOTCL_SUCCESS == iotcl_telemetry_schema_set_bool(&schema, SCHEMA_SLOT_ONLINE, true));
+    CHECK(IOTCL_SUCCESS == iotcl_telemetry_schema_set_null(&schema, SCHEMA_SLOT_ERROR));
+
+    // object slots only group their fields and cannot hold a value of any type
+    CHECK(IOTCL_SUCCESS != iotcl_telemetry_schema_set_number(&schema, SCHEMA_SLOT_LIGHT, 1));
+    CHECK(IOTCL_SUCCESS != iotcl_telemetry_schema_set_string(&schema, SCHEMA_SLOT_LIGHT, "x"));
+    CHECK(IOTCL_SUCCESS != iotcl_telemetry_schema_set_bool(&schema, SCHEMA_SLOT_LIGHT, true));
+    CHECK(IOTCL_SUCCESS != iotcl_telemetry_schema_set_null(&schema, SCHEMA_SLOT_LIGHT));
+    // and neither can fields of a different type or slots past the table
+    CHECK(IOTCL_SUCCESS != iotcl_telemetry_schema_set_string(&schema, SCHEMA_SLOT_TEMPERATURE, "x"));
+    CHECK(IOTCL_SUCCESS != iotcl_telemetry_schema_set_number(&schema, SCHEMA_SLOT_COUNT, 1));
+
+    check_schema_message(&schema, iotcl_telemetry_create());
+    check_schema_message(&schema, iotcl_telemetry_create_in_buffer(buffer, sizeof(buffer)));
+}
+
+static const char RESET_EXPECTED_JSON[] = "{\"d\":[]}";
+
+// Resetting a message with two data sets leaves it without data sets, and it can be filled again
+static void check_reset_message(IotclMessageHandle msg) {
+    CHECK(NULL != msg);
+    if (!msg) {
+        return;
+    }
+    CHECK(IOTCL_SUCCESS == iotcl_telemetry_add_new_data_set(msg, CHECK_TIMESTAMP));
+    CHECK(IOTCL_SUCCESS == iotcl_telemetry_set_number(msg, "light.red", 12));
+    CHECK(IOTCL_SUCCESS == iotcl_telemetry_add_new_data_set(msg, CHECK_TIMESTAMP));
+    CHECK(IOTCL_SUCCESS == iotcl_telemetry_set_string(msg, "status", "ok"));
+    CHECK(IOTCL_SUCCESS == iotcl_telemetry_reset(msg));
+    CHECK(is_serialized_as(msg, RESET_EXPECTED_JSON));
+    CHECK(IOTCL_SUCCESS == iotcl_telemetry_add_new_data_set(msg, CHECK_TIMESTAMP));
+    CHECK(IOTCL_SUCCESS == iotcl_telemetry_set_string(msg, "status", "ok"));
+    CHECK(is_serialized_as(msg, "{\"d\":[{\"dt\":\"" CHECK_TIMESTAMP "\",\"d\":{\"status\":\"ok\"}}]}"));
+    iotcl_telemetry_destroy(msg);
+}
+
+static void check_reset(void) {
+    static char buffer[CHECK_BUFFER_SIZE];
+    check_reset_message(iotcl_telemetry_create());
+    check_reset_message(iotcl_telemetry_create_in_buffer(buffer, sizeof(buffer)));
+
+#if IOTCL_TELEMETRY_POOL_SIZE > 0
+    // all pooled handles are handed out before one comes from the heap
+    IotclMessageHandle pooled[IOTCL_TELEMETRY_POOL_SIZE];
+    for (int i = 0; i < IOTCL_TELEMETRY_POOL_SIZE; i++) {
+        pooled[i] = iotcl_telemetry_create();
+        CHECK(NULL != pooled[i]);
+        for (int j = 0; j < i; j++) {
+            CHECK(pooled[i] != pooled[j]);
+        }
+    }
+    IotclMessageHandle heap_msg = iotcl_telemetry_create();
+    CHECK(NULL != heap_msg);
+    for (int i = 0; i < IOTCL_TELEMETRY_POOL_SIZE; i++) {
+        CHECK(heap_msg != pooled[i]);
+    }
+
+    // a destroyed pooled handle goes back to the pool, without the values of its last message
+    CHECK(IOTCL_SUCCESS == iotcl_telemetry_set_string(pooled[0], "status", "ok"));
+    iotcl_telemetry_destroy(pooled[0]);
+    IotclMessageHandle reused = iotcl_telemetry_create();
+    CHECK(reused == pooled[0]);
+    CHECK(is_serialized_as(reused, RESET_EXPECTED_JSON));
+
+    iotcl_telemetry_destroy(heap_msg);
+    for (int i = 0; i < IOTCL_TELEMETRY_POOL_SIZE; i++) {
+        iotcl_telemetry_destroy(pooled[i]);
+    }
+#endif
+}
+
+static bool is_in_buffer(const void *ptr, const void *buffer, size_t size) {
+    return (const char *) ptr >= (const char *) buffer && (const char *) ptr < (const char *) buffer + size;
+}
+
+static void check_arena(void) {
+    static char arena_buffer[CHECK_ARENA_SIZE];
+    IotclArenaStats stats;
+
+    CHECK(IOTCL_SUCCESS == iotcl_arena_configure(arena_buffer, sizeof(arena_buffer)));
+    iotcl_arena_get_stats(&stats);
+    CHECK(stats.size > 0 && stats.size <= sizeof(arena_buffer));
+    CHECK(0 == stats.used && 0 == stats.peak && 0 == stats.num_fallbacks);
+
+    // allocations inside the scope come from the arena and are all released when it ends
+    iotcl_arena_begin();
+    void *first = iotcl_malloc(32);
+    void *second = iotcl_malloc(48);
+    CHECK(is_in_buffer(first, arena_buffer, sizeof(arena_buffer)));
+    CHECK(is_in_buffer(second, arena_buffer, sizeof(arena_buffer)));
+    iotcl_arena_get_stats(&stats);
+    CHECK(stats.used >= 32 + 48);
+    size_t used_in_scope = stats.used;
+    CHECK(stats.peak == used_in_scope);
+    iotcl_free(first); // does nothing
+    iotcl_free(second);
+    iotcl_arena_end();
+    iotcl_arena_get_stats(&stats);
+    CHECK(0 == stats.used);
+    CHECK(stats.peak == used_in_scope);
+
+    // an allocation that does not fit falls back to the heap, and the arena stays usable for the ones that fit
+    iotcl_arena_begin();
+    void *in_arena = iotcl_malloc(stats.size / 2);
+    void *on_heap = iotcl_malloc(stats.size);
+    void *after_fallback = iotcl_malloc(16);
+    CHECK(NULL != in_arena && is_in_buffer(in_arena, arena_buffer, sizeof(arena_buffer)));
+    CHECK(NULL != on_heap && !is_in_buffer(on_heap, arena_buffer, sizeof(arena_buffer)));
+    CHECK(NULL != after_fallback && is_in_buffer(after_fallback, arena_buffer, sizeof(arena_buffer)));
+    iotcl_arena_get_stats(&stats);
+    CHECK(1 == stats.num_fallbacks);
+    CHECK(stats.peak >= stats.used && stats.peak > used_in_scope);
+    iotcl_free(on_heap); // fallback allocations are freed normally
+    iotcl_arena_end();
+    iotcl_arena_get_stats(&stats);
+    CHECK(0 == stats.used);
+
+    // without a scope, allocations come from the heap
+    void *outside_scope = iotcl_malloc(16);
+    CHECK(NULL != outside_scope && !is_in_buffer(outside_scope, arena_buffer, sizeof(arena_buffer)));
+    iotcl_free(outside_scope);
+
+    CHECK(IOTCL_SUCCESS == iotcl_arena_configure(NULL, 0));
+}
+
+// The values that iotcl_json_stream_is_at_path() found, like the DRA responses are parsed
+typedef struct {
+    int32_t status;
+    int32_t error_code;
+    unsigned int num_matched;
+} JsonStreamResult;
+
+static int on_json_stream_event(void *context, const IotclJsonStream *stream, const IotclJsonStreamEvent *event) {
+    JsonStreamResult *result = (JsonStreamResult *) context;
+    if (iotcl_json_stream_is_at_path(stream, event, "status")) {
+        result->num_matched += iotcl_json_stream_get_int(event, &result->status) ? 1 : 0;
+    } else if (iotcl_json_stream_is_at_path(stream, event, "d.ec")) {
+        result->num_matched += iotcl_json_stream_get_int(event, &result->error_code) ? 1 : 0;
+    }
+    return IOTCL_SUCCESS;
+}
+
+static void check_json_stream(void) {
+    // keys match regardless of their case, and anything after the document is ignored, as with cJSON
+    static const char document[] = "{\"Status\":200,\"D\":{\"eC\":3,\"ecx\":4}}\r\n{\"status\":500}";
+    JsonStreamResult result = {0};
+    IotclJsonStream stream;
+    iotcl_json_stream_init(&stream, on_json_stream_event, &result);
+    // in two chunks, so that the trailing data is fed after the document was complete
+    size_t split = strlen(document) - 4;
+    CHECK(IOTCL_SUCCESS == iotcl_json_stream_feed(&stream, document, split));
+    CHECK(IOTCL_SUCCESS == iotcl_json_stream_feed(&stream, &document[split], sizeof(document) - split));
+    CHECK(IOTCL_SUCCESS == iotcl_json_stream_finish(&stream));
+    CHECK(2 == result.num_matched);
+    CHECK(200 == result.status);
+    CHECK(3 == result.error_code);
+
+    // but an incomplete document is still an error
+    iotcl_json_stream_init(&stream, on_json_stream_event, &result);
+    CHECK(IOTCL_SUCCESS == iotcl_json_stream_feed(&stream, document, 10));
+    CHECK(IOTCL_ERR_PARSING_ERROR == iotcl_json_stream_finish(&stream));
+}
+
+typedef struct {
+    const char *name;
+    void (*fn)(void);
+} CheckSection;
+
+static const CheckSection sections[] = {
+    {"batch", check_batch},
+    {"schema", check_schema},
+    {"reset", check_reset},
+    {"arena", check_arena},
+    {"json_stream", check_json_stream},
+};
+
+int main(int argc, char *argv[]) {
+    for (int i = 1; i < argc; i++) {
+        if (0 == strcmp(argv[i], "--verbose")) {
+            is_verbose = true;
+        } else {
+            fprintf(stderr, "Usage: %s [--verbose]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    IotclClientConfig config;
+    iotcl_init_client_config(&config);
+    config.device.instance_type = IOTCL_DCT_AWS_DEDICATED;
+    config.device.duid = CHECK_DUID;
+    config.mqtt_send_cb = on_send;
+    if (IOTCL_SUCCESS != iotcl_init(&config)) {
+        fprintf(stderr, "FAIL: iotcl_init()\n");
+        return 1;
+    }
+
+    for (size_t i = 0; i < sizeof(sections) / sizeof(sections[0]); i++) {
+        unsigned int num_failed_before = num_failed;
+        sections[i].fn();
+        printf("%-12s %s\n", sections[i].name, num_failed == num_failed_before ? "ok" : "FAILED");
+    }
+
+    iotcl_deinit();
+    if (num_failed) {
+        printf("%u checks failed\n", num_failed);
+        return 1;
+    }
+    printf("PASS\n");
+    return 0;
+}
@@ -0,0 +1,392 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include "iotc_mqtt_packet.h"
+#include "iotc_fake_broker.h"
+
+#define IOTC_FAKE_BROKER_MAX_CLIENTS        4
+#define IOTC_FAKE_BROKER_MAX_SUBSCRIPTIONS  4
+#define IOTC_FAKE_BROKER_MAX_DELAYED_ACKS   64
+#define IOTC_FAKE_BROKER_TOPIC_MAX_LENGTH   256
+#define IOTC_FAKE_BROKER_POLL_MS            5
+
+typedef struct {
+    int fd;
+    IotcMqttRxBuffer rx;
+    char subscriptions[IOTC_FAKE_BROKER_MAX_SUBSCRIPTIONS][IOTC_FAKE_BROKER_TOPIC_MAX_LENGTH];
+    uint8_t num_subscriptions;
+    uint16_t last_packet_id;
+} IotcFakeBrokerClient;
+
+typedef struct {
+    int fd;
+    uint16_t packet_id;
+    uint64_t due_ms;
+} IotcFakeBrokerDelayedAck;
+
+static IotcFakeBrokerConfig config;
+static IotcFakeBrokerStats stats;
+static IotcFakeBrokerClient clients[IOTC_FAKE_BROKER_MAX_CLIENTS];
+static IotcFakeBrokerDelayedAck delayed_acks[IOTC_FAKE_BROKER_MAX_DELAYED_ACKS];
+static int listen_fd = -1;
+static uint16_t listen_port = 0;
+static volatile bool is_running = false;
+static pthread_t thread;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000ULL + (uint64_t) ts.tv_nsec / 1000000ULL;
+}
+
+static bool send_to(int fd, uint8_t type, uint8_t flags, const uint8_t *body, size_t body_length) {
+    if (!iotc_mqtt_packet_send(fd, type, flags, body, body_length)) {
+        return false;
+    }
+    uint8_t header[IOTC_MQTT_PACKET_MAX_HEADER_SIZE];
+    stats.bytes_sent += iotc_mqtt_packet_write_header(header, type, flags, body_length) + body_length;
+    return true;
+}
+
+static void close_client(IotcFakeBrokerClient *client) {
+    if (client->fd < 0) {
+        return;
+    }
+    for (int i = 0; i < IOTC_FAKE_BROKER_MAX_DELAYED_ACKS; i++) {
+        if (delayed_acks[i].fd == client->fd) {
+            delayed_acks[i].fd = -1;
+        }
+    }
+    close(client->fd);
+    client->fd = -1;
+    iotc_mqtt_rx_buffer_free(&client->rx);
+    client->num_subscriptions = 0;
+}
+
+static void send_puback(int fd, uint16_t packet_id) {
+    uint8_t body[2];
+    iotc_mqtt_packet_put_u16(body, 0, packet_id);
+    if (send_to(fd, IOTC_MQTT_PACKET_PUBACK, 0, body, sizeof(body))) {
+        stats.num_pubacks++;
+    }
+}
+
+// Sends a QoS 1 message to the client if it is subscribed to the topic
+static bool forward(IotcFakeBrokerClient *client, const char *topic, size_t topic_length, const uint8_t *payload, size_t payload_length) {
+    bool is_subscribed = false;
+    for (uint8_t i = 0; i < client->num_subscriptions; i++) {
+        if (iotc_mqtt_topic_matches(client->subscriptions[i], topic, topic_length)) {
+            is_subscribed = true;
+            break;
+        }
+    }
+    if (!is_subscribed) {
+        return false;
+    }
+    size_t body_length = 2 + topic_length + 2 + payload_length;
+    uint8_t *body = (uint8_t *) malloc(body_length);
+    if (!body) {
+        return false;
+    }
+    client->last_packet_id++;
+    if (0 == client->last_packet_id) {
+        client->last_packet_id = 1;
+    }
+    size_t pos = iotc_mqtt_packet_put_string(body, 0, topic, topic_length);
+    pos = iotc_mqtt_packet_put_u16(body, pos, client->last_packet_id);
+    memcpy(&body[pos], payload, payload_length);
+    bool is_sent = send_to(client->fd, IOTC_MQTT_PACKET_PUBLISH, 0x02, body, body_length);
+    free(body);
+    if (is_sent) {
+        stats.num_forwarded++;
+    }
+    return is_sent;
+}
+
+static bool on_publish(IotcFakeBrokerClient *client, const IotcMqttPacket *p) {
+    const char *topic;
+    size_t topic_length;
+    size_t pos = 0;
+    uint16_t packet_id = 0;
+    uint8_t qos = (uint8_t) ((p->flags >> 1) & 0x03);
+    if (!iotc_mqtt_packet_get_string(p, &pos, &topic, &topic_length)
+        || topic_length >= IOTC_FAKE_BROKER_TOPIC_MAX_LENGTH
+        || (qos > 0 && !iotc_mqtt_packet_get_u16(p, &pos, &packet_id))) {
+        return false;
+    }
+    stats.num_publishes++;
+    if (qos > 0) {
+        if (config.puback_delay_ms) {
+            int i;
+            for (i = 0; i < IOTC_FAKE_BROKER_MAX_DELAYED_ACKS; i++) {
+                if (delayed_acks[i].fd < 0) {
+                    delayed_acks[i].fd = client->fd;
+                    delayed_acks[i].packet_id = packet_id;
+                    delayed_acks[i].due_ms = now_ms() + config.puback_delay_ms;
+                    break;
+                }
+            }
+            if (IOTC_FAKE_BROKER_MAX_DELAYED_ACKS == i) {
+                send_puback(client->fd, packet_id);
+            }
+        } else {
+            send_puback(client->fd, packet_id);
+        }
+    }
+    const uint8_t *payload = &p->data[pos];
+    size_t payload_length = p->data_length - pos;
+    for (int i = 0; i < IOTC_FAKE_BROKER_MAX_CLIENTS; i++) {
+        if (clients[i].fd >= 0) {
+            forward(&clients[i], topic, topic_length, payload, payload_length);
+        }
+    }
+    if (config.publish_cb) {
+        char topic_copy[IOTC_FAKE_BROKER_TOPIC_MAX_LENGTH];
+        char *payload_copy = (char *) malloc(payload_length + 1);
+        if (payload_copy) {
+            memcpy(topic_copy, topic, topic_length);
+            topic_copy[topic_length] = 0;
+            memcpy(payload_copy, payload, payload_length);
+            payload_copy[payload_length] = 0;
+            config.publish_cb(config.publish_context, topic_copy, payload_copy, payload_length);
+            free(payload_copy);
+        }
+    }
+    return true;
+}
+
+static bool on_subscribe(IotcFakeBrokerClient *client, const IotcMqttPacket *p) {
+    uint16_t packet_id;
+    size_t pos = 0;
+    uint8_t body[2 + IOTC_FAKE_BROKER_MAX_SUBSCRIPTIONS];
+    size_t body_length = 2;
+    if (!iotc_mqtt_packet_get_u16(p, &pos, &packet_id)) {
+        return false;
+    }
+    iotc_mqtt_packet_put_u16(body, 0, packet_id);
+    while (pos < p->data_length && body_length < sizeof(body)) {
+        const char *filter;
+        size_t filter_length;
+        if (!iotc_mqtt_packet_get_string(p, &pos, &filter, &filter_length) || pos >= p->data_length) {
+            return false;
+        }
+        pos++; // requested QoS
+        if (filter_length >= IOTC_FAKE_BROKER_TOPIC_MAX_LENGTH || client->num_subscriptions >= IOTC_FAKE_BROKER_MAX_SUBSCRIPTIONS) {
+            body[body_length++] = 0x80;
+            continue;
+        }
+        char *subscription = client->subscriptions[client->num_subscriptions++];
+        memcpy(subscription, filter, filter_length);
+        subscription[filter_length] = 0;
+        body[body_length++] = 1; // granted QoS 1
+    }
+    return send_to(client->fd, IOTC_MQTT_PACKET_SUBACK, 0, body, body_length);
+}
+
+// Returns false if the client should be disconnected
+static bool on_packet(IotcFakeBrokerClient *client, const IotcMqttPacket *p) {
+    uint8_t connack[2] = {0, config.connack_code};
+    switch (p->type) {
+        case IOTC_MQTT_PACKET_CONNECT:
+            stats.num_connects++;
+            return send_to(client->fd, IOTC_MQTT_PACKET_CONNACK, 0, connack, sizeof(connack)) && 0 == config.connack_code;
+        case IOTC_MQTT_PACKET_PUBLISH:
+            return on_publish(client, p);
+        case IOTC_MQTT_PACKET_PUBACK:
+            return true;
+        case IOTC_MQTT_PACKET_SUBSCRIBE:
+            return on_subscribe(client, p);
+        case IOTC_MQTT_PACKET_PINGREQ:
+            return send_to(client->fd, IOTC_MQTT_PACKET_PINGRESP, 0, NULL, 0);
+        default:
+            return false; // DISCONNECT or something that this broker does not support
+    }
+}
+
+static void accept_client(void) {
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0) {
+        return;
+    }
+    for (int i = 0; i < IOTC_FAKE_BROKER_MAX_CLIENTS; i++) {
+        if (clients[i].fd < 0) {
+            int flag = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+            clients[i].fd = fd;
+            clients[i].num_subscriptions = 0;
+            clients[i].last_packet_id = 0;
+            iotc_mqtt_rx_buffer_init(&clients[i].rx);
+            return;
+        }
+    }
+    close(fd);
+}
+
+static void read_client(IotcFakeBrokerClient *client) {
+    size_t previous_length = client->rx.length;
+    bool is_open = iotc_mqtt_rx_buffer_read(&client->rx, client->fd);
+    stats.bytes_received += client->rx.length - previous_length;
+    IotcMqttPacket packet;
+    size_t packet_size;
+    while (client->fd >= 0 && iotc_mqtt_rx_buffer_peek(&client->rx, &packet, &packet_size)) {
+        if (!on_packet(client, &packet)) {
+            close_client(client);
+            return;
+        }
+        iotc_mqtt_rx_buffer_consume(&client->rx, packet_size);
+    }
+    if (!is_open) {
+        close_client(client);
+    }
+}
+
+static void send_due_acks(void) {
+    uint64_t now = now_ms();
+    for (int i = 0; i < IOTC_FAKE_BROKER_MAX_DELAYED_ACKS; i++) {
+        if (delayed_acks[i].fd >= 0 && delayed_acks[i].due_ms <= now) {
+            send_puback(delayed_acks[i].fd, delayed_acks[i].packet_id);
+            delayed_acks[i].fd = -1;
+        }
+    }
+}
+
+static void *broker_thread(void *arg) {
+    (void) arg;
+    while (is_running) {
+        struct pollfd fds[1 + IOTC_FAKE_BROKER_MAX_CLIENTS];
+        int client_index[1 + IOTC_FAKE_BROKER_MAX_CLIENTS];
+        nfds_t nfds = 0;
+        fds[nfds].fd = listen_fd;
+        fds[nfds].events = POLLIN;
+        client_index[nfds++] = -1;
+        pthread_mutex_lock(&lock);
+        for (int i = 0; i < IOTC_FAKE_BROKER_MAX_CLIENTS; i++) {
+            if (clients[i].fd >= 0) {
+                fds[nfds].fd = clients[i].fd;
+                fds[nfds].events = POLLIN;
+                client_index[nfds++] = i;
+            }
+        }
+        pthread_mutex_unlock(&lock);
+
+        poll(fds, nfds, IOTC_FAKE_BROKER_POLL_MS);
+
+        pthread_mutex_lock(&lock);
+        for (nfds_t i = 0; i < nfds; i++) {
+            if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR))) {
+                continue;
+            }
+            if (client_index[i] < 0) {
+                accept_client();
+            } else if (clients[client_index[i]].fd == fds[i].fd) {
+                read_client(&clients[client_index[i]]);
+            }
+        }
+        send_due_acks();
+        pthread_mutex_unlock(&lock);
+    }
+    return NULL;
+}
+
+bool iotc_fake_broker_start(const IotcFakeBrokerConfig *new_config) {
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    int flag = 1;
+
+    config = *new_config;
+    memset(&stats, 0, sizeof(stats));
+    for (int i = 0; i < IOTC_FAKE_BROKER_MAX_CLIENTS; i++) {
+        clients[i].fd = -1;
+    }
+    for (int i = 0; i < IOTC_FAKE_BROKER_MAX_DELAYED_ACKS; i++) {
+        delayed_acks[i].fd = -1;
+    }
+
+    listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        return false;
+    }
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(config.port);
+    if (0 != bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr))
+        || 0 != listen(listen_fd, IOTC_FAKE_BROKER_MAX_CLIENTS)
+        || 0 != getsockname(listen_fd, (struct sockaddr *) &addr, &addr_len)) {
+        close(listen_fd);
+        listen_fd = -1;
+        return false;
+    }
+    listen_port = ntohs(addr.sin_port);
+
+    is_running = true;
+    if (0 != pthread_create(&thread, NULL, broker_thread, NULL)) {
+        is_running = false;
+        close(listen_fd);
+        listen_fd = -1;
+        return false;
+    }
+    return true;
+}
+
+void iotc_fake_broker_stop(void) {
+    if (!is_running) {
+        return;
+    }
+    is_running = false;
+    pthread_join(thread, NULL);
+    for (int i = 0; i < IOTC_FAKE_BROKER_MAX_CLIENTS; i++) {
+        close_client(&clients[i]);
+    }
+    close(listen_fd);
+    listen_fd = -1;
+}
+
+uint16_t iotc_fake_broker_get_port(void) {
+    return listen_port;
+}
+
+int iotc_fake_broker_inject(const char *topic, const char *payload) {
+    int num_sent = 0;
+    pthread_mutex_lock(&lock);
+    for (int i = 0; i < IOTC_FAKE_BROKER_MAX_CLIENTS; i++) {
+        if (clients[i].fd >= 0
+            && forward(&clients[i], topic, strlen(topic), (const uint8_t *) payload, strlen(payload))) {
+            num_sent++;
+        }
+    }
+    pthread_mutex_unlock(&lock);
+    return num_sent;
+}
+
+void iotc_fake_broker_drop_clients(void) {
+    pthread_mutex_lock(&lock);
+    for (int i = 0; i < IOTC_FAKE_BROKER_MAX_CLIENTS; i++) {
+        close_client(&clients[i]);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+void iotc_fake_broker_get_stats(IotcFakeBrokerStats *out_stats) {
+    pthread_mutex_lock(&lock);
+    *out_stats = stats;
+    pthread_mutex_unlock(&lock);
+}
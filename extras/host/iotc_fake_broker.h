@@ -0,0 +1,55 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * An in-process MQTT 3.1.1 broker on the loopback interface, which runs in its own thread.
+ * It accepts any client, acknowledges QoS 1 messages, forwards messages to matching subscriptions,
+ * and lets the test inject C2D messages and drop connections, so that the SDK can be benchmarked
+ * without an external broker.
+ */
+
+#ifndef IOTC_FAKE_BROKER_H
+#define IOTC_FAKE_BROKER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Called from the broker thread for every received PUBLISH
+typedef void (*IotcFakeBrokerPublishCallback)(void *context, const char *topic, const char *payload, size_t payload_length);
+
+typedef struct {
+    uint16_t port;                  // 0 picks a free port. See iotc_fake_broker_get_port().
+    uint8_t connack_code;           // 0 accepts connections. Other values refuse them with that return code.
+    unsigned long puback_delay_ms;  // Delays PUBACKs to simulate the round trip to a remote broker
+    IotcFakeBrokerPublishCallback publish_cb; // optional
+    void *publish_context;
+} IotcFakeBrokerConfig;
+
+typedef struct {
+    uint32_t num_connects;
+    uint32_t num_publishes;         // PUBLISH packets received from clients
+    uint32_t num_pubacks;           // PUBACKs sent
+    uint32_t num_forwarded;         // PUBLISH packets sent to subscribers, including injected ones
+    uint64_t bytes_received;
+    uint64_t bytes_sent;
+} IotcFakeBrokerStats;
+
+// Returns false if the broker could not listen on the port
+bool iotc_fake_broker_start(const IotcFakeBrokerConfig *config);
+
+void iotc_fake_broker_stop(void);
+
+uint16_t iotc_fake_broker_get_port(void);
+
+// Sends a QoS 1 message to the clients subscribed to the topic. Returns the number of clients it was sent to.
+int iotc_fake_broker_inject(const char *topic, const char *payload);
+
+// Closes all client connections, like a broker restart or a network failure would
+void iotc_fake_broker_drop_clients(void);
+
+void iotc_fake_broker_get_stats(IotcFakeBrokerStats *stats);
+
+#endif // IOTC_FAKE_BROKER_H
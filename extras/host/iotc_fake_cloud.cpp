@@ -0,0 +1,67 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "iotcl.h"
+#include "iotcl_util.h"
+#include "iotcl_dra_identity.h"
+#include "iotc_fake_cloud.h"
+
+#define IOTC_FAKE_CLOUD_DISCOVERY_RESPONSE \
+    "{\"d\":{\"ec\":0,\"bu\":\"https://fake-cloud.local/api/2.1/agent/device\",\"pf\":\"aws\",\"dip\":1}," \
+    "\"status\":200,\"message\":\"Success\"}"
+
+#define IOTC_FAKE_CLOUD_IDENTITY_FORMAT \
+    "{\"d\":{\"ec\":0,\"ct\":200,\"meta\":{\"at\":7,\"df\":60,\"cd\":\"XG4EOUT\",\"gtw\":null,\"edge\":0,\"pf\":0,\"hwv\":\"\",\"swv\":\"\",\"v\":2.1}," \
+    "\"has\":{\"d\":0,\"attr\":1,\"set\":0,\"r\":0,\"ota\":0}," \
+    "\"p\":{\"n\":\"mqtt\",\"h\":\"fake-broker.local\",\"p\":8883,\"id\":\"%s\",\"un\":\"\"," \
+    "\"topics\":{\"rpt\":\"$aws/rules/msg_d2c_rpt/%s/2.1/0\",\"flt\":\"$aws/rules/msg_d2c_flt/%s/2.1/3\"," \
+    "\"od\":\"$aws/rules/msg_d2c_od/%s/2.1/4\",\"hb\":\"$aws/rules/msg_d2c_hb/%s/2.1/5\"," \
+    "\"ack\":\"$aws/rules/msg_d2c_ack/%s/2.1/6\",\"dl\":\"$aws/rules/msg_d2c_dl/%s/2.1/7\"," \
+    "\"di\":\"$aws/rules/msg_d2c_di/%s/2.1/1\",\"c2d\":\"iot/%s/cmd\"}}}," \
+    "\"status\":200,\"message\":\"Device info loaded successfully.\"}"
+
+// Returns the response for the format filled with the DUID, which appears nine times
+static char *format_identity(const char *duid) {
+    int size = snprintf(NULL, 0, IOTC_FAKE_CLOUD_IDENTITY_FORMAT, duid, duid, duid, duid, duid, duid, duid, duid, duid);
+    char *response = (char *) iotcl_malloc((size_t) size + 1);
+    if (response) {
+        sprintf(response, IOTC_FAKE_CLOUD_IDENTITY_FORMAT, duid, duid, duid, duid, duid, duid, duid, duid, duid);
+    }
+    return response;
+}
+
+int iotc_fake_cloud_https_handler(
+        void *context,
+        const char *host,
+        const char *path,
+        const char *send_str,
+        char **response_data
+) {
+    IotcFakeCloudStats *stats = (IotcFakeCloudStats *) context;
+    const char *duid = strstr(path, IOTCL_DRA_IDENTITY_PREFIX);
+    (void) host;
+    (void) send_str;
+
+    if (duid) {
+        duid += strlen(IOTCL_DRA_IDENTITY_PREFIX);
+        *response_data = format_identity(duid);
+        if (stats) {
+            stats->num_identity_requests++;
+        }
+    } else {
+        *response_data = iotcl_strdup(IOTC_FAKE_CLOUD_DISCOVERY_RESPONSE);
+        if (stats) {
+            stats->num_discovery_requests++;
+        }
+    }
+    return *response_data ? IOTCL_SUCCESS : IOTCL_ERR_OUT_OF_MEMORY;
+}
+
+void iotc_fake_cloud_get_c2d_topic(char *buffer, size_t buffer_size, const char *duid) {
+    snprintf(buffer, buffer_size, "iot/%s/cmd", duid);
+}
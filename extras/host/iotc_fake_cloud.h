@@ -0,0 +1,36 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * Canned IoTConnect discovery and identity responses, served through the HTTPS handler of the POSIX transport.
+ * The identity response points the device at the topics that the AWS back end would use.
+ */
+
+#ifndef IOTC_FAKE_CLOUD_H
+#define IOTC_FAKE_CLOUD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+    uint32_t num_discovery_requests;
+    uint32_t num_identity_requests;
+} IotcFakeCloudStats;
+
+// Has the IotcPosixHttpsHandler signature. The context is an optional IotcFakeCloudStats.
+// Requests with an identity path (/uid/<duid>) get the identity response, and everything else
+// gets the discovery response. Returns IOTCL_SUCCESS or IOTCL_ERR_OUT_OF_MEMORY.
+int iotc_fake_cloud_https_handler(
+        void *context,
+        const char *host,
+        const char *path,
+        const char *send_str,
+        char **response_data
+);
+
+// Writes the C2D topic that the identity response assigns to the device
+void iotc_fake_cloud_get_c2d_topic(char *buffer, size_t buffer_size, const char *duid);
+
+#endif // IOTC_FAKE_CLOUD_H
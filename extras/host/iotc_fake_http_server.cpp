@@ -0,0 +1,236 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "iotc_fake_http_server.h"
+
+#define IOTC_FAKE_HTTP_REQUEST_MAX_LENGTH   4096
+#define IOTC_FAKE_HTTP_HEADER_MAX_LENGTH    256
+#define IOTC_FAKE_HTTP_POLL_MS              5
+#define IOTC_FAKE_HTTP_RECEIVE_TIMEOUT_S    5
+
+static IotcFakeHttpServerConfig config;
+static IotcFakeHttpServerStats stats;
+static uint32_t drop_after_bytes = 0;
+static uint32_t drop_count = 0;
+static int listen_fd = -1;
+static uint16_t listen_port = 0;
+static volatile bool is_running = false;
+static pthread_t thread;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static bool send_all(int fd, const void *data, size_t length) {
+    const uint8_t *p = (const uint8_t *) data;
+    while (length > 0) {
+        ssize_t sent = send(fd, p, length, MSG_NOSIGNAL);
+        if (sent <= 0) {
+            return false;
+        }
+        p += sent;
+        length -= (size_t) sent;
+    }
+    return true;
+}
+
+static void send_status(int fd, const char *status, const char *extra_header) {
+    char header[IOTC_FAKE_HTTP_HEADER_MAX_LENGTH];
+    int length = snprintf(header, sizeof(header), "HTTP/1.1 %s\r\n%sContent-Length: 0\r\nConnection: close\r\n\r\n",
+        status, extra_header ? extra_header : "");
+    send_all(fd, header, (size_t) length);
+}
+
+// Returns the value of the header, which ends at "\r\n", or NULL
+static const char *find_header(const char *request, const char *name) {
+    size_t name_length = strlen(name);
+    for (const char *line = strstr(request, "\r\n"); line; line = strstr(line, "\r\n")) {
+        line += 2;
+        if (0 == strncasecmp(line, name, name_length) && ':' == line[name_length]) {
+            const char *value = &line[name_length + 1];
+            while (' ' == *value) {
+                value++;
+            }
+            return value;
+        }
+    }
+    return NULL;
+}
+
+static void respond(int fd, const char *request) {
+    char path[IOTC_FAKE_HTTP_REQUEST_MAX_LENGTH];
+    char header[IOTC_FAKE_HTTP_HEADER_MAX_LENGTH];
+    unsigned long first = 0;
+    unsigned long last = 0;
+
+    pthread_mutex_lock(&lock);
+    stats.num_requests++;
+    pthread_mutex_unlock(&lock);
+
+    if (1 != sscanf(request, "GET %4095s HTTP/1.", path)) {
+        send_status(fd, "400 Bad Request", NULL);
+        return;
+    }
+    path[strcspn(path, "?")] = '\0';
+    if (!config.file_path || 0 != strcmp(path, config.file_path)) {
+        send_status(fd, "404 Not Found", NULL);
+        return;
+    }
+
+    const char *range = find_header(request, "Range");
+    size_t start = 0;
+    size_t length = config.file_size;
+    if (range && !config.is_range_ignored) {
+        int num_values = sscanf(range, "bytes=%lu-%lu", &first, &last);
+        if (num_values < 1) {
+            send_status(fd, "400 Bad Request", NULL);
+            return;
+        }
+        if (first >= config.file_size) {
+            snprintf(header, sizeof(header), "Content-Range: bytes */%lu\r\n", (unsigned long) config.file_size);
+            send_status(fd, "416 Range Not Satisfiable", header);
+            return;
+        }
+        if (num_values < 2 || last >= config.file_size) {
+            last = (unsigned long) config.file_size - 1;
+        }
+        start = first;
+        length = last - first + 1;
+        snprintf(header, sizeof(header),
+            "HTTP/1.1 206 Partial Content\r\nContent-Range: bytes %lu-%lu/%lu\r\nContent-Length: %lu\r\n"
+            "Content-Type: application/octet-stream\r\nConnection: close\r\n\r\n",
+            first, last, (unsigned long) config.file_size, (unsigned long) length);
+    } else {
+        snprintf(header, sizeof(header),
+            "HTTP/1.1 200 OK\r\nContent-Length: %lu\r\nContent-Type: application/octet-stream\r\nConnection: close\r\n\r\n",
+            (unsigned long) length);
+    }
+
+    pthread_mutex_lock(&lock);
+    if (range && !config.is_range_ignored) {
+        stats.num_range_requests++;
+    }
+    if (drop_count && length > drop_after_bytes) {
+        drop_count--;
+        length = drop_after_bytes; // the client sees the connection close before the end of the body
+        stats.num_dropped++;
+    }
+    pthread_mutex_unlock(&lock);
+
+    if (send_all(fd, header, strlen(header)) && send_all(fd, &config.file[start], length)) {
+        pthread_mutex_lock(&lock);
+        stats.bytes_sent += length;
+        pthread_mutex_unlock(&lock);
+    }
+}
+
+// Reads the request up to the empty line and responds
+static void serve_client(int fd) {
+    char request[IOTC_FAKE_HTTP_REQUEST_MAX_LENGTH + 1];
+    size_t length = 0;
+    struct timeval timeout = {IOTC_FAKE_HTTP_RECEIVE_TIMEOUT_S, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    while (length < IOTC_FAKE_HTTP_REQUEST_MAX_LENGTH) {
+        ssize_t received = recv(fd, &request[length], IOTC_FAKE_HTTP_REQUEST_MAX_LENGTH - length, 0);
+        if (received <= 0) {
+            return;
+        }
+        length += (size_t) received;
+        request[length] = '\0';
+        if (strstr(request, "\r\n\r\n")) {
+            respond(fd, request);
+            return;
+        }
+    }
+}
+
+static void *server_thread(void *arg) {
+    (void) arg;
+    while (is_running) {
+        struct pollfd pfd = {listen_fd, POLLIN, 0};
+        if (poll(&pfd, 1, IOTC_FAKE_HTTP_POLL_MS) <= 0) {
+            continue;
+        }
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) {
+            continue;
+        }
+        serve_client(fd);
+        close(fd);
+    }
+    return NULL;
+}
+
+bool iotc_fake_http_server_start(const IotcFakeHttpServerConfig *c) {
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    int flag = 1;
+
+    config = *c;
+    memset(&stats, 0, sizeof(stats));
+    drop_after_bytes = 0;
+    drop_count = 0;
+    listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        return false;
+    }
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(config.port);
+    if (0 != bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr))
+        || 0 != listen(listen_fd, 4)
+        || 0 != getsockname(listen_fd, (struct sockaddr *) &addr, &addr_len)) {
+        close(listen_fd);
+        listen_fd = -1;
+        return false;
+    }
+    listen_port = ntohs(addr.sin_port);
+
+    is_running = true;
+    if (0 != pthread_create(&thread, NULL, server_thread, NULL)) {
+        is_running = false;
+        close(listen_fd);
+        listen_fd = -1;
+        return false;
+    }
+    return true;
+}
+
+void iotc_fake_http_server_stop(void) {
+    if (!is_running) {
+        return;
+    }
+    is_running = false;
+    pthread_join(thread, NULL);
+    close(listen_fd);
+    listen_fd = -1;
+}
+
+uint16_t iotc_fake_http_server_get_port(void) {
+    return listen_port;
+}
+
+void iotc_fake_http_server_drop_after(uint32_t num_bytes, uint32_t count) {
+    pthread_mutex_lock(&lock);
+    drop_after_bytes = num_bytes;
+    drop_count = count;
+    pthread_mutex_unlock(&lock);
+}
+
+void iotc_fake_http_server_get_stats(IotcFakeHttpServerStats *out_stats) {
+    pthread_mutex_lock(&lock);
+    *out_stats = stats;
+    pthread_mutex_unlock(&lock);
+}
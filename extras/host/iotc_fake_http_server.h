@@ -0,0 +1,47 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * An in-process HTTP/1.1 server on the loopback interface, which runs in its own thread and serves one file,
+ * like the storage that OTA images are downloaded from. It supports single Range requests, can be made to ignore
+ * them as some servers do, and can cut responses short as if the link dropped, so that the OTA download
+ * (see src/iotc_ota.h) can be tested against it through the POSIX transport. Each connection gets one response.
+ */
+
+#ifndef IOTC_FAKE_HTTP_SERVER_H
+#define IOTC_FAKE_HTTP_SERVER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+    uint16_t port;                  // 0 picks a free port. See iotc_fake_http_server_get_port().
+    const char *file_path;          // GETs of this path, with any URL parameters, get the file. Other paths get 404.
+    const uint8_t *file;            // Needs to remain valid while the server runs
+    size_t file_size;
+    bool is_range_ignored;          // Sends the whole file with 200 for Range requests
+} IotcFakeHttpServerConfig;
+
+typedef struct {
+    uint32_t num_requests;
+    uint32_t num_range_requests;    // Responded with 206
+    uint32_t num_dropped;           // Responses cut short by iotc_fake_http_server_drop_after()
+    uint64_t bytes_sent;            // Of the bodies
+} IotcFakeHttpServerStats;
+
+// Returns false if the server could not listen on the port
+bool iotc_fake_http_server_start(const IotcFakeHttpServerConfig *config);
+
+void iotc_fake_http_server_stop(void);
+
+uint16_t iotc_fake_http_server_get_port(void);
+
+// The body of the next count responses with a body is cut off after num_bytes, and the connection is closed
+void iotc_fake_http_server_drop_after(uint32_t num_bytes, uint32_t count);
+
+void iotc_fake_http_server_get_stats(IotcFakeHttpServerStats *stats);
+
+#endif // IOTC_FAKE_HTTP_SERVER_H
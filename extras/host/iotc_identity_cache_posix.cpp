@@ -0,0 +1,32 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+#include <string.h>
+#include "iotc_identity_cache.h"
+
+// The identity cache storage of the host SDK, in RAM. It lasts as long as the process,
+// so a second iotconnect_sdk_init() in the same process starts from the cache.
+
+static uint8_t storage[IOTC_IDENTITY_CACHE_EEPROM_SIZE];
+
+size_t iotc_identity_cache_storage_size(void) {
+    return sizeof(storage);
+}
+
+bool iotc_identity_cache_storage_read(size_t offset, void *data, size_t size) {
+    if (offset + size > sizeof(storage)) {
+        return false;
+    }
+    memcpy(data, &storage[offset], size);
+    return true;
+}
+
+bool iotc_identity_cache_storage_write(size_t offset, const void *data, size_t size) {
+    if (offset + size > sizeof(storage)) {
+        return false;
+    }
+    memcpy(&storage[offset], data, size);
+    return true;
+}
@@ -0,0 +1,678 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <Arduino.h>
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include <util/delay.h>
+
+#include "iotcl.h"
+#include "iotc_modem_emulator.h"
+
+#define IOTC_MODEM_CTS_bm                   PIN4_bm // input, driven by the modem. Low lets the MCU send.
+#define IOTC_MODEM_RTS_bm                   PIN7_bm // output, driven by the MCU. Low lets the modem send.
+
+#define IOTC_MODEM_OUTPUT_QUEUE_SIZE        8192
+#define IOTC_MODEM_MAX_URCS                 32
+#define IOTC_MODEM_URC_MAX_LENGTH           256
+#define IOTC_MODEM_LINE_MAX_LENGTH          512
+#define IOTC_MODEM_PAYLOAD_MAX_LENGTH       2048
+#define IOTC_MODEM_MAX_SUBSCRIPTIONS        4
+#define IOTC_MODEM_MAX_MESSAGES             8
+#define IOTC_MODEM_MAX_FAULTS               4
+#define IOTC_MODEM_TOPIC_MAX_LENGTH         128
+#define IOTC_MODEM_PATH_MAX_LENGTH          256
+#define IOTC_MODEM_PUBLISH_MAX_PAYLOAD_SIZE 1024
+#define IOTC_MODEM_HCESIGN_CONTEXT_ID       1
+
+typedef struct {
+    uint8_t data;
+    uint64_t due_ns;
+} IotcModemOutputByte;
+
+// A URC that is sent once the time comes
+typedef struct {
+    bool is_used;
+    uint64_t due_ns;
+    char text[IOTC_MODEM_URC_MAX_LENGTH];
+} IotcModemUrc;
+
+// A message from the broker that waits for AT+SQNSMQTTRCVMESSAGE
+typedef struct {
+    bool is_used;
+    uint16_t message_id;
+    char topic[IOTC_MODEM_TOPIC_MAX_LENGTH];
+    char *payload;
+} IotcModemMessage;
+
+typedef struct {
+    char command_prefix[48];
+    IotcModemFault fault;
+    uint32_t count;
+} IotcModemFaultRule;
+
+typedef enum {
+    IOTC_MODEM_PAYLOAD_NONE = 0,
+    IOTC_MODEM_PAYLOAD_MQTT_PUBLISH,
+    IOTC_MODEM_PAYLOAD_HTTP_SEND
+} IotcModemPayloadKind;
+
+static IotcModemEmulatorConfig config;
+static IotcModemEmulatorStats stats;
+static uint64_t now_ns = 0;
+static uint64_t byte_ns = 0;
+static bool is_pumping = false;
+
+// MCU to modem
+static uint64_t tx_line_free_ns = 0;
+static bool is_tx_byte_written = false;
+static uint8_t tx_byte = 0;
+static char line[IOTC_MODEM_LINE_MAX_LENGTH];
+static size_t line_length = 0;
+static IotcModemPayloadKind payload_kind = IOTC_MODEM_PAYLOAD_NONE;
+static char payload[IOTC_MODEM_PAYLOAD_MAX_LENGTH + 1];
+static size_t payload_length = 0;
+static size_t payload_expected = 0;
+static char payload_target[IOTC_MODEM_PATH_MAX_LENGTH]; // the topic or the HTTP path
+static unsigned int payload_qos = 0;
+
+// Modem to MCU
+static IotcModemOutputByte output[IOTC_MODEM_OUTPUT_QUEUE_SIZE];
+static size_t output_head = 0;
+static size_t output_count = 0;
+static uint64_t output_last_due_ns = 0;
+static uint64_t rx_line_free_ns = 0;
+static IotcModemUrc urcs[IOTC_MODEM_MAX_URCS];
+
+static IotcModemFaultRule faults[IOTC_MODEM_MAX_FAULTS];
+
+// MQTT
+static bool is_mqtt_connected = false;
+static bool is_mqtt_signing = false;
+static uint16_t last_message_id = 0;
+static char subscriptions[IOTC_MODEM_MAX_SUBSCRIPTIONS][IOTC_MODEM_TOPIC_MAX_LENGTH];
+static IotcModemMessage messages[IOTC_MODEM_MAX_MESSAGES];
+
+// HTTP
+static char http_host[IOTC_MODEM_PATH_MAX_LENGTH];
+static char *http_body = NULL;
+static size_t http_body_length = 0;
+static size_t http_body_offset = 0;
+
+void iotc_avr_usart1_transmit(uint8_t data) {
+    tx_byte = data;
+    is_tx_byte_written = true;
+}
+
+// Queues modem output, paced at the baud rate and split into chunks if configured
+static void emit_bytes(const char *data, size_t length, uint64_t at_ns) {
+    for (size_t i = 0; i < length; i++) {
+        if (output_count == IOTC_MODEM_OUTPUT_QUEUE_SIZE) {
+            fprintf(stderr, "Modem emulator: the output queue is full\n");
+            return;
+        }
+        uint64_t due_ns = output_last_due_ns + byte_ns;
+        if (due_ns < at_ns) {
+            due_ns = at_ns;
+        }
+        if (config.chunk_size && i > 0 && 0 == i % config.chunk_size) {
+            due_ns += (uint64_t) config.chunk_gap_us * 1000ULL;
+        }
+        IotcModemOutputByte *b = &output[(output_head + output_count) % IOTC_MODEM_OUTPUT_QUEUE_SIZE];
+        b->data = (uint8_t) data[i];
+        b->due_ns = due_ns;
+        output_count++;
+        output_last_due_ns = due_ns;
+    }
+}
+
+static void emit(const char *str, uint64_t at_ns) {
+    emit_bytes(str, strlen(str), at_ns);
+}
+
+static void emit_result(bool is_ok, uint64_t at_ns) {
+    if (!is_ok) {
+        stats.num_errors++;
+    }
+    emit(is_ok ? "\r\nOK\r\n" : "\r\nERROR\r\n", at_ns);
+}
+
+static void schedule_urc(uint64_t due_ns, const char *format, ...) {
+    for (int i = 0; i < IOTC_MODEM_MAX_URCS; i++) {
+        IotcModemUrc *urc = &urcs[i];
+        if (urc->is_used) {
+            continue;
+        }
+        va_list args;
+        va_start(args, format);
+        strcpy(urc->text, "\r\n+");
+        vsnprintf(&urc->text[3], sizeof(urc->text) - 5, format, args);
+        va_end(args);
+        strcat(urc->text, "\r\n");
+        urc->due_ns = due_ns;
+        urc->is_used = true;
+        return;
+    }
+    fprintf(stderr, "Modem emulator: too many pending URCs\n");
+}
+
+// Copies the argument at index from a comma separated list into buffer, without the quotes
+static bool get_argument(const char *args, int index, char *buffer, size_t buffer_size) {
+    bool is_quoted = false;
+    int current = 0;
+    size_t length = 0;
+    for (const char *p = args; *p; p++) {
+        if ('"' == *p) {
+            is_quoted = !is_quoted;
+        } else if (',' == *p && !is_quoted) {
+            if (current == index) {
+                break;
+            }
+            current++;
+        } else if (current == index && length + 1 < buffer_size) {
+            buffer[length++] = *p;
+        }
+    }
+    buffer[length] = '\0';
+    return current == index;
+}
+
+static long get_number_argument(const char *args, int index, long default_value) {
+    char buffer[16];
+    if (!get_argument(args, index, buffer, sizeof(buffer)) || !buffer[0]) {
+        return default_value;
+    }
+    return strtol(buffer, NULL, 10);
+}
+
+static bool is_subscribed(const char *topic) {
+    for (int i = 0; i < IOTC_MODEM_MAX_SUBSCRIPTIONS; i++) {
+        if (0 == strcmp(subscriptions[i], topic)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint16_t next_message_id(void) {
+    last_message_id++;
+    if (0 == last_message_id) {
+        last_message_id = 1;
+    }
+    return last_message_id;
+}
+
+static void free_http_body(void) {
+    if (http_body) {
+        iotcl_free(http_body);
+    }
+    http_body = NULL;
+    http_body_length = 0;
+    http_body_offset = 0;
+}
+
+static void free_messages(void) {
+    for (int i = 0; i < IOTC_MODEM_MAX_MESSAGES; i++) {
+        free(messages[i].payload);
+        messages[i].payload = NULL;
+        messages[i].is_used = false;
+    }
+}
+
+static bool is_file_path(const char *path) {
+    if (!config.http_file_path) {
+        return false;
+    }
+    size_t length = strlen(config.http_file_path);
+    return 0 == strncmp(path, config.http_file_path, length) && ('\0' == path[length] || '?' == path[length]);
+}
+
+// The modem passes the body on, but not the Content-Range header
+static void run_file_request(const char *header, uint64_t at_ns) {
+    int status_code = 200;
+    size_t offset = 0;
+    size_t length = config.http_file_size;
+    unsigned long first;
+    unsigned long last;
+    free_http_body();
+    stats.num_http_requests++;
+    if (2 == sscanf(header, "Range: bytes=%lu-%lu", &first, &last) && first <= last) {
+        if (first >= config.http_file_size) {
+            status_code = 416;
+            length = 0;
+        } else {
+            status_code = 206;
+            offset = first;
+            length = (last < config.http_file_size ? last + 1 : config.http_file_size) - first;
+        }
+    }
+    if (length) {
+        http_body = (char *) iotcl_malloc(length);
+        memcpy(http_body, &config.http_file[offset], length);
+        http_body_length = length;
+    }
+    schedule_urc(at_ns + (uint64_t) config.http_latency_ms * 1000000ULL,
+        "SQNHTTPRING: 0,%d,\"application/octet-stream\",%u", status_code, (unsigned int) length);
+}
+
+static void run_http_request(const char *path, const char *send_str, uint64_t at_ns) {
+    int status_code = 500;
+    free_http_body();
+    stats.num_http_requests++;
+    if (config.http_handler
+        && IOTCL_SUCCESS == config.http_handler(config.http_context, http_host, path, send_str, &http_body)
+        && http_body) {
+        status_code = 200;
+        http_body_length = strlen(http_body);
+    }
+    schedule_urc(at_ns + (uint64_t) config.http_latency_ms * 1000000ULL,
+        "SQNHTTPRING: 0,%d,\"application/json\",%u", status_code, (unsigned int) (config.http_chunked ? 0 : http_body_length));
+}
+
+static void mqtt_publish_received(uint64_t at_ns) {
+    uint16_t message_id = next_message_id();
+    stats.num_published++;
+    emit_result(true, at_ns);
+    schedule_urc(at_ns, "SQNSMQTTPUBLISH: 0,%u", (unsigned int) message_id);
+    schedule_urc(at_ns + (payload_qos ? (uint64_t) config.broker_latency_ms * 1000000ULL : 0),
+        "SQNSMQTTONPUBLISH: 0,%u,0", (unsigned int) message_id);
+}
+
+static void payload_received(uint64_t at_ns) {
+    uint64_t respond_ns = at_ns + (uint64_t) config.response_latency_us * 1000ULL;
+    IotcModemPayloadKind kind = payload_kind;
+    payload_kind = IOTC_MODEM_PAYLOAD_NONE;
+    if (payload_length > IOTC_MODEM_PAYLOAD_MAX_LENGTH) {
+        emit_result(false, respond_ns);
+        return;
+    }
+    payload[payload_length] = '\0';
+    if (IOTC_MODEM_PAYLOAD_MQTT_PUBLISH == kind) {
+        mqtt_publish_received(respond_ns);
+    } else {
+        emit_result(true, respond_ns);
+        run_http_request(payload_target, payload, respond_ns);
+    }
+}
+
+static void expect_payload(IotcModemPayloadKind kind, size_t length, uint64_t respond_ns) {
+    stats.num_prompts++;
+    payload_kind = kind;
+    payload_expected = length;
+    payload_length = 0;
+    emit("\r\n> ", respond_ns);
+}
+
+static void handle_mqtt_command(const char *command, const char *args, uint64_t respond_ns) {
+    char topic[IOTC_MODEM_TOPIC_MAX_LENGTH];
+
+    if (0 == strcmp(command, "AT+SQNSMQTTCONNECT")) {
+        if (is_mqtt_connected) {
+            emit_result(false, respond_ns);
+            return;
+        }
+        emit_result(true, respond_ns);
+        // The modem asks the MCU to sign the TLS handshake with the key in the ECC608
+        is_mqtt_signing = true;
+        schedule_urc(respond_ns + (uint64_t) config.connect_latency_ms * 500000ULL,
+            "SQNHCESIGN: %d,0,32,%s", IOTC_MODEM_HCESIGN_CONTEXT_ID,
+            "00112233445566778899aabbccddeeff00112233445566778899aabbccddeeff");
+    } else if (0 == strcmp(command, "AT+SQNHCESIGN")) {
+        if (!is_mqtt_signing) {
+            emit_result(false, respond_ns);
+            return;
+        }
+        is_mqtt_signing = false;
+        is_mqtt_connected = true;
+        emit_result(true, respond_ns);
+        schedule_urc(respond_ns + (uint64_t) config.connect_latency_ms * 500000ULL, "SQNSMQTTONCONNECT: 0,0");
+    } else if (0 == strcmp(command, "AT+SQNSMQTTDISCONNECT")) {
+        if (!is_mqtt_connected) {
+            emit_result(false, respond_ns);
+            return;
+        }
+        iotc_modem_emulator_drop_connection();
+        emit_result(true, respond_ns);
+    } else if (0 == strcmp(command, "AT+SQNSMQTTSUBSCRIBE")) {
+        get_argument(args, 1, topic, sizeof(topic));
+        int slot = -1;
+        for (int i = 0; i < IOTC_MODEM_MAX_SUBSCRIPTIONS && slot < 0; i++) {
+            if (!subscriptions[i][0] || 0 == strcmp(subscriptions[i], topic)) {
+                slot = i;
+            }
+        }
+        if (!is_mqtt_connected || slot < 0) {
+            emit_result(false, respond_ns);
+            return;
+        }
+        strcpy(subscriptions[slot], topic);
+        emit_result(true, respond_ns);
+        schedule_urc(respond_ns + (uint64_t) config.broker_latency_ms * 1000000ULL,
+            "SQNSMQTTONSUBSCRIBE: 0,\"%s\",0", topic);
+    } else if (0 == strcmp(command, "AT+SQNSMQTTPUBLISH")) {
+        get_argument(args, 1, payload_target, sizeof(payload_target));
+        payload_qos = (unsigned int) get_number_argument(args, 2, 0);
+        long length = get_number_argument(args, 3, 0);
+        if (!is_mqtt_connected || length <= 0 || length > IOTC_MODEM_PUBLISH_MAX_PAYLOAD_SIZE) {
+            emit_result(false, respond_ns);
+            return;
+        }
+        expect_payload(IOTC_MODEM_PAYLOAD_MQTT_PUBLISH, (size_t) length, respond_ns);
+    } else if (0 == strcmp(command, "AT+SQNSMQTTRCVMESSAGE")) {
+        get_argument(args, 1, topic, sizeof(topic));
+        long message_id = get_number_argument(args, 2, -1);
+        for (int i = 0; i < IOTC_MODEM_MAX_MESSAGES; i++) {
+            IotcModemMessage *m = &messages[i];
+            if (m->is_used && 0 == strcmp(m->topic, topic) && (message_id < 0 || m->message_id == message_id)) {
+                emit("\r\n", respond_ns);
+                emit(m->payload, respond_ns);
+                emit_result(true, respond_ns);
+                free(m->payload);
+                m->payload = NULL;
+                m->is_used = false;
+                return;
+            }
+        }
+        emit_result(false, respond_ns);
+    } else {
+        emit_result(true, respond_ns); // configuration
+    }
+}
+
+static void handle_http_command(const char *command, const char *args, uint64_t respond_ns) {
+    char path[IOTC_MODEM_PATH_MAX_LENGTH];
+
+    if (0 == strcmp(command, "AT+SQNHTTPCFG")) {
+        get_argument(args, 1, http_host, sizeof(http_host));
+        emit_result(true, respond_ns);
+    } else if (0 == strcmp(command, "AT+SQNHTTPQRY")) {
+        get_argument(args, 2, path, sizeof(path));
+        emit_result(true, respond_ns);
+        if (is_file_path(path)) {
+            char header[IOTC_MODEM_PATH_MAX_LENGTH];
+            get_argument(args, 3, header, sizeof(header));
+            run_file_request(header, respond_ns);
+        } else {
+            run_http_request(path, NULL, respond_ns);
+        }
+    } else if (0 == strcmp(command, "AT+SQNHTTPSND")) {
+        get_argument(args, 2, payload_target, sizeof(payload_target));
+        long length = get_number_argument(args, 3, 0);
+        if (length <= 0) {
+            emit_result(false, respond_ns);
+            return;
+        }
+        expect_payload(IOTC_MODEM_PAYLOAD_HTTP_SEND, (size_t) length, respond_ns);
+    } else if (0 == strcmp(command, "AT+SQNHTTPRCV")) {
+        long length = get_number_argument(args, 1, 0);
+        if (!http_body || length < 0) {
+            emit_result(false, respond_ns);
+            return;
+        }
+        size_t remaining = http_body_length - http_body_offset;
+        if (0 == remaining) {
+            emit_result(false, respond_ns); // as the modem does when there is no more data
+            return;
+        }
+        size_t chunk_length = ((size_t) length < remaining) ? (size_t) length : remaining;
+        emit("\r\n<<<", respond_ns);
+        emit_bytes(&http_body[http_body_offset], chunk_length, respond_ns);
+        http_body_offset += chunk_length;
+        emit_result(true, respond_ns);
+    } else {
+        emit_result(true, respond_ns);
+    }
+}
+
+static bool apply_fault(const char *command_line, uint64_t respond_ns) {
+    for (int i = 0; i < IOTC_MODEM_MAX_FAULTS; i++) {
+        IotcModemFaultRule *rule = &faults[i];
+        if (0 == rule->count || 0 != strncmp(command_line, rule->command_prefix, strlen(rule->command_prefix))) {
+            continue;
+        }
+        rule->count--;
+        if (IOTC_MODEM_FAULT_ERROR == rule->fault) {
+            emit_result(false, respond_ns);
+        }
+        return true;
+    }
+    return false;
+}
+
+static void handle_command(const char *command_line, uint64_t at_ns) {
+    uint64_t respond_ns = at_ns + (uint64_t) config.response_latency_us * 1000ULL;
+    char command[32];
+    const char *args = strchr(command_line, '=');
+    size_t command_length = args ? (size_t) (args - command_line) : strlen(command_line);
+
+    stats.num_commands++;
+    if (apply_fault(command_line, respond_ns)) {
+        return;
+    }
+    if (command_length >= sizeof(command)) {
+        emit_result(false, respond_ns);
+        return;
+    }
+    memcpy(command, command_line, command_length);
+    command[command_length] = '\0';
+    args = args ? args + 1 : "";
+
+    if (0 == strncmp(command, "AT+SQNSMQTT", strlen("AT+SQNSMQTT")) || 0 == strcmp(command, "AT+SQNHCESIGN")) {
+        handle_mqtt_command(command, args, respond_ns);
+    } else if (0 == strncmp(command, "AT+SQNHTTP", strlen("AT+SQNHTTP"))) {
+        handle_http_command(command, args, respond_ns);
+    } else {
+        emit_result(true, respond_ns);
+    }
+}
+
+// A byte from the MCU has arrived at the modem
+static void receive_byte(uint8_t data, uint64_t at_ns) {
+    stats.bytes_to_modem++;
+    if (IOTC_MODEM_PAYLOAD_NONE != payload_kind) {
+        if (payload_length < IOTC_MODEM_PAYLOAD_MAX_LENGTH) {
+            payload[payload_length] = (char) data;
+        }
+        payload_length++;
+        if (payload_length == payload_expected) {
+            payload_received(at_ns);
+        }
+        return;
+    }
+    if ('\r' == data) {
+        line[line_length] = '\0';
+        if (line_length > 0) {
+            handle_command(line, at_ns);
+        }
+        line_length = 0;
+    } else if ('\n' != data && line_length + 1 < sizeof(line)) {
+        line[line_length++] = (char) data;
+    }
+}
+
+static uint64_t output_ready_ns(void) {
+    uint64_t due_ns = output[output_head].due_ns;
+    return (due_ns > rx_line_free_ns) ? due_ns : rx_line_free_ns;
+}
+
+static bool can_receive(void) {
+    return output_count > 0 && !(VPORTC.OUT & IOTC_MODEM_RTS_bm) && (USART1.CTRLA & USART_RXCIE_bm);
+}
+
+static bool can_transmit(void) {
+    return (USART1.CTRLA & USART_DREIE_bm) && !(VPORTC.IN & IOTC_MODEM_CTS_bm);
+}
+
+// Returns when something can happen next, or UINT64_MAX if nothing is waiting
+static uint64_t next_event_ns(void) {
+    uint64_t next_ns = UINT64_MAX;
+    for (int i = 0; i < IOTC_MODEM_MAX_URCS; i++) {
+        if (urcs[i].is_used && urcs[i].due_ns < next_ns) {
+            next_ns = urcs[i].due_ns;
+        }
+    }
+    if (can_receive() && output_ready_ns() < next_ns) {
+        next_ns = output_ready_ns();
+    }
+    if (can_transmit() && tx_line_free_ns < next_ns) {
+        next_ns = tx_line_free_ns;
+    }
+    return next_ns;
+}
+
+// Does what is due at now_ns: sends due URCs, moves one byte in each direction and runs the interrupts
+static void pump(void) {
+    for (int i = 0; i < IOTC_MODEM_MAX_URCS; i++) {
+        if (urcs[i].is_used && urcs[i].due_ns <= now_ns) {
+            urcs[i].is_used = false;
+            stats.num_urcs++;
+            emit(urcs[i].text, urcs[i].due_ns);
+        }
+    }
+    if (can_transmit() && tx_line_free_ns <= now_ns) {
+        is_tx_byte_written = false;
+        USART1_DRE_vect();
+        if (is_tx_byte_written) {
+            tx_line_free_ns = now_ns + byte_ns;
+            receive_byte(tx_byte, tx_line_free_ns);
+        }
+    }
+    if (can_receive() && output_ready_ns() <= now_ns) {
+        USART1.RXDATAL = output[output_head].data;
+        output_head = (output_head + 1) % IOTC_MODEM_OUTPUT_QUEUE_SIZE;
+        output_count--;
+        rx_line_free_ns = now_ns + byte_ns;
+        stats.bytes_from_modem++;
+        USART1_RXC_vect();
+    }
+}
+
+static void advance_to(uint64_t target_ns) {
+    if (is_pumping) {
+        // called from an interrupt, which only moves the clock
+        if (target_ns > now_ns) {
+            now_ns = target_ns;
+        }
+        return;
+    }
+    is_pumping = true;
+    for (;;) {
+        uint64_t next_ns = next_event_ns();
+        if (next_ns > target_ns) {
+            break;
+        }
+        if (next_ns > now_ns) {
+            now_ns = next_ns;
+        }
+        pump();
+    }
+    if (target_ns > now_ns) {
+        now_ns = target_ns;
+    }
+    is_pumping = false;
+}
+
+unsigned long millis(void) {
+    advance_to(now_ns + IOTC_MODEM_CLOCK_READ_NS);
+    return (unsigned long) (now_ns / 1000000ULL);
+}
+
+unsigned long micros(void) {
+    advance_to(now_ns + IOTC_MODEM_CLOCK_READ_NS);
+    return (unsigned long) (now_ns / 1000ULL);
+}
+
+void delay(unsigned long ms) {
+    advance_to(now_ns + (uint64_t) ms * 1000000ULL);
+}
+
+void _delay_ms(double ms) {
+    advance_to(now_ns + (uint64_t) (ms * 1000000.0));
+}
+
+void iotc_modem_emulator_start(const IotcModemEmulatorConfig *c) {
+    config = *c;
+    if (!config.baud_rate) {
+        config.baud_rate = IOTC_MODEM_DEFAULT_BAUD_RATE;
+    }
+    byte_ns = 10ULL * 1000000000ULL / config.baud_rate; // 8N1
+    memset(&stats, 0, sizeof(stats));
+    memset(urcs, 0, sizeof(urcs));
+    memset(faults, 0, sizeof(faults));
+    memset(subscriptions, 0, sizeof(subscriptions));
+    free_messages();
+    free_http_body();
+    output_head = 0;
+    output_count = 0;
+    output_last_due_ns = now_ns;
+    rx_line_free_ns = now_ns;
+    tx_line_free_ns = now_ns;
+    line_length = 0;
+    payload_kind = IOTC_MODEM_PAYLOAD_NONE;
+    is_mqtt_connected = false;
+    is_mqtt_signing = false;
+    VPORTC.IN &= (uint8_t) ~IOTC_MODEM_CTS_bm; // the modem is always ready to receive
+    schedule_urc(now_ns + (uint64_t) config.boot_ms * 1000000ULL, "SYSSTART");
+}
+
+uint64_t iotc_modem_emulator_get_time_ns(void) {
+    return now_ns;
+}
+
+void iotc_modem_emulator_get_stats(IotcModemEmulatorStats *s) {
+    *s = stats;
+}
+
+bool iotc_modem_emulator_inject_fault(const char *command_prefix, IotcModemFault fault, uint32_t count) {
+    for (int i = 0; i < IOTC_MODEM_MAX_FAULTS; i++) {
+        IotcModemFaultRule *rule = &faults[i];
+        if (rule->count) {
+            continue;
+        }
+        strncpy(rule->command_prefix, command_prefix, sizeof(rule->command_prefix) - 1);
+        rule->command_prefix[sizeof(rule->command_prefix) - 1] = '\0';
+        rule->fault = fault;
+        rule->count = count;
+        return true;
+    }
+    return false;
+}
+
+bool iotc_modem_emulator_inject_message(const char *topic, const char *message_payload) {
+    if (!is_mqtt_connected || !is_subscribed(topic) || strlen(topic) >= IOTC_MODEM_TOPIC_MAX_LENGTH) {
+        return false;
+    }
+    for (int i = 0; i < IOTC_MODEM_MAX_MESSAGES; i++) {
+        IotcModemMessage *m = &messages[i];
+        if (m->is_used) {
+            continue;
+        }
+        m->payload = strdup(message_payload);
+        if (!m->payload) {
+            return false;
+        }
+        strcpy(m->topic, topic);
+        m->message_id = next_message_id();
+        m->is_used = true;
+        schedule_urc(now_ns, "SQNSMQTTONMESSAGE: 0,\"%s\",%u,1,%u",
+            topic, (unsigned int) strlen(message_payload), (unsigned int) m->message_id);
+        return true;
+    }
+    return false;
+}
+
+void iotc_modem_emulator_drop_connection(void) {
+    if (!is_mqtt_connected) {
+        return;
+    }
+    is_mqtt_connected = false;
+    memset(subscriptions, 0, sizeof(subscriptions));
+    free_messages();
+    schedule_urc(now_ns, "SQNSMQTTONDISCONNECT: 0,0");
+}
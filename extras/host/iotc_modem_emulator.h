@@ -0,0 +1,93 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * Emulates the Sequans Monarch modem on the other side of USART1, so that the Sequans controller of the
+ * AVR-IoT Cellular library, and the SDK code that uses it, can run on the host unchanged.
+ *
+ * The emulator answers the AT commands that the SDK and the library send for MQTT and HTTP,
+ * sends the URCs that the modem would send, paces both directions at the baud rate, and honors the RTS line.
+ * The modem output can be delivered in chunks with gaps, and commands can be made to fail.
+ *
+ * Time is virtual, so that results are the same from run to run: the emulator provides millis(), micros(),
+ * delay() and _delay_ms(). Each clock read costs IOTC_MODEM_CLOCK_READ_NS, and a delay advances the clock by
+ * its length. The USART interrupts run whenever the clock advances past the time when they would fire.
+ */
+
+#ifndef IOTC_MODEM_EMULATOR_H
+#define IOTC_MODEM_EMULATOR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// The virtual time that a busy loop iteration with a clock read takes on the AVR
+#define IOTC_MODEM_CLOCK_READ_NS 1000
+
+#define IOTC_MODEM_DEFAULT_BAUD_RATE 115200
+
+// Has the IotcPosixHttpsHandler signature, so that iotc_fake_cloud_https_handler() can serve the requests.
+// send_str is NULL for GET requests. The response data must be allocated with iotcl_malloc().
+typedef int (*IotcModemHttpHandler)(
+        void *context,
+        const char *host,
+        const char *path,
+        const char *send_str,
+        char **response_data
+);
+
+typedef struct {
+    uint32_t baud_rate;                 // 0 for IOTC_MODEM_DEFAULT_BAUD_RATE
+    uint32_t response_latency_us;       // From the end of a command to the start of its response
+    uint32_t chunk_size;                // Splits the modem output into chunks of this many bytes. 0 does not split it.
+    uint32_t chunk_gap_us;              // The pause between chunks
+    uint32_t boot_ms;                   // From iotc_modem_emulator_start() to +SYSSTART
+    uint32_t connect_latency_ms;        // The TLS handshake and the MQTT connection, split around the signing request
+    uint32_t broker_latency_ms;         // The round trip to the broker for QoS 1 publishes and subscriptions
+    uint32_t http_latency_ms;           // From an HTTP request to its +SQNHTTPRING
+    bool http_chunked;                  // +SQNHTTPRING reports no content length, as for a chunked response
+    IotcModemHttpHandler http_handler;  // Serves the HTTP requests. Without it, they fail with status 500.
+    void *http_context;
+    // Optional. GET requests for this path, without the URL parameters, are served from http_file,
+    // with 206 for a Range header, 416 for a range past the end, and 200 without one.
+    const char *http_file_path;
+    const uint8_t *http_file;
+    size_t http_file_size;
+} IotcModemEmulatorConfig;
+
+typedef struct {
+    uint32_t num_commands;              // AT command lines received. Each one is a round trip.
+    uint32_t num_prompts;               // '>' prompts for a payload
+    uint32_t num_urcs;                  // Unsolicited result codes sent
+    uint32_t num_errors;                // ERROR responses, including the injected ones
+    uint32_t num_published;             // MQTT messages accepted from the device
+    uint32_t num_http_requests;
+    uint64_t bytes_to_modem;
+    uint64_t bytes_from_modem;
+} IotcModemEmulatorStats;
+
+typedef enum {
+    IOTC_MODEM_FAULT_ERROR = 0,         // The command gets ERROR
+    IOTC_MODEM_FAULT_NO_RESPONSE        // The command gets nothing, so the controller times out
+} IotcModemFault;
+
+// Resets the modem and queues +SYSSTART, which SequansController.begin() waits for. The clock keeps running.
+void iotc_modem_emulator_start(const IotcModemEmulatorConfig *config);
+
+uint64_t iotc_modem_emulator_get_time_ns(void);
+
+void iotc_modem_emulator_get_stats(IotcModemEmulatorStats *stats);
+
+// The next count commands that start with command_prefix, like "AT+SQNSMQTTPUBLISH", get the fault.
+// Returns false if too many faults are pending.
+bool iotc_modem_emulator_inject_fault(const char *command_prefix, IotcModemFault fault, uint32_t count);
+
+// Delivers a QoS 1 message from the broker. Returns false if the device is not connected and subscribed to the topic.
+bool iotc_modem_emulator_inject_message(const char *topic, const char *payload);
+
+// Closes the MQTT connection as if the broker dropped it
+void iotc_modem_emulator_drop_connection(void);
+
+#endif // IOTC_MODEM_EMULATOR_H
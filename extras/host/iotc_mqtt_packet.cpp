@@ -0,0 +1,180 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "iotc_mqtt_packet.h"
+
+#define IOTC_MQTT_RX_BUFFER_INITIAL_SIZE 1024
+
+size_t iotc_mqtt_packet_write_header(uint8_t *header, uint8_t type, uint8_t flags, size_t remaining_length) {
+    size_t pos = 0;
+    header[pos++] = (uint8_t) ((type << 4) | (flags & 0x0F));
+    do {
+        uint8_t encoded = (uint8_t) (remaining_length % 128);
+        remaining_length /= 128;
+        if (remaining_length > 0) {
+            encoded |= 0x80;
+        }
+        header[pos++] = encoded;
+    } while (remaining_length > 0 && pos < IOTC_MQTT_PACKET_MAX_HEADER_SIZE);
+    return pos;
+}
+
+size_t iotc_mqtt_packet_put_u16(uint8_t *buffer, size_t pos, uint16_t value) {
+    buffer[pos++] = (uint8_t) (value >> 8);
+    buffer[pos++] = (uint8_t) (value & 0xFF);
+    return pos;
+}
+
+size_t iotc_mqtt_packet_put_string(uint8_t *buffer, size_t pos, const char *str, size_t str_len) {
+    pos = iotc_mqtt_packet_put_u16(buffer, pos, (uint16_t) str_len);
+    memcpy(&buffer[pos], str, str_len);
+    return pos + str_len;
+}
+
+bool iotc_mqtt_packet_get_u16(const IotcMqttPacket *p, size_t *pos, uint16_t *value) {
+    if (*pos + 2 > p->data_length) {
+        return false;
+    }
+    *value = (uint16_t) ((p->data[*pos] << 8) | p->data[*pos + 1]);
+    *pos += 2;
+    return true;
+}
+
+bool iotc_mqtt_packet_get_string(const IotcMqttPacket *p, size_t *pos, const char **str, size_t *str_len) {
+    uint16_t length;
+    if (!iotc_mqtt_packet_get_u16(p, pos, &length) || *pos + length > p->data_length) {
+        return false;
+    }
+    *str = (const char *) &p->data[*pos];
+    *str_len = length;
+    *pos += length;
+    return true;
+}
+
+bool iotc_mqtt_packet_send_all(int fd, const void *data, size_t length) {
+    const uint8_t *p = (const uint8_t *) data;
+    while (length > 0) {
+        ssize_t sent = send(fd, p, length, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+            if (EAGAIN == errno || EWOULDBLOCK == errno) {
+                usleep(100);
+                continue;
+            }
+            return false;
+        }
+        p += sent;
+        length -= (size_t) sent;
+    }
+    return true;
+}
+
+bool iotc_mqtt_packet_send(int fd, uint8_t type, uint8_t flags, const uint8_t *body, size_t body_length) {
+    uint8_t header[IOTC_MQTT_PACKET_MAX_HEADER_SIZE];
+    size_t header_length = iotc_mqtt_packet_write_header(header, type, flags, body_length);
+    if (!iotc_mqtt_packet_send_all(fd, header, header_length)) {
+        return false;
+    }
+    return 0 == body_length || iotc_mqtt_packet_send_all(fd, body, body_length);
+}
+
+void iotc_mqtt_rx_buffer_init(IotcMqttRxBuffer *rx) {
+    rx->data = NULL;
+    rx->size = 0;
+    rx->length = 0;
+}
+
+void iotc_mqtt_rx_buffer_free(IotcMqttRxBuffer *rx) {
+    free(rx->data);
+    iotc_mqtt_rx_buffer_init(rx);
+}
+
+bool iotc_mqtt_rx_buffer_read(IotcMqttRxBuffer *rx, int fd) {
+    while (true) {
+        if (rx->length == rx->size) {
+            size_t new_size = rx->size ? rx->size * 2 : IOTC_MQTT_RX_BUFFER_INITIAL_SIZE;
+            uint8_t *new_data = (uint8_t *) realloc(rx->data, new_size);
+            if (!new_data) {
+                return false;
+            }
+            rx->data = new_data;
+            rx->size = new_size;
+        }
+        ssize_t received = recv(fd, &rx->data[rx->length], rx->size - rx->length, MSG_DONTWAIT);
+        if (received > 0) {
+            rx->length += (size_t) received;
+            continue;
+        }
+        if (0 == received) {
+            return false; // closed by the peer
+        }
+        if (EINTR == errno) {
+            continue;
+        }
+        return (EAGAIN == errno || EWOULDBLOCK == errno);
+    }
+}
+
+bool iotc_mqtt_rx_buffer_peek(const IotcMqttRxBuffer *rx, IotcMqttPacket *packet, size_t *packet_size) {
+    size_t remaining_length = 0;
+    size_t multiplier = 1;
+    size_t pos = 1;
+    if (rx->length < 2) {
+        return false;
+    }
+    while (true) {
+        if (pos >= rx->length || pos >= IOTC_MQTT_PACKET_MAX_HEADER_SIZE) {
+            return false;
+        }
+        uint8_t encoded = rx->data[pos++];
+        remaining_length += (encoded & 0x7F) * multiplier;
+        multiplier *= 128;
+        if (!(encoded & 0x80)) {
+            break;
+        }
+    }
+    if (rx->length < pos + remaining_length) {
+        return false;
+    }
+    packet->type = (uint8_t) (rx->data[0] >> 4);
+    packet->flags = (uint8_t) (rx->data[0] & 0x0F);
+    packet->data = &rx->data[pos];
+    packet->data_length = remaining_length;
+    *packet_size = pos + remaining_length;
+    return true;
+}
+
+void iotc_mqtt_rx_buffer_consume(IotcMqttRxBuffer *rx, size_t packet_size) {
+    memmove(rx->data, &rx->data[packet_size], rx->length - packet_size);
+    rx->length -= packet_size;
+}
+
+bool iotc_mqtt_topic_matches(const char *filter, const char *topic, size_t topic_len) {
+    size_t t = 0;
+    for (const char *f = filter; *f; f++) {
+        if ('#' == *f) {
+            return true;
+        }
+        if ('+' == *f) {
+            while (t < topic_len && topic[t] != '/') {
+                t++;
+            }
+            continue;
+        }
+        if (t >= topic_len || topic[t] != *f) {
+            return false;
+        }
+        t++;
+    }
+    return t == topic_len;
+}
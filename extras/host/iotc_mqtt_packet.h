@@ -0,0 +1,81 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * Minimal MQTT 3.1.1 packet encoding and decoding shared by the POSIX transport and the fake broker.
+ * Only the packets that the SDK needs are supported.
+ */
+
+#ifndef IOTC_MQTT_PACKET_H
+#define IOTC_MQTT_PACKET_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define IOTC_MQTT_PACKET_CONNECT        1
+#define IOTC_MQTT_PACKET_CONNACK        2
+#define IOTC_MQTT_PACKET_PUBLISH        3
+#define IOTC_MQTT_PACKET_PUBACK         4
+#define IOTC_MQTT_PACKET_SUBSCRIBE      8
+#define IOTC_MQTT_PACKET_SUBACK         9
+#define IOTC_MQTT_PACKET_PINGREQ        12
+#define IOTC_MQTT_PACKET_PINGRESP       13
+#define IOTC_MQTT_PACKET_DISCONNECT     14
+
+// Fixed header with the largest remaining length
+#define IOTC_MQTT_PACKET_MAX_HEADER_SIZE 5
+
+// A received packet. The data points into the receive buffer.
+typedef struct {
+    uint8_t type;
+    uint8_t flags;                  // The low 4 bits of the first byte
+    const uint8_t *data;            // Variable header and payload
+    size_t data_length;
+} IotcMqttPacket;
+
+// Buffer that collects the bytes received from a socket until there is a whole packet
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    size_t length;
+} IotcMqttRxBuffer;
+
+// Writes the fixed header into header (IOTC_MQTT_PACKET_MAX_HEADER_SIZE bytes) and returns its length
+size_t iotc_mqtt_packet_write_header(uint8_t *header, uint8_t type, uint8_t flags, size_t remaining_length);
+
+// Appends a length prefixed string at pos and returns the position after it
+size_t iotc_mqtt_packet_put_string(uint8_t *buffer, size_t pos, const char *str, size_t str_len);
+
+size_t iotc_mqtt_packet_put_u16(uint8_t *buffer, size_t pos, uint16_t value);
+
+// Reads a length prefixed string at *pos. Returns false if the packet is too short.
+bool iotc_mqtt_packet_get_string(const IotcMqttPacket *p, size_t *pos, const char **str, size_t *str_len);
+
+bool iotc_mqtt_packet_get_u16(const IotcMqttPacket *p, size_t *pos, uint16_t *value);
+
+// Sends all data or returns false if the socket was closed
+bool iotc_mqtt_packet_send_all(int fd, const void *data, size_t length);
+
+// Sends a packet that has a fixed header followed by the body
+bool iotc_mqtt_packet_send(int fd, uint8_t type, uint8_t flags, const uint8_t *body, size_t body_length);
+
+void iotc_mqtt_rx_buffer_init(IotcMqttRxBuffer *rx);
+
+void iotc_mqtt_rx_buffer_free(IotcMqttRxBuffer *rx);
+
+// Reads what is available from the non-blocking socket. Returns false if the socket was closed or failed.
+bool iotc_mqtt_rx_buffer_read(IotcMqttRxBuffer *rx, int fd);
+
+// Returns true and the packet if a whole packet was received.
+// The packet stays valid until iotc_mqtt_rx_buffer_consume() is called.
+bool iotc_mqtt_rx_buffer_peek(const IotcMqttRxBuffer *rx, IotcMqttPacket *packet, size_t *packet_size);
+
+void iotc_mqtt_rx_buffer_consume(IotcMqttRxBuffer *rx, size_t packet_size);
+
+// Returns true if the topic matches the filter with the + and # wildcards
+bool iotc_mqtt_topic_matches(const char *filter, const char *topic, size_t topic_len);
+
+#endif // IOTC_MQTT_PACKET_H
@@ -0,0 +1,329 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "iotcl_sha256.h"
+#include "iotc_ota_delta.h"
+#include "iotc_ota_delta_encoder.h"
+
+#define HASH_BITS 18
+#define MAX_CHAIN_LENGTH 64
+// A forward extension stops once it has not improved for this many bytes
+#define MAX_EXTENSION_GAP 256
+// Zero differences shorter than this are added as they are, as a new run would take as much space
+#define MIN_UNCHANGED_GAP 2
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+    bool is_out_of_memory;
+} Buffer;
+
+typedef struct {
+    const uint8_t *source;
+    size_t source_size;
+    const uint8_t *target;
+    size_t target_size;
+    int32_t *head;                  // The last source position with a hash
+    int32_t *previous;              // The previous source position with the same hash
+    size_t source_position;         // Where the last COPY or ADD ended
+    uint8_t pattern_lengths[IOTC_OTA_DELTA_NUM_PATTERNS];
+    uint8_t patterns[IOTC_OTA_DELTA_NUM_PATTERNS][IOTC_OTA_DELTA_PATTERN_SIZE];
+    Buffer out;
+    IotcOtaDeltaEncoderStats stats;
+} Encoder;
+
+static void put_bytes(Buffer *b, const void *data, size_t size) {
+    if (b->size + size > b->capacity) {
+        size_t capacity = (b->capacity ? b->capacity * 2 : 4096) + size;
+        uint8_t *p = (uint8_t *) realloc(b->data, capacity);
+        if (!p) {
+            b->is_out_of_memory = true;
+            return;
+        }
+        b->data = p;
+        b->capacity = capacity;
+    }
+    memcpy(&b->data[b->size], data, size);
+    b->size += size;
+}
+
+static void put_u32(Buffer *b, uint32_t value) {
+    uint8_t bytes[4] = {(uint8_t) value, (uint8_t) (value >> 8), (uint8_t) (value >> 16), (uint8_t) (value >> 24)};
+    put_bytes(b, bytes, sizeof(bytes));
+}
+
+static void put_varint(Buffer *b, uint32_t value) {
+    uint8_t bytes[5];
+    size_t length = 0;
+    do {
+        bytes[length] = (uint8_t) (value & 0x7F);
+        value >>= 7;
+        if (value) {
+            bytes[length] |= 0x80;
+        }
+        length++;
+    } while (value);
+    put_bytes(b, bytes, length);
+}
+
+static uint32_t hash_at(const uint8_t *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return (uint32_t) ((v * 0x9E3779B97F4A7C15ULL) >> (64 - HASH_BITS));
+}
+
+static size_t match_length(const Encoder *e, size_t source_position, size_t target_position) {
+    size_t limit = e->source_size - source_position;
+    if (e->target_size - target_position < limit) {
+        limit = e->target_size - target_position;
+    }
+    size_t length = 0;
+    while (length < limit && e->source[source_position + length] == e->target[target_position + length]) {
+        length++;
+    }
+    return length;
+}
+
+// How far a match can extend with at least half of the bytes the same. The score is the bytes
+// that are the same minus those that differ.
+static size_t extend_match(const Encoder *e, size_t source_position, size_t target_position, long *score) {
+    size_t limit = e->source_size - source_position;
+    if (e->target_size - target_position < limit) {
+        limit = e->target_size - target_position;
+    }
+    long same = 0;
+    long best_score = 0;
+    size_t best_length = 0;
+    for (size_t i = 0; i < limit && i - best_length < MAX_EXTENSION_GAP; i++) {
+        if (e->source[source_position + i] == e->target[target_position + i]) {
+            same++;
+        }
+        if (same * 2 - (long) (i + 1) > best_score) {
+            best_score = same * 2 - (long) (i + 1);
+            best_length = i + 1;
+        }
+    }
+    *score = best_score;
+    return best_length;
+}
+
+static void put_insert(Encoder *e, size_t target_position, size_t length) {
+    if (!length) {
+        return;
+    }
+    put_varint(&e->out, (uint32_t) (length << 2 | IOTC_OTA_DELTA_OP_INSERT));
+    put_bytes(&e->out, &e->target[target_position], length);
+    e->stats.num_inserts++;
+    e->stats.inserted_bytes += (uint32_t) length;
+}
+
+// The same as the decoder, so that both have the same patterns
+static int find_pattern(Encoder *e, const uint8_t *added, size_t count) {
+    for (int i = 0; i < IOTC_OTA_DELTA_NUM_PATTERNS; i++) {
+        if (e->pattern_lengths[i] == count && 0 == memcmp(e->patterns[i], added, count)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void push_pattern(Encoder *e, int index, const uint8_t *added, size_t count) {
+    // index is the slot that the pattern leaves, or the last one for a new pattern
+    memmove(e->patterns[1], e->patterns[0], sizeof(e->patterns[0]) * (size_t) index);
+    memmove(&e->pattern_lengths[1], &e->pattern_lengths[0], (size_t) index);
+    memcpy(e->patterns[0], added, count);
+    e->pattern_lengths[0] = (uint8_t) count;
+}
+
+static void put_run(Encoder *e, size_t unchanged, const uint8_t *added, size_t count) {
+    e->stats.num_runs++;
+    if (!count) {
+        put_varint(&e->out, (uint32_t) (unchanged << 3));
+        return;
+    }
+    int index = find_pattern(e, added, count);
+    if (index >= 0) {
+        put_varint(&e->out, (uint32_t) (unchanged << 3 | (size_t) index));
+        if (index) {
+            push_pattern(e, index, added, count);
+        }
+        e->stats.num_pattern_runs++;
+    } else if (count <= IOTC_OTA_DELTA_PATTERN_SIZE) {
+        put_varint(&e->out, (uint32_t) (unchanged << 3 | (count + IOTC_OTA_DELTA_NUM_PATTERNS - 1)));
+        put_bytes(&e->out, added, count);
+        push_pattern(e, IOTC_OTA_DELTA_NUM_PATTERNS - 1, added, count);
+        e->stats.added_bytes += (uint32_t) count;
+    } else {
+        put_varint(&e->out, (uint32_t) (unchanged << 3 | IOTC_OTA_DELTA_CODE_LONG));
+        put_varint(&e->out, (uint32_t) count);
+        put_bytes(&e->out, added, count);
+        e->stats.added_bytes += (uint32_t) count;
+    }
+}
+
+// A COPY if the bytes are the same, or else an ADD
+static void put_match(Encoder *e, size_t source_position, size_t target_position, size_t length) {
+    const uint8_t *s = &e->source[source_position];
+    const uint8_t *t = &e->target[target_position];
+    bool is_same = 0 == memcmp(s, t, length);
+    int64_t offset = (int64_t) source_position - (int64_t) e->source_position;
+    put_varint(&e->out, (uint32_t) (length << 2 | (is_same ? IOTC_OTA_DELTA_OP_COPY : IOTC_OTA_DELTA_OP_ADD)));
+    put_varint(&e->out, (uint32_t) ((offset << 1) ^ (offset >> 63)));
+    e->source_position = source_position + length;
+    if (is_same) {
+        e->stats.num_copies++;
+        return;
+    }
+    e->stats.num_adds++;
+
+    uint8_t *added = (uint8_t *) malloc(length);
+    if (!added) {
+        e->out.is_out_of_memory = true;
+        return;
+    }
+    size_t i = 0;
+    while (i < length) {
+        size_t unchanged = 0;
+        while (i + unchanged < length && s[i + unchanged] == t[i + unchanged]) {
+            unchanged++;
+        }
+        i += unchanged;
+        // the added bytes end at a long enough run of unchanged ones, or where a pattern ends
+        size_t count = 0;
+        size_t gap = 0;
+        while (i + count + gap < length && gap < MIN_UNCHANGED_GAP) {
+            if (s[i + count + gap] == t[i + count + gap]) {
+                gap++;
+            } else {
+                count += gap + 1;
+                gap = 0;
+            }
+        }
+        for (size_t j = 0; j < count; j++) {
+            added[j] = (uint8_t) (t[i + j] - s[i + j]);
+        }
+        put_run(e, unchanged, added, count);
+        i += count;
+    }
+    free(added);
+}
+
+static bool build_index(Encoder *e) {
+    e->head = (int32_t *) malloc(sizeof(int32_t) << HASH_BITS);
+    e->previous = (int32_t *) malloc(sizeof(int32_t) * (e->source_size + 1));
+    if (!e->head || !e->previous) {
+        return false;
+    }
+    memset(e->head, 0xFF, sizeof(int32_t) << HASH_BITS);
+    for (size_t i = 0; i + IOTC_OTA_DELTA_MIN_MATCH <= e->source_size; i++) {
+        uint32_t h = hash_at(&e->source[i]);
+        e->previous[i] = e->head[h];
+        e->head[h] = (int32_t) i;
+    }
+    return true;
+}
+
+static void encode(Encoder *e) {
+    size_t position = 0;
+    size_t insert_start = 0;
+    while (position + IOTC_OTA_DELTA_MIN_MATCH <= e->target_size) {
+        size_t best_source = 0;
+        size_t best_length = 0;
+        long best_score = 0;
+
+        // where the source would continue, if what was inserted replaced as many bytes
+        size_t next_source = e->source_position + (position - insert_start);
+        if (next_source < e->source_size) {
+            best_length = extend_match(e, next_source, position, &best_score);
+            best_source = next_source;
+        }
+        int chain_length = 0;
+        for (int32_t candidate = e->head[hash_at(&e->target[position])];
+             candidate >= 0 && chain_length < MAX_CHAIN_LENGTH;
+             candidate = e->previous[candidate], chain_length++) {
+            if (match_length(e, (size_t) candidate, position) < IOTC_OTA_DELTA_MIN_MATCH) {
+                continue;
+            }
+            long score;
+            size_t length = extend_match(e, (size_t) candidate, position, &score);
+            if (score > best_score) {
+                best_score = score;
+                best_length = length;
+                best_source = (size_t) candidate;
+            }
+        }
+        if (best_score < IOTC_OTA_DELTA_MIN_MATCH) {
+            position++;
+            continue;
+        }
+        // take back what matches before the match from what would be inserted
+        while (position > insert_start && best_source > 0
+               && e->source[best_source - 1] == e->target[position - 1]) {
+            best_source--;
+            position--;
+            best_length++;
+        }
+        put_insert(e, insert_start, position - insert_start);
+        put_match(e, best_source, position, best_length);
+        position += best_length;
+        insert_start = position;
+    }
+    put_insert(e, insert_start, e->target_size - insert_start);
+}
+
+uint8_t *iotc_ota_delta_encode(
+        const uint8_t *source,
+        size_t source_size,
+        const uint8_t *target,
+        size_t target_size,
+        size_t *delta_size,
+        IotcOtaDeltaEncoderStats *stats
+) {
+    Encoder e;
+    uint8_t digest[IOTCL_SHA256_DIGEST_SIZE];
+    IotclSha256 sha;
+    uint8_t reserved[3] = {0};
+
+    memset(&e, 0, sizeof(e));
+    e.source = source;
+    e.source_size = source_size;
+    e.target = target;
+    e.target_size = target_size;
+
+    put_bytes(&e.out, IOTC_OTA_DELTA_MAGIC, 4);
+    put_bytes(&e.out, "\x01", 1);
+    put_bytes(&e.out, reserved, sizeof(reserved));
+    put_u32(&e.out, (uint32_t) source_size);
+    put_u32(&e.out, (uint32_t) target_size);
+    iotcl_sha256_init(&sha);
+    iotcl_sha256_update(&sha, source, source_size);
+    iotcl_sha256_finish(&sha, digest);
+    put_bytes(&e.out, digest, sizeof(digest));
+    iotcl_sha256_init(&sha);
+    iotcl_sha256_update(&sha, target, target_size);
+    iotcl_sha256_finish(&sha, digest);
+    put_bytes(&e.out, digest, sizeof(digest));
+
+    if (build_index(&e)) {
+        encode(&e);
+    } else {
+        e.out.is_out_of_memory = true;
+    }
+    free(e.head);
+    free(e.previous);
+    if (e.out.is_out_of_memory) {
+        free(e.out.data);
+        return NULL;
+    }
+    if (stats) {
+        *stats = e.stats;
+    }
+    *delta_size = e.out.size;
+    return e.out.data;
+}
@@ -0,0 +1,45 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * Generates the delta packages that src/iotc_ota_delta.h applies on the device. See there for the format.
+ *
+ * The target is matched against the source with an index of IOTC_OTA_DELTA_MIN_MATCH byte sequences
+ * of the source. Each match is extended forward for as long as most of the bytes are the same, as bsdiff does,
+ * so that code which only moved becomes one ADD of its changed addresses, instead of many short copies.
+ * The source position that would follow the previous match is tried as well, which finds the code after
+ * a changed part of the same size. What does not match is inserted.
+ */
+
+#ifndef IOTC_OTA_DELTA_ENCODER_H
+#define IOTC_OTA_DELTA_ENCODER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The shortest match that is looked up in the index
+#define IOTC_OTA_DELTA_MIN_MATCH 8
+
+typedef struct {
+    uint32_t num_copies;
+    uint32_t num_inserts;
+    uint32_t num_adds;
+    uint32_t num_runs;              // Of the ADD commands
+    uint32_t num_pattern_runs;      // ADD runs with a recent pattern
+    uint32_t inserted_bytes;
+    uint32_t added_bytes;           // In the package, not counting the patterns
+} IotcOtaDeltaEncoderStats;
+
+// Returns the package allocated with malloc(), or NULL if out of memory. stats is optional.
+uint8_t *iotc_ota_delta_encode(
+        const uint8_t *source,
+        size_t source_size,
+        const uint8_t *target,
+        size_t target_size,
+        size_t *delta_size,
+        IotcOtaDeltaEncoderStats *stats
+);
+
+#endif // IOTC_OTA_DELTA_ENCODER_H
@@ -0,0 +1,117 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "iotcl.h"
+#include "iotc_ota_file_sink.h"
+
+#define IOTC_OTA_STATE_SUFFIX ".state"
+#define IOTC_OTA_TEMP_SUFFIX ".tmp"
+
+static void get_state_path(const IotcOtaFileSink *sink, char *path, size_t path_size, const char *suffix) {
+    snprintf(path, path_size, "%s" IOTC_OTA_STATE_SUFFIX "%s", sink->path, suffix);
+}
+
+static int file_sink_open(void *context, uint32_t offset) {
+    IotcOtaFileSink *sink = (IotcOtaFileSink *) context;
+    sink->is_complete = false;
+    sink->image_size = 0;
+    // "r+" keeps what is there for a resume. It fails if there is no file, which only a fresh download can take.
+    sink->file = fopen(sink->path, offset ? "r+b" : "w+b");
+    if (!sink->file) {
+        return IOTCL_ERR_FAILED;
+    }
+    if (0 != ftruncate(fileno(sink->file), (off_t) offset) || 0 != fseek(sink->file, (long) offset, SEEK_SET)) {
+        fclose(sink->file);
+        sink->file = NULL;
+        return IOTCL_ERR_FAILED;
+    }
+    return IOTCL_SUCCESS;
+}
+
+static int file_sink_write(void *context, uint32_t offset, const uint8_t *data, size_t data_length) {
+    IotcOtaFileSink *sink = (IotcOtaFileSink *) context;
+    if (ftell(sink->file) != (long) offset || fwrite(data, 1, data_length, sink->file) != data_length) {
+        return IOTCL_ERR_FAILED;
+    }
+    return IOTCL_SUCCESS;
+}
+
+static int file_sink_close(void *context, bool is_complete, uint32_t image_size, const uint8_t *digest) {
+    IotcOtaFileSink *sink = (IotcOtaFileSink *) context;
+    if (!sink->file) {
+        return IOTCL_ERR_FAILED;
+    }
+    int status = (0 == fclose(sink->file)) ? IOTCL_SUCCESS : IOTCL_ERR_FAILED;
+    sink->file = NULL;
+    if (is_complete && IOTCL_SUCCESS == status) {
+        sink->is_complete = true;
+        sink->image_size = image_size;
+        memcpy(sink->digest, digest, sizeof(sink->digest));
+    }
+    return status;
+}
+
+// The state replaces the previous one with a rename, so that a crash while saving leaves one of the two
+static int file_sink_save_state(void *context, const void *state, size_t state_size) {
+    IotcOtaFileSink *sink = (IotcOtaFileSink *) context;
+    char path[IOTC_OTA_FILE_PATH_MAX_LENGTH + 16];
+    char temp_path[IOTC_OTA_FILE_PATH_MAX_LENGTH + 16];
+
+    if (sink->file && (0 != fflush(sink->file) || 0 != fsync(fileno(sink->file)))) {
+        return IOTCL_ERR_FAILED;
+    }
+    get_state_path(sink, path, sizeof(path), "");
+    get_state_path(sink, temp_path, sizeof(temp_path), IOTC_OTA_TEMP_SUFFIX);
+    FILE *f = fopen(temp_path, "wb");
+    if (!f) {
+        return IOTCL_ERR_FAILED;
+    }
+    bool is_written = (fwrite(state, 1, state_size, f) == state_size) && 0 == fflush(f) && 0 == fsync(fileno(f));
+    if (0 != fclose(f) || !is_written || 0 != rename(temp_path, path)) {
+        remove(temp_path);
+        return IOTCL_ERR_FAILED;
+    }
+    return IOTCL_SUCCESS;
+}
+
+static int file_sink_load_state(void *context, void *state, size_t state_size) {
+    IotcOtaFileSink *sink = (IotcOtaFileSink *) context;
+    char path[IOTC_OTA_FILE_PATH_MAX_LENGTH + 16];
+    get_state_path(sink, path, sizeof(path), "");
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return IOTCL_ERR_FAILED;
+    }
+    bool is_read = (fread(state, 1, state_size, f) == state_size);
+    fclose(f);
+    return is_read ? IOTCL_SUCCESS : IOTCL_ERR_FAILED;
+}
+
+const IotConnectOtaSink iotc_ota_file_sink = {
+    file_sink_open,
+    file_sink_write,
+    file_sink_close,
+    file_sink_save_state,
+    file_sink_load_state
+};
+
+bool iotc_ota_file_sink_init(IotcOtaFileSink *sink, const char *path) {
+    memset(sink, 0, sizeof(*sink));
+    if (strlen(path) >= sizeof(sink->path)) {
+        return false;
+    }
+    strcpy(sink->path, path);
+    return true;
+}
+
+void iotc_ota_file_sink_remove(const IotcOtaFileSink *sink) {
+    char path[IOTC_OTA_FILE_PATH_MAX_LENGTH + 16];
+    get_state_path(sink, path, sizeof(path), "");
+    remove(path);
+    remove(sink->path);
+}
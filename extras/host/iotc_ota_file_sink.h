@@ -0,0 +1,36 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * An OTA download sink (see src/iotc_ota.h) that writes the image to a file, and the download progress
+ * to the file with ".state" appended to its name, so that a download resumes across runs of the process.
+ * The data is synced to the disk before the progress is saved, as a flash sink would need to do.
+ */
+
+#ifndef IOTC_OTA_FILE_SINK_H
+#define IOTC_OTA_FILE_SINK_H
+
+#include <stdio.h>
+#include "iotc_ota.h"
+
+#define IOTC_OTA_FILE_PATH_MAX_LENGTH 256
+
+typedef struct {
+    char path[IOTC_OTA_FILE_PATH_MAX_LENGTH];
+    FILE *file;
+    uint32_t image_size;                // Once the download is complete
+    uint8_t digest[IOTCL_SHA256_DIGEST_SIZE];
+    bool is_complete;
+} IotcOtaFileSink;
+
+extern const IotConnectOtaSink iotc_ota_file_sink;
+
+// Returns false if the path is too long. Pass sink as IotConnectOtaConfig.sink_context.
+bool iotc_ota_file_sink_init(IotcOtaFileSink *sink, const char *path);
+
+// Removes the image and the saved progress, so that the next download starts over
+void iotc_ota_file_sink_remove(const IotcOtaFileSink *sink);
+
+#endif // IOTC_OTA_FILE_SINK_H
@@ -0,0 +1,1006 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <Arduino.h>
+#include "log.h"
+
+#include "iotcl.h"
+#include "iotcl_c2d.h"
+#include "iotcl_internal.h"
+#include "iotcl_json_writer.h"
+#include "iotc_mqtt_packet.h"
+#include "iotc_transport_posix.h"
+
+#define IOTC_POSIX_CONNECT_TIMEOUT_MS   10000
+#define IOTC_POSIX_MAX_CONN_RETRIES     3
+#define IOTC_POSIX_DEFAULT_KEEP_ALIVE_S 60
+#define IOTC_POSIX_STREAM_CHUNK_SIZE    512
+// Small and odd, so that streamed HTTPS responses are split in the middle of values, as the modem would split them
+#define IOTC_POSIX_HTTPS_CHUNK_SIZE     100
+#define IOTC_POSIX_HTTP_BUFFER_SIZE     1024
+#define IOTC_POSIX_HTTP_TIMEOUT_S       10
+
+// This mirrors the publish queue of iotc_mqtt_client.cpp, with PUBACKs in place of the modem URCs.
+typedef enum {
+    IOTC_POSIX_PUBLISH_FREE = 0,
+    IOTC_POSIX_PUBLISH_QUEUED,      // waiting for a place in the in-flight window, or to be retried
+    IOTC_POSIX_PUBLISH_IN_FLIGHT    // sent and waiting for the PUBACK
+} IotcPosixPublishState;
+
+typedef struct {
+    char *data;                 // The topic, its null terminator and the payload in one allocation
+    size_t payload_length;
+    uint16_t publish_id;        // Assigned by this client and reported to the delivery callback
+    uint16_t packet_id;         // The MQTT packet identifier of the last attempt
+    unsigned long sent_ms;      // When the message was sent, or when it was queued for a retry
+    IotclDeliveryClass delivery_class;
+    bool is_retry;
+    IotcPosixPublishState state;
+} IotcPosixPublishSlot;
+
+static IotcPosixTransportConfig config = {0};
+static IotcPosixTransportStats stats = {0};
+
+static IotConnectMqttClientConfig *c = NULL;
+static IotConnectConnectionStatus state = IOTC_CS_UNDEFINED;
+static unsigned long state_start_ms = 0;
+static unsigned long backoff_ms = 0;
+static uint32_t backoff_random = 1;
+static uint8_t num_attempts = 0;
+static uint8_t num_auth_failures = 0;
+static bool is_blocking_init = false;
+
+static int sock = -1;
+static IotcMqttRxBuffer rx;
+static uint8_t *tx_buffer = NULL;
+static size_t tx_buffer_size = 0;
+static unsigned long last_tx_ms = 0;
+static unsigned long last_rx_ms = 0;
+static bool is_ping_pending = false;
+static uint16_t last_packet_id = 0;
+
+static IotcPosixPublishSlot publish_slots[IOTC_MQTT_PUBLISH_QUEUE_SIZE];
+static uint16_t last_publish_id = 0;
+
+static bool is_sequence_before(uint16_t a, uint16_t b) {
+    return (int16_t) (a - b) < 0;
+}
+
+static uint16_t keep_alive_s(void) {
+    return config.keep_alive_s ? config.keep_alive_s : IOTC_POSIX_DEFAULT_KEEP_ALIVE_S;
+}
+
+static uint16_t next_packet_id(void) {
+    last_packet_id++;
+    if (0 == last_packet_id) {
+        last_packet_id = 1;
+    }
+    return last_packet_id;
+}
+
+// Returns a buffer of at least the given size that is used to assemble outbound packets
+static uint8_t *get_tx_buffer(size_t size) {
+    if (size > tx_buffer_size) {
+        uint8_t *new_buffer = (uint8_t *) realloc(tx_buffer, size);
+        if (!new_buffer) {
+            return NULL;
+        }
+        tx_buffer = new_buffer;
+        tx_buffer_size = size;
+    }
+    return tx_buffer;
+}
+
+static bool send_bytes(const void *data, size_t length) {
+    if (sock < 0 || !iotc_mqtt_packet_send_all(sock, data, length)) {
+        return false;
+    }
+    stats.bytes_sent += length;
+    last_tx_ms = millis();
+    return true;
+}
+
+static bool send_packet(uint8_t type, uint8_t flags, const uint8_t *body, size_t body_length) {
+    uint8_t header[IOTC_MQTT_PACKET_MAX_HEADER_SIZE];
+    size_t header_length = iotc_mqtt_packet_write_header(header, type, flags, body_length);
+    return send_bytes(header, header_length) && (0 == body_length || send_bytes(body, body_length));
+}
+
+static void close_socket(void) {
+    if (sock >= 0) {
+        close(sock);
+        sock = -1;
+    }
+    iotc_mqtt_rx_buffer_free(&rx);
+    is_ping_pending = false;
+}
+
+// Returns the connected socket, or -1
+static int connect_to(const char *host, uint16_t port) {
+    char port_str[8];
+    struct addrinfo hints;
+    struct addrinfo *result = NULL;
+    int fd = -1;
+    snprintf(port_str, sizeof(port_str), "%u", port);
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (0 != getaddrinfo(host, port_str, &hints, &result)) {
+        Log.errorf(F("Unable to resolve %s\n"), host);
+        return -1;
+    }
+    for (struct addrinfo *ai = result; ai; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        if (0 == connect(fd, ai->ai_addr, ai->ai_addrlen)) {
+            break;
+        }
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(result);
+    return fd;
+}
+
+static bool open_socket(void) {
+    const char *host = config.mqtt_host ? config.mqtt_host : IOTC_POSIX_DEFAULT_MQTT_HOST;
+    uint16_t port = config.mqtt_port ? config.mqtt_port : IOTC_POSIX_DEFAULT_MQTT_PORT;
+    sock = connect_to(host, port);
+    if (sock < 0) {
+        Log.errorf(F("Unable to connect to the MQTT broker at %s:%u\n"), host, (unsigned int) port);
+        return false;
+    }
+    int flag = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+    iotc_mqtt_rx_buffer_init(&rx);
+    last_rx_ms = millis();
+    return true;
+}
+
+static bool send_connect(void) {
+    IotclMqttConfig *mc = iotcl_mqtt_get_config();
+    size_t client_id_length = strlen(mc->client_id);
+    size_t username_length = mc->username ? strlen(mc->username) : 0;
+    size_t length = 10 + 2 + client_id_length + (username_length ? 2 + username_length : 0);
+    uint8_t *body = get_tx_buffer(length);
+    if (!body) {
+        return false;
+    }
+    size_t pos = iotc_mqtt_packet_put_string(body, 0, "MQTT", 4);
+    body[pos++] = 4; // protocol level 3.1.1
+    body[pos++] = (uint8_t) (0x02 | (username_length ? 0x80 : 0)); // clean session
+    pos = iotc_mqtt_packet_put_u16(body, pos, keep_alive_s());
+    pos = iotc_mqtt_packet_put_string(body, pos, mc->client_id, client_id_length);
+    if (username_length) {
+        pos = iotc_mqtt_packet_put_string(body, pos, mc->username, username_length);
+    }
+    return send_packet(IOTC_MQTT_PACKET_CONNECT, 0, body, pos);
+}
+
+static bool send_subscribe(void) {
+    IotclMqttConfig *mc = iotcl_mqtt_get_config();
+    size_t topic_length = strlen(mc->sub_c2d);
+    uint8_t *body = get_tx_buffer(2 + 2 + topic_length + 1);
+    if (!body) {
+        return false;
+    }
+    size_t pos = iotc_mqtt_packet_put_u16(body, 0, next_packet_id());
+    pos = iotc_mqtt_packet_put_string(body, pos, mc->sub_c2d, topic_length);
+    body[pos++] = 1; // QoS 1
+    return send_packet(IOTC_MQTT_PACKET_SUBSCRIBE, 0x02, body, pos);
+}
+
+static bool send_puback(uint16_t packet_id) {
+    uint8_t body[2];
+    iotc_mqtt_packet_put_u16(body, 0, packet_id);
+    return send_packet(IOTC_MQTT_PACKET_PUBACK, 0, body, sizeof(body));
+}
+
+static void complete_publish(IotcPosixPublishSlot *slot, IotConnectDeliveryStatus status) {
+    uint16_t publish_id = slot->publish_id;
+    iotcl_free(slot->data);
+    slot->data = NULL;
+    slot->state = IOTC_POSIX_PUBLISH_FREE;
+    if (IOTC_DS_DELIVERED != status) {
+        Log.warnf(F("Message %u was not delivered. Status: %d\n"), publish_id, (int) status);
+    }
+    if (c && c->delivery_cb) {
+        c->delivery_cb(publish_id, status);
+    }
+}
+
+// Critical messages are queued again instead of being reported as failed
+static void finish_publish(IotcPosixPublishSlot *slot, IotConnectDeliveryStatus status) {
+    if (IOTC_DS_DELIVERED != status && IOTCL_DC_CRITICAL == slot->delivery_class) {
+        Log.warnf(F("Critical message %u was not delivered. Status: %d. Retrying...\n"), slot->publish_id, (int) status);
+        slot->is_retry = true;
+        slot->sent_ms = millis();
+        slot->state = IOTC_POSIX_PUBLISH_QUEUED;
+        return;
+    }
+    complete_publish(slot, status);
+}
+
+static void fail_publishes(bool is_discarding_queued) {
+    for (uint8_t i = 0; i < IOTC_MQTT_PUBLISH_QUEUE_SIZE; i++) {
+        IotcPosixPublishSlot *slot = &publish_slots[i];
+        if (IOTC_POSIX_PUBLISH_IN_FLIGHT == slot->state) {
+            finish_publish(slot, IOTC_DS_FAILED);
+        }
+        if (IOTC_POSIX_PUBLISH_QUEUED == slot->state
+            && (is_discarding_queued || IOTCL_DC_AT_MOST_ONCE == slot->delivery_class)) {
+            complete_publish(slot, IOTC_DS_DISCARDED);
+        }
+    }
+}
+
+static uint8_t publish_priority(const IotcPosixPublishSlot *slot) {
+    switch (slot->delivery_class) {
+        case IOTCL_DC_CRITICAL:
+            return 0;
+        case IOTCL_DC_AT_MOST_ONCE:
+            return 2;
+        default:
+            return 1;
+    }
+}
+
+static IotcPosixPublishSlot *find_next_publish(void) {
+    IotcPosixPublishSlot *next = NULL;
+    for (uint8_t i = 0; i < IOTC_MQTT_PUBLISH_QUEUE_SIZE; i++) {
+        IotcPosixPublishSlot *slot = &publish_slots[i];
+        if (IOTC_POSIX_PUBLISH_QUEUED != slot->state) {
+            continue;
+        }
+        if (slot->is_retry && millis() - slot->sent_ms < IOTC_MQTT_PUBLISH_RETRY_DELAY_MS) {
+            continue;
+        }
+        if (!next
+            || publish_priority(slot) < publish_priority(next)
+            || (publish_priority(slot) == publish_priority(next) && is_sequence_before(slot->publish_id, next->publish_id))) {
+            next = slot;
+        }
+    }
+    return next;
+}
+
+// Writes the fixed header, the topic and the packet identifier of a PUBLISH packet into the TX buffer
+static size_t build_publish_header(
+        IotcPosixPublishSlot *slot,
+        const char *topic,
+        size_t payload_length,
+        uint8_t **header
+) {
+    size_t topic_length = strlen(topic);
+    bool is_qos1 = IOTCL_DC_AT_MOST_ONCE != slot->delivery_class;
+    size_t remaining_length = 2 + topic_length + (is_qos1 ? 2 : 0) + payload_length;
+    uint8_t *buffer = get_tx_buffer(IOTC_MQTT_PACKET_MAX_HEADER_SIZE + 2 + topic_length + 2);
+    if (!buffer) {
+        return 0;
+    }
+    size_t pos = iotc_mqtt_packet_write_header(
+        buffer,
+        IOTC_MQTT_PACKET_PUBLISH,
+        (uint8_t) (is_qos1 ? 0x02 : 0x00) | (slot->is_retry ? 0x08 : 0x00), // the DUP flag on retries
+        remaining_length
+    );
+    pos = iotc_mqtt_packet_put_string(buffer, pos, topic, topic_length);
+    if (is_qos1) {
+        slot->packet_id = next_packet_id();
+        pos = iotc_mqtt_packet_put_u16(buffer, pos, slot->packet_id);
+    }
+    *header = buffer;
+    return pos;
+}
+
+// A QoS 0 message is delivered as far as the client can tell once it is sent
+static void end_publish(IotcPosixPublishSlot *slot) {
+    stats.num_published++;
+    slot->sent_ms = millis();
+    if (IOTCL_DC_AT_MOST_ONCE == slot->delivery_class) {
+        complete_publish(slot, IOTC_DS_DELIVERED);
+    } else {
+        slot->state = IOTC_POSIX_PUBLISH_IN_FLIGHT;
+    }
+}
+
+static bool write_publish(IotcPosixPublishSlot *slot) {
+    uint8_t *header;
+    size_t header_length = build_publish_header(slot, slot->data, slot->payload_length, &header);
+    if (!header_length || !send_bytes(header, header_length)) {
+        return false;
+    }
+    const char *payload = &slot->data[strlen(slot->data) + 1];
+    if (!send_bytes(payload, slot->payload_length)) {
+        return false;
+    }
+    end_publish(slot);
+    return true;
+}
+
+static void process_publishes(void) {
+    uint8_t num_in_flight = 0;
+    for (uint8_t i = 0; i < IOTC_MQTT_PUBLISH_QUEUE_SIZE; i++) {
+        IotcPosixPublishSlot *slot = &publish_slots[i];
+        if (IOTC_POSIX_PUBLISH_IN_FLIGHT != slot->state) {
+            continue;
+        }
+        if (millis() - slot->sent_ms <= IOTC_MQTT_PUBLISH_TIMEOUT_MS) {
+            num_in_flight++;
+        } else {
+            finish_publish(slot, IOTC_DS_TIMED_OUT);
+        }
+    }
+
+    while (num_in_flight < IOTC_MQTT_PUBLISH_WINDOW) {
+        IotcPosixPublishSlot *next = find_next_publish();
+        if (!next) {
+            break;
+        }
+        bool is_qos0 = IOTCL_DC_AT_MOST_ONCE == next->delivery_class;
+        if (!write_publish(next)) {
+            finish_publish(next, IOTC_DS_FAILED);
+            break; // the connection loss will be picked up by the loop
+        }
+        if (!is_qos0) {
+            num_in_flight++;
+        }
+    }
+}
+
+static void on_puback(uint16_t packet_id) {
+    stats.num_acked++;
+    for (uint8_t i = 0; i < IOTC_MQTT_PUBLISH_QUEUE_SIZE; i++) {
+        IotcPosixPublishSlot *slot = &publish_slots[i];
+        if (IOTC_POSIX_PUBLISH_IN_FLIGHT == slot->state && slot->packet_id == packet_id) {
+            finish_publish(slot, IOTC_DS_DELIVERED);
+            return;
+        }
+    }
+}
+
+// Passes a received message through the C2D filter to the callback, like the AVR client does with modem chunks
+static void on_publish(const IotcMqttPacket *p) {
+    const char *topic;
+    size_t topic_length;
+    size_t pos = 0;
+    uint16_t packet_id = 0;
+    uint8_t qos = (uint8_t) ((p->flags >> 1) & 0x03);
+    if (!iotc_mqtt_packet_get_string(p, &pos, &topic, &topic_length)
+        || (qos > 0 && !iotc_mqtt_packet_get_u16(p, &pos, &packet_id))) {
+        Log.error(F("Received a malformed MQTT PUBLISH packet"));
+        return;
+    }
+    stats.num_received++;
+    if (qos > 0) {
+        send_puback(packet_id);
+    }
+
+    char c2d_buffer[IOTC_MQTT_C2D_BUFFER_SIZE];
+    IotclC2dFilter filter;
+    size_t c2d_length;
+    iotcl_c2d_filter_init(&filter, c2d_buffer, sizeof(c2d_buffer));
+    iotcl_c2d_filter_feed(&filter, (const char *) &p->data[pos], p->data_length - pos);
+    if (iotcl_c2d_filter_finish(&filter, &c2d_length)) {
+        return; // called function will print the error
+    }
+    c->c2d_msg_cb(c2d_buffer, c2d_length);
+}
+
+static void set_state(IotConnectConnectionStatus new_state) {
+    state = new_state;
+    state_start_ms = millis();
+    if (c && c->status_cb) {
+        c->status_cb(new_state);
+    }
+}
+
+// The same seeding and jitter as iotc_mqtt_client_seed_backoff() and iotc_mqtt_client_next_backoff()
+static void seed_backoff(const char *client_id) {
+    uint32_t hash = 2166136261UL; // FNV-1a
+    for (const char *p = client_id; p && *p; p++) {
+        hash = (hash ^ (uint8_t) *p) * 16777619UL;
+    }
+    hash ^= (uint32_t) micros();
+    backoff_random = hash ? hash : 1;
+}
+
+static unsigned long next_backoff(unsigned long previous_ms) {
+    if (previous_ms < IOTC_MQTT_BACKOFF_BASE_MS) {
+        previous_ms = IOTC_MQTT_BACKOFF_BASE_MS;
+    }
+    unsigned long upper_ms = (previous_ms > IOTC_MQTT_BACKOFF_CAP_MS / 3) ? IOTC_MQTT_BACKOFF_CAP_MS : previous_ms * 3;
+    backoff_random ^= backoff_random << 13;
+    backoff_random ^= backoff_random >> 17;
+    backoff_random ^= backoff_random << 5;
+    return IOTC_MQTT_BACKOFF_BASE_MS + backoff_random % (upper_ms - IOTC_MQTT_BACKOFF_BASE_MS + 1);
+}
+
+static void start_backoff(bool is_auth_failure) {
+    close_socket();
+    if (is_auth_failure && num_auth_failures < UINT8_MAX) {
+        num_auth_failures++;
+    }
+    if (num_attempts < UINT8_MAX) {
+        num_attempts++;
+    }
+    bool is_persistent = c->auto_reconnect && !is_blocking_init;
+    if (!is_persistent && num_attempts >= IOTC_POSIX_MAX_CONN_RETRIES) {
+        Log.errorf(F("Failed to connect to MQTT after %d retries\n"), IOTC_POSIX_MAX_CONN_RETRIES);
+        fail_publishes(true);
+        set_state(IOTC_CS_MQTT_DISCONNECTED);
+        return;
+    }
+    backoff_ms = next_backoff(backoff_ms);
+    Log.errorf(F("Failed to connect to MQTT. Retrying in %lu ms\n"), backoff_ms);
+    set_state(IOTC_CS_MQTT_BACKOFF);
+}
+
+static bool refresh_config_if_needed(void) {
+    IotclMqttConfig *mc = iotcl_mqtt_get_config();
+    bool has_config = mc->client_id && mc->sub_c2d;
+    if (!c->rediscovery_cb || (has_config && num_auth_failures < IOTC_MQTT_REDISCOVERY_THRESHOLD)) {
+        return has_config;
+    }
+    Log.warn(F("Repeated MQTT connection failures. Running discovery again..."));
+    if (!c->rediscovery_cb()) {
+        Log.error(F("Discovery failed"));
+        return false;
+    }
+    num_auth_failures = 0;
+    return true;
+}
+
+static void on_connection_lost(void) {
+    Log.warn(F("The MQTT connection was lost"));
+    close_socket();
+    fail_publishes(!c->auto_reconnect);
+    set_state(IOTC_CS_MQTT_DISCONNECTED);
+    if (c->auto_reconnect) {
+        start_backoff(false);
+    }
+}
+
+// Handles one received packet. Returns false if the connection should be dropped.
+static bool process_packet(const IotcMqttPacket *p) {
+    size_t pos = 0;
+    uint16_t packet_id;
+    switch (p->type) {
+        case IOTC_MQTT_PACKET_CONNACK:
+            if (IOTC_CS_MQTT_CONNECTING != state || p->data_length < 2) {
+                return false;
+            }
+            if (0 != p->data[1]) {
+                Log.errorf(F("The MQTT broker refused the connection with code %d\n"), p->data[1]);
+                start_backoff(true);
+                return true;
+            }
+            set_state(IOTC_CS_MQTT_SUBSCRIBING);
+            if (!send_subscribe()) {
+                return false;
+            }
+            return true;
+        case IOTC_MQTT_PACKET_SUBACK:
+            if (IOTC_CS_MQTT_SUBSCRIBING != state || p->data_length < 3) {
+                return false;
+            }
+            if (0x80 == p->data[2]) {
+                Log.errorf(F("ERROR: Unable to subscribe for C2D messages topic %s!\n"), iotcl_mqtt_get_config()->sub_c2d);
+                start_backoff(false);
+                return true;
+            }
+            num_attempts = 0;
+            num_auth_failures = 0;
+            backoff_ms = 0;
+            stats.num_connects++;
+            set_state(IOTC_CS_MQTT_CONNECTED);
+            return true;
+        case IOTC_MQTT_PACKET_PUBACK:
+            if (iotc_mqtt_packet_get_u16(p, &pos, &packet_id)) {
+                on_puback(packet_id);
+            }
+            return true;
+        case IOTC_MQTT_PACKET_PUBLISH:
+            on_publish(p);
+            return true;
+        case IOTC_MQTT_PACKET_PINGRESP:
+            is_ping_pending = false;
+            return true;
+        default:
+            Log.warnf(F("Ignoring MQTT packet of type %d\n"), p->type);
+            return true;
+    }
+}
+
+// Reads and handles the received packets. Returns false if the connection was lost.
+static bool process_incoming(bool *has_processed) {
+    size_t previous_length = rx.length;
+    if (!iotc_mqtt_rx_buffer_read(&rx, sock)) {
+        return false;
+    }
+    if (rx.length > previous_length) {
+        stats.bytes_received += rx.length - previous_length;
+        last_rx_ms = millis();
+    }
+    IotcMqttPacket packet;
+    size_t packet_size;
+    IotConnectConnectionStatus previous_state = state;
+    while (sock >= 0 && iotc_mqtt_rx_buffer_peek(&rx, &packet, &packet_size)) {
+        *has_processed = true;
+        if (!process_packet(&packet)) {
+            return false;
+        }
+        if (sock < 0) {
+            break; // the broker refused the connection and the socket was closed
+        }
+        iotc_mqtt_rx_buffer_consume(&rx, packet_size);
+        if (state != previous_state) {
+            break; // let the state machine handle the change first
+        }
+    }
+    return true;
+}
+
+static bool step(void) {
+    bool has_processed = false;
+    switch (state) {
+        case IOTC_CS_MQTT_TLS:
+            if (!refresh_config_if_needed()) {
+                start_backoff(false);
+                return false;
+            }
+            // There is no TLS on the host. The connection is requested right away.
+            if (!open_socket()) {
+                start_backoff(false);
+                return false;
+            }
+            set_state(IOTC_CS_MQTT_CONNECTING);
+            if (!send_connect()) {
+                start_backoff(false);
+                return false;
+            }
+            return true;
+
+        case IOTC_CS_MQTT_CONNECTING:
+        case IOTC_CS_MQTT_SUBSCRIBING:
+            if (!process_incoming(&has_processed)) {
+                Log.error(F("The MQTT broker closed the connection while connecting"));
+                start_backoff(true);
+                return false;
+            }
+            if (!has_processed && millis() - state_start_ms > IOTC_POSIX_CONNECT_TIMEOUT_MS) {
+                Log.error(F("Timed out while connecting to MQTT"));
+                start_backoff(false);
+                return false;
+            }
+            return has_processed;
+
+        case IOTC_CS_MQTT_BACKOFF:
+            if (millis() - state_start_ms < backoff_ms) {
+                return false;
+            }
+            set_state(IOTC_CS_MQTT_TLS);
+            return true;
+
+        case IOTC_CS_MQTT_CONNECTED:
+            if (!process_incoming(&has_processed)) {
+                on_connection_lost();
+                return false;
+            }
+            if (is_ping_pending && millis() - last_rx_ms > keep_alive_s() * 1000UL) {
+                Log.error(F("The MQTT broker did not respond to the keepalive"));
+                on_connection_lost();
+                return false;
+            }
+            if (!is_ping_pending && millis() - last_tx_ms >= keep_alive_s() * 500UL) {
+                is_ping_pending = send_packet(IOTC_MQTT_PACKET_PINGREQ, 0, NULL, 0);
+            }
+            process_publishes();
+            return has_processed;
+
+        default:
+            return false;
+    }
+}
+
+static int posix_https_request(IotConnectHttpResponse *response, const char *host, const char *path, const char *send_str) {
+    response->data = NULL;
+    if (!config.https_handler) {
+        Log.error(F("No HTTPS handler is configured for the POSIX transport"));
+        return IOTCL_ERR_CONFIG_MISSING;
+    }
+    stats.num_https_requests++;
+    return config.https_handler(config.https_context, host, path, send_str, &response->data);
+}
+
+static void posix_free_https_response(IotConnectHttpResponse *response) {
+    iotcl_free(response->data);
+    response->data = NULL;
+}
+
+static int posix_https_request_streamed(
+        const char *host,
+        const char *path,
+        const char *send_str,
+        IotConnectHttpBodySink sink_fn,
+        void *context
+) {
+    IotConnectHttpResponse response;
+    int status = posix_https_request(&response, host, path, send_str);
+    if (status) {
+        return status;
+    }
+    size_t length = response.data ? strlen(response.data) : 0;
+    for (size_t offset = 0; offset < length && IOTCL_SUCCESS == status; offset += IOTC_POSIX_HTTPS_CHUNK_SIZE) {
+        size_t chunk_length = length - offset;
+        if (chunk_length > IOTC_POSIX_HTTPS_CHUNK_SIZE) {
+            chunk_length = IOTC_POSIX_HTTPS_CHUNK_SIZE;
+        }
+        status = sink_fn(context, &response.data[offset], chunk_length);
+    }
+    posix_free_https_response(&response);
+    return status;
+}
+
+// Reads the response header into buffer and parses the status code and the content length.
+// Returns the number of bytes of the body that were read with the header, or -1 on error.
+static ssize_t read_http_header(int fd, char *buffer, size_t buffer_size, IotConnectHttpRangeResponse *response) {
+    size_t length = 0;
+    char *body = NULL;
+    while (!body) {
+        if (length + 1 >= buffer_size) {
+            Log.error(F("HTTP: The response header is too long"));
+            return -1;
+        }
+        ssize_t received = recv(fd, &buffer[length], buffer_size - 1 - length, 0);
+        if (received <= 0) {
+            Log.error(F("HTTP: The connection closed before the response header"));
+            return -1;
+        }
+        stats.bytes_received += (uint64_t) received;
+        length += (size_t) received;
+        buffer[length] = '\0';
+        body = strstr(buffer, "\r\n\r\n");
+    }
+    *body = '\0';
+    body += 4;
+
+    unsigned int status_code = 0;
+    if (1 != sscanf(buffer, "HTTP/1.%*d %u", &status_code)) {
+        Log.error(F("HTTP: Malformed status line"));
+        return -1;
+    }
+    response->status_code = (uint16_t) status_code;
+    for (char *line = strstr(buffer, "\r\n"); line; line = strstr(line, "\r\n")) {
+        line += 2;
+        if (0 == strncasecmp(line, "Content-Length:", strlen("Content-Length:"))) {
+            response->content_length = (uint32_t) strtoul(&line[strlen("Content-Length:")], NULL, 10);
+        }
+    }
+    return (ssize_t) (length - (size_t) (body - buffer));
+}
+
+// Range requests are plain HTTP to the configured server, with a new connection for each request
+static int posix_https_get_range(
+        const char *host,
+        const char *path,
+        uint32_t offset,
+        uint32_t length,
+        IotConnectHttpBodySink sink_fn,
+        void *context,
+        IotConnectHttpRangeResponse *response
+) {
+    char buffer[IOTC_POSIX_HTTP_BUFFER_SIZE];
+    response->status_code = 0;
+    response->content_length = 0;
+    if (!config.http_port) {
+        Log.error(F("No HTTP server is configured for the range requests of the POSIX transport"));
+        return IOTCL_ERR_CONFIG_MISSING;
+    }
+    if (0 == length || (uint32_t) (offset + length - 1) < offset) {
+        return IOTCL_ERR_BAD_VALUE;
+    }
+    const char *server = config.http_host ? config.http_host : IOTC_POSIX_DEFAULT_MQTT_HOST;
+    int fd = connect_to(server, config.http_port);
+    if (fd < 0) {
+        Log.errorf(F("Unable to connect to the HTTP server at %s:%u\n"), server, (unsigned int) config.http_port);
+        return IOTCL_ERR_FAILED;
+    }
+    stats.num_https_requests++;
+    struct timeval timeout = {IOTC_POSIX_HTTP_TIMEOUT_S, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    int request_length = snprintf(buffer, sizeof(buffer),
+        "GET %s HTTP/1.1\r\nHost: %s\r\nRange: bytes=%lu-%lu\r\nConnection: close\r\n\r\n",
+        path, host, (unsigned long) offset, (unsigned long) (offset + length - 1));
+    if (request_length <= 0 || (size_t) request_length >= sizeof(buffer)) {
+        close(fd);
+        return IOTCL_ERR_OVERFLOW;
+    }
+    if (send(fd, buffer, (size_t) request_length, MSG_NOSIGNAL) != request_length) {
+        close(fd);
+        return IOTCL_ERR_FAILED;
+    }
+    stats.bytes_sent += (uint64_t) request_length;
+
+    ssize_t chunk_length = read_http_header(fd, buffer, sizeof(buffer), response);
+    if (chunk_length < 0) {
+        close(fd);
+        return IOTCL_ERR_FAILED;
+    }
+    if (206 != response->status_code && 200 != response->status_code) {
+        close(fd);
+        return IOTCL_SUCCESS; // for the caller to handle
+    }
+    if (0 == response->content_length) {
+        Log.error(F("HTTP: The response to a range request has no content length"));
+        close(fd);
+        return IOTCL_ERR_FAILED;
+    }
+
+    // the part of the body that came with the header is moved to the start of the buffer
+    size_t header_length = strlen(buffer) + 4;
+    memmove(buffer, &buffer[header_length], (size_t) chunk_length);
+    uint32_t total_read = 0;
+    int status = IOTCL_SUCCESS;
+    while (IOTCL_SUCCESS == status && total_read < response->content_length) {
+        if (0 == chunk_length) {
+            chunk_length = recv(fd, buffer, sizeof(buffer), 0);
+            if (chunk_length <= 0) {
+                Log.errorf(F("HTTP: Got %lu of %lu bytes\n"), (unsigned long) total_read, (unsigned long) response->content_length);
+                status = IOTCL_ERR_FAILED;
+                break;
+            }
+            stats.bytes_received += (uint64_t) chunk_length;
+        }
+        if ((uint32_t) chunk_length > response->content_length - total_read) {
+            chunk_length = (ssize_t) (response->content_length - total_read);
+        }
+        total_read += (uint32_t) chunk_length;
+        status = sink_fn(context, buffer, (size_t) chunk_length);
+        chunk_length = 0;
+    }
+    close(fd);
+    return status;
+}
+
+static bool posix_mqtt_start(IotConnectMqttClientConfig *mqtt_config) {
+    if (!iotcl_mqtt_get_config()) {
+        Log.error(F("iotc_mqtt_client_start() c-lib not initialized?"));
+        return false;
+    }
+    if (!mqtt_config) {
+        Log.error(F("iotc_mqtt_client_start() called with invalid arguments"));
+        return false;
+    }
+    c = mqtt_config;
+    close_socket();
+    seed_backoff(iotcl_mqtt_get_config()->client_id);
+    num_attempts = 0;
+    num_auth_failures = 0;
+    backoff_ms = 0;
+    set_state(IOTC_CS_MQTT_TLS);
+    return true;
+}
+
+static void posix_mqtt_loop(void) {
+    unsigned long start = millis();
+    while (step()) {
+        if (millis() - start >= IOTC_MQTT_LOOP_BUDGET_MS) {
+            break;
+        }
+    }
+}
+
+static bool posix_mqtt_init(IotConnectMqttClientConfig *mqtt_config) {
+    if (!posix_mqtt_start(mqtt_config)) {
+        return false;
+    }
+    is_blocking_init = true;
+    while (IOTC_CS_MQTT_CONNECTED != state && IOTC_CS_MQTT_DISCONNECTED != state) {
+        posix_mqtt_loop();
+        delay(1);
+    }
+    is_blocking_init = false;
+    return IOTC_CS_MQTT_CONNECTED == state;
+}
+
+static void posix_mqtt_disconnect(void) {
+    Log.info(F("Closing the MQTT connection"));
+    if (sock >= 0) {
+        send_packet(IOTC_MQTT_PACKET_DISCONNECT, 0, NULL, 0);
+    }
+    close_socket();
+    fail_publishes(true);
+    if (IOTC_CS_MQTT_DISCONNECTED != state && IOTC_CS_UNDEFINED != state) {
+        set_state(IOTC_CS_MQTT_DISCONNECTED);
+    }
+}
+
+static bool posix_mqtt_is_connected(void) {
+    return IOTC_CS_MQTT_CONNECTED == state;
+}
+
+static IotConnectConnectionStatus posix_mqtt_get_status(void) {
+    return state;
+}
+
+static uint16_t next_publish_id(void) {
+    last_publish_id++;
+    if (0 == last_publish_id) {
+        last_publish_id = 1;
+    }
+    return last_publish_id;
+}
+
+static uint16_t posix_mqtt_publish(const char *topic, const char *message, IotclDeliveryClass delivery_class) {
+    if (!c || IOTC_CS_UNDEFINED == state || IOTC_CS_MQTT_DISCONNECTED == state) {
+        Log.error(F("Attempted publish without being connected to a broker"));
+        return 0;
+    }
+    size_t topic_length = strlen(topic);
+    size_t payload_length = strlen(message);
+    IotcPosixPublishSlot *slot = NULL;
+    IotcPosixPublishSlot *oldest_droppable = NULL;
+    for (uint8_t i = 0; i < IOTC_MQTT_PUBLISH_QUEUE_SIZE; i++) {
+        IotcPosixPublishSlot *s = &publish_slots[i];
+        if (IOTC_POSIX_PUBLISH_FREE == s->state) {
+            slot = s;
+            break;
+        }
+        if (IOTC_POSIX_PUBLISH_QUEUED == s->state && IOTCL_DC_AT_MOST_ONCE == s->delivery_class
+            && (!oldest_droppable || is_sequence_before(s->publish_id, oldest_droppable->publish_id))) {
+            oldest_droppable = s;
+        }
+    }
+    if (!slot && oldest_droppable && IOTCL_DC_AT_MOST_ONCE != delivery_class) {
+        complete_publish(oldest_droppable, IOTC_DS_DISCARDED);
+        slot = oldest_droppable;
+    }
+    if (!slot) {
+        Log.warn(F("The MQTT publish queue is full. Consider calling iotconnect_sdk_loop() more often or increasing IOTC_MQTT_PUBLISH_QUEUE_SIZE"));
+        return 0;
+    }
+    // acks are queued from the C2D callbacks, inside the arena scope of the C2D message, but need to outlive it
+    unsigned int arena_depth = iotcl_arena_suspend();
+    slot->data = (char *) iotcl_malloc(topic_length + 1 + payload_length);
+    iotcl_arena_resume(arena_depth);
+    if (!slot->data) {
+        Log.error(F("Out of memory while queuing the MQTT message"));
+        return 0;
+    }
+    memcpy(slot->data, topic, topic_length + 1);
+    memcpy(&slot->data[topic_length + 1], message, payload_length);
+    slot->payload_length = payload_length;
+    slot->delivery_class = delivery_class;
+    slot->is_retry = false;
+    slot->publish_id = next_publish_id();
+    slot->state = IOTC_POSIX_PUBLISH_QUEUED;
+
+    if (IOTC_CS_MQTT_CONNECTED == state) {
+        process_publishes();
+    }
+    return slot->publish_id;
+}
+
+static bool socket_payload_sink(void *context, const char *data, size_t data_len) {
+    size_t *remaining = (size_t *) context;
+    if (data_len > *remaining) {
+        return false;
+    }
+    *remaining -= data_len;
+    return send_bytes(data, data_len);
+}
+
+static uint16_t posix_mqtt_publish_streamed(
+        const char *topic,
+        IotclMqttPayloadWriter writer_fn,
+        void *context,
+        IotclDeliveryClass delivery_class
+) {
+    if (!c || IOTC_CS_MQTT_CONNECTED != state || IOTCL_DC_CRITICAL == delivery_class) {
+        return 0;
+    }
+
+    process_publishes();
+    IotcPosixPublishSlot *slot = NULL;
+    uint8_t num_in_flight = 0;
+    for (uint8_t i = 0; i < IOTC_MQTT_PUBLISH_QUEUE_SIZE; i++) {
+        IotcPosixPublishSlot *s = &publish_slots[i];
+        if (IOTC_POSIX_PUBLISH_FREE == s->state) {
+            slot = s;
+        } else if (IOTC_POSIX_PUBLISH_QUEUED == s->state) {
+            return 0;
+        } else {
+            num_in_flight++;
+        }
+    }
+    if (!slot || num_in_flight >= IOTC_MQTT_PUBLISH_WINDOW) {
+        return 0;
+    }
+
+    // the fixed header needs the payload length, so measure the payload first
+    IotclJsonWriter w;
+    iotcl_json_writer_init_with_sink(&w, NULL, 0, NULL, NULL);
+    writer_fn(&w, context);
+    size_t payload_length = iotcl_json_writer_get_total_length(&w);
+    if (w.overflow || 0 == payload_length) {
+        return 0;
+    }
+
+    slot->data = NULL;
+    slot->payload_length = payload_length;
+    slot->delivery_class = delivery_class;
+    slot->is_retry = false;
+    uint8_t *header;
+    size_t header_length = build_publish_header(slot, topic, payload_length, &header);
+    if (!header_length || !send_bytes(header, header_length)) {
+        return 0;
+    }
+    slot->publish_id = next_publish_id();
+
+    char chunk[IOTC_POSIX_STREAM_CHUNK_SIZE];
+    size_t remaining = payload_length;
+    iotcl_json_writer_init_with_sink(&w, chunk, sizeof(chunk), socket_payload_sink, &remaining);
+    writer_fn(&w, context);
+    iotcl_json_writer_flush(&w);
+    if (w.overflow || remaining > 0) {
+        Log.error(F("The MQTT payload changed while it was being written"));
+        // the broker is waiting for the rest of the packet, so complete it with JSON whitespace
+        for (; remaining > 0; remaining--) {
+            send_bytes(" ", 1);
+        }
+    }
+    end_publish(slot);
+    return slot->publish_id;
+}
+
+static uint16_t posix_mqtt_get_last_publish_id(void) {
+    return last_publish_id;
+}
+
+void iotc_posix_transport_configure(const IotcPosixTransportConfig *new_config) {
+    config = *new_config;
+}
+
+void iotc_posix_transport_get_stats(IotcPosixTransportStats *out_stats) {
+    *out_stats = stats;
+}
+
+void iotc_posix_transport_reset_stats(void) {
+    memset(&stats, 0, sizeof(stats));
+}
+
+// The POSIX transport is the default transport of the host build
+const IotConnectTransport iotc_default_transport = {
+    NULL, // the host clock is already set
+    posix_https_request,
+    posix_free_https_response,
+    posix_https_request_streamed,
+    posix_https_get_range,
+    posix_mqtt_start,
+    posix_mqtt_init,
+    posix_mqtt_disconnect,
+    posix_mqtt_is_connected,
+    posix_mqtt_get_status,
+    posix_mqtt_loop,
+    posix_mqtt_publish,
+    posix_mqtt_publish_streamed,
+    posix_mqtt_get_last_publish_id
+};
@@ -0,0 +1,60 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * A transport for Linux and other POSIX systems (see iotc_transport.h), which is the default transport of the host build.
+ * MQTT 3.1.1 is spoken over a plain TCP socket to a local broker, like Mosquitto or iotc_fake_broker.h,
+ * instead of the broker from identity. There is no TLS.
+ * HTTPS requests are passed to a handler, which can serve canned responses (see iotc_fake_cloud.h)
+ * or forward them to a real HTTPS client. The range requests of OTA downloads are sent as plain HTTP
+ * to a local server, like iotc_fake_http_server.h, instead of the host from the URL.
+ */
+
+#ifndef IOTC_TRANSPORT_POSIX_H
+#define IOTC_TRANSPORT_POSIX_H
+
+#include <stdint.h>
+#include "iotc_transport.h"
+
+#define IOTC_POSIX_DEFAULT_MQTT_HOST "127.0.0.1"
+#define IOTC_POSIX_DEFAULT_MQTT_PORT 1883
+
+// Should return IOTCL_SUCCESS and a null-terminated response body allocated with iotcl_malloc().
+typedef int (*IotcPosixHttpsHandler)(
+        void *context,
+        const char *host,
+        const char *path,
+        const char *send_str,
+        char **response_data
+);
+
+typedef struct {
+    const char *mqtt_host;          // IOTC_POSIX_DEFAULT_MQTT_HOST if NULL
+    uint16_t mqtt_port;             // IOTC_POSIX_DEFAULT_MQTT_PORT if 0
+    uint16_t keep_alive_s;          // 60 if 0
+    IotcPosixHttpsHandler https_handler; // HTTPS requests fail if NULL
+    void *https_context;
+    const char *http_host;          // For range requests. IOTC_POSIX_DEFAULT_MQTT_HOST if NULL.
+    uint16_t http_port;             // Range requests fail if 0
+} IotcPosixTransportConfig;
+
+typedef struct {
+    uint32_t num_connects;
+    uint32_t num_published;         // PUBLISH packets sent, including retries
+    uint32_t num_acked;             // PUBACKs received
+    uint32_t num_received;          // PUBLISH packets received
+    uint32_t num_https_requests;
+    uint64_t bytes_sent;
+    uint64_t bytes_received;
+} IotcPosixTransportStats;
+
+// Should be called before iotconnect_sdk_init(). The strings need to remain valid while the transport is used.
+void iotc_posix_transport_configure(const IotcPosixTransportConfig *config);
+
+void iotc_posix_transport_get_stats(IotcPosixTransportStats *stats);
+
+void iotc_posix_transport_reset_stats(void);
+
+#endif // IOTC_TRANSPORT_POSIX_H
@@ -0,0 +1,38 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * The parts of the Arduino API that the SDK uses, implemented for the host build. See host_shim.cpp and host_clock.cpp.
+ */
+
+#ifndef IOTC_HOST_ARDUINO_H
+#define IOTC_HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+// Flash strings are regular strings on the host
+class __FlashStringHelper;
+#define F(string_literal) (reinterpret_cast<const __FlashStringHelper *>(string_literal))
+
+unsigned long millis(void);
+
+unsigned long micros(void);
+
+void delay(unsigned long ms);
+
+long random(long min_value, long max_value);
+
+// From avr-libc, which has it in stdlib.h
+char *itoa(int value, char *str, int radix);
+
+inline void noInterrupts(void) {}
+
+inline void interrupts(void) {}
+
+#endif // IOTC_HOST_ARDUINO_H
@@ -0,0 +1,34 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * The Arduino clock functions on the monotonic clock of the host. The modem emulator provides virtual ones instead.
+ */
+
+#include <time.h>
+#include "Arduino.h"
+
+static uint64_t monotonic_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000ULL + (uint64_t) ts.tv_nsec / 1000ULL;
+}
+
+static uint64_t start_us = monotonic_us();
+
+unsigned long millis(void) {
+    return (unsigned long) ((monotonic_us() - start_us) / 1000ULL);
+}
+
+unsigned long micros(void) {
+    return (unsigned long) (monotonic_us() - start_us);
+}
+
+void delay(unsigned long ms) {
+    struct timespec ts;
+    ts.tv_sec = (time_t) (ms / 1000);
+    ts.tv_nsec = (long) (ms % 1000) * 1000000L;
+    nanosleep(&ts, NULL);
+}
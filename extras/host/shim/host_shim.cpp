@@ -0,0 +1,102 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+#include <stdarg.h>
+#include "Arduino.h"
+#include "log.h"
+
+LogClass Log;
+
+long random(long min_value, long max_value) {
+    if (max_value <= min_value) {
+        return min_value;
+    }
+    return min_value + (long) (rand() % (max_value - min_value));
+}
+
+char *itoa(int value, char *str, int radix) {
+    static const char digits[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+    char reversed[sizeof(int) * 8 + 1];
+    unsigned int magnitude = (value < 0 && 10 == radix) ? 0U - (unsigned int) value : (unsigned int) value;
+    size_t length = 0;
+    char *p = str;
+    if (radix < 2 || radix > 36) {
+        *str = '\0';
+        return str;
+    }
+    do {
+        reversed[length++] = digits[magnitude % (unsigned int) radix];
+        magnitude /= (unsigned int) radix;
+    } while (magnitude);
+    if (value < 0 && 10 == radix) {
+        *p++ = '-';
+    }
+    while (length) {
+        *p++ = reversed[--length];
+    }
+    *p = '\0';
+    return str;
+}
+
+// Same output as the AVR-IoT Cellular library Log: error(), warn() etc. append a newline, the f variants do not.
+#define LOG_FUNCTIONS(name, level, prefix) \
+    void LogClass::name(const char *str) { \
+        if (log_level >= (level)) { \
+            printf("%s%s\r\n", (prefix), str); \
+        } \
+    } \
+    void LogClass::name(const __FlashStringHelper *str) { \
+        name(reinterpret_cast<const char *>(str)); \
+    } \
+    void LogClass::name##f(const char *format, ...) { \
+        if (log_level >= (level)) { \
+            va_list args; \
+            va_start(args, format); \
+            printf("%s", (prefix)); \
+            vprintf(format, args); \
+            va_end(args); \
+        } \
+    } \
+    void LogClass::name##f(const __FlashStringHelper *format, ...) { \
+        if (log_level >= (level)) { \
+            va_list args; \
+            va_start(args, format); \
+            printf("%s", (prefix)); \
+            vprintf(reinterpret_cast<const char *>(format), args); \
+            va_end(args); \
+        } \
+    }
+
+LOG_FUNCTIONS(error, LogLevel::ERROR, "[ERROR] ")
+LOG_FUNCTIONS(warn, LogLevel::WARN, "[WARN] ")
+LOG_FUNCTIONS(info, LogLevel::INFO, "[INFO] ")
+LOG_FUNCTIONS(debug, LogLevel::DEBUG, "[DEBUG] ")
+LOG_FUNCTIONS(raw, LogLevel::ERROR, "")
+
+// Leaves args as it was, because the Sequans controller formats the same arguments again after logging them
+void LogClass::rawfv(const char *format, va_list args) {
+    if (log_level >= LogLevel::ERROR) {
+        va_list args_copy;
+        va_copy(args_copy, args);
+        vprintf(format, args_copy);
+        va_end(args_copy);
+    }
+}
+
+void LogClass::rawfv(const __FlashStringHelper *format, va_list args) {
+    rawfv(reinterpret_cast<const char *>(format), args);
+}
+
+void LogClass::begin(unsigned long baud_rate) {
+    (void) baud_rate;
+}
+
+void LogClass::setLogLevel(LogLevel level) {
+    log_level = level;
+}
+
+LogLevel LogClass::getLogLevel(void) {
+    return log_level;
+}
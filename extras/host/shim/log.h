@@ -0,0 +1,58 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * Host version of the AVR-IoT Cellular library Log, which prints to stdout.
+ */
+
+#ifndef IOTC_HOST_LOG_H
+#define IOTC_HOST_LOG_H
+
+#include <stdarg.h>
+#include "Arduino.h"
+
+enum class LogLevel { NONE, ERROR, WARN, INFO, DEBUG };
+
+class LogClass {
+public:
+    void begin(unsigned long baud_rate);
+
+    void setLogLevel(LogLevel log_level);
+    LogLevel getLogLevel(void);
+
+    void error(const char *str);
+    void error(const __FlashStringHelper *str);
+    void errorf(const char *format, ...);
+    void errorf(const __FlashStringHelper *format, ...);
+
+    void warn(const char *str);
+    void warn(const __FlashStringHelper *str);
+    void warnf(const char *format, ...);
+    void warnf(const __FlashStringHelper *format, ...);
+
+    void info(const char *str);
+    void info(const __FlashStringHelper *str);
+    void infof(const char *format, ...);
+    void infof(const __FlashStringHelper *format, ...);
+
+    void debug(const char *str);
+    void debug(const __FlashStringHelper *str);
+    void debugf(const char *format, ...);
+    void debugf(const __FlashStringHelper *format, ...);
+
+    void raw(const char *str);
+    void raw(const __FlashStringHelper *str);
+    void rawf(const char *format, ...);
+    void rawf(const __FlashStringHelper *format, ...);
+    void rawfv(const char *format, va_list args);
+    void rawfv(const __FlashStringHelper *format, va_list args);
+
+private:
+    LogLevel log_level = LogLevel::INFO;
+};
+
+extern LogClass Log;
+
+#endif // IOTC_HOST_LOG_H
@@ -0,0 +1,252 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * Creates, applies and describes the OTA delta packages of src/iotc_ota_delta.h.
+ *
+ * create  Generates a package that turns the running firmware (source) into the new one (target),
+ *         and checks it by applying it with the device code.
+ * apply   Applies a package to the source with the device code, as a download would, in ranges.
+ * info    Prints the header of a package.
+ *
+ * Upload the package to IoTConnect with a file name that ends with IOTC_OTA_DELTA_FILE_EXTENSION,
+ * next to the full image, so that devices that run another firmware can download the full image.
+ *
+ * Usage: iotc_ota_delta create source.bin target.bin delta.iotd
+ *        iotc_ota_delta apply source.bin delta.iotd target.bin
+ *        iotc_ota_delta info delta.iotd
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <Arduino.h>
+#include "log.h"
+
+#include "iotcl.h"
+#include "iotcl_sha256.h"
+#include "iotc_ota.h"
+#include "iotc_ota_delta.h"
+#include "iotc_ota_delta_encoder.h"
+#include "iotc_ota_file_sink.h"
+
+typedef struct {
+    const uint8_t *data;
+    size_t size;
+} Image;
+
+// Where the check of a new package writes the target
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+} MemorySink;
+
+static uint8_t *read_file(const char *path, size_t *size) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        fprintf(stderr, "Unable to open %s\n", path);
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long length = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *data = (uint8_t *) malloc(length > 0 ? (size_t) length : 1);
+    if (!data || length < 0 || fread(data, 1, (size_t) length, f) != (size_t) length) {
+        fprintf(stderr, "Unable to read %s\n", path);
+        free(data);
+        data = NULL;
+    }
+    fclose(f);
+    *size = (size_t) length;
+    return data;
+}
+
+static bool write_file(const char *path, const uint8_t *data, size_t size) {
+    FILE *f = fopen(path, "wb");
+    bool is_written = f && fwrite(data, 1, size, f) == size;
+    if (f && 0 != fclose(f)) {
+        is_written = false;
+    }
+    if (!is_written) {
+        fprintf(stderr, "Unable to write %s\n", path);
+    }
+    return is_written;
+}
+
+static void print_digest(const char *name, const uint8_t *digest) {
+    printf("%s", name);
+    for (int i = 0; i < IOTCL_SHA256_DIGEST_SIZE; i++) {
+        printf("%02x", digest[i]);
+    }
+    printf("\n");
+}
+
+static int read_source(void *context, uint32_t offset, uint8_t *data, size_t data_length) {
+    const Image *source = (const Image *) context;
+    if (offset + data_length > source->size) {
+        return IOTCL_ERR_OVERFLOW;
+    }
+    memcpy(data, &source->data[offset], data_length);
+    return IOTCL_SUCCESS;
+}
+
+static int memory_open(void *context, uint32_t offset) {
+    MemorySink *m = (MemorySink *) context;
+    m->size = offset;
+    return IOTCL_SUCCESS;
+}
+
+static int memory_write(void *context, uint32_t offset, const uint8_t *data, size_t data_length) {
+    MemorySink *m = (MemorySink *) context;
+    if (offset != m->size || offset + data_length > m->capacity) {
+        return IOTCL_ERR_OVERFLOW;
+    }
+    memcpy(&m->data[offset], data, data_length);
+    m->size += data_length;
+    return IOTCL_SUCCESS;
+}
+
+static int memory_close(void *context, bool is_complete, uint32_t image_size, const uint8_t *digest) {
+    (void) context;
+    (void) is_complete;
+    (void) image_size;
+    (void) digest;
+    return IOTCL_SUCCESS;
+}
+
+static const IotConnectOtaSink memory_sink = {memory_open, memory_write, memory_close, NULL, NULL};
+
+// Passes the package to the delta sink in ranges, as the download would
+static int apply(const Image *source, const uint8_t *delta, size_t delta_size,
+                 const IotConnectOtaSink *target_sink, void *target_context) {
+    static IotConnectOtaDelta d;
+    IotConnectOtaDeltaConfig c = {0};
+    c.read_source = read_source;
+    c.source_context = (void *) source;
+    c.source_size = (uint32_t) source->size;
+    c.target_sink = target_sink;
+    c.target_context = target_context;
+    iotconnect_ota_delta_init(&d, &c);
+
+    int status = iotconnect_ota_delta_sink.open(&d, 0);
+    for (size_t offset = 0; IOTCL_SUCCESS == status && offset < delta_size; offset += IOTC_OTA_RANGE_SIZE) {
+        size_t length = delta_size - offset < IOTC_OTA_RANGE_SIZE ? delta_size - offset : IOTC_OTA_RANGE_SIZE;
+        status = iotconnect_ota_delta_sink.write(&d, (uint32_t) offset, &delta[offset], length);
+    }
+    if (status) {
+        iotconnect_ota_delta_sink.close(&d, false, 0, NULL);
+        return status;
+    }
+    return iotconnect_ota_delta_sink.close(&d, true, (uint32_t) delta_size, NULL);
+}
+
+static int create(const char *source_path, const char *target_path, const char *delta_path) {
+    Image source;
+    size_t target_size;
+    size_t delta_size;
+    IotcOtaDeltaEncoderStats s;
+    int exit_code = 1;
+    uint8_t *delta = NULL;
+    MemorySink check = {0};
+
+    source.data = read_file(source_path, &source.size);
+    uint8_t *target = read_file(target_path, &target_size);
+    if (!source.data || !target) {
+        goto cleanup;
+    }
+    delta = iotc_ota_delta_encode(source.data, source.size, target, target_size, &delta_size, &s);
+    if (!delta) {
+        fprintf(stderr, "Out of memory\n");
+        goto cleanup;
+    }
+    check.data = (uint8_t *) malloc(target_size);
+    check.capacity = target_size;
+    if (!check.data || apply(&source, delta, delta_size, &memory_sink, &check)
+        || check.size != target_size || 0 != memcmp(check.data, target, target_size)) {
+        fprintf(stderr, "The package does not reproduce the target\n");
+        goto cleanup;
+    }
+    if (!write_file(delta_path, delta, delta_size)) {
+        goto cleanup;
+    }
+    printf("Source %lu bytes, target %lu bytes, delta %lu bytes (%.1f%% of the target)\n",
+        (unsigned long) source.size, (unsigned long) target_size, (unsigned long) delta_size,
+        target_size ? 100.0 * (double) delta_size / (double) target_size : 0.0);
+    printf("%u copies, %u inserts with %u bytes, %u adds with %u runs (%u with a pattern) and %u added bytes\n",
+        s.num_copies, s.num_inserts, s.inserted_bytes, s.num_adds, s.num_runs, s.num_pattern_runs, s.added_bytes);
+    exit_code = 0;
+
+    cleanup:
+    free((void *) source.data);
+    free(target);
+    free(delta);
+    free(check.data);
+    return exit_code;
+}
+
+static int apply_file(const char *source_path, const char *delta_path, const char *target_path) {
+    Image source;
+    size_t delta_size;
+    IotcOtaFileSink target;
+    int exit_code = 1;
+
+    source.data = read_file(source_path, &source.size);
+    uint8_t *delta = read_file(delta_path, &delta_size);
+    if (!source.data || !delta) {
+        goto cleanup;
+    }
+    if (!iotc_ota_file_sink_init(&target, target_path)) {
+        fprintf(stderr, "The target path is too long\n");
+        goto cleanup;
+    }
+    if (apply(&source, delta, delta_size, &iotc_ota_file_sink, &target) || !target.is_complete) {
+        fprintf(stderr, "Unable to apply %s to %s\n", delta_path, source_path);
+        goto cleanup;
+    }
+    printf("Wrote %lu bytes to %s\n", (unsigned long) target.image_size, target_path);
+    print_digest("SHA-256: ", target.digest);
+    exit_code = 0;
+
+    cleanup:
+    free((void *) source.data);
+    free(delta);
+    return exit_code;
+}
+
+static int info(const char *delta_path) {
+    size_t size;
+    uint8_t *delta = read_file(delta_path, &size);
+    if (!delta) {
+        return 1;
+    }
+    if (size < IOTC_OTA_DELTA_HEADER_SIZE || 0 != memcmp(delta, IOTC_OTA_DELTA_MAGIC, 4)) {
+        fprintf(stderr, "%s is not a delta package\n", delta_path);
+        free(delta);
+        return 1;
+    }
+    printf("Version %u, %lu bytes\n", delta[4], (unsigned long) size);
+    printf("Source size: %lu\n", (unsigned long) (delta[8] | delta[9] << 8 | delta[10] << 16 | (uint32_t) delta[11] << 24));
+    printf("Target size: %lu\n", (unsigned long) (delta[12] | delta[13] << 8 | delta[14] << 16 | (uint32_t) delta[15] << 24));
+    print_digest("Source SHA-256: ", &delta[16]);
+    print_digest("Target SHA-256: ", &delta[16 + IOTCL_SHA256_DIGEST_SIZE]);
+    free(delta);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    Log.setLogLevel(LogLevel::ERROR);
+    if (5 == argc && 0 == strcmp(argv[1], "create")) {
+        return create(argv[2], argv[3], argv[4]);
+    } else if (5 == argc && 0 == strcmp(argv[1], "apply")) {
+        return apply_file(argv[2], argv[3], argv[4]);
+    } else if (3 == argc && 0 == strcmp(argv[1], "info")) {
+        return info(argv[2]);
+    }
+    fprintf(stderr, "Usage: %s create source.bin target.bin delta%s\n", argv[0], IOTC_OTA_DELTA_FILE_EXTENSION);
+    fprintf(stderr, "       %s apply source.bin delta%s target.bin\n", argv[0], IOTC_OTA_DELTA_FILE_EXTENSION);
+    fprintf(stderr, "       %s info delta%s\n", argv[0], IOTC_OTA_DELTA_FILE_EXTENSION);
+    return 2;
+}
@@ -0,0 +1,296 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: MIT
+# Copyright (C) 2024 Avnet
+# Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+
+"""
+Generates a typed C telemetry and command binding from an IoTConnect device template JSON file.
+
+The generated header contains a packed struct with one member for each template attribute
+and the generated source contains a telemetry serializer that writes the struct into a message created
+with iotcl_telemetry_create_in_buffer(), with all keys and punctuation pre-baked into PROGMEM strings.
+A command dispatch table is generated as well, which calls a handler function for each template command.
+The handler functions are declared in the generated header and must be implemented by the application,
+so that any drift between the template and the application code shows up as a compile or link error.
+
+Example:
+    python3 scripts/generate-template-binding.py files/avriot-template.json -o examples/avr-iot-sample
+"""
+
+import argparse
+import json
+import os
+import re
+import sys
+
+# Template attribute type -> (C member declaration format, JSON writer statement format)
+# The writer statement format receives the member access expression as {v}
+# and the name of the decimal precision macro as {precision}.
+ATTRIBUTE_TYPES = {
+    "STRING": ("const char *{name}", "iotcl_json_writer_string(w, {v});"),
+    "DATE": ("const char *{name}", "iotcl_json_writer_string(w, {v});"),
+    "DATETIME": ("const char *{name}", "iotcl_json_writer_string(w, {v});"),
+    "TIME": ("const char *{name}", "iotcl_json_writer_string(w, {v});"),
+    "INTEGER": ("int32_t {name}", "iotcl_json_writer_int32(w, {v});"),
+    "LONG": ("int32_t {name}", "iotcl_json_writer_int32(w, {v});"),
+    "DECIMAL": ("double {name}", "iotcl_json_writer_decimal(w, {v}, {precision});"),
+    "BOOLEAN": ("bool {name}", "iotcl_json_writer_bool(w, {v});"),
+    "BIT": ("bool {name}", "iotcl_json_writer_bool(w, {v});"),
+    "LATLONG": (
+        "double {name}[2]",
+        "iotcl_json_writer_char(w, '['); iotcl_json_writer_decimal(w, {v}[0], {precision}); "
+        "iotcl_json_writer_char(w, ','); iotcl_json_writer_decimal(w, {v}[1], {precision}); iotcl_json_writer_char(w, ']');"
+    ),
+}
+
+
+class GeneratorError(Exception):
+    pass
+
+
+def c_identifier(name):
+    identifier = re.sub(r"[^0-9A-Za-z_]", "_", name)
+    if not identifier or identifier[0].isdigit():
+        identifier = "_" + identifier
+    return identifier
+
+
+def camel_case(name):
+    return "".join(part[:1].upper() + part[1:] for part in re.split(r"[^0-9A-Za-z]+", name) if part)
+
+
+def c_string_literal(value):
+    escaped = value.replace("\\", "\\\\").replace("\"", "\\\"")
+    return "\"" + escaped + "\""
+
+
+def json_key(name):
+    # json.dumps takes care of escaping the name the same way the JSON writer would
+    return json.dumps(name, ensure_ascii=False)
+
+
+class Binding:
+    def __init__(self, template, prefix, decimal_precision):
+        self.prefix = prefix
+        self.macro_prefix = prefix.upper()
+        self.decimal_precision = decimal_precision
+        self.precision_macro = "%s_DECIMAL_PRECISION" % self.macro_prefix
+        self.type_prefix = camel_case(prefix)
+        self.template_code = template.get("code", prefix)
+        self.attributes = template.get("attributes") or []
+        self.commands = [c for c in (template.get("commands") or []) if not c.get("isOTACommand")]
+        self.key_definitions = []  # (identifier, json fragment)
+        self.writer_statements = []
+        self.struct_definitions = []
+        self.struct_members = []
+        self._build()
+
+    def _add_key(self, path, fragment):
+        identifier = "%s_KEY_%s" % (self.macro_prefix, c_identifier(path).upper())
+        self.key_definitions.append((identifier, fragment))
+        self.writer_statements.append("iotcl_json_writer_raw_P(w, %s);" % identifier)
+
+    def _member(self, attribute, context):
+        attribute_type = attribute.get("type")
+        if attribute_type not in ATTRIBUTE_TYPES:
+            raise GeneratorError("Attribute \"%s\"%s has unsupported type %s" % (attribute["name"], context, attribute_type))
+        declaration, writer = ATTRIBUTE_TYPES[attribute_type]
+        return declaration.format(name=c_identifier(attribute["name"])), writer
+
+    def _build(self):
+        separator = ""
+        for attribute in self.attributes:
+            name = attribute["name"]
+            member_name = c_identifier(name)
+            if attribute.get("type") == "OBJECT":
+                children = attribute.get("childs") or []
+                if not children:
+                    print("Warning: Skipping object \"%s\" without child attributes" % name, file=sys.stderr)
+                    continue
+                struct_name = "%sTelemetry%s" % (self.type_prefix, camel_case(name))
+                members = []
+                child_separator = ""
+                for child in children:
+                    declaration, writer = self._member(child, " of object \"%s\"" % name)
+                    members.append(declaration)
+                    fragment = child_separator + json_key(child["name"]) + ":"
+                    if not child_separator:
+                        fragment = separator + json_key(name) + ":{" + fragment
+                    self._add_key(name + "_" + child["name"], fragment)
+                    self.writer_statements.append(writer.format(
+                        v="t->%s.%s" % (member_name, c_identifier(child["name"])), precision=self.precision_macro))
+                    child_separator = ","
+                self.writer_statements.append("iotcl_json_writer_char(w, '}');")
+                self.struct_definitions.append((struct_name, members))
+                self.struct_members.append("%s %s" % (struct_name, member_name))
+            else:
+                declaration, writer = self._member(attribute, "")
+                self.struct_members.append(declaration)
+                self._add_key(name, separator + json_key(name) + ":")
+                self.writer_statements.append(writer.format(v="t->%s" % member_name, precision=self.precision_macro))
+            separator = ","
+
+    def command_handler_name(self, command):
+        return "%s_on_%s" % (self.prefix, c_identifier(command["command"]))
+
+    def header(self, source_name):
+        guard = "%s_BINDING_H" % self.macro_prefix
+        out = []
+        out.append(FILE_HEADER.format(source=source_name))
+        out.append("#ifndef %s" % guard)
+        out.append("#define %s" % guard)
+        out.append("")
+        out.append("#include <stdbool.h>")
+        out.append("#include <stdint.h>")
+        out.append("#include \"iotcl_telemetry.h\"")
+        out.append("#include \"iotcl_c2d.h\"")
+        out.append("")
+        out.append("#ifdef __cplusplus")
+        out.append("extern \"C\" {")
+        out.append("#endif")
+        out.append("")
+        out.append("#define %s_TEMPLATE_CODE %s" % (self.macro_prefix, c_string_literal(self.template_code)))
+        out.append("")
+        out.append("// Number of decimal places for DECIMAL attributes")
+        out.append("#ifndef %s" % self.precision_macro)
+        out.append("#define %s %d" % (self.precision_macro, self.decimal_precision))
+        out.append("#endif")
+        out.append("")
+        for struct_name, members in self.struct_definitions:
+            out.append("typedef struct __attribute__((packed)) {")
+            for member in members:
+                out.append("    %s;" % member)
+            out.append("} %s;" % struct_name)
+            out.append("")
+        out.append("typedef struct __attribute__((packed)) {")
+        for member in self.struct_members:
+            out.append("    %s;" % member)
+        out.append("} %sTelemetry;" % self.type_prefix)
+        out.append("")
+        out.append("// Writes all attributes into the current data set of a message created with iotcl_telemetry_create_in_buffer().")
+        out.append("// String attributes that are NULL will be sent as null.")
+        out.append("int %s_telemetry_serialize(const %sTelemetry *t, IotclMessageHandle message);" % (self.prefix, self.type_prefix))
+        out.append("")
+        if self.commands:
+            out.append("// Command handlers that need to be implemented by the application.")
+            out.append("// args points to the command arguments (the text after the command name and a space) or an empty string.")
+            for command in self.commands:
+                out.append("void %s(IotclC2dEventData data, const char *args);" % self.command_handler_name(command))
+            out.append("")
+        out.append("// Calls the handler of the received command.")
+        out.append("// Returns IOTCL_ERR_BAD_VALUE if the command is not a part of the template.")
+        out.append("int %s_dispatch_command(IotclC2dEventData data);" % self.prefix)
+        out.append("")
+        out.append("#ifdef __cplusplus")
+        out.append("}")
+        out.append("#endif")
+        out.append("")
+        out.append("#endif // %s" % guard)
+        out.append("")
+        return "\n".join(out)
+
+    def source(self, source_name, header_name):
+        out = []
+        out.append(FILE_HEADER.format(source=source_name))
+        out.append("#include <string.h>")
+        out.append("#include \"iotcl_cfg.h\"")
+        out.append("#include \"iotcl_pgmspace.h\"")
+        out.append("#include \"iotcl_json_writer.h\"")
+        out.append("#include \"%s\"" % header_name)
+        out.append("")
+        for identifier, fragment in self.key_definitions:
+            out.append("static const char %s[] PROGMEM = %s;" % (identifier, c_string_literal(fragment)))
+        out.append("")
+        out.append("static void %s_telemetry_write(IotclJsonWriter *w, void *context) {" % self.prefix)
+        out.append("    const %sTelemetry *t = (const %sTelemetry *) context;" % (self.type_prefix, self.type_prefix))
+        for statement in self.writer_statements:
+            out.append("    %s" % statement)
+        out.append("}")
+        out.append("")
+        out.append("int %s_telemetry_serialize(const %sTelemetry *t, IotclMessageHandle message) {" % (self.prefix, self.type_prefix))
+        out.append("    if (!t) {")
+        out.append("        return IOTCL_ERR_MISSING_VALUE;")
+        out.append("    }")
+        out.append("    return iotcl_telemetry_write_raw_values(message, %s_telemetry_write, (void *) t);" % self.prefix)
+        out.append("}")
+        out.append("")
+        out.append("typedef void (*%sCommandHandler)(IotclC2dEventData data, const char *args);" % self.type_prefix)
+        out.append("")
+        out.append("typedef struct {")
+        out.append("    const char *name; // PROGMEM")
+        out.append("    %sCommandHandler handler;" % self.type_prefix)
+        out.append("} %sCommandEntry;" % self.type_prefix)
+        out.append("")
+        for command in self.commands:
+            out.append("static const char %s_COMMAND_%s[] PROGMEM = %s;" % (
+                self.macro_prefix, c_identifier(command["command"]).upper(), c_string_literal(command["command"])))
+        out.append("")
+        if self.commands:
+            out.append("static const %sCommandEntry %s_commands[] PROGMEM = {" % (self.type_prefix, self.prefix))
+            for command in self.commands:
+                out.append("    {%s_COMMAND_%s, %s}," % (
+                    self.macro_prefix, c_identifier(command["command"]).upper(), self.command_handler_name(command)))
+            out.append("};")
+            out.append("")
+        out.append("int %s_dispatch_command(IotclC2dEventData data) {" % self.prefix)
+        out.append("    const char *command = iotcl_c2d_get_command(data);")
+        out.append("    if (!command) {")
+        out.append("        return IOTCL_ERR_MISSING_VALUE;")
+        out.append("    }")
+        if self.commands:
+            out.append("    for (size_t i = 0; i < sizeof(%s_commands) / sizeof(%s_commands[0]); i++) {" % (self.prefix, self.prefix))
+            out.append("        const char *name = (const char *) pgm_read_ptr(&%s_commands[i].name);" % self.prefix)
+            out.append("        size_t name_len = strlen_P(name);")
+            out.append("        if (0 == strncmp_P(command, name, name_len) && (command[name_len] == '\\0' || command[name_len] == ' ')) {")
+            out.append("            %sCommandHandler handler = (%sCommandHandler) pgm_read_ptr(&%s_commands[i].handler);" % (
+                self.type_prefix, self.type_prefix, self.prefix))
+            out.append("            handler(data, command[name_len] == ' ' ? &command[name_len + 1] : &command[name_len]);")
+            out.append("            return IOTCL_SUCCESS;")
+            out.append("        }")
+            out.append("    }")
+        out.append("    return IOTCL_ERR_BAD_VALUE;")
+        out.append("}")
+        out.append("")
+        return "\n".join(out)
+
+
+FILE_HEADER = """/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ *
+ * Generated by scripts/generate-template-binding.py from {source}. Do not edit.
+ */
+"""
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Generate a C telemetry and command binding from an IoTConnect device template.")
+    parser.add_argument("template", help="Device template JSON file exported from IoTConnect")
+    parser.add_argument("-o", "--output-dir", default=".", help="Directory where the generated files will be written")
+    parser.add_argument("-p", "--prefix", help="Prefix for generated file, type and function names. Defaults to the template code.")
+    parser.add_argument("-d", "--decimal-precision", type=int, default=4, choices=range(0, 10), metavar="0-9",
+                        help="Number of decimal places for DECIMAL attributes. Defaults to 4.")
+    args = parser.parse_args()
+
+    with open(args.template, "r", encoding="utf-8") as f:
+        template = json.load(f)
+
+    prefix = c_identifier((args.prefix or template.get("code") or "template").lower())
+    try:
+        binding = Binding(template, prefix, args.decimal_precision)
+    except GeneratorError as e:
+        print("Error: %s" % e, file=sys.stderr)
+        return 1
+
+    source_name = os.path.basename(args.template)
+    header_name = "%s_binding.h" % prefix
+    os.makedirs(args.output_dir, exist_ok=True)
+    with open(os.path.join(args.output_dir, header_name), "w", encoding="utf-8", newline="\n") as f:
+        f.write(binding.header(source_name))
+    with open(os.path.join(args.output_dir, "%s_binding.cpp" % prefix), "w", encoding="utf-8", newline="\n") as f:
+        f.write(binding.source(source_name, header_name))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -4,6 +4,7 @@
  */
 
 #include <util/delay.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -11,8 +12,10 @@
 
 #include "iotcl.h"
 #include "iotcl_cfg.h"
+#include "iotcl_internal.h"
 #include "http_client.h"
 #include "log.h"
+#include "timeout_timer.h"
 #include "iotc_http_request.h"
 
 // rough number of extra buffer bytes we need to not cause overflow when 
@@ -31,7 +34,80 @@
 #define HTTP_BODY_BUFFER_MIN_SIZE (64)
 #define HTTP_BODY_BUFFER_MAX_SIZE (1800)
 
-static int16_t fixed_http_client_read_body(char* buffer, const uint32_t buffer_size, const uint32_t request_bytes) {
+#if IOTC_HTTPS_READ_MAX_SIZE + HTTP_RESPONSE_BUFFER_SLACK > HTTP_BODY_BUFFER_MAX_SIZE
+#error "IOTC_HTTPS_READ_MAX_SIZE is larger than what the modem can return with one read"
+#endif
+
+// Reads of responses without a content length do not get smaller than this
+#define HTTP_BODY_READ_MIN_SIZE (HTTP_BODY_BUFFER_MIN_SIZE - HTTP_RESPONSE_BUFFER_SLACK)
+
+// How long to wait for the data to start after asking the modem for it
+#define HTTP_BODY_START_TIMEOUT_MS (1000)
+
+// For the result of a command that returns no data, like the AT command that wakes up the modem,
+// and anything unexpected before it
+#define HTTP_RESULT_BUFFER_SIZE (32)
+
+// "Range: bytes=4294967295-4294967295"
+#define HTTP_RANGE_HEADER_SIZE (36)
+
+// Host names up to this long are remembered, so that consecutive requests to the same host skip the configuration
+#define HTTP_CONFIGURED_HOST_MAX_LENGTH (64)
+
+static IotConnectHttpStats http_stats = {0};
+
+// The host that the modem HTTP client was configured for by the last request that got a response.
+// The modem keeps the configuration, so it is not sent again for the next request to the same host,
+// like the ranges of a download. Cleared when a request fails, in case the modem was reset.
+static char configured_host[HTTP_CONFIGURED_HOST_MAX_LENGTH] = "";
+
+// Waits for the three '<' bytes that start the data. The modem responds with ERROR instead if it has
+// no more data, which is detected right away rather than by waiting for the start bytes to time out.
+// Returns 1 when the data starts, 0 if there is no more data and -2 if it timed out.
+static int16_t wait_for_body_start(void) {
+    static const char error_marker[] = "ERROR";
+    uint8_t start_bytes = 3;
+    uint8_t error_bytes_matched = 0;
+    TimeoutTimer timeout_timer(HTTP_BODY_START_TIMEOUT_MS);
+    while (start_bytes > 0) {
+        int16_t data = SequansController.readByte();
+        if (data < 0) {
+            if (timeout_timer.hasTimedOut()) {
+                return -2;
+            }
+            continue;
+        }
+        if ('<' == data) {
+            start_bytes--;
+            continue;
+        }
+        if (data == error_marker[error_bytes_matched]) {
+            error_bytes_matched++;
+        } else {
+            error_bytes_matched = ('E' == data) ? 1 : 0;
+        }
+        if (sizeof(error_marker) - 1 == error_bytes_matched) {
+            SequansController.waitForByte('\n', HTTP_BODY_START_TIMEOUT_MS); // the rest of the line
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// SequansController.writeCommand() waits 200 ms before each command to clear what the modem sent before it.
+// There should be nothing after the +SQNHTTPRING that HttpClient waited for, so the clearing is only done
+// if the response is not the expected OK.
+static void wake_modem(void) {
+    char response[HTTP_RESULT_BUFFER_SIZE];
+    if (!SequansController.writeString(F("AT"), true)
+        || ResponseResult::OK != SequansController.readResponse(response, sizeof(response))) {
+        SequansController.writeCommand(F("AT"));
+    }
+}
+
+// Returns the number of bytes read, 0 if the modem has no more data, -2 if it timed out and -1 on error.
+// The modem needs to be woken up with an AT command before the first read of a response.
+static int16_t fixed_http_client_read_body(char* buffer, const uint32_t buffer_size, const uint32_t request_bytes, bool is_first_read) {
 
     // Safeguard against the limitation in the Sequans AT command parameter
     // for the response receive command.
@@ -52,10 +128,15 @@ static int16_t fixed_http_client_read_body(char* buffer, const uint32_t buffer_s
 
     // Fix for bringing the modem out of idling and prevent timeout whilst
     // waiting for modem response during the next AT command
-    SequansController.writeCommand(F("AT"));
+    if (is_first_read) {
+        wake_modem();
+        http_stats.num_round_trips++;
+    }
 
     // We send the buffer size with the receive command so that we only
     // receive that. The rest will be flushed from the modem.
+    http_stats.num_reads++;
+    http_stats.num_round_trips++;
     if (!SequansController.writeString(F("AT+SQNHTTPRCV=0,%lu"),
                                        true,
                                        request_bytes)) {
@@ -63,14 +144,11 @@ static int16_t fixed_http_client_read_body(char* buffer, const uint32_t buffer_s
         return -1;
     }
 
-    // We receive three start bytes '<', have to wait for them
-    uint8_t start_bytes = 3;
-    while (start_bytes > 0) {
-        if (SequansController.waitForByte('<', 1000)) {
-            start_bytes--;
-        } else {
-            return -2; // timed out
-        }
+    unsigned long wait_start = millis();
+    int16_t start = wait_for_body_start();
+    http_stats.wait_ms += millis() - wait_start;
+    if (start <= 0) {
+        return start;
     }
 
     // Now we are ready to receive the payload. We only check for error and
@@ -86,113 +164,351 @@ static int16_t fixed_http_client_read_body(char* buffer, const uint32_t buffer_s
     return strlen(buffer);
 }
 
-int iotconnect_https_request(
-        IotConnectHttpResponse *response,
-        const char *host,
-        const char *path,
-        const char *send_str
-) {
-    response->data = NULL;
-    if (!HttpClient.configure(host, 443, true)) {
-        Log.error(F("Failed to configure https client"));
-        return IOTCL_ERR_FAILED;
+// Reads exactly size bytes of the body, which can be binary, unlike fixed_http_client_read_body() that
+// stops at a null byte. The caller knows how much is left from the content length, so the modem sends all of it.
+// Returns size, 0 if the modem has no more data, -2 if it timed out and -1 on error.
+static int16_t read_body_exact(char *buffer, uint16_t size, bool is_first_read) {
+    if (is_first_read) {
+        wake_modem();
+        http_stats.num_round_trips++;
     }
 
-    HttpResponse http_rsp;
+    http_stats.num_reads++;
+    http_stats.num_round_trips++;
+    if (!SequansController.writeString(F("AT+SQNHTTPRCV=0,%u"), true, (unsigned int) size)) {
+        Log.error(F("Was not able to write HTTP read body AT command\n"));
+        return -1;
+    }
+
+    unsigned long wait_start = millis();
+    int16_t start = wait_for_body_start();
+    http_stats.wait_ms += millis() - wait_start;
+    if (start <= 0) {
+        return start;
+    }
+
+    TimeoutTimer timeout_timer(HTTP_BODY_START_TIMEOUT_MS);
+    for (uint16_t i = 0; i < size;) {
+        int16_t data = SequansController.readByte();
+        if (data < 0) {
+            if (timeout_timer.hasTimedOut()) {
+                Log.errorf(F("HTTP: The modem stopped after %u of %u bytes\n"), (unsigned int) i, (unsigned int) size);
+                return -2;
+            }
+            continue;
+        }
+        buffer[i++] = (char) data;
+        timeout_timer.reset();
+    }
+
+    char response[HTTP_RESULT_BUFFER_SIZE];
+    if (ResponseResult::OK != SequansController.readResponse(response, sizeof(response))) {
+        return -1;
+    }
+    return (int16_t) size;
+}
+
+// Sends the request with an extra header, or "" for none. HttpClient formats the header as a string,
+// so it must not be NULL. Errors only if there was no response.
+// http_rsp.data_size is the content length, or 0 for chunked transfers.
+static int https_send_request(const char *host, const char *path, const char *send_str, const char *header, HttpResponse *http_rsp) {
+    if (0 != strcmp(configured_host, host)) {
+        configured_host[0] = '\0';
+        http_stats.num_round_trips++;
+        if (!HttpClient.configure(host, 443, true)) {
+            Log.error(F("Failed to configure https client"));
+            return IOTCL_ERR_FAILED;
+        }
+    }
+
+    http_stats.num_round_trips++;
     if (!send_str || 0 == strlen(send_str)) {
         Log.debugf(F("get: %s %s\n"), host, path);
-        http_rsp = HttpClient.get(path);
+        *http_rsp = HttpClient.get(path, header);
     } else {
         Log.debugf(F("post: %s %s >>%s<<\n"), host, path, send_str);
-        http_rsp = HttpClient.post(
+        *http_rsp = HttpClient.post(
             path,
             send_str,
-            NULL,
+            header,
             HttpClientClass::CONTENT_TYPE_APPLICATION_JSON,
             HTTP_DEFAULT_TIMEOUT_MS
         );
     }
 
-    if (0 == http_rsp.status_code) {
+    if (0 == http_rsp->status_code) {
+        configured_host[0] = '\0';
         Log.errorf(F("Unable to get response from the server for URL https://%s%s\n"), host, path);
         return IOTCL_ERR_FAILED;
     }
+    if (strlen(host) < sizeof(configured_host)) {
+        strcpy(configured_host, host);
+    }
 
-    if (200 != http_rsp.status_code) {
-        Log.warnf(F("Unexpected HTTP response status code %u\n"), http_rsp.status_code);
+    Log.debugf(F("Reported data size is %lu\n"), (unsigned long) http_rsp->data_size);
+    return IOTCL_SUCCESS;
+}
+
+// The size of the next read of a response without a content length, so that it takes about
+// IOTC_HTTPS_READ_TARGET_MS at the throughput of the previous read
+static uint32_t next_read_size(uint32_t bytes_read, unsigned long elapsed_ms) {
+    if (0 == elapsed_ms) {
+        return IOTC_HTTPS_READ_MAX_SIZE; // faster than the clock can tell
     }
+    uint32_t size = (uint32_t) ((uint64_t) bytes_read * IOTC_HTTPS_READ_TARGET_MS / elapsed_ms);
+    if (size < HTTP_BODY_READ_MIN_SIZE) {
+        return HTTP_BODY_READ_MIN_SIZE;
+    }
+    return size > IOTC_HTTPS_READ_MAX_SIZE ? IOTC_HTTPS_READ_MAX_SIZE : size;
+}
 
-    Log.debugf(F("Reported data size is %u\n"), http_rsp.data_size);
+static void finish_stats(size_t total_read, unsigned long read_start) {
+    http_stats.read_ms = millis() - read_start;
+    http_stats.body_bytes = (uint32_t) total_read;
+    http_stats.bytes_per_s = http_stats.read_ms ? (uint32_t) ((uint64_t) total_read * 1000 / http_stats.read_ms) : 0;
+    Log.debugf(F("HTTP: %lu bytes in %u reads and %u round trips. Waited %lu ms for the response and %lu ms for the data. %lu B/s\n"),
+        (unsigned long) http_stats.body_bytes,
+        (unsigned int) http_stats.num_reads,
+        (unsigned int) http_stats.num_round_trips,
+        (unsigned long) http_stats.request_ms,
+        (unsigned long) http_stats.wait_ms,
+        (unsigned long) http_stats.bytes_per_s
+    );
+}
 
-    const size_t BUFFER_SIZE = 2000;
-    // we need to allow slack for the buffer
-    const size_t REQUEST_DATA_MAX_SIZE = BUFFER_SIZE - HTTP_BODY_BUFFER_MIN_SIZE;
+// content_length is optional. It is set to the length from the response headers, or 0 if it is not known,
+// before the body is passed to sink_fn.
+static int https_request_streamed(
+        const char *host,
+        const char *path,
+        const char *send_str,
+        IotConnectHttpBodySink sink_fn,
+        void *context,
+        uint32_t *content_length
+) {
+    HttpResponse http_rsp;
+    memset(&http_stats, 0, sizeof(http_stats));
+    unsigned long request_start = millis();
+    int status = https_send_request(host, path, send_str, "", &http_rsp);
+    http_stats.request_ms = millis() - request_start;
+    if (status) {
+        return status; // called function will print the error
+    }
+    if (200 != http_rsp.status_code) {
+        Log.warnf(F("Unexpected HTTP response status code %u\n"), http_rsp.status_code);
+    }
+    uint32_t data_size = http_rsp.data_size;
+    if (content_length) {
+        *content_length = data_size;
+    }
 
-    if (!http_rsp.data_size) {
+    // With a content length, the buffer only needs to fit the body, and exactly as much as is left is read.
+    // Otherwise, the read size follows the throughput.
+    uint32_t read_size = IOTC_HTTPS_READ_MAX_SIZE;
+    if (!data_size) {
         // we didn't get content length, so must be chunked transfer
-        Log.debugf(F("HTTP Client: Did not get content-length. Getting up to %d bytes of data\n"), REQUEST_DATA_MAX_SIZE);
-    } else if (http_rsp.data_size > REQUEST_DATA_MAX_SIZE) {
-        Log.errorf(F("HTTP Client: Content length is %d but the buffer can accomodate up to %d bytes of data\n"), (int) http_rsp.data_size, REQUEST_DATA_MAX_SIZE);
-        return IOTCL_ERR_OVERFLOW;
+        Log.debug(F("HTTP Client: Did not get content-length. Reading until the data runs out"));
+    } else if (data_size < read_size) {
+        read_size = data_size;
+    }
+    size_t buffer_size = read_size + HTTP_RESPONSE_BUFFER_SLACK;
+    if (buffer_size < HTTP_BODY_BUFFER_MIN_SIZE) {
+        buffer_size = HTTP_BODY_BUFFER_MIN_SIZE;
     }
 
-    response->data = (char *) iotcl_malloc(BUFFER_SIZE);
-    if (!response->data ) {
-        Log.errorf(F("HTTP Client: Failed to allocate %d bytes!\n"), (int) BUFFER_SIZE);
+    IOTCL_HEAP_TAG_SCOPE(IOTCL_HEAP_TAG_HTTP);
+    char *buffer = (char *) iotcl_malloc(buffer_size);
+    if (!buffer) {
+        Log.errorf(F("HTTP Client: Failed to allocate %d bytes!\n"), (int) buffer_size);
         return IOTCL_ERR_OUT_OF_MEMORY;
     }
-    memset(response->data, 0, BUFFER_SIZE);
 
-    // do roughly 1k at a time as there could be other limitations on the modem side
-    const size_t CHUNK_SIZE = REQUEST_DATA_MAX_SIZE / 2; 
     size_t total_read = 0;
-    int16_t chunk_bytes_read = 0;
-    int data_chunk_size = 0; // we need this value checked at the end of do/while
-    do {
-        // read up to CHUNK_SIZE bytes at a time...
-        data_chunk_size = CHUNK_SIZE;
-        // ...unless would we exceed the buffer by the next request
-        if (total_read + CHUNK_SIZE > REQUEST_DATA_MAX_SIZE) {
-            data_chunk_size = REQUEST_DATA_MAX_SIZE - total_read;
-        }
-
-        size_t buffer_remaining = BUFFER_SIZE - total_read;
-        if (buffer_remaining > HTTP_BODY_BUFFER_MAX_SIZE) {
-            // we need to not hit the error condition where buffer is too 
-            // just use a truncated buffer range unless we reach the boundary
-            buffer_remaining = HTTP_BODY_BUFFER_MAX_SIZE - 1;
-        } else if(buffer_remaining < HTTP_BODY_BUFFER_MIN_SIZE) {
-            Log.error(F("HTTP Client: Response overflow. Ran out of buffer space!\n"));
-            iotconnect_free_https_response(response);
-            return IOTCL_ERR_OVERFLOW;  
+    unsigned long read_start = millis();
+    while (true) {
+        if (data_size) {
+            if (total_read >= data_size) {
+                break; // no need to ask the modem for more
+            }
+            if (data_size - total_read < read_size) {
+                read_size = (uint32_t) (data_size - total_read);
+            }
         }
-        chunk_bytes_read = fixed_http_client_read_body(&response->data[total_read], buffer_remaining, data_chunk_size);
+        buffer[0] = '\0';
+        unsigned long chunk_start = millis();
+        int16_t chunk_bytes_read = fixed_http_client_read_body(buffer, (uint32_t) buffer_size, read_size, 0 == http_stats.num_reads);
         if (chunk_bytes_read == -2) {
             // timed out waiting for data. That's all we got
             Log.debug(F("HTTP: No mode data."));
             break;
         } else if (chunk_bytes_read == 0) {
             break;
-        } else if (chunk_bytes_read > 0) {
-            total_read += (size_t) chunk_bytes_read;
-            Log.debugf(F("HTTP: Read %d bytes\n"), (int) chunk_bytes_read);
-        } else {
+        } else if (chunk_bytes_read < 0) {
             Log.debugf(F("HTTP: Error %d\n"), (int) chunk_bytes_read);
-            iotconnect_free_https_response(response);
-            return IOTCL_ERR_FAILED;
+            status = IOTCL_ERR_FAILED;
+            break;
         }
-        // we are done when we get the full chunk
-    } while (chunk_bytes_read == data_chunk_size);
+        total_read += (size_t) chunk_bytes_read;
+        Log.debugf(F("HTTP: Read %d bytes\n"), (int) chunk_bytes_read);
+        status = sink_fn(context, buffer, (size_t) chunk_bytes_read);
+        if (status) {
+            break;
+        }
+        if (!data_size) {
+            // without a content length, we are done when we get less than we asked for
+            if ((uint32_t) chunk_bytes_read < read_size) {
+                break;
+            }
+            read_size = next_read_size((uint32_t) chunk_bytes_read, millis() - chunk_start);
+        }
+    }
+    iotcl_free(buffer);
+    finish_stats(total_read, read_start);
 
-    if (0 == total_read) {
+    if (!status && 0 == total_read) {
         Log.error(F("Http response was empty"));
-        iotconnect_free_https_response(response);
+        status = IOTCL_ERR_FAILED;
+    } else if (!status && data_size && total_read < data_size) {
+        Log.errorf(F("HTTP: Got %lu of %lu bytes\n"), (unsigned long) total_read, (unsigned long) data_size);
+        status = IOTCL_ERR_FAILED;
+    }
+    return status;
+}
+
+int iotconnect_https_request_streamed(
+        const char *host,
+        const char *path,
+        const char *send_str,
+        IotConnectHttpBodySink sink_fn,
+        void *context
+) {
+    return https_request_streamed(host, path, send_str, sink_fn, context, NULL);
+}
+
+int iotconnect_https_get_range(
+        const char *host,
+        const char *path,
+        uint32_t offset,
+        uint32_t length,
+        IotConnectHttpBodySink sink_fn,
+        void *context,
+        IotConnectHttpRangeResponse *response
+) {
+    char header[HTTP_RANGE_HEADER_SIZE];
+    HttpResponse http_rsp;
+
+    response->status_code = 0;
+    response->content_length = 0;
+    if (0 == length || (uint32_t) (offset + length - 1) < offset) {
+        return IOTCL_ERR_BAD_VALUE;
+    }
+    snprintf(header, sizeof(header), "Range: bytes=%lu-%lu", (unsigned long) offset, (unsigned long) (offset + length - 1));
+
+    memset(&http_stats, 0, sizeof(http_stats));
+    unsigned long request_start = millis();
+    int status = https_send_request(host, path, NULL, header, &http_rsp);
+    http_stats.request_ms = millis() - request_start;
+    if (status) {
+        return status;
+    }
+    response->status_code = http_rsp.status_code;
+    response->content_length = http_rsp.data_size;
+    if (206 != http_rsp.status_code && 200 != http_rsp.status_code) {
+        return IOTCL_SUCCESS; // for the caller to handle
+    }
+    if (0 == http_rsp.data_size) {
+        // A binary body can only be read exactly when its size is known
+        Log.error(F("HTTP: The response to a range request has no content length"));
         return IOTCL_ERR_FAILED;
     }
-    response->data[total_read] = '\0'; // make sure that the srtring is terminated
+
+    uint32_t buffer_size = http_rsp.data_size < IOTC_HTTPS_READ_MAX_SIZE ? http_rsp.data_size : IOTC_HTTPS_READ_MAX_SIZE;
+    IOTCL_HEAP_TAG_SCOPE(IOTCL_HEAP_TAG_HTTP);
+    char *buffer = (char *) iotcl_malloc(buffer_size);
+    if (!buffer) {
+        Log.errorf(F("HTTP Client: Failed to allocate %d bytes!\n"), (int) buffer_size);
+        return IOTCL_ERR_OUT_OF_MEMORY;
+    }
+
+    uint32_t total_read = 0;
+    unsigned long read_start = millis();
+    while (IOTCL_SUCCESS == status && total_read < http_rsp.data_size) {
+        uint32_t read_size = http_rsp.data_size - total_read;
+        if (read_size > buffer_size) {
+            read_size = buffer_size;
+        }
+        int16_t bytes_read = read_body_exact(buffer, (uint16_t) read_size, 0 == http_stats.num_reads);
+        if (bytes_read <= 0) {
+            Log.errorf(F("HTTP: Got %lu of %lu bytes\n"), (unsigned long) total_read, (unsigned long) http_rsp.data_size);
+            status = IOTCL_ERR_FAILED;
+            break;
+        }
+        total_read += (uint32_t) bytes_read;
+        status = sink_fn(context, buffer, (size_t) bytes_read);
+    }
+    iotcl_free(buffer);
+    finish_stats(total_read, read_start);
+    return status;
+}
+
+void iotconnect_https_get_last_stats(IotConnectHttpStats *stats) {
+    *stats = http_stats;
+}
+
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+    uint32_t content_length;    // From the response headers, or 0 if it is not known
+} HttpBodyCollector;
+
+// Appends the chunks to the response data. With a content length, the body is allocated once and filled in place.
+// Otherwise, the buffer grows by half each time, so that the body is copied a few times instead of once per chunk.
+static int https_collect_body(void *context, const char *data, size_t data_length) {
+    HttpBodyCollector *collector = (HttpBodyCollector *) context;
+    size_t needed = collector->length + data_length + 1;
+    if (needed > collector->capacity) {
+        size_t capacity = collector->capacity + collector->capacity / 2;
+        if (collector->content_length >= needed - 1) {
+            capacity = (size_t) collector->content_length + 1;
+        } else if (capacity < needed) {
+            capacity = needed;
+        }
+        IOTCL_HEAP_TAG_SCOPE(IOTCL_HEAP_TAG_HTTP);
+        char *grown = (char *) iotcl_malloc(capacity);
+        if (!grown) {
+            Log.errorf(F("HTTP Client: Failed to allocate %d bytes!\n"), (int) capacity);
+            return IOTCL_ERR_OUT_OF_MEMORY;
+        }
+        if (collector->length) {
+            memcpy(grown, collector->data, collector->length);
+        }
+        iotcl_free(collector->data);
+        collector->data = grown;
+        collector->capacity = capacity;
+    }
+    memcpy(&collector->data[collector->length], data, data_length);
+    collector->length += data_length;
+    collector->data[collector->length] = '\0'; // make sure that the string is terminated
     return IOTCL_SUCCESS;
 }
 
+int iotconnect_https_request(
+        IotConnectHttpResponse *response,
+        const char *host,
+        const char *path,
+        const char *send_str
+) {
+    HttpBodyCollector collector = {0};
+    int status = https_request_streamed(host, path, send_str, https_collect_body, &collector, &collector.content_length);
+    if (status) {
+        iotcl_free(collector.data);
+        collector.data = NULL;
+    }
+    response->data = collector.data;
+    return status;
+}
+
 void iotconnect_free_https_response(IotConnectHttpResponse *response) {
     if (response->data) {
         iotcl_free(response->data);
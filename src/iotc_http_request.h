@@ -6,10 +6,47 @@
 #ifndef IOTC_HTTP_REQUEST_H
 #define IOTC_HTTP_REQUEST_H
 
+#include <stddef.h>
+#include <stdint.h>
+
+// The most that is read from the modem at a time, which is also the size of the buffer for the body.
+// Responses with a content length get a buffer that fits them if they are smaller.
+// The modem can return up to 1790 bytes with one read.
+#ifndef IOTC_HTTPS_READ_MAX_SIZE
+#define IOTC_HTTPS_READ_MAX_SIZE 968
+#endif
+
+// Responses without a content length are read in parts that should take about this long
+// at the throughput measured while reading the previous part.
+#ifndef IOTC_HTTPS_READ_TARGET_MS
+#define IOTC_HTTPS_READ_TARGET_MS 250
+#endif
+
 typedef struct IotConnectHttpResponse {
     char *data; // add flexibility for future, but at this point we only have response data
 } IotConnectHttpResponse;
 
+// Receives the response body chunk by chunk. The data is not null terminated and is only valid during the call.
+// Return IOTCL_SUCCESS to receive the next chunk. Any other value stops the request and is returned from it.
+typedef int (*IotConnectHttpBodySink)(void *context, const char *data, size_t data_length);
+
+// The response to a GET with a Range header
+typedef struct {
+    uint16_t status_code;       // 206 for the range, 200 if the server sent the whole resource instead, 416 if offset is past its end
+    uint32_t content_length;    // Of the body, which is the whole resource for 200. 0 if unknown.
+} IotConnectHttpRangeResponse;
+
+// Where the time of a request went
+typedef struct {
+    uint32_t body_bytes;
+    uint32_t request_ms;        // From configuring the request to the response from the server
+    uint32_t read_ms;           // Reading the body from the modem
+    uint32_t wait_ms;           // The part of read_ms spent waiting for the modem to start sending the data
+    uint32_t bytes_per_s;       // The body over read_ms
+    uint16_t num_reads;         // AT+SQNHTTPRCV commands
+    uint16_t num_round_trips;   // All AT commands of the request, including the reads
+} IotConnectHttpStats;
+
 // Helper to deal with http chunked transfers which are always returned by iotconnect services.
 // Free data with iotconnect_free_https_response
 int iotconnect_https_request(
@@ -21,5 +58,33 @@ int iotconnect_https_request(
 
 void iotconnect_free_https_response(IotConnectHttpResponse* response);
 
+// Same as iotconnect_https_request(), but passes the body to sink_fn as each chunk is read from the modem,
+// so that only one chunk is held in memory and the size of the response is not limited.
+int iotconnect_https_request_streamed(
+        const char *host,
+        const char *path,
+        const char *send_str,
+        IotConnectHttpBodySink sink_fn,
+        void *context
+);
+
+// GETs length bytes of the resource from offset with a Range header and passes the body to sink_fn,
+// which also gets the whole resource if the server does not support ranges and responds with 200.
+// The body is read exactly as it is, so it can be binary. A response with a status code other than 200 or 206
+// has no body and is not an error, so that the caller can tell the end of the resource from a failure.
+// The response is filled in before the body is passed to sink_fn.
+int iotconnect_https_get_range(
+        const char *host,
+        const char *path,
+        uint32_t offset,
+        uint32_t length,
+        IotConnectHttpBodySink sink_fn,
+        void *context,
+        IotConnectHttpRangeResponse *response
+);
+
+// Returns the statistics of the last request, also when it failed
+void iotconnect_https_get_last_stats(IotConnectHttpStats *stats);
+
 
 #endif // IOTC_DISCOVERY_CLIENT_H
\ No newline at end of file
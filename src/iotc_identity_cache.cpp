@@ -0,0 +1,209 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include <Arduino.h>
+#include "log.h"
+
+#include "iotcl.h"
+#include "iotcl_util.h"
+#include "iotc_identity_cache.h"
+
+#define IOTC_IDENTITY_CACHE_MAGIC 0x4349 // "IC"
+
+// Followed by the strings of iotc_identity_cache_strings[] in that order, each with its terminator
+typedef struct {
+    uint16_t magic;             // must be first. See iotc_identity_cache_invalidate()
+    uint8_t version;
+    uint8_t connection_type;
+    uint16_t length;            // of the strings
+    uint16_t device_crc;        // of the CPID, environment and DUID
+    uint32_t created;           // time() when the record was stored
+    uint16_t crc;               // of the header with this field set to zero, and the strings
+} IotcIdentityCacheHeader;
+
+// The stored settings. Empty strings are stored for the missing ones.
+static const size_t iotc_identity_cache_strings[] = {
+    offsetof(IotclMqttConfig, host),
+    offsetof(IotclMqttConfig, client_id),
+    offsetof(IotclMqttConfig, username),
+    offsetof(IotclMqttConfig, pub_rpt),
+    offsetof(IotclMqttConfig, pub_ack),
+    offsetof(IotclMqttConfig, sub_c2d),
+    offsetof(IotclMqttConfig, cd),
+};
+
+#define IOTC_IDENTITY_CACHE_NUM_STRINGS (sizeof(iotc_identity_cache_strings) / sizeof(iotc_identity_cache_strings[0]))
+
+static char **config_string(IotclMqttConfig *mc, size_t index) {
+    return (char **) ((char *) mc + iotc_identity_cache_strings[index]);
+}
+
+static uint16_t device_crc(const char *cpid, const char *env, const char *duid) {
+    // with the terminators, so that the values can't run into each other
+    uint16_t crc = iotcl_crc16_update(0xFFFF, cpid, strlen(cpid) + 1);
+    crc = iotcl_crc16_update(crc, env, strlen(env) + 1);
+    return iotcl_crc16_update(crc, duid, strlen(duid) + 1);
+}
+
+static uint16_t header_crc(const IotcIdentityCacheHeader *h) {
+    IotcIdentityCacheHeader copy = *h;
+    copy.crc = 0;
+    return iotcl_crc16_update(0xFFFF, &copy, sizeof(copy));
+}
+
+// Moves the strings into the library configuration. Returns false if they are not all there or if out of memory.
+static bool configure_from_strings(const char *strings, size_t length) {
+    IotclMqttConfig *mc = iotcl_mqtt_get_config();
+    IotclMqttConfig values = {0};
+    const char *p = strings;
+    bool is_valid = true;
+
+    for (size_t i = 0; i < IOTC_IDENTITY_CACHE_NUM_STRINGS && is_valid; i++) {
+        const char *end = (const char *) memchr(p, 0, length - (size_t) (p - strings));
+        if (!end) {
+            is_valid = false;
+        } else if (end != p) {
+            *config_string(&values, i) = iotcl_strdup(p);
+            is_valid = NULL != *config_string(&values, i);
+            p = end + 1;
+        } else if (offsetof(IotclMqttConfig, username) == iotc_identity_cache_strings[i]) {
+            p = end + 1; // username is optional
+        } else {
+            is_valid = false;
+        }
+    }
+    if (is_valid) {
+        values.version = iotcl_strdup(IOTCL_PROTOCOL_VERSION_DEFAULT);
+        is_valid = NULL != values.version;
+    }
+    if (!is_valid) {
+        for (size_t i = 0; i < IOTC_IDENTITY_CACHE_NUM_STRINGS; i++) {
+            iotcl_free(*config_string(&values, i));
+        }
+        iotcl_free(values.version);
+        return false;
+    }
+    *mc = values; // the library now owns the values
+    return true;
+}
+
+bool iotc_identity_cache_load(
+        IotConnectConnectionType connection_type,
+        const char *cpid,
+        const char *env,
+        const char *duid,
+        uint32_t ttl
+) {
+    IotclMqttConfig *mc = iotcl_mqtt_get_config();
+    IotcIdentityCacheHeader h;
+
+    if (mc->host || mc->client_id || mc->sub_c2d) {
+        Log.error(F("The library's MQTT configuration should not be set when loading the cached settings"));
+        return false;
+    }
+    if (!iotc_identity_cache_storage_read(0, &h, sizeof(h))
+        || IOTC_IDENTITY_CACHE_MAGIC != h.magic
+        || IOTC_IDENTITY_CACHE_VERSION != h.version
+        || sizeof(h) + h.length > iotc_identity_cache_storage_size()
+    ) {
+        return false; // nothing was stored yet, or an older version was
+    }
+    if (connection_type != (IotConnectConnectionType) h.connection_type || device_crc(cpid, env, duid) != h.device_crc) {
+        Log.info(F("The cached MQTT settings are for a different device configuration"));
+        return false;
+    }
+    time_t now = time(NULL);
+    if (h.created < (uint32_t) IOTC_IDENTITY_CACHE_MIN_TIME || now < (time_t) h.created || (uint32_t) (now - (time_t) h.created) >= ttl) {
+        Log.info(F("The cached MQTT settings have expired"));
+        return false;
+    }
+
+    char *strings = (char *) iotcl_malloc(h.length);
+    if (!strings) {
+        Log.error(F("Out of memory while loading the cached MQTT settings"));
+        return false;
+    }
+    bool is_loaded = false;
+    if (!iotc_identity_cache_storage_read(sizeof(h), strings, h.length)) {
+        Log.error(F("Unable to read the cached MQTT settings"));
+    } else if (iotcl_crc16_update(header_crc(&h), strings, h.length) != h.crc) {
+        Log.warn(F("The cached MQTT settings are corrupted"));
+    } else if (!configure_from_strings(strings, h.length)) {
+        Log.error(F("Unable to load the cached MQTT settings"));
+    } else {
+        is_loaded = true;
+    }
+    iotcl_free(strings);
+    return is_loaded;
+}
+
+void iotc_identity_cache_store(
+        IotConnectConnectionType connection_type,
+        const char *cpid,
+        const char *env,
+        const char *duid
+) {
+    IotclMqttConfig *mc = iotcl_mqtt_get_config();
+    IotcIdentityCacheHeader h;
+    size_t length = 0;
+
+    time_t now = time(NULL);
+    if (now < (time_t) IOTC_IDENTITY_CACHE_MIN_TIME) {
+        Log.warn(F("The clock is not synced. The MQTT settings will not be cached."));
+        return;
+    }
+    if (!mc->host || !mc->client_id || !mc->sub_c2d) {
+        return; // nothing to connect with
+    }
+    for (size_t i = 0; i < IOTC_IDENTITY_CACHE_NUM_STRINGS; i++) {
+        const char *value = *config_string(mc, i);
+        length += (value ? strlen(value) : 0) + 1;
+    }
+    if (sizeof(h) + length > iotc_identity_cache_storage_size()) {
+        Log.warnf(F("The MQTT settings need %u bytes, which is more than the cache can hold\n"), (unsigned int) (sizeof(h) + length));
+        iotc_identity_cache_invalidate();
+        return;
+    }
+
+    memset(&h, 0, sizeof(h)); // also the padding, which is a part of the CRC
+    h.magic = IOTC_IDENTITY_CACHE_MAGIC;
+    h.version = IOTC_IDENTITY_CACHE_VERSION;
+    h.connection_type = (uint8_t) connection_type;
+    h.length = (uint16_t) length;
+    h.device_crc = device_crc(cpid, env, duid);
+    h.created = (uint32_t) now;
+
+    // The strings are written before the header, so that the old header fails the CRC check
+    // if the write is interrupted
+    uint16_t crc = header_crc(&h);
+    size_t offset = sizeof(h);
+    for (size_t i = 0; i < IOTC_IDENTITY_CACHE_NUM_STRINGS; i++) {
+        const char *value = *config_string(mc, i);
+        if (!value) {
+            value = "";
+        }
+        size_t size = strlen(value) + 1;
+        crc = iotcl_crc16_update(crc, value, size);
+        if (!iotc_identity_cache_storage_write(offset, value, size)) {
+            Log.error(F("Unable to cache the MQTT settings"));
+            return;
+        }
+        offset += size;
+    }
+    h.crc = crc;
+    if (!iotc_identity_cache_storage_write(0, &h, sizeof(h))) {
+        Log.error(F("Unable to cache the MQTT settings"));
+    }
+}
+
+void iotc_identity_cache_invalidate(void) {
+    IotcIdentityCacheHeader h;
+    if (iotc_identity_cache_storage_read(0, &h, sizeof(h)) && IOTC_IDENTITY_CACHE_MAGIC == h.magic) {
+        uint16_t magic = 0;
+        iotc_identity_cache_storage_write(0, &magic, sizeof(magic));
+    }
+}
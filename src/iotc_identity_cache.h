@@ -0,0 +1,66 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * Keeps the MQTT settings from discovery and identity (iotcl_mqtt_get_config()) in persistent storage,
+ * so that the device can connect to the broker at boot without the two HTTPS requests.
+ *
+ * The record holds the connection type, a CRC of the CPID, environment and DUID that it was obtained for,
+ * the time when it was stored and the settings as strings, protected by a CRC-16.
+ * A record is used only if it is intact, is for the same device configuration and was stored less than
+ * the TTL ago according to the synced clock. A record with an unknown age is never used.
+ */
+
+#ifndef IOTC_IDENTITY_CACHE_H
+#define IOTC_IDENTITY_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include "iotconnect.h"
+
+// Bump if the record layout changes, so that old records are ignored
+#define IOTC_IDENTITY_CACHE_VERSION 1
+
+// Where the record is kept in the EEPROM of the AVR, and how much of it the record can take.
+// The AVR128DB48 has 512 bytes of EEPROM. The rest is left to the application.
+#ifndef IOTC_IDENTITY_CACHE_EEPROM_OFFSET
+#define IOTC_IDENTITY_CACHE_EEPROM_OFFSET 0
+#endif
+#ifndef IOTC_IDENTITY_CACHE_EEPROM_SIZE
+#define IOTC_IDENTITY_CACHE_EEPROM_SIZE 384
+#endif
+
+// Records stored while the clock was earlier than this (2024-01-01) were stored with an unsynced clock
+#define IOTC_IDENTITY_CACHE_MIN_TIME 1704067200L
+
+// Configures the library MQTT settings from the stored record if there is a valid one that is younger than ttl seconds.
+// The library MQTT settings should be empty. Returns false if there was nothing to use.
+bool iotc_identity_cache_load(
+        IotConnectConnectionType connection_type,
+        const char *cpid,
+        const char *env,
+        const char *duid,
+        uint32_t ttl
+);
+
+// Stores the current library MQTT settings. Does nothing if the clock is not synced.
+void iotc_identity_cache_store(
+        IotConnectConnectionType connection_type,
+        const char *cpid,
+        const char *env,
+        const char *duid
+);
+
+// Makes sure that the stored record is not used again
+void iotc_identity_cache_invalidate(void);
+
+// The persistent storage for the record, provided by the platform at link time.
+// On the AVR-IoT Cellular board, it is the EEPROM (see iotc_identity_cache_eeprom.cpp).
+size_t iotc_identity_cache_storage_size(void);
+bool iotc_identity_cache_storage_read(size_t offset, void *data, size_t size);
+bool iotc_identity_cache_storage_write(size_t offset, const void *data, size_t size);
+
+#endif // IOTC_IDENTITY_CACHE_H
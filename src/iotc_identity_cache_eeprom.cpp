@@ -0,0 +1,30 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+#include <avr/eeprom.h>
+#include "iotc_identity_cache.h"
+
+// The identity cache storage in the EEPROM of the AVR
+
+size_t iotc_identity_cache_storage_size(void) {
+    return IOTC_IDENTITY_CACHE_EEPROM_SIZE;
+}
+
+bool iotc_identity_cache_storage_read(size_t offset, void *data, size_t size) {
+    if (offset + size > IOTC_IDENTITY_CACHE_EEPROM_SIZE) {
+        return false;
+    }
+    eeprom_read_block(data, (const void *) (IOTC_IDENTITY_CACHE_EEPROM_OFFSET + offset), size);
+    return true;
+}
+
+bool iotc_identity_cache_storage_write(size_t offset, const void *data, size_t size) {
+    if (offset + size > IOTC_IDENTITY_CACHE_EEPROM_SIZE) {
+        return false;
+    }
+    // only the bytes that changed are written, which saves the EEPROM from wearing out
+    eeprom_update_block(data, (void *) (IOTC_IDENTITY_CACHE_EEPROM_OFFSET + offset), size);
+    return true;
+}
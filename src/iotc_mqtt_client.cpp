@@ -5,33 +5,105 @@
 
 
 #include <stddef.h>
+#include <stdlib.h>
 #include <string.h>
 #include <Arduino.h>
 #include "log.h"
 #include "lte.h"
 #include "ecc608.h"
 #include "mqtt_client.h"
+#include "sequans_controller.h"
+#include "iotcl_internal.h"
 #include "iotc_mqtt_client.h"
 
 #define MQTT_SECURE_PORT 8883
-#define IOTC_MQTT_CONN_RETRY_INTERVAL_MS      5000
+#define IOTC_MQTT_C2D_READ_TIMEOUT_MS         1000
+#define IOTC_MQTT_CONNECT_TIMEOUT_MS          60000
+#define IOTC_MQTT_PUBLISH_PROMPT_TIMEOUT_MS   2000
+#define IOTC_MQTT_PUBLISH_MAX_PAYLOAD_SIZE    1024 // This is a limitation of the modem
 #define IOTC_MAX_MQTT_CONN_RETRIES            3
 
-static bool disconnect_received = false;
+static volatile bool disconnect_received = false;
 static IotConnectMqttClientConfig* c = NULL;
 
+// Connection state machine. See iotc_mqtt_client_step().
+static IotConnectConnectionStatus state = IOTC_CS_UNDEFINED;
+static unsigned long state_start_ms = 0; // when the current state was entered
+static unsigned long backoff_ms = 0; // the current delay between attempts. 0 until an attempt fails.
+static uint8_t num_attempts = 0;
+static uint8_t num_auth_failures = 0; // TLS setup failures and broker rejections in a row
+static bool is_blocking_init = false; // the number of attempts is limited while iotc_mqtt_client_init() waits
+static uint32_t backoff_random = 1; // xorshift32 state of the backoff jitter. See iotc_mqtt_client_seed_backoff().
+
 typedef struct {
-    bool has_message;
     char topic[MQTT_TOPIC_MAX_LENGTH];
     uint16_t message_length;
     int32_t message_id;
-} IotcMqttLastC2dMessage;
+} IotcMqttC2dMessage;
+
+// Single producer (the receive callback, which runs in the ISR) and single consumer (iotc_mqtt_client_loop()) ring.
+// Each side only writes its own index, and the indices run from 0 to 2 * IOTC_MQTT_C2D_QUEUE_SIZE - 1,
+// so that a full queue can be told apart from an empty one without wasting a slot.
+typedef struct {
+    IotcMqttC2dMessage slots[IOTC_MQTT_C2D_QUEUE_SIZE];
+    volatile uint8_t head; // written by the producer
+    volatile uint8_t tail; // written by the consumer
+    IotcMqttC2dQueueStats stats; // written by the producer
+} IotcMqttC2dQueue;
+
+#define IOTC_MQTT_C2D_QUEUE_INDEX_WRAP (2 * IOTC_MQTT_C2D_QUEUE_SIZE)
+
+#if IOTC_MQTT_C2D_QUEUE_SIZE < 1 || IOTC_MQTT_C2D_QUEUE_SIZE > 127
+#error "IOTC_MQTT_C2D_QUEUE_SIZE must be between 1 and 127"
+#endif
+
+static IotcMqttC2dQueue c2d_queue = {0};
+
+typedef enum {
+    IOTC_MQTT_PUBLISH_FREE = 0,
+    IOTC_MQTT_PUBLISH_QUEUED,       // waiting for a place in the in-flight window, or to be retried
+    IOTC_MQTT_PUBLISH_IN_FLIGHT,    // passed to the modem and waiting for the publish URC
+    IOTC_MQTT_PUBLISH_DONE          // the URC was received and the result needs to be reported
+} IotcMqttPublishState;
+
+// Outbound messages. The publish URCs run in the ISR and only move IN_FLIGHT messages to DONE.
+// Everything else is done by iotc_mqtt_client_loop() and iotc_mqtt_client_send_message().
+typedef struct {
+    char *data;                 // The topic, its null terminator and the payload in one allocation
+    uint16_t payload_length;
+    uint16_t publish_id;        // Assigned by this client and reported to the delivery callback
+    uint16_t send_sequence;     // The order in which messages were passed to the modem
+    unsigned long sent_ms;      // When the message was passed to the modem, or when it was queued for a retry
+    uint8_t delivery_class;     // IotclDeliveryClass
+    bool is_retry;              // A critical message that failed before. It waits IOTC_MQTT_PUBLISH_RETRY_DELAY_MS.
+    volatile int32_t message_id; // Assigned by the modem. -1 until it is reported.
+    volatile int8_t result;     // Status code from the publish URC
+    volatile uint8_t state;     // IotcMqttPublishState
+} IotcMqttPublishSlot;
+
+#if IOTC_MQTT_PUBLISH_QUEUE_SIZE < 1 || IOTC_MQTT_PUBLISH_WINDOW < 1 || IOTC_MQTT_PUBLISH_WINDOW > IOTC_MQTT_PUBLISH_QUEUE_SIZE
+#error "IOTC_MQTT_PUBLISH_WINDOW must be between 1 and IOTC_MQTT_PUBLISH_QUEUE_SIZE"
+#endif
+
+static IotcMqttPublishSlot publish_slots[IOTC_MQTT_PUBLISH_QUEUE_SIZE] = {0};
+static uint16_t last_publish_id = 0;
+static uint16_t next_send_sequence = 0;
 
-static IotcMqttLastC2dMessage last_c2d_message = {0};
+// Compares 16 bit sequence numbers that can wrap around
+static bool is_sequence_before(uint16_t a, uint16_t b) {
+    return (int16_t) (a - b) < 0;
+}
+
+static uint8_t c2d_queue_count(uint8_t head, uint8_t tail) {
+    return (uint8_t) ((head + IOTC_MQTT_C2D_QUEUE_INDEX_WRAP - tail) % IOTC_MQTT_C2D_QUEUE_INDEX_WRAP);
+}
 
+static uint8_t c2d_queue_next(uint8_t index) {
+    return (uint8_t) ((index + 1) % IOTC_MQTT_C2D_QUEUE_INDEX_WRAP);
+}
 
-// NOTE: Will run in ISR. Not in real use temporarily.
-// TODO: Handle this and implement offloading the message from the ISR
+
+// NOTE: Will run in ISR.
 static void iotc_mqtt_client_on_receive(
     const char* topic,
     const uint16_t message_length,
@@ -48,127 +120,696 @@ static void iotc_mqtt_client_on_receive(
             itoa(message_id, buff, 10);
             Log.raw(buff);
         }
-        if (last_c2d_message.has_message) {
-            Log.warn(F("Previous C2D message was not processed. Consider increasing the frequency of calls to iotconnect_sdk_loop() or reducing C2D messaging rate"));
+        c2d_queue.stats.num_received++;
+        uint8_t head = c2d_queue.head;
+        uint8_t pending = c2d_queue_count(head, c2d_queue.tail);
+        if (pending >= IOTC_MQTT_C2D_QUEUE_SIZE) {
+            c2d_queue.stats.num_dropped++;
+            Log.warn(F("C2D message queue is full. Dropping the message. Consider increasing the frequency of calls to iotconnect_sdk_loop() or IOTC_MQTT_C2D_QUEUE_SIZE"));
+            return;
+        }
+        IotcMqttC2dMessage *slot = &c2d_queue.slots[head % IOTC_MQTT_C2D_QUEUE_SIZE];
+        strncpy(slot->topic, topic, sizeof(slot->topic) - 1);
+        slot->topic[sizeof(slot->topic) - 1] = '\0';
+        slot->message_id = message_id;
+        slot->message_length = message_length;
+        if (pending + 1 > c2d_queue.stats.max_pending) {
+            c2d_queue.stats.max_pending = pending + 1;
+        }
+        // publish the slot to the consumer only after it is filled
+        c2d_queue.head = c2d_queue_next(head);
+}
+
+// Returns the next byte received from the modem, or -1 if none arrives in time
+static int16_t iotc_mqtt_client_read_byte(void) {
+    unsigned long start = millis();
+    while (!SequansController.isRxReady()) {
+        if (millis() - start > IOTC_MQTT_C2D_READ_TIMEOUT_MS) {
+            return -1;
+        }
+        delay(1);
+    }
+    return SequansController.readByte();
+}
+
+// Does the same as MqttClient.readMessage(), but passes the payload to the filter in small chunks as it arrives,
+// so that it does not need a buffer of the message size.
+static bool iotc_mqtt_client_read_c2d_message(const IotcMqttC2dMessage *message, IotclC2dFilter *filter) {
+    char chunk[IOTC_MQTT_C2D_READ_CHUNK_SIZE];
+
+    SequansController.clearReceiveBuffer();
+    if (message->message_id < 0) {
+        SequansController.writeString(F("AT+SQNSMQTTRCVMESSAGE=0,\"%s\""), true, message->topic);
+    } else {
+        SequansController.writeString(F("AT+SQNSMQTTRCVMESSAGE=0,\"%s\",%u"), true, message->topic, (unsigned int) message->message_id);
+    }
+    // The payload is preceded by \r\n
+    if (!SequansController.waitForByte('\r', 100) || !SequansController.waitForByte('\n', 100)) {
+        return false;
+    }
+
+    uint16_t remaining = message->message_length;
+    while (remaining > 0) {
+        uint16_t chunk_length = (remaining < sizeof(chunk)) ? remaining : (uint16_t) sizeof(chunk);
+        for (uint16_t i = 0; i < chunk_length; i++) {
+            int16_t byte = iotc_mqtt_client_read_byte();
+            if (byte < 0) {
+                return false;
+            }
+            chunk[i] = (char) byte;
+        }
+        // keep reading if the filter fails, so that the modem response is consumed. The error is reported at the end.
+        iotcl_c2d_filter_feed(filter, chunk, chunk_length);
+        remaining -= chunk_length;
+    }
+
+    // The payload is followed by \r\nOK\r\n
+    return SequansController.readResponse() == ResponseResult::OK;
+}
+
+// Parses up to max_fields comma separated numbers of URC data like "0,12,-3" into fields.
+// Returns the number of fields parsed.
+static uint8_t parse_urc_numbers(const char *urc_data, long *fields, uint8_t max_fields) {
+    uint8_t num_fields = 0;
+    const char *p = urc_data;
+    while (num_fields < max_fields) {
+        char *end;
+        fields[num_fields] = strtol(p, &end, 10);
+        if (end == p) {
+            break;
+        }
+        num_fields++;
+        if (',' != *end) {
+            break;
+        }
+        p = end + 1;
+    }
+    return num_fields;
+}
+
+// Returns the in-flight message that was passed to the modem first, among those without a known message id
+static IotcMqttPublishSlot *find_oldest_unidentified_publish(void) {
+    IotcMqttPublishSlot *oldest = NULL;
+    for (uint8_t i = 0; i < IOTC_MQTT_PUBLISH_QUEUE_SIZE; i++) {
+        IotcMqttPublishSlot *slot = &publish_slots[i];
+        if (IOTC_MQTT_PUBLISH_IN_FLIGHT == slot->state && slot->message_id < 0
+            && (!oldest || is_sequence_before(slot->send_sequence, oldest->send_sequence))) {
+            oldest = slot;
+        }
+    }
+    return oldest;
+}
+
+// NOTE: Will run in ISR.
+// "+SQNSMQTTPUBLISH: 0,<message id>" follows the payload and tells which message id the modem assigned.
+// The modem accepts one publish command at a time, so it belongs to the first message that does not have an id yet.
+static void on_mqtt_publish_accepted(char *urc_data) {
+    long fields[2];
+    if (parse_urc_numbers(urc_data, fields, 2) < 2) {
+        return;
+    }
+    IotcMqttPublishSlot *slot = find_oldest_unidentified_publish();
+    if (slot) {
+        slot->message_id = (int32_t) fields[1];
+    }
+}
+
+// NOTE: Will run in ISR.
+// "+SQNSMQTTONPUBLISH: 0,<message id>,<status code>" is received once the message is delivered or has failed.
+static void on_mqtt_publish_done(char *urc_data) {
+    long fields[3];
+    if (parse_urc_numbers(urc_data, fields, 3) < 3) {
+        return;
+    }
+    IotcMqttPublishSlot *slot = NULL;
+    for (uint8_t i = 0; i < IOTC_MQTT_PUBLISH_QUEUE_SIZE; i++) {
+        if (IOTC_MQTT_PUBLISH_IN_FLIGHT == publish_slots[i].state && publish_slots[i].message_id == (int32_t) fields[1]) {
+            slot = &publish_slots[i];
+            break;
+        }
+    }
+    if (!slot) {
+        // the id was not reported, so it is assumed that messages complete in order
+        slot = find_oldest_unidentified_publish();
+    }
+    if (slot) {
+        slot->result = (int8_t) fields[2];
+        slot->state = IOTC_MQTT_PUBLISH_DONE;
+    }
+}
+
+static void iotc_mqtt_client_complete_publish(IotcMqttPublishSlot *slot, IotConnectDeliveryStatus status) {
+    uint16_t publish_id = slot->publish_id;
+    iotcl_free(slot->data);
+    slot->data = NULL;
+    slot->state = IOTC_MQTT_PUBLISH_FREE;
+    if (IOTC_DS_DELIVERED != status) {
+        Log.warnf(F("Message %u was not delivered. Status: %d\n"), publish_id, (int) status);
+    }
+    if (c && c->delivery_cb) {
+        c->delivery_cb(publish_id, status);
+    }
+}
+
+// Critical messages are queued again instead of being reported as failed
+static void iotc_mqtt_client_finish_publish(IotcMqttPublishSlot *slot, IotConnectDeliveryStatus status) {
+    if (IOTC_DS_DELIVERED != status && IOTCL_DC_CRITICAL == slot->delivery_class) {
+        Log.warnf(F("Critical message %u was not delivered. Status: %d. Retrying...\n"), slot->publish_id, (int) status);
+        slot->is_retry = true;
+        slot->sent_ms = millis();
+        slot->state = IOTC_MQTT_PUBLISH_QUEUED;
+        return;
+    }
+    iotc_mqtt_client_complete_publish(slot, status);
+}
+
+// Fails the in-flight messages, which the modem will not report after the connection is gone.
+// Queued fire-and-forget messages are discarded, as they would be stale by the time the client reconnects,
+// and so are all other queued messages if they will not be sent.
+static void iotc_mqtt_client_fail_publishes(bool is_discarding_queued) {
+    for (uint8_t i = 0; i < IOTC_MQTT_PUBLISH_QUEUE_SIZE; i++) {
+        IotcMqttPublishSlot *slot = &publish_slots[i];
+        if (IOTC_MQTT_PUBLISH_IN_FLIGHT == slot->state) {
+            iotc_mqtt_client_finish_publish(slot, IOTC_DS_FAILED);
+        } else if (IOTC_MQTT_PUBLISH_DONE == slot->state) {
+            iotc_mqtt_client_finish_publish(slot, slot->result ? IOTC_DS_FAILED : IOTC_DS_DELIVERED);
+        }
+        if (IOTC_MQTT_PUBLISH_QUEUED == slot->state
+            && (is_discarding_queued || IOTCL_DC_AT_MOST_ONCE == slot->delivery_class)) {
+            iotc_mqtt_client_complete_publish(slot, IOTC_DS_DISCARDED);
+        }
+    }
+}
+
+// Critical messages are sent first and fire-and-forget messages last
+static uint8_t publish_priority(const IotcMqttPublishSlot *slot) {
+    switch (slot->delivery_class) {
+        case IOTCL_DC_CRITICAL:
+            return 0;
+        case IOTCL_DC_AT_MOST_ONCE:
+            return 2;
+        default:
+            return 1;
+    }
+}
+
+// Returns the queued message that should be sent next, or NULL if none is ready
+static IotcMqttPublishSlot *find_next_publish(void) {
+    IotcMqttPublishSlot *next = NULL;
+    for (uint8_t i = 0; i < IOTC_MQTT_PUBLISH_QUEUE_SIZE; i++) {
+        IotcMqttPublishSlot *slot = &publish_slots[i];
+        if (IOTC_MQTT_PUBLISH_QUEUED != slot->state) {
+            continue;
+        }
+        if (slot->is_retry && millis() - slot->sent_ms < IOTC_MQTT_PUBLISH_RETRY_DELAY_MS) {
+            continue;
+        }
+        if (!next
+            || publish_priority(slot) < publish_priority(next)
+            || (publish_priority(slot) == publish_priority(next) && is_sequence_before(slot->publish_id, next->publish_id))) {
+            next = slot;
+        }
+    }
+    return next;
+}
+
+// Passes the message to the modem. This waits only for the modem, and not for the broker.
+// Sends the publish command and waits for the modem to ask for the payload. The slot is in flight once this succeeds.
+static bool iotc_mqtt_client_begin_publish(IotcMqttPublishSlot *slot, const char *topic) {
+    SequansController.writeString(F("AT+SQNSMQTTPUBLISH=0,\"%s\",%u,%u"),
+        true,
+        topic,
+        (unsigned int) (IOTCL_DC_AT_MOST_ONCE == slot->delivery_class ? AT_MOST_ONCE : AT_LEAST_ONCE),
+        (unsigned int) slot->payload_length
+    );
+    if (!SequansController.waitForByte('>', IOTC_MQTT_PUBLISH_PROMPT_TIMEOUT_MS)) {
+        Log.warn(F("Timed out waiting to deliver MQTT payload."));
+        return false;
+    }
+    slot->message_id = -1;
+    slot->send_sequence = next_send_sequence++;
+    slot->sent_ms = millis();
+    slot->state = IOTC_MQTT_PUBLISH_IN_FLIGHT; // before the payload, as the URCs can arrive right after it
+    return true;
+}
+
+// Reads the response of the modem after the payload was written
+static bool iotc_mqtt_client_end_publish(IotcMqttPublishSlot *slot) {
+    if (SequansController.readResponse() != ResponseResult::OK) {
+        noInterrupts();
+        bool is_in_flight = (IOTC_MQTT_PUBLISH_IN_FLIGHT == slot->state);
+        slot->state = IOTC_MQTT_PUBLISH_QUEUED;
+        interrupts();
+        if (is_in_flight) {
+            return false;
+        }
+        slot->state = IOTC_MQTT_PUBLISH_DONE; // the URC was already received, so the modem did take it
+    }
+    return true;
+}
+
+static bool iotc_mqtt_client_write_publish(IotcMqttPublishSlot *slot) {
+    const char *topic = slot->data;
+    const char *payload = slot->data + strlen(topic) + 1;
+    if (!iotc_mqtt_client_begin_publish(slot, topic)) {
+        return false;
+    }
+    SequansController.writeBytes((const uint8_t *) payload, slot->payload_length);
+    return iotc_mqtt_client_end_publish(slot);
+}
+
+// Passes the streamed payload to the modem, but never more than the length given in the publish command
+static bool modem_payload_sink(void *context, const char *data, size_t data_len) {
+    size_t *remaining = (size_t *) context;
+    if (data_len > *remaining) {
+        return false;
+    }
+    *remaining -= data_len;
+    return SequansController.writeBytes((const uint8_t *) data, data_len);
+}
+
+// Reports finished messages, times out the ones that were not reported in time,
+// and passes queued messages to the modem while the in-flight window allows it.
+static void iotc_mqtt_client_process_publishes(void) {
+    uint8_t num_in_flight = 0;
+    for (uint8_t i = 0; i < IOTC_MQTT_PUBLISH_QUEUE_SIZE; i++) {
+        IotcMqttPublishSlot *slot = &publish_slots[i];
+        if (IOTC_MQTT_PUBLISH_DONE == slot->state) {
+            iotc_mqtt_client_finish_publish(slot, slot->result ? IOTC_DS_FAILED : IOTC_DS_DELIVERED);
+        } else if (IOTC_MQTT_PUBLISH_IN_FLIGHT == slot->state) {
+            if (millis() - slot->sent_ms <= IOTC_MQTT_PUBLISH_TIMEOUT_MS) {
+                num_in_flight++;
+                continue;
+            }
+            noInterrupts();
+            bool is_timed_out = (IOTC_MQTT_PUBLISH_IN_FLIGHT == slot->state);
+            if (is_timed_out) {
+                slot->state = IOTC_MQTT_PUBLISH_QUEUED; // keeps the URC handler away until it is freed
+            }
+            interrupts();
+            iotc_mqtt_client_finish_publish(slot, is_timed_out ? IOTC_DS_TIMED_OUT : (slot->result ? IOTC_DS_FAILED : IOTC_DS_DELIVERED));
+        }
+    }
+
+    while (num_in_flight < IOTC_MQTT_PUBLISH_WINDOW) {
+        IotcMqttPublishSlot *next = find_next_publish();
+        if (!next) {
+            break;
+        }
+        if (!iotc_mqtt_client_write_publish(next)) {
+            iotc_mqtt_client_finish_publish(next, IOTC_DS_FAILED);
+            break; // the modem is not responding. Try the rest later.
         }
-        strcpy(last_c2d_message.topic, topic);
-        last_c2d_message.message_id = message_id;
-        last_c2d_message.message_length = message_length;
-        last_c2d_message.has_message = true;
+        num_in_flight++;
+    }
 }
 
+// NOTE: Will run in ISR.
 static void on_mqtt_disconnected(void) {
+    // the state machine reports the disconnect from iotc_mqtt_client_loop()
     disconnect_received = true;
-    if (c->status_cb) {
-        c->status_cb(IOTC_CS_MQTT_DISCONNECTED);
+}
+
+static void iotc_mqtt_client_set_state(IotConnectConnectionStatus new_state) {
+    state = new_state;
+    state_start_ms = millis();
+    if (c && c->status_cb) {
+        c->status_cb(new_state);
+    }
+}
+
+// Seeds the backoff jitter from the client ID, which contains the DUID, and the time of the connect,
+// so that devices that lost the connection together do not draw the same delays. random() is not seeded
+// by the SDK or the Arduino core, and reseeding it would affect the application.
+static void iotc_mqtt_client_seed_backoff(const char *client_id) {
+    uint32_t hash = 2166136261UL; // FNV-1a
+    for (const char *p = client_id; p && *p; p++) {
+        hash = (hash ^ (uint8_t) *p) * 16777619UL;
+    }
+    hash ^= (uint32_t) micros();
+    backoff_random = hash ? hash : 1;
+}
+
+static unsigned long iotc_mqtt_client_next_backoff(unsigned long previous_ms) {
+    if (previous_ms < IOTC_MQTT_BACKOFF_BASE_MS) {
+        previous_ms = IOTC_MQTT_BACKOFF_BASE_MS;
+    }
+    unsigned long upper_ms = (previous_ms > IOTC_MQTT_BACKOFF_CAP_MS / 3) ? IOTC_MQTT_BACKOFF_CAP_MS : previous_ms * 3;
+    backoff_random ^= backoff_random << 13;
+    backoff_random ^= backoff_random >> 17;
+    backoff_random ^= backoff_random << 5;
+    return IOTC_MQTT_BACKOFF_BASE_MS + backoff_random % (upper_ms - IOTC_MQTT_BACKOFF_BASE_MS + 1);
+}
+
+static void iotc_mqtt_client_start_backoff(bool is_auth_failure) {
+    IotclMqttConfig* mc = iotcl_mqtt_get_config();
+    MqttClient.end();
+    if (is_auth_failure && num_auth_failures < UINT8_MAX) {
+        num_auth_failures++;
+    }
+    if (num_attempts < UINT8_MAX) {
+        num_attempts++;
+    }
+    bool is_persistent = c->auto_reconnect && !is_blocking_init;
+    if (!is_persistent && num_attempts >= IOTC_MAX_MQTT_CONN_RETRIES) {
+        Log.errorf(F("Failed to connect to MQTT after %d retries\n"), IOTC_MAX_MQTT_CONN_RETRIES);
+        iotc_mqtt_client_fail_publishes(true);
+        iotc_mqtt_client_set_state(IOTC_CS_MQTT_DISCONNECTED);
+        return;
+    }
+    backoff_ms = iotc_mqtt_client_next_backoff(backoff_ms);
+    Log.errorf(F("Failed to connect to MQTT using host:%s, client id:%s, username:%s. Retrying in %lu ms\n"),
+        mc->host ? mc->host : "[none]",
+        mc->client_id ? mc->client_id : "[none]",
+        mc->username ? mc->username : "[empty]",
+        backoff_ms
+    );
+    iotc_mqtt_client_set_state(IOTC_CS_MQTT_BACKOFF);
+}
+
+// Returns true if the MQTT settings are there to make the next connection attempt
+static bool iotc_mqtt_client_refresh_config_if_needed(void) {
+    IotclMqttConfig* mc = iotcl_mqtt_get_config();
+    bool has_config = mc->host && mc->client_id && mc->sub_c2d;
+    if (!c->rediscovery_cb || (has_config && num_auth_failures < IOTC_MQTT_REDISCOVERY_THRESHOLD)) {
+        return has_config;
+    }
+    Log.warn(F("Repeated MQTT connection failures. Running discovery again..."));
+    if (!c->rediscovery_cb()) {
+        Log.error(F("Discovery failed"));
+        return false;
+    }
+    num_auth_failures = 0;
+    return true;
+}
+
+// Reads one pending C2D message from the modem and passes it to the callback.
+static void iotc_mqtt_client_process_c2d_message(void) {
+    IotcMqttC2dMessage *message = &c2d_queue.slots[c2d_queue.tail % IOTC_MQTT_C2D_QUEUE_SIZE];
+    char c2d_buffer[IOTC_MQTT_C2D_BUFFER_SIZE];
+    IotclC2dFilter filter;
+    size_t c2d_length;
+    if (0 == message->message_id) {
+        // BUG: if QOS is zero, the AVR IoT library returns 0 instead of -1.
+        // This causes the fetch with msg_id = 0 to fail.
+        message->message_id = -1;
+    }
+    iotcl_c2d_filter_init(&filter, c2d_buffer, sizeof(c2d_buffer));
+    bool is_read = iotc_mqtt_client_read_c2d_message(message, &filter);
+    // the slot can be reused once the message is read from the modem
+    c2d_queue.tail = c2d_queue_next(c2d_queue.tail);
+    if (!is_read) {
+        Log.error(F("Failed to read the C2D message from the modem"));
+        return;
+    }
+    if (iotcl_c2d_filter_finish(&filter, &c2d_length)) {
+        return; // called function will print the error
+    }
+    c->c2d_msg_cb(c2d_buffer, c2d_length);
+}
+
+// Does one step of the connection state machine.
+// Returns true if the next step can be done right away, or false if the state machine is waiting for something.
+static bool iotc_mqtt_client_step(void) {
+    IotclMqttConfig* mc = iotcl_mqtt_get_config();
+    switch (state) {
+        case IOTC_CS_MQTT_TLS:
+            disconnect_received = false;
+            if (!Lte.isConnected()) {
+                Log.error(F("LTE is not connected"));
+                iotc_mqtt_client_start_backoff(false);
+                return false;
+            }
+            if (!iotc_mqtt_client_refresh_config_if_needed()) {
+                iotc_mqtt_client_start_backoff(false);
+                return false;
+            }
+            mc = iotcl_mqtt_get_config(); // may have been replaced
+            // This configures TLS, requests the connection and waits for the handshake, so it is the one step
+            // that runs past IOTC_MQTT_LOOP_BUDGET_MS. See IOTC_MQTT_TLS_STEP_TIMEOUT_MS.
+            if (!MqttClient.begin(mc->client_id,
+                mc->host,
+                MQTT_SECURE_PORT,
+                true,
+                60,
+                true,
+                mc->username ? mc->username : "",
+                "",
+                IOTC_MQTT_TLS_STEP_TIMEOUT_MS)) {
+                iotc_mqtt_client_start_backoff(true);
+                return false;
+            }
+            iotc_mqtt_client_set_state(IOTC_CS_MQTT_CONNECTING);
+            return true;
+
+        case IOTC_CS_MQTT_CONNECTING:
+            if (MqttClient.isConnected()) {
+                iotc_mqtt_client_set_state(IOTC_CS_MQTT_SUBSCRIBING);
+                return true;
+            }
+            if (disconnect_received) {
+                Log.errorf(F("Received a disconnect while attempting to connect to MQTT using host:%s\n"), mc->host);
+                iotc_mqtt_client_start_backoff(true); // most likely rejected by the broker
+            } else if (millis() - state_start_ms > IOTC_MQTT_CONNECT_TIMEOUT_MS) {
+                Log.errorf(F("Timed out while attempting to connect to MQTT using host:%s\n"), mc->host);
+                iotc_mqtt_client_start_backoff(false);
+            }
+            return false;
+
+        case IOTC_CS_MQTT_SUBSCRIBING:
+            MqttClient.onReceive(iotc_mqtt_client_on_receive);
+            SequansController.registerCallback(F("SQNSMQTTPUBLISH"), on_mqtt_publish_accepted);
+            SequansController.registerCallback(F("SQNSMQTTONPUBLISH"), on_mqtt_publish_done);
+            if (!MqttClient.subscribe(mc->sub_c2d, AT_LEAST_ONCE)) {
+                Log.errorf(F("ERROR: Unable to subscribe for C2D messages topic %s!\n"), mc->sub_c2d);
+                iotc_mqtt_client_start_backoff(false);
+                return false;
+            }
+            num_attempts = 0;
+            num_auth_failures = 0;
+            backoff_ms = 0;
+            iotc_mqtt_client_set_state(IOTC_CS_MQTT_CONNECTED);
+            return true;
+
+        case IOTC_CS_MQTT_BACKOFF:
+            if (millis() - state_start_ms < backoff_ms) {
+                return false;
+            }
+            iotc_mqtt_client_set_state(IOTC_CS_MQTT_TLS);
+            return true;
+
+        case IOTC_CS_MQTT_CONNECTED:
+            if (disconnect_received || !MqttClient.isConnected()) {
+                Log.warn(F("The MQTT connection was lost"));
+                // queued messages can still be sent after reconnecting
+                iotc_mqtt_client_fail_publishes(!c->auto_reconnect);
+                iotc_mqtt_client_set_state(IOTC_CS_MQTT_DISCONNECTED);
+                if (c->auto_reconnect) {
+                    // the same settings and the C2D subscription will be used again
+                    iotc_mqtt_client_start_backoff(false);
+                }
+                return false;
+            }
+            iotc_mqtt_client_process_publishes();
+            // process pending messages one by one in the order in which they were received
+            if (0 == c2d_queue_count(c2d_queue.head, c2d_queue.tail)) {
+                return false;
+            }
+            iotc_mqtt_client_process_c2d_message();
+            return true;
+
+        default:
+            return false;
     }
 }
 
 void iotc_mqtt_client_disconnect(void) {
     Log.info(F("Closing the MQTT connection"));
     MqttClient.end();
+    iotc_mqtt_client_fail_publishes(true);
+    if (IOTC_CS_MQTT_DISCONNECTED != state && IOTC_CS_UNDEFINED != state) {
+        iotc_mqtt_client_set_state(IOTC_CS_MQTT_DISCONNECTED);
+    }
 }
 
 bool iotc_mqtt_client_is_connected(void) {
-    return MqttClient.isConnected();
+    return IOTC_CS_MQTT_CONNECTED == state && MqttClient.isConnected();
 }
 
-bool iotc_mqtt_client_send_message(const char* topic, const char *message) {
-    return MqttClient.publish(topic, message, AT_LEAST_ONCE);
+IotConnectConnectionStatus iotc_mqtt_client_get_status(void) {
+    return state;
 }
 
-void iotc_mqtt_client_loop() {
-    if (!MqttClient.isConnected()) {
-        if (c->status_cb) {
-            c->status_cb(IOTC_CS_MQTT_DISCONNECTED);
-            return;
+static uint16_t iotc_mqtt_client_next_publish_id(void) {
+    last_publish_id++;
+    if (0 == last_publish_id) {
+        last_publish_id = 1; // 0 means that the message was not queued
+    }
+    return last_publish_id;
+}
+
+uint16_t iotc_mqtt_client_publish(const char *topic, const char *message, IotclDeliveryClass delivery_class) {
+    if (!c || IOTC_CS_UNDEFINED == state || IOTC_CS_MQTT_DISCONNECTED == state) {
+        Log.error(F("Attempted publish without being connected to a broker"));
+        return 0;
+    }
+    size_t topic_length = strlen(topic);
+    size_t payload_length = strlen(message);
+    if (payload_length > IOTC_MQTT_PUBLISH_MAX_PAYLOAD_SIZE) {
+        Log.errorf(F("MQTT message is longer than the max size of %d\n"), IOTC_MQTT_PUBLISH_MAX_PAYLOAD_SIZE);
+        return 0;
+    }
+    IotcMqttPublishSlot *slot = NULL;
+    IotcMqttPublishSlot *oldest_droppable = NULL;
+    for (uint8_t i = 0; i < IOTC_MQTT_PUBLISH_QUEUE_SIZE; i++) {
+        IotcMqttPublishSlot *s = &publish_slots[i];
+        if (IOTC_MQTT_PUBLISH_FREE == s->state) {
+            slot = s;
+            break;
+        }
+        if (IOTC_MQTT_PUBLISH_QUEUED == s->state && IOTCL_DC_AT_MOST_ONCE == s->delivery_class
+            && (!oldest_droppable || is_sequence_before(s->publish_id, oldest_droppable->publish_id))) {
+            oldest_droppable = s;
         }
     }
+    if (!slot && oldest_droppable && IOTCL_DC_AT_MOST_ONCE != delivery_class) {
+        // make room by dropping a fire-and-forget message that was not sent yet
+        iotc_mqtt_client_complete_publish(oldest_droppable, IOTC_DS_DISCARDED);
+        slot = oldest_droppable;
+    }
+    if (!slot) {
+        Log.warn(F("The MQTT publish queue is full. Consider calling iotconnect_sdk_loop() more often or increasing IOTC_MQTT_PUBLISH_QUEUE_SIZE"));
+        return 0;
+    }
+    // acks are queued from the C2D callbacks, inside the arena scope of the C2D message, but need to outlive it
+    unsigned int arena_depth = iotcl_arena_suspend();
+    slot->data = (char *) iotcl_malloc(topic_length + 1 + payload_length);
+    iotcl_arena_resume(arena_depth);
+    if (!slot->data) {
+        Log.error(F("Out of memory while queuing the MQTT message"));
+        return 0;
+    }
+    memcpy(slot->data, topic, topic_length + 1);
+    memcpy(&slot->data[topic_length + 1], message, payload_length);
+    slot->payload_length = (uint16_t) payload_length;
+    slot->delivery_class = (uint8_t) delivery_class;
+    slot->is_retry = false;
+    slot->publish_id = iotc_mqtt_client_next_publish_id();
+    slot->state = IOTC_MQTT_PUBLISH_QUEUED;
 
-    if (last_c2d_message.has_message) {
-        last_c2d_message.has_message = false;
-        char data_buffer[last_c2d_message.message_length + 1] = {0};
-        if (0 == last_c2d_message.message_id) {
-            // BUG: if QOS is zero, the AVR IoT library returns 0 instead of -1.
-            // This causes the fetch with msg_id = 0 to fail.
-            last_c2d_message.message_id = -1;
+    if (IOTC_CS_MQTT_CONNECTED == state) {
+        iotc_mqtt_client_process_publishes(); // send right away if the window allows it
+    }
+    return slot->publish_id;
+}
+
+uint16_t iotc_mqtt_client_publish_streamed(
+        const char *topic,
+        IotclMqttPayloadWriter writer_fn,
+        void *context,
+        IotclDeliveryClass delivery_class
+) {
+    // critical messages need to be kept for retries, so they can only be queued
+    if (!c || IOTC_CS_MQTT_CONNECTED != state || IOTCL_DC_CRITICAL == delivery_class) {
+        return 0;
+    }
+
+    // send what is queued first to keep the order, and see if there is room left in the window
+    iotc_mqtt_client_process_publishes();
+    IotcMqttPublishSlot *slot = NULL;
+    uint8_t num_in_flight = 0;
+    for (uint8_t i = 0; i < IOTC_MQTT_PUBLISH_QUEUE_SIZE; i++) {
+        IotcMqttPublishSlot *s = &publish_slots[i];
+        if (IOTC_MQTT_PUBLISH_FREE == s->state) {
+            slot = s;
+        } else if (IOTC_MQTT_PUBLISH_QUEUED == s->state) {
+            return 0;
+        } else {
+            num_in_flight++;
         }
-        MqttClient.readMessage(
-            last_c2d_message.topic,
-            data_buffer,
-            last_c2d_message.message_length + 1,
-            last_c2d_message.message_id
-        );
-        data_buffer[last_c2d_message.message_length] = '\0'; // terminate the string, just in case
-        c->c2d_msg_cb(data_buffer);
+    }
+    if (!slot || num_in_flight >= IOTC_MQTT_PUBLISH_WINDOW) {
+        return 0;
     }
 
-#if 0
-    // Receiving messages seems to be the main loop into a stuck state.
-    // We need to investigate this further...
-    // Known issue for now.
-    IotclMqttConfig* mc = iotcl_mqtt_get_config();
-    if (!mc) {
-        Log.error(F("iotc_mqtt_client_loop(): Error: iotcl not configured?!"));
-    	return; // called function will print the error
+    // the publish command needs the payload length, so measure the payload first
+    IotclJsonWriter w;
+    iotcl_json_writer_init_with_sink(&w, NULL, 0, NULL, NULL);
+    writer_fn(&w, context);
+    size_t payload_length = iotcl_json_writer_get_total_length(&w);
+    if (w.overflow || 0 == payload_length) {
+        return 0;
+    }
+    if (payload_length > IOTC_MQTT_PUBLISH_MAX_PAYLOAD_SIZE) {
+        Log.errorf(F("MQTT message is longer than the max size of %d\n"), IOTC_MQTT_PUBLISH_MAX_PAYLOAD_SIZE);
+        return 0;
+    }
+
+    slot->data = NULL;
+    slot->payload_length = (uint16_t) payload_length;
+    slot->delivery_class = (uint8_t) delivery_class;
+    slot->is_retry = false;
+    if (!iotc_mqtt_client_begin_publish(slot, topic)) {
+        return 0;
     }
-    String message = MqttClient.readMessage(mc->sub_c2d);
-    // Read message will return an empty string if there were no new
-    // messages, so anything other than that means that there was a new
-    // message
-    if (message != "") {
-        Log.infof(F("Got new message: %s\n"), message.c_str());
-        if (c->c2d_msg_cb) {
-            const char* c_str = message.c_str();
-            c->c2d_msg_cb(c_str);
+    slot->publish_id = iotc_mqtt_client_next_publish_id();
+
+    char chunk[IOTC_MQTT_PUBLISH_WRITE_CHUNK_SIZE];
+    size_t remaining = payload_length;
+    iotcl_json_writer_init_with_sink(&w, chunk, sizeof(chunk), modem_payload_sink, &remaining);
+    writer_fn(&w, context);
+    iotcl_json_writer_flush(&w);
+    if (w.overflow || remaining > 0) {
+        Log.error(F("The MQTT payload changed while it was being written"));
+        // the modem is waiting for the rest of the payload, so complete it with JSON whitespace
+        for (; remaining > 0; remaining--) {
+            SequansController.writeBytes((const uint8_t *) " ", 1);
         }
     }
-#endif
+    if (!iotc_mqtt_client_end_publish(slot)) {
+        // the payload was consumed, so report the failure instead of having the caller send it again
+        iotc_mqtt_client_complete_publish(slot, IOTC_DS_FAILED);
+    }
+    return slot->publish_id;
 }
 
-bool iotc_mqtt_client_connect(void) {
-    IotclMqttConfig* mc = iotcl_mqtt_get_config();
-    for (int i = 0; i < IOTC_MAX_MQTT_CONN_RETRIES; i++) {
-        if(MqttClient.begin(mc->client_id,
-            mc->host,
-            MQTT_SECURE_PORT,
-            true,
-            60,
-            true,
-            mc->username ? mc->username : "",
-            "",
-            30000)) {
-            return true;
-        } else {
-            unsigned int backoff = (rand() % IOTC_MQTT_CONN_RETRY_INTERVAL_MS) + 1000; // minimum 1 second
-            Log.errorf(F("Failed to connect to MQTT using host:%s, client id:%s, username:%s. Retrying in %d ms\n"),
-                mc->host,
-                mc->client_id,
-                mc->username ? mc->username : "[empty]",
-                backoff
-            );
-            MqttClient.end();
-            delay(backoff);
+bool iotc_mqtt_client_send_message(const char* topic, const char *message, IotclDeliveryClass delivery_class) {
+    return 0 != iotc_mqtt_client_publish(topic, message, delivery_class);
+}
+
+uint16_t iotc_mqtt_client_get_last_publish_id(void) {
+    return last_publish_id;
+}
+
+void iotc_mqtt_client_loop(void) {
+    unsigned long start = millis();
+    while (iotc_mqtt_client_step()) {
+        if (millis() - start >= IOTC_MQTT_LOOP_BUDGET_MS) {
+            break; // continue in the next call
         }
     }
-    Log.errorf(F("Failed to connect to MQTT after %d retries\n"), IOTC_MAX_MQTT_CONN_RETRIES);
-    return false;
 }
 
-bool iotc_mqtt_client_init(IotConnectMqttClientConfig *config) {
-    disconnect_received = false;
-    c = config;
+void iotc_mqtt_client_get_c2d_queue_stats(IotcMqttC2dQueueStats *stats) {
+    // the counters are updated by the ISR, and are wider than what can be read atomically
+    noInterrupts();
+    *stats = c2d_queue.stats;
+    interrupts();
+}
 
+bool iotc_mqtt_client_start(IotConnectMqttClientConfig *config) {
     IotclMqttConfig* mc = iotcl_mqtt_get_config();
 
     if (!mc) {
-        Log.error(F("iotc_mqtt_client_init() c-lib not initialized?"));
+        Log.error(F("iotc_mqtt_client_start() c-lib not initialized?"));
     	return false;
     }
-    if (!c) {
-        Log.error(F("iotc_mqtt_client_init() called with invalid arguments"));
+    if (!config) {
+        Log.error(F("iotc_mqtt_client_start() called with invalid arguments"));
         return false;
     }
+    c = config;
+    c2d_queue.tail = c2d_queue.head; // discard messages from a previous connection
 
     if (!Lte.isConnected()) {
         Log.error(F("LTE must be up and running before initializing MQTT"));
@@ -188,45 +829,25 @@ bool iotc_mqtt_client_init(IotConnectMqttClientConfig *config) {
         mc->username ? mc->username : "[empty]"
     );
 
-
     MqttClient.onDisconnect(on_mqtt_disconnected);
 
-    if (!iotc_mqtt_client_connect()) {
-        return false;
-    }
-
-    int tires_num_500ms = 120; // 60 seconds
-    while (!MqttClient.isConnected()) {
-        tires_num_500ms--;
-        if (tires_num_500ms < 0) {
-            Log.raw(F("")); // start in a new line
-            Log.errorf(F("Timed out while attempting to connect to MQTT using host:%s, client id:%s, username:%s\n"),
-                mc->host,
-                mc->client_id,
-                mc->username ? mc->username : "[empty]"
-            );
-            MqttClient.end();
-            return false;
-        }
-        if (disconnect_received) {
-            Log.errorf(F("Received a disconnect while attempting to connect to MQTT using host:%s, client id:%s, username:%s\n"),
-                mc->host,
-                mc->client_id,
-                mc->username ? mc->username : "[empty]"
-            );
-            return false;
-        }
-        Log.rawf(F("_"));
-        delay(500);
-    }
-
-    MqttClient.onReceive(iotc_mqtt_client_on_receive);
-
+    iotc_mqtt_client_seed_backoff(mc->client_id);
+    num_attempts = 0;
+    num_auth_failures = 0;
+    backoff_ms = 0;
+    iotc_mqtt_client_set_state(IOTC_CS_MQTT_TLS);
+    return true;
+}
 
-    if(!MqttClient.subscribe(mc->sub_c2d, AT_LEAST_ONCE)) {
-        Log.errorf(F("ERROR: Unable to subscribe for C2D messages topic %s!\n"), mc->sub_c2d);
+bool iotc_mqtt_client_init(IotConnectMqttClientConfig *config) {
+    if (!iotc_mqtt_client_start(config)) {
         return false;
     }
-
-    return true;
+    is_blocking_init = true;
+    while (IOTC_CS_MQTT_CONNECTED != state && IOTC_CS_MQTT_DISCONNECTED != state) {
+        iotc_mqtt_client_loop();
+        delay(10);
+    }
+    is_blocking_init = false;
+    return IOTC_CS_MQTT_CONNECTED == state;
 }
@@ -10,21 +10,155 @@
 #include "iotconnect.h"
 
 
-typedef void (*IotConnectC2dCallback)(const char* message);
+// Number of received C2D messages that can wait for iotconnect_sdk_loop() to process them.
+// Each slot holds the topic name, so it takes a little more than MQTT_TOPIC_MAX_LENGTH bytes of RAM.
+#ifndef IOTC_MQTT_C2D_QUEUE_SIZE
+#define IOTC_MQTT_C2D_QUEUE_SIZE 4
+#endif
+
+// iotc_mqtt_client_loop() keeps advancing the connection and processing C2D messages for up to this long.
+// The exception is the step that establishes the TLS session. See IOTC_MQTT_TLS_STEP_TIMEOUT_MS.
+#ifndef IOTC_MQTT_LOOP_BUDGET_MS
+#define IOTC_MQTT_LOOP_BUDGET_MS 100
+#endif
+
+// The TLS session is established by MqttClient.begin() of the AVR-IoT Cellular library, which blocks until
+// the modem asks the ECC608 to sign the handshake, and again until the broker accepts the connection.
+// It keeps the connection state to itself, so the wait cannot be split into steps of the state machine.
+// Instead, each of the two waits is limited to this long, instead of the 30 seconds of the library, so that
+// iotc_mqtt_client_loop() can block for at most about twice this while connecting. An attempt that runs out of time
+// is retried after the backoff. Increase this if handshakes time out on a slow link.
+#ifndef IOTC_MQTT_TLS_STEP_TIMEOUT_MS
+#define IOTC_MQTT_TLS_STEP_TIMEOUT_MS 8000UL
+#endif
+
+// The delay between connection attempts starts at the base and grows with decorrelated jitter:
+// each delay is random between the base and three times the previous delay, but never above the cap.
+// This keeps a fleet of devices that lost the connection at the same time from reconnecting all at once.
+#ifndef IOTC_MQTT_BACKOFF_BASE_MS
+#define IOTC_MQTT_BACKOFF_BASE_MS 1000UL
+#endif
+#ifndef IOTC_MQTT_BACKOFF_CAP_MS
+#define IOTC_MQTT_BACKOFF_CAP_MS 300000UL
+#endif
+
+// With auto_reconnect, the rediscovery callback is called after this many attempts in a row have failed
+// to set up TLS or were rejected by the broker, as the MQTT settings may have changed.
+// Attempts that fail because the network is down or time out are not counted.
+#ifndef IOTC_MQTT_REDISCOVERY_THRESHOLD
+#define IOTC_MQTT_REDISCOVERY_THRESHOLD 5
+#endif
+
+// C2D messages are read from the modem in chunks of this many bytes, which are placed on the stack.
+#ifndef IOTC_MQTT_C2D_READ_CHUNK_SIZE
+#define IOTC_MQTT_C2D_READ_CHUNK_SIZE 32
+#endif
+
+// Only the values that the library uses are kept from a received C2D message (see iotcl_c2d_filter_init()),
+// and this is the size of the stack buffer that holds them. It needs to fit the OTA URLs, which can be long
+// if they are signed. Messages with values that do not fit are rejected, regardless of the message size.
+#ifndef IOTC_MQTT_C2D_BUFFER_SIZE
+#define IOTC_MQTT_C2D_BUFFER_SIZE 512
+#endif
+
+// Number of outbound messages that can wait to be sent or for the broker to acknowledge them.
+// Each queued message holds a heap copy of its topic and payload until its delivery is reported.
+#ifndef IOTC_MQTT_PUBLISH_QUEUE_SIZE
+#define IOTC_MQTT_PUBLISH_QUEUE_SIZE 4
+#endif
+
+// The number of messages passed to the modem that can wait for the acknowledgement from the broker at once.
+// Sending the next message does not wait for the previous one to be acknowledged, as long as this allows it.
+#ifndef IOTC_MQTT_PUBLISH_WINDOW
+#define IOTC_MQTT_PUBLISH_WINDOW 2
+#endif
+
+// A message that is not acknowledged within this time after it was passed to the modem is reported as timed out.
+#ifndef IOTC_MQTT_PUBLISH_TIMEOUT_MS
+#define IOTC_MQTT_PUBLISH_TIMEOUT_MS 30000UL
+#endif
+
+// Streamed payloads (see iotc_mqtt_client_publish_streamed()) are passed to the modem in chunks of this many bytes,
+// which are placed on the stack.
+#ifndef IOTC_MQTT_PUBLISH_WRITE_CHUNK_SIZE
+#define IOTC_MQTT_PUBLISH_WRITE_CHUNK_SIZE 32
+#endif
+
+// A critical message that failed, timed out or was interrupted by a connection loss is sent again after this delay.
+#ifndef IOTC_MQTT_PUBLISH_RETRY_DELAY_MS
+#define IOTC_MQTT_PUBLISH_RETRY_DELAY_MS 5000UL
+#endif
+
+typedef struct {
+    uint32_t num_received;  // Messages reported by the modem
+    uint32_t num_dropped;   // Messages that did not fit into the queue and were not processed
+    uint8_t max_pending;    // The highest number of messages that were waiting in the queue at once
+} IotcMqttC2dQueueStats;
+
+// The message is the received C2D JSON reduced to the values that the library uses.
+// The message buffer is owned by the MQTT client, but it can be modified by the callback.
+typedef void (*IotConnectC2dCallback)(char* message, size_t message_length);
+
+// Should obtain new MQTT settings with discovery and identity and return true if successful.
+typedef bool (*IotConnectRediscoveryCallback)(void);
 
 typedef struct {
     IotConnectC2dCallback c2d_msg_cb; // callback for inbound messages
     IotConnectStatusCallback status_cb; // callback for connection status
+    bool auto_reconnect; // keep reconnecting with backoff after the connection is lost or a connection attempt fails
+    IotConnectRediscoveryCallback rediscovery_cb; // optional. Called after IOTC_MQTT_REDISCOVERY_THRESHOLD TLS or broker failures in a row
+    IotConnectDeliveryCallback delivery_cb; // optional. Called from iotc_mqtt_client_loop() once the delivery of a message is known
 } IotConnectMqttClientConfig;
 
+// Starts connecting without waiting. The connection is advanced by iotc_mqtt_client_loop(),
+// which reports each state change to the status callback.
+// With auto_reconnect, the connection attempts continue until iotc_mqtt_client_disconnect() is called.
+// Without it, the client gives up after a few attempts and stays disconnected after the connection is lost.
+bool iotc_mqtt_client_start(IotConnectMqttClientConfig *c);
+
+// Starts connecting and runs iotc_mqtt_client_loop() until connected, or until all connection attempts fail.
+// The number of attempts is limited even with auto_reconnect, but auto_reconnect applies once connected.
 bool iotc_mqtt_client_init(IotConnectMqttClientConfig *c);
 
 void iotc_mqtt_client_disconnect(void);
 
 bool iotc_mqtt_client_is_connected(void);
 
+IotConnectConnectionStatus iotc_mqtt_client_get_status(void);
+
 void iotc_mqtt_client_loop(void);
 
-bool iotc_mqtt_client_send_message(const char *topic, const char *message);
+// Queues a message and returns right away with a publish ID that will be passed to the delivery callback,
+// or 0 if the message could not be queued. The message is passed to the modem immediately if the publish window
+// allows it, or later by iotc_mqtt_client_loop(). Messages can be queued while a connection attempt is in progress.
+// The delivery class decides how the queued messages are scheduled:
+//  - Critical messages are sent first. They are retried until delivered and survive reconnects.
+//    Only iotc_mqtt_client_disconnect(), or giving up on the connection without auto_reconnect, discards them.
+//  - At-least-once (QoS 1) messages are reported as failed or timed out, and are not retried.
+//  - At-most-once (QoS 0) messages are sent last. When the queue is full, the oldest one that was not sent yet
+//    is discarded to make room for a message of another class. They are also discarded when the connection is lost.
+uint16_t iotc_mqtt_client_publish(const char *topic, const char *message, IotclDeliveryClass delivery_class);
+
+// Publishes a message that is written by writer_fn straight to the modem, so that it never needs to be held in RAM.
+// writer_fn is called twice and needs to write the same output both times. It is first called with a writer that
+// only counts the bytes to obtain the payload length, and then with a writer that passes the bytes to the modem.
+// The message is published right away and the delivery is reported to the delivery callback like with
+// iotc_mqtt_client_publish(). Returns 0 if the message cannot be published right away, because the client is not
+// connected, the publish window is full or other messages are queued, or if the message is critical,
+// as critical messages need to be kept for retries. In that case, the message can be queued instead.
+uint16_t iotc_mqtt_client_publish_streamed(
+        const char *topic,
+        IotclMqttPayloadWriter writer_fn,
+        void *context,
+        IotclDeliveryClass delivery_class
+);
+
+// Same as iotc_mqtt_client_publish(), but returns true if the message was queued.
+bool iotc_mqtt_client_send_message(const char *topic, const char *message, IotclDeliveryClass delivery_class);
+
+// Returns the publish ID of the last queued message.
+uint16_t iotc_mqtt_client_get_last_publish_id(void);
+
+void iotc_mqtt_client_get_c2d_queue_stats(IotcMqttC2dQueueStats *stats);
 
 #endif // IOTC_MQTT_CLIENT_H
\ No newline at end of file
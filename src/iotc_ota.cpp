@@ -0,0 +1,338 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <Arduino.h>
+#include "log.h"
+
+#include "iotcl.h"
+#include "iotcl_c2d.h"
+#include "iotcl_util.h"
+#include "iotc_transport.h"
+#include "iotc_ota.h"
+
+#define IOTC_OTA_STATE_MAGIC 0x544F // "OT"
+#define IOTC_OTA_STATE_VERSION 1
+
+#define IOTC_OTA_ACK_MESSAGE_SIZE 48
+
+// What is passed to IotConnectOtaSink.save_state()
+typedef struct {
+    uint16_t magic;             // 0 if nothing is saved
+    uint8_t version;
+    uint16_t id_crc;            // See IotConnectOta.id_crc
+    uint32_t offset;
+    IotclSha256 sha;            // of the data up to offset
+    uint16_t crc;               // of the state with this field set to zero
+} IotcOtaSavedState;
+
+static_assert(sizeof(IotcOtaSavedState) <= IOTC_OTA_STATE_MAX_SIZE, "IOTC_OTA_STATE_MAX_SIZE needs to be updated");
+
+// The context of a range request
+typedef struct {
+    IotConnectOta *ota;
+    IotConnectHttpRangeResponse response;
+    uint32_t body_position;     // Where the data of the response is in the image
+    bool has_data;
+    bool is_sink_failed;
+} IotcOtaRequest;
+
+static uint16_t state_crc(const IotcOtaSavedState *s) {
+    IotcOtaSavedState copy = *s;
+    copy.crc = 0;
+    return iotcl_crc16_update(0xFFFF, &copy, sizeof(copy));
+}
+
+// Signed URLs get new parameters each time that they are issued, so they are not a part of the identity.
+// A download can then resume with a new URL for the same file.
+static uint16_t url_id_crc(const char *host, const char *resource) {
+    uint16_t crc = iotcl_crc16_update(0xFFFF, host, strlen(host) + 1);
+    return iotcl_crc16_update(crc, resource, strcspn(resource, "?"));
+}
+
+static bool copy_string(char *dest, size_t dest_size, const char *src) {
+    if (!src) {
+        dest[0] = '\0';
+        return true;
+    }
+    if (strlen(src) >= dest_size) {
+        return false;
+    }
+    strcpy(dest, src);
+    return true;
+}
+
+static void send_ack(IotConnectOta *ota, int ota_status, const char *message) {
+    if (ota->ack_id[0]) {
+        iotcl_mqtt_send_ota_ack(ota->ack_id, ota_status, message);
+    }
+}
+
+// Reports the progress if IOTC_OTA_ACK_INTERVAL_MS passed since the last report, or always if is_forced
+static void send_progress_ack(IotConnectOta *ota, bool is_forced) {
+    char message[IOTC_OTA_ACK_MESSAGE_SIZE];
+    if (!is_forced && ota->is_acked && millis() - ota->acked_ms < IOTC_OTA_ACK_INTERVAL_MS) {
+        return;
+    }
+    if (0 == ota->progress.offset) {
+        snprintf(message, sizeof(message), "Downloading");
+    } else if (ota->progress.image_size) {
+        snprintf(message, sizeof(message), "Downloaded %lu of %lu bytes",
+            (unsigned long) ota->progress.offset, (unsigned long) ota->progress.image_size);
+    } else {
+        snprintf(message, sizeof(message), "Downloaded %lu bytes", (unsigned long) ota->progress.offset);
+    }
+    send_ack(ota, IOTCL_C2D_EVT_OTA_DOWNLOADING, message);
+    ota->acked_ms = millis();
+    ota->is_acked = true;
+}
+
+static void save_state(IotConnectOta *ota, bool is_cleared) {
+    IotcOtaSavedState s;
+    if (!ota->sink->save_state) {
+        return;
+    }
+    memset(&s, 0, sizeof(s)); // also the padding, which is a part of the CRC
+    if (!is_cleared) {
+        s.magic = IOTC_OTA_STATE_MAGIC;
+        s.version = IOTC_OTA_STATE_VERSION;
+        s.id_crc = ota->id_crc;
+        s.offset = ota->progress.offset;
+        s.sha = ota->sha;
+        s.crc = state_crc(&s);
+    }
+    if (ota->sink->save_state(ota->sink_context, &s, sizeof(s))) {
+        Log.warn(F("OTA: Unable to save the download progress"));
+        return;
+    }
+    ota->saved_offset = ota->progress.offset;
+    ota->progress.num_saves++;
+}
+
+// Restores the offset and the SHA-256 context from the state saved for the same URL, if there is one
+static void load_state(IotConnectOta *ota) {
+    IotcOtaSavedState s;
+    if (!ota->sink->load_state
+        || ota->sink->load_state(ota->sink_context, &s, sizeof(s))
+        || IOTC_OTA_STATE_MAGIC != s.magic
+        || IOTC_OTA_STATE_VERSION != s.version
+        || state_crc(&s) != s.crc
+        || ota->id_crc != s.id_crc
+        || s.sha.length != s.offset
+    ) {
+        return;
+    }
+    ota->progress.offset = s.offset;
+    ota->progress.resumed_from = s.offset;
+    ota->saved_offset = s.offset;
+    ota->sha = s.sha;
+}
+
+static void fail(IotConnectOta *ota, const char *message, bool is_progress_kept) {
+    Log.errorf(F("OTA: %s\n"), message);
+    ota->state = IOTC_OTA_FAILED;
+    if (is_progress_kept) {
+        if (ota->progress.offset != ota->saved_offset) {
+            save_state(ota, false);
+        }
+    } else {
+        save_state(ota, true);
+    }
+    ota->sink->close(ota->sink_context, false, 0, NULL);
+    send_ack(ota, IOTCL_C2D_EVT_OTA_DOWNLOAD_FAILED, message);
+}
+
+static void complete(IotConnectOta *ota) {
+    ota->progress.image_size = ota->progress.offset;
+    iotcl_sha256_finish(&ota->sha, ota->digest);
+    if (ota->has_expected_sha256 && 0 != memcmp(ota->digest, ota->expected_sha256, sizeof(ota->digest))) {
+        // the data is of no use for a resume
+        fail(ota, "The image does not match the expected SHA-256", false);
+        return;
+    }
+    save_state(ota, true);
+    if (ota->sink->close(ota->sink_context, true, ota->progress.image_size, ota->digest)) {
+        ota->state = IOTC_OTA_FAILED;
+        Log.error(F("OTA: The image was rejected by the sink"));
+        send_ack(ota, IOTCL_C2D_EVT_OTA_DOWNLOAD_FAILED, "The image was rejected");
+        return;
+    }
+    ota->state = IOTC_OTA_COMPLETE;
+    Log.infof(F("OTA: Downloaded %lu bytes with %u requests\n"),
+        (unsigned long) ota->progress.image_size, (unsigned int) ota->progress.num_requests);
+    // IOTCL_C2D_EVT_OTA_DOWNLOAD_DONE is up to the application, once the new firmware runs
+    send_progress_ack(ota, true);
+}
+
+static void retry(IotConnectOta *ota) {
+    ota->num_failures++;
+    if (ota->num_failures > IOTC_OTA_MAX_RETRIES) {
+        fail(ota, "The download failed", true);
+        return;
+    }
+    ota->progress.num_retries++;
+    ota->failed_ms = millis();
+    if (ota->progress.offset != ota->saved_offset) {
+        save_state(ota, false); // in case the device is reset while it waits
+    }
+    Log.warnf(F("OTA: The download stopped at %lu bytes. Retrying in %lu ms\n"),
+        (unsigned long) ota->progress.offset, (unsigned long) (IOTC_OTA_RETRY_DELAY_MS << (ota->num_failures - 1)));
+}
+
+// Receives the body of a range response. The data that precedes the offset, which is there if the server sent
+// the whole image, is skipped.
+static int range_sink(void *context, const char *data, size_t data_length) {
+    IotcOtaRequest *r = (IotcOtaRequest *) context;
+    IotConnectOta *ota = r->ota;
+
+    if (!r->has_data) {
+        r->has_data = true;
+        if (200 == r->response.status_code) {
+            r->body_position = 0;
+            ota->progress.image_size = r->response.content_length;
+        } else {
+            r->body_position = ota->progress.offset;
+        }
+    }
+    uint32_t end = r->body_position + (uint32_t) data_length;
+    if (end > ota->progress.offset) {
+        size_t skip = (size_t) (ota->progress.offset - r->body_position);
+        const uint8_t *p = (const uint8_t *) data + skip;
+        size_t length = data_length - skip;
+        if (ota->sink->write(ota->sink_context, ota->progress.offset, p, length)) {
+            r->is_sink_failed = true;
+            return IOTCL_ERR_FAILED;
+        }
+        iotcl_sha256_update(&ota->sha, p, length);
+        ota->progress.offset += (uint32_t) length;
+        if (ota->progress.offset - ota->saved_offset >= IOTC_OTA_SAVE_INTERVAL) {
+            save_state(ota, false);
+        }
+    }
+    r->body_position = end;
+    return IOTCL_SUCCESS;
+}
+
+int iotconnect_ota_start(IotConnectOta *ota, const IotConnectOtaConfig *config) {
+    const IotConnectTransport *transport = iotconnect_sdk_get_transport();
+
+    memset(ota, 0, sizeof(*ota));
+    if (!config->host || !config->resource || !config->sink
+        || !config->sink->open || !config->sink->write || !config->sink->close) {
+        Log.error(F("OTA: The host, the resource and the sink are required"));
+        return IOTCL_ERR_MISSING_VALUE;
+    }
+    if (!transport->https_get_range) {
+        Log.error(F("OTA: The transport does not support range requests"));
+        return IOTCL_ERR_CONFIG_MISSING;
+    }
+    if (!copy_string(ota->host, sizeof(ota->host), config->host)
+        || !copy_string(ota->resource, sizeof(ota->resource), config->resource)
+        || !copy_string(ota->ack_id, sizeof(ota->ack_id), config->ack_id)) {
+        Log.error(F("OTA: The URL or the ack ID is too long. See IOTC_OTA_RESOURCE_MAX_LENGTH."));
+        return IOTCL_ERR_OVERFLOW;
+    }
+    if (config->expected_sha256) {
+        memcpy(ota->expected_sha256, config->expected_sha256, sizeof(ota->expected_sha256));
+        ota->has_expected_sha256 = true;
+    }
+    ota->sink = config->sink;
+    ota->sink_context = config->sink_context;
+    ota->id_crc = url_id_crc(ota->host, ota->resource);
+    iotcl_sha256_init(&ota->sha);
+
+    load_state(ota);
+    int status = ota->sink->open(ota->sink_context, ota->progress.offset);
+    if (status && ota->progress.offset) {
+        Log.warn(F("OTA: The sink can not resume the download. Starting over."));
+        memset(&ota->progress, 0, sizeof(ota->progress));
+        ota->saved_offset = 0;
+        iotcl_sha256_init(&ota->sha);
+        status = ota->sink->open(ota->sink_context, 0);
+    }
+    if (status) {
+        Log.error(F("OTA: Unable to open the sink"));
+        return status;
+    }
+    if (ota->progress.offset) {
+        Log.infof(F("OTA: Resuming the download of https://%s%s at %lu bytes\n"),
+            ota->host, ota->resource, (unsigned long) ota->progress.offset);
+    } else {
+        Log.infof(F("OTA: Downloading https://%s%s\n"), ota->host, ota->resource);
+    }
+    ota->state = IOTC_OTA_DOWNLOADING;
+    return IOTCL_SUCCESS;
+}
+
+IotConnectOtaState iotconnect_ota_loop(IotConnectOta *ota) {
+    if (IOTC_OTA_DOWNLOADING != ota->state) {
+        return ota->state;
+    }
+    if (ota->num_failures && millis() - ota->failed_ms < (IOTC_OTA_RETRY_DELAY_MS << (ota->num_failures - 1))) {
+        return ota->state;
+    }
+    send_progress_ack(ota, false);
+
+    IotcOtaRequest r;
+    memset(&r, 0, sizeof(r));
+    r.ota = ota;
+    ota->progress.num_requests++;
+    int status = iotconnect_sdk_get_transport()->https_get_range(
+        ota->host,
+        ota->resource,
+        ota->progress.offset,
+        IOTC_OTA_RANGE_SIZE,
+        range_sink,
+        &r,
+        &r.response
+    );
+
+    if (r.is_sink_failed) {
+        fail(ota, "Unable to store the image", true);
+    } else if (status) {
+        retry(ota);
+    } else if (206 == r.response.status_code) {
+        if (!r.has_data) {
+            retry(ota);
+        } else if (r.response.content_length < IOTC_OTA_RANGE_SIZE) {
+            complete(ota); // the last range is short
+        } else {
+            ota->num_failures = 0;
+        }
+    } else if (200 == r.response.status_code) {
+        if (r.has_data && ota->progress.offset == r.response.content_length) {
+            complete(ota);
+        } else {
+            retry(ota);
+        }
+    } else if (416 == r.response.status_code && ota->progress.offset > 0) {
+        complete(ota); // the image ended at the end of the previous range
+    } else {
+        char message[IOTC_OTA_ACK_MESSAGE_SIZE];
+        snprintf(message, sizeof(message), "Unexpected HTTP status %u", (unsigned int) r.response.status_code);
+        fail(ota, message, true);
+    }
+    return ota->state;
+}
+
+void iotconnect_ota_abort(IotConnectOta *ota) {
+    if (IOTC_OTA_DOWNLOADING != ota->state) {
+        return;
+    }
+    if (ota->progress.offset != ota->saved_offset) {
+        save_state(ota, false);
+    }
+    ota->sink->close(ota->sink_context, false, 0, NULL);
+    ota->state = IOTC_OTA_IDLE;
+}
+
+void iotconnect_ota_get_progress(const IotConnectOta *ota, IotConnectOtaProgress *progress) {
+    *progress = ota->progress;
+}
+
+const uint8_t *iotconnect_ota_get_digest(const IotConnectOta *ota) {
+    return IOTC_OTA_COMPLETE == ota->state ? ota->digest : NULL;
+}
@@ -0,0 +1,169 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * Downloads an OTA firmware image with HTTP Range requests of IOTC_OTA_RANGE_SIZE bytes, passes the data
+ * to a storage sink (flash, an external memory or a file) as it arrives and computes its SHA-256 on the way.
+ *
+ * iotconnect_ota_loop() downloads one range per call, so the application can keep calling iotconnect_sdk_loop()
+ * in between, which keeps the MQTT connection alive and sends the IOTCL_C2D_EVT_OTA_DOWNLOADING progress acks
+ * that the download queues every IOTC_OTA_ACK_INTERVAL_MS.
+ *
+ * A range that fails, for example because the LTE link dropped, is retried with backoff from where the data stopped.
+ * Every IOTC_OTA_SAVE_INTERVAL bytes, the offset and the SHA-256 context are saved through the sink,
+ * so that iotconnect_ota_start() with the same URL resumes the download after a reset as well.
+ * If the server does not support ranges, the whole image is read with one request, and the part
+ * that was downloaded before is skipped.
+ *
+ * The end of the image is where the server returns less than a whole range, as the modem does not pass on
+ * the Content-Range header with the total size.
+ *
+ * Typical use:
+ *
+ * static IotConnectOta ota; // about 600 bytes, so better not on the stack
+ *
+ * // in the OTA callback:
+ * IotConnectOtaConfig c = {0};
+ * c.host = iotcl_c2d_get_ota_url_hostname(data, 0);
+ * c.resource = iotcl_c2d_get_ota_url_resource(data, 0);
+ * c.ack_id = iotcl_c2d_get_ack_id(data);
+ * c.sink = &flash_sink;
+ * iotconnect_ota_start(&ota, &c); // copies the strings, so the event data can go away
+ *
+ * // in the main loop:
+ * if (IOTC_OTA_DOWNLOADING == iotconnect_ota_loop(&ota)) { ... }
+ * iotconnect_sdk_loop();
+ */
+
+#ifndef IOTC_OTA_H
+#define IOTC_OTA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "iotcl_sha256.h"
+#include "iotc_http_request.h"
+
+// The size of the Range requests. A multiple of the SHA-256 block size, so that the saved
+// SHA-256 contexts rarely hold a partial block. Each range is read from the modem in IOTC_HTTPS_READ_MAX_SIZE parts.
+#ifndef IOTC_OTA_RANGE_SIZE
+#define IOTC_OTA_RANGE_SIZE (IOTC_HTTPS_READ_MAX_SIZE / 64 * 64 * 4)
+#endif
+
+// How much data is downloaded between the saves of the progress, which wear the storage of the sink
+#ifndef IOTC_OTA_SAVE_INTERVAL
+#define IOTC_OTA_SAVE_INTERVAL 8192
+#endif
+
+// How often IOTCL_C2D_EVT_OTA_DOWNLOADING acks report the progress
+#ifndef IOTC_OTA_ACK_INTERVAL_MS
+#define IOTC_OTA_ACK_INTERVAL_MS 60000UL
+#endif
+
+// Failed ranges are retried this many times in a row, with a delay that starts at IOTC_OTA_RETRY_DELAY_MS
+// and doubles with each retry, before the download fails
+#ifndef IOTC_OTA_MAX_RETRIES
+#define IOTC_OTA_MAX_RETRIES 6
+#endif
+#ifndef IOTC_OTA_RETRY_DELAY_MS
+#define IOTC_OTA_RETRY_DELAY_MS 2000UL
+#endif
+
+// The strings are copied into the download context, so the URL from the OTA event can be freed.
+// Signed URLs are long.
+#ifndef IOTC_OTA_HOST_MAX_LENGTH
+#define IOTC_OTA_HOST_MAX_LENGTH 64
+#endif
+#ifndef IOTC_OTA_RESOURCE_MAX_LENGTH
+#define IOTC_OTA_RESOURCE_MAX_LENGTH 320
+#endif
+#ifndef IOTC_OTA_ACK_ID_MAX_LENGTH
+#define IOTC_OTA_ACK_ID_MAX_LENGTH 40
+#endif
+
+// Upper bound of the state_size that is passed to IotConnectOtaSink.save_state() and load_state(),
+// for sinks that keep the state in a fixed-size record. iotc_ota.cpp checks that it holds.
+#define IOTC_OTA_STATE_MAX_SIZE (sizeof(IotclSha256) + 24)
+
+typedef enum {
+    IOTC_OTA_IDLE = 0,
+    IOTC_OTA_DOWNLOADING,
+    IOTC_OTA_COMPLETE,      // The image was downloaded and verified, and the sink was closed
+    IOTC_OTA_FAILED         // See the log. The progress saved before a failure to download is kept for a resume.
+} IotConnectOtaState;
+
+// Where the image goes. The functions return IOTCL_SUCCESS, or an error that fails the download.
+typedef struct {
+    // Called by iotconnect_ota_start(). The data continues from offset, and anything stored past it should be
+    // discarded. The offset is 0 unless the download resumes from a state that was returned by load_state().
+    int (*open)(void *context, uint32_t offset);
+    // The data in order, from offset in the image
+    int (*write)(void *context, uint32_t offset, const uint8_t *data, size_t data_length);
+    // Called once when the download ends. If is_complete, the image has image_size bytes with the SHA-256 digest,
+    // which matched the expected one if it was given. Returning an error fails a complete download,
+    // which the sink can do if the image does not pass its own checks.
+    int (*close)(void *context, bool is_complete, uint32_t image_size, const uint8_t *digest);
+    // Optional. Keep the state in persistent storage, and return it from load_state(), so that a download can resume
+    // after a reset. The data written before save_state() is called should be persistent by the time it returns.
+    // load_state() returns an error if nothing was saved. The state has a CRC, so it can be returned unchecked.
+    int (*save_state)(void *context, const void *state, size_t state_size);
+    int (*load_state)(void *context, void *state, size_t state_size);
+} IotConnectOtaSink;
+
+typedef struct {
+    const char *host;                   // iotcl_c2d_get_ota_url_hostname()
+    const char *resource;               // iotcl_c2d_get_ota_url_resource(), with the URL parameters
+    const char *ack_id;                 // Optional. The progress and failures are acked to IoTConnect with it.
+    const uint8_t *expected_sha256;     // Optional. IOTCL_SHA256_DIGEST_SIZE bytes that the image should hash to.
+    const IotConnectOtaSink *sink;
+    void *sink_context;
+} IotConnectOtaConfig;
+
+typedef struct {
+    uint32_t offset;                    // Downloaded bytes
+    uint32_t image_size;                // 0 until it is known, which is usually at the end
+    uint32_t resumed_from;              // The offset that the download was resumed from
+    uint16_t num_requests;
+    uint16_t num_retries;
+    uint16_t num_saves;
+} IotConnectOtaProgress;
+
+// The state of a download. The fields are internal.
+typedef struct {
+    IotConnectOtaState state;
+    char host[IOTC_OTA_HOST_MAX_LENGTH + 1];
+    char resource[IOTC_OTA_RESOURCE_MAX_LENGTH + 1];
+    char ack_id[IOTC_OTA_ACK_ID_MAX_LENGTH + 1];
+    uint8_t expected_sha256[IOTCL_SHA256_DIGEST_SIZE];
+    bool has_expected_sha256;
+    const IotConnectOtaSink *sink;
+    void *sink_context;
+    uint16_t id_crc;                    // of the URL without its parameters, which identifies a saved state
+    IotclSha256 sha;
+    IotConnectOtaProgress progress;
+    uint32_t saved_offset;
+    uint8_t num_failures;               // in a row
+    unsigned long failed_ms;
+    unsigned long acked_ms;
+    bool is_acked;
+    uint8_t digest[IOTCL_SHA256_DIGEST_SIZE];
+} IotConnectOta;
+
+// Opens the sink and resumes the download if the sink has a saved state for the same URL.
+// Needs the SDK to be initialized with a transport that supports range requests.
+int iotconnect_ota_start(IotConnectOta *ota, const IotConnectOtaConfig *config);
+
+// Downloads the next range, unless the download is waiting to retry. Returns the state after that.
+IotConnectOtaState iotconnect_ota_loop(IotConnectOta *ota);
+
+// Stops the download and closes the sink. The saved progress is kept, so that the download can be resumed.
+void iotconnect_ota_abort(IotConnectOta *ota);
+
+void iotconnect_ota_get_progress(const IotConnectOta *ota, IotConnectOtaProgress *progress);
+
+// The SHA-256 of the image, once the download is complete
+const uint8_t *iotconnect_ota_get_digest(const IotConnectOta *ota);
+
+#endif // IOTC_OTA_H
@@ -0,0 +1,418 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+#include <string.h>
+#include <Arduino.h>
+#include "log.h"
+
+#include "iotcl.h"
+#include "iotcl_c2d.h"
+#include "iotcl_util.h"
+#include "iotc_ota_delta.h"
+
+#define IOTC_OTA_DELTA_STATE_MAGIC 0x5444 // "DT"
+
+#define HEADER_SOURCE_SIZE_OFFSET 8
+#define HEADER_TARGET_SIZE_OFFSET 12
+#define HEADER_SOURCE_SHA_OFFSET 16
+#define HEADER_TARGET_SHA_OFFSET (HEADER_SOURCE_SHA_OFFSET + IOTCL_SHA256_DIGEST_SIZE)
+
+// What the package is being read for
+typedef enum {
+    STEP_HEADER = 0,
+    STEP_COMMAND,           // The varint of the length and the op
+    STEP_SOURCE_OFFSET,     // The zigzag varint of COPY and ADD
+    STEP_INSERT_DATA,
+    STEP_RUN,               // The varint that starts an ADD run
+    STEP_RUN_ADDED,         // The varint count of added bytes of an ADD run with IOTC_OTA_DELTA_CODE_LONG
+    STEP_ADD_DATA,
+    STEP_DONE
+} IotcOtaDeltaStep;
+
+// Saved in front of the state of the download
+typedef struct {
+    uint16_t magic;
+    uint16_t crc;           // of the progress
+    IotConnectOtaDeltaProgress progress;
+} IotcOtaDeltaSavedState;
+
+// What the delta saves in the target sink, which is built on the stack instead of allocating it for each save
+typedef struct {
+    IotcOtaDeltaSavedState delta;
+    uint8_t download[IOTC_OTA_STATE_MAX_SIZE]; // Only state_size bytes are saved, right after the delta state
+} IotcOtaDeltaStateRecord;
+
+static uint32_t get_u32(const uint8_t *p) {
+    return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static uint32_t get_target_size(const IotConnectOtaDeltaProgress *p) {
+    return get_u32(&p->header[HEADER_TARGET_SIZE_OFFSET]);
+}
+
+static uint32_t get_source_size(const IotConnectOtaDeltaProgress *p) {
+    return get_u32(&p->header[HEADER_SOURCE_SIZE_OFFSET]);
+}
+
+static int check_header(IotConnectOtaDelta *d) {
+    const IotConnectOtaDeltaProgress *p = &d->progress;
+    if (0 != memcmp(p->header, IOTC_OTA_DELTA_MAGIC, 4) || IOTC_OTA_DELTA_VERSION != p->header[4]) {
+        Log.error(F("OTA delta: Not a delta package, or an unsupported version"));
+        return IOTCL_ERR_PARSING_ERROR;
+    }
+    if ((d->config.source_size && d->config.source_size != get_source_size(p))
+        || (d->config.source_sha256
+            && 0 != memcmp(d->config.source_sha256, &p->header[HEADER_SOURCE_SHA_OFFSET], IOTCL_SHA256_DIGEST_SIZE))) {
+        Log.error(F("OTA delta: The package is for a different firmware than the running one"));
+        return IOTCL_ERR_BAD_VALUE;
+    }
+    if (0 == get_target_size(p)) {
+        Log.error(F("OTA delta: The target image is empty"));
+        return IOTCL_ERR_BAD_VALUE;
+    }
+    return IOTCL_SUCCESS;
+}
+
+static int emit(IotConnectOtaDelta *d, const uint8_t *data, size_t data_length) {
+    IotConnectOtaDeltaProgress *p = &d->progress;
+    int status = d->config.target_sink->write(d->config.target_context, p->target_offset, data, data_length);
+    if (status) {
+        return status;
+    }
+    iotcl_sha256_update(&p->sha, data, data_length);
+    p->target_offset += (uint32_t) data_length;
+    return IOTCL_SUCCESS;
+}
+
+// Writes the source bytes at the source position to the target, with the added bytes added to them if not NULL
+static int copy_source(IotConnectOtaDelta *d, const uint8_t *added, size_t length) {
+    IotConnectOtaDeltaProgress *p = &d->progress;
+    while (length) {
+        size_t chunk_length = length < sizeof(d->window) ? length : sizeof(d->window);
+        int status = d->config.read_source(d->config.source_context, p->source_position, d->window, chunk_length);
+        if (status) {
+            Log.error(F("OTA delta: Unable to read the running image"));
+            return status;
+        }
+        if (added) {
+            for (size_t i = 0; i < chunk_length; i++) {
+                d->window[i] += added[i];
+            }
+            added += chunk_length;
+        }
+        status = emit(d, d->window, chunk_length);
+        if (status) {
+            return status;
+        }
+        p->source_position += (uint32_t) chunk_length;
+        length -= chunk_length;
+    }
+    return IOTCL_SUCCESS;
+}
+
+static void end_command(IotConnectOtaDeltaProgress *p) {
+    p->step = (p->target_offset == get_target_size(p)) ? STEP_DONE : STEP_COMMAND;
+}
+
+static void end_run(IotConnectOtaDeltaProgress *p) {
+    if (0 == p->length) {
+        end_command(p);
+    } else {
+        p->step = STEP_RUN;
+    }
+}
+
+// Adds a pattern to the source bytes, and makes it the most recent one
+static int apply_pattern(IotConnectOtaDelta *d, uint8_t index) {
+    IotConnectOtaDeltaProgress *p = &d->progress;
+    uint8_t length = p->pattern_lengths[index];
+    if (0 == length || length > p->length) {
+        Log.error(F("OTA delta: Bad ADD pattern"));
+        return IOTCL_ERR_PARSING_ERROR;
+    }
+    if (index) {
+        uint8_t pattern[IOTC_OTA_DELTA_PATTERN_SIZE];
+        memcpy(pattern, p->patterns[index], sizeof(pattern));
+        memmove(p->patterns[1], p->patterns[0], sizeof(pattern) * index);
+        memmove(&p->pattern_lengths[1], &p->pattern_lengths[0], index);
+        memcpy(p->patterns[0], pattern, sizeof(pattern));
+        p->pattern_lengths[0] = length;
+    }
+    p->length -= length;
+    int status = copy_source(d, p->patterns[0], length);
+    end_run(p);
+    return status;
+}
+
+// Starts reading added bytes, which become the most recent pattern if is_pattern
+static int start_added(IotConnectOtaDeltaProgress *p, uint32_t count, bool is_pattern) {
+    if (0 == count || count > p->length) {
+        Log.error(F("OTA delta: Bad ADD run"));
+        return IOTCL_ERR_PARSING_ERROR;
+    }
+    p->run_length = count;
+    p->is_pattern = is_pattern;
+    if (is_pattern) {
+        memmove(p->patterns[1], p->patterns[0], sizeof(p->patterns[0]) * (IOTC_OTA_DELTA_NUM_PATTERNS - 1));
+        memmove(&p->pattern_lengths[1], &p->pattern_lengths[0], IOTC_OTA_DELTA_NUM_PATTERNS - 1);
+        p->pattern_lengths[0] = (uint8_t) count;
+    }
+    p->step = STEP_ADD_DATA;
+    return IOTCL_SUCCESS;
+}
+
+// Acts on a varint that was read in the current step
+static int handle_value(IotConnectOtaDelta *d) {
+    IotConnectOtaDeltaProgress *p = &d->progress;
+    uint32_t value = p->value;
+    int status = IOTCL_SUCCESS;
+
+    switch (p->step) {
+        case STEP_COMMAND:
+            p->op = (uint8_t) (value & 3);
+            p->length = value >> 2;
+            if (p->op > IOTC_OTA_DELTA_OP_ADD || 0 == p->length
+                || p->length > get_target_size(p) - p->target_offset) {
+                Log.error(F("OTA delta: Bad command"));
+                return IOTCL_ERR_PARSING_ERROR;
+            }
+            if (IOTC_OTA_DELTA_OP_INSERT == p->op) {
+                p->run_length = p->length;
+                p->step = STEP_INSERT_DATA;
+            } else {
+                p->step = STEP_SOURCE_OFFSET;
+            }
+            break;
+        case STEP_SOURCE_OFFSET: {
+            int32_t offset = (int32_t) (value >> 1) ^ -(int32_t) (value & 1);
+            int64_t position = (int64_t) p->source_position + offset;
+            if (position < 0 || position + p->length > (int64_t) get_source_size(p)) {
+                Log.error(F("OTA delta: A command reads past the running image"));
+                return IOTCL_ERR_PARSING_ERROR;
+            }
+            p->source_position = (uint32_t) position;
+            if (IOTC_OTA_DELTA_OP_COPY == p->op) {
+                status = copy_source(d, NULL, p->length);
+                end_command(p);
+            } else {
+                p->step = STEP_RUN;
+            }
+            break;
+        }
+        case STEP_RUN: {
+            uint32_t unchanged = value >> 3;
+            uint8_t code = (uint8_t) (value & 7);
+            if (unchanged > p->length) {
+                Log.error(F("OTA delta: Bad ADD run"));
+                return IOTCL_ERR_PARSING_ERROR;
+            }
+            p->length -= unchanged;
+            status = copy_source(d, NULL, unchanged);
+            if (status || 0 == p->length) {
+                end_command(p);
+            } else if (code < IOTC_OTA_DELTA_NUM_PATTERNS) {
+                status = apply_pattern(d, code);
+            } else if (IOTC_OTA_DELTA_CODE_LONG == code) {
+                p->step = STEP_RUN_ADDED;
+            } else {
+                status = start_added(p, code - IOTC_OTA_DELTA_NUM_PATTERNS + 1, true);
+            }
+            break;
+        }
+        case STEP_RUN_ADDED:
+            status = start_added(p, value, false);
+            break;
+        default:
+            return IOTCL_ERR_FAILED;
+    }
+    return status;
+}
+
+// Writes the data of an INSERT or of the added bytes of an ADD run
+static int handle_data(IotConnectOtaDelta *d, const uint8_t *data, size_t data_length) {
+    IotConnectOtaDeltaProgress *p = &d->progress;
+    int status;
+    if (STEP_INSERT_DATA == p->step) {
+        status = emit(d, data, data_length);
+    } else {
+        if (p->is_pattern) {
+            memcpy(&p->patterns[0][p->pattern_lengths[0] - p->run_length], data, data_length);
+        }
+        status = copy_source(d, data, data_length);
+    }
+    p->run_length -= (uint32_t) data_length;
+    p->length -= (uint32_t) data_length;
+    if (0 == p->run_length) {
+        end_run(p);
+    }
+    return status;
+}
+
+static int delta_open(void *context, uint32_t offset) {
+    IotConnectOtaDelta *d = (IotConnectOtaDelta *) context;
+    IotConnectOtaDeltaProgress *p = &d->progress;
+    if (0 == offset) {
+        memset(p, 0, sizeof(*p));
+        iotcl_sha256_init(&p->sha);
+    } else if (!d->is_loaded || offset != p->input_offset) {
+        return IOTCL_ERR_FAILED; // the download starts over
+    }
+    d->is_loaded = false;
+    return d->config.target_sink->open(d->config.target_context, p->target_offset);
+}
+
+static int delta_write(void *context, uint32_t offset, const uint8_t *data, size_t data_length) {
+    IotConnectOtaDelta *d = (IotConnectOtaDelta *) context;
+    IotConnectOtaDeltaProgress *p = &d->progress;
+    if (offset != p->input_offset) {
+        return IOTCL_ERR_FAILED;
+    }
+    while (data_length) {
+        size_t used = 1;
+        int status = IOTCL_SUCCESS;
+        switch (p->step) {
+            case STEP_HEADER: {
+                size_t header_length = p->input_offset;
+                used = sizeof(p->header) - header_length;
+                if (used > data_length) {
+                    used = data_length;
+                }
+                memcpy(&p->header[header_length], data, used);
+                if (header_length + used == sizeof(p->header)) {
+                    status = check_header(d);
+                    p->step = STEP_COMMAND;
+                }
+                break;
+            }
+            case STEP_INSERT_DATA:
+            case STEP_ADD_DATA:
+                used = p->run_length < data_length ? p->run_length : data_length;
+                status = handle_data(d, data, used);
+                break;
+            case STEP_DONE:
+                Log.error(F("OTA delta: The package has data past the end of the target image"));
+                return IOTCL_ERR_PARSING_ERROR;
+            default:
+                // a varint
+                if (0 == p->shift) {
+                    p->value = 0;
+                }
+                if (p->shift > 28) {
+                    Log.error(F("OTA delta: Bad number"));
+                    return IOTCL_ERR_PARSING_ERROR;
+                }
+                p->value |= (uint32_t) (data[0] & 0x7F) << p->shift;
+                p->shift += 7;
+                if (0 == (data[0] & 0x80)) {
+                    p->shift = 0;
+                    status = handle_value(d);
+                }
+                break;
+        }
+        if (status) {
+            return status;
+        }
+        p->input_offset += (uint32_t) used;
+        data += used;
+        data_length -= used;
+    }
+    return IOTCL_SUCCESS;
+}
+
+static int delta_close(void *context, bool is_complete, uint32_t image_size, const uint8_t *digest) {
+    IotConnectOtaDelta *d = (IotConnectOtaDelta *) context;
+    IotConnectOtaDeltaProgress *p = &d->progress;
+    uint8_t target_digest[IOTCL_SHA256_DIGEST_SIZE];
+    (void) image_size;
+    (void) digest;
+
+    if (!is_complete) {
+        return d->config.target_sink->close(d->config.target_context, false, 0, NULL);
+    }
+    if (STEP_DONE != p->step) {
+        Log.error(F("OTA delta: The package ended before the target image"));
+        d->config.target_sink->close(d->config.target_context, false, 0, NULL);
+        return IOTCL_ERR_PARSING_ERROR;
+    }
+    iotcl_sha256_finish(&p->sha, target_digest);
+    if (0 != memcmp(target_digest, &p->header[HEADER_TARGET_SHA_OFFSET], sizeof(target_digest))) {
+        Log.error(F("OTA delta: The new image does not match its SHA-256"));
+        d->config.target_sink->close(d->config.target_context, false, 0, NULL);
+        return IOTCL_ERR_BAD_VALUE;
+    }
+    return d->config.target_sink->close(d->config.target_context, true, p->target_offset, target_digest);
+}
+
+// The state of the target sink holds the progress of the delta, followed by the state of the download
+static int delta_save_state(void *context, const void *state, size_t state_size) {
+    IotConnectOtaDelta *d = (IotConnectOtaDelta *) context;
+    IotcOtaDeltaStateRecord r;
+    if (!d->config.target_sink->save_state) {
+        return IOTCL_SUCCESS; // the download will start over after a reset
+    }
+    if (state_size > sizeof(r.download)) {
+        Log.error(F("OTA delta: The download state is larger than IOTC_OTA_STATE_MAX_SIZE"));
+        return IOTCL_ERR_OVERFLOW;
+    }
+    memset(&r.delta, 0, sizeof(r.delta));
+    r.delta.magic = IOTC_OTA_DELTA_STATE_MAGIC;
+    r.delta.progress = d->progress;
+    r.delta.crc = iotcl_crc16_update(0xFFFF, &r.delta.progress, sizeof(r.delta.progress));
+    memcpy(r.download, state, state_size);
+    return d->config.target_sink->save_state(d->config.target_context, &r, sizeof(r.delta) + state_size);
+}
+
+static int delta_load_state(void *context, void *state, size_t state_size) {
+    IotConnectOtaDelta *d = (IotConnectOtaDelta *) context;
+    IotcOtaDeltaStateRecord r;
+    d->is_loaded = false;
+    if (!d->config.target_sink->load_state) {
+        return IOTCL_ERR_CONFIG_MISSING;
+    }
+    if (state_size > sizeof(r.download)) {
+        Log.error(F("OTA delta: The download state is larger than IOTC_OTA_STATE_MAX_SIZE"));
+        return IOTCL_ERR_OVERFLOW;
+    }
+    int status = d->config.target_sink->load_state(d->config.target_context, &r, sizeof(r.delta) + state_size);
+    if (status) {
+        return status; // nothing was saved
+    }
+    if (IOTC_OTA_DELTA_STATE_MAGIC != r.delta.magic
+        || r.delta.crc != iotcl_crc16_update(0xFFFF, &r.delta.progress, sizeof(r.delta.progress))) {
+        return IOTCL_ERR_PARSING_ERROR;
+    }
+    d->progress = r.delta.progress;
+    d->is_loaded = true;
+    memcpy(state, r.download, state_size);
+    return IOTCL_SUCCESS;
+}
+
+const IotConnectOtaSink iotconnect_ota_delta_sink = {
+    delta_open,
+    delta_write,
+    delta_close,
+    delta_save_state,
+    delta_load_state
+};
+
+void iotconnect_ota_delta_init(IotConnectOtaDelta *delta, const IotConnectOtaDeltaConfig *config) {
+    memset(delta, 0, sizeof(*delta));
+    delta->config = *config;
+}
+
+int iotconnect_ota_delta_find_url(IotclC2dEventData data, bool is_delta) {
+    const size_t extension_length = strlen(IOTC_OTA_DELTA_FILE_EXTENSION);
+    int num_urls = iotcl_c2d_get_ota_url_count(data);
+    for (int i = 0; i < num_urls; i++) {
+        const char *file_name = iotcl_c2d_get_ota_original_filename(data, i);
+        size_t length = file_name ? strlen(file_name) : 0;
+        bool is_delta_file = length > extension_length
+            && 0 == strcmp(&file_name[length - extension_length], IOTC_OTA_DELTA_FILE_EXTENSION);
+        if (is_delta_file == is_delta) {
+            return i;
+        }
+    }
+    return -1;
+}
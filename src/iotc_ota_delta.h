@@ -0,0 +1,138 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * Applies a delta package, which is a binary diff of the new firmware against the running one, as it is downloaded
+ * by iotc_ota.h. The delta is an IotConnectOtaSink that rebuilds the new image from the running image and the diff,
+ * and writes it to another sink, usually the staging area of the flash. It needs no RAM for either image:
+ * the running image is read through a window of IOTC_OTA_DELTA_WINDOW_SIZE bytes, and the new image is written
+ * to the staging sink in order, as a full image would be.
+ *
+ * A package is generated on the host with extras/host/tools/iotc_ota_delta.cpp. It is little endian:
+ *
+ *   "IOTD", version (1 byte), 3 reserved bytes, the size of the source (running) image (4 bytes),
+ *   the size of the target (new) image (4 bytes), the SHA-256 of the source and the SHA-256 of the target,
+ *
+ * followed by commands until the target is complete. Each command starts with a varint of (length << 2 | op):
+ *
+ *   COPY    A zigzag varint source offset, relative to where the previous COPY or ADD ended in the source.
+ *           length bytes are copied from there.
+ *   INSERT  length bytes that are written as they are.
+ *   ADD     A source offset as for COPY, then runs until length bytes are written. This is how code that moved,
+ *           with its addresses changed, is patched. A run is a varint of (unchanged << 3 | code). unchanged bytes
+ *           are copied from the source, and then, unless that completes the command, bytes are added to the next
+ *           source bytes: the most recent (code 0) or the second most recent (code 1) pattern of added bytes,
+ *           1 to 5 bytes that follow (code 2 to 6) and become the most recent pattern, or a varint count
+ *           of bytes that follow (code 7). The same address change repeats all over the image, so it is mostly
+ *           a pattern, and a run is one or two bytes.
+ *
+ * The package is verified by the download against IotConnectOtaConfig.expected_sha256, and the target against
+ * the SHA-256 in the header, before the staging sink is closed with is_complete. A package for a different
+ * source image fails as soon as its header is received, if the source size or its SHA-256 is known.
+ *
+ * The progress of the delta is saved with the progress of the download, in the state of the staging sink,
+ * so a delta download resumes after a reset as a full image download does.
+ *
+ * Typical use, with a URL for the full image and one for the delta in the OTA event:
+ *
+ * static IotConnectOtaDelta delta;
+ *
+ * int index = iotconnect_ota_delta_find_url(data, true);
+ * if (index >= 0) {
+ *     IotConnectOtaDeltaConfig dc = {0};
+ *     dc.read_source = read_running_image; // from the application flash
+ *     dc.source_size = running_image_size;
+ *     dc.target_sink = &flash_sink;
+ *     iotconnect_ota_delta_init(&delta, &dc);
+ *     c.sink = &iotconnect_ota_delta_sink;
+ *     c.sink_context = &delta;
+ * } else {
+ *     index = iotconnect_ota_delta_find_url(data, false);
+ *     c.sink = &flash_sink;
+ * }
+ * c.host = iotcl_c2d_get_ota_url_hostname(data, index);
+ * ...
+ */
+
+#ifndef IOTC_OTA_DELTA_H
+#define IOTC_OTA_DELTA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "iotcl_c2d.h"
+#include "iotcl_sha256.h"
+#include "iotc_ota.h"
+
+// How much of the source image is read at a time
+#ifndef IOTC_OTA_DELTA_WINDOW_SIZE
+#define IOTC_OTA_DELTA_WINDOW_SIZE 64
+#endif
+
+// The original file names of delta packages in the OTA event end with this
+#ifndef IOTC_OTA_DELTA_FILE_EXTENSION
+#define IOTC_OTA_DELTA_FILE_EXTENSION ".iotd"
+#endif
+
+#define IOTC_OTA_DELTA_MAGIC "IOTD"
+#define IOTC_OTA_DELTA_VERSION 1
+#define IOTC_OTA_DELTA_HEADER_SIZE (4 + 4 + 4 + 4 + IOTCL_SHA256_DIGEST_SIZE * 2)
+#define IOTC_OTA_DELTA_PATTERN_SIZE 5 // The most bytes that a pattern of an ADD run can have
+#define IOTC_OTA_DELTA_NUM_PATTERNS 2
+#define IOTC_OTA_DELTA_CODE_LONG 7    // The ADD run code with a count
+
+typedef enum {
+    IOTC_OTA_DELTA_OP_COPY = 0,
+    IOTC_OTA_DELTA_OP_INSERT = 1,
+    IOTC_OTA_DELTA_OP_ADD = 2
+} IotConnectOtaDeltaOp;
+
+typedef struct {
+    // Reads the running image. Returns IOTCL_SUCCESS, or an error that fails the download.
+    int (*read_source)(void *context, uint32_t offset, uint8_t *data, size_t data_length);
+    void *source_context;
+    uint32_t source_size;               // Optional. Packages for an image of another size are rejected.
+    const uint8_t *source_sha256;       // Optional. Packages for an image with another SHA-256 are rejected.
+    const IotConnectOtaSink *target_sink; // Where the new image goes, with the state of the download if it saves one
+    void *target_context;
+} IotConnectOtaDeltaConfig;
+
+// The progress of applying the delta, which is saved with the progress of the download
+typedef struct {
+    uint32_t input_offset;              // Of the package
+    uint32_t target_offset;
+    uint32_t source_position;           // Where the last COPY or ADD ended
+    uint32_t length;                    // What is left of the current command
+    uint32_t run_length;                // What is left of the INSERT data or the added bytes of an ADD run
+    uint32_t value;                     // The varint being read
+    uint8_t shift;
+    uint8_t step;
+    uint8_t op;
+    bool is_pattern;                    // The added bytes being read are the new most recent pattern
+    uint8_t pattern_lengths[IOTC_OTA_DELTA_NUM_PATTERNS];
+    uint8_t patterns[IOTC_OTA_DELTA_NUM_PATTERNS][IOTC_OTA_DELTA_PATTERN_SIZE]; // The most recent first
+    uint8_t header[IOTC_OTA_DELTA_HEADER_SIZE];
+    IotclSha256 sha;                    // of the target
+} IotConnectOtaDeltaProgress;
+
+// The state of a delta. The fields are internal.
+typedef struct {
+    IotConnectOtaDeltaConfig config;
+    IotConnectOtaDeltaProgress progress;
+    bool is_loaded;                     // The progress was restored by load_state()
+    uint8_t window[IOTC_OTA_DELTA_WINDOW_SIZE];
+} IotConnectOtaDelta;
+
+// Pass a delta initialized with iotconnect_ota_delta_init() as the sink context
+extern const IotConnectOtaSink iotconnect_ota_delta_sink;
+
+// The config is copied, but the strings and the sink that it points to need to remain valid during the download
+void iotconnect_ota_delta_init(IotConnectOtaDelta *delta, const IotConnectOtaDeltaConfig *config);
+
+// Returns the index of the first URL in the OTA event that is a delta package if is_delta, or a full image if not,
+// according to the original file name. Returns -1 if there is none.
+int iotconnect_ota_delta_find_url(IotclC2dEventData data, bool is_delta);
+
+#endif // IOTC_OTA_DELTA_H
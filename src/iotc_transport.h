@@ -0,0 +1,81 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * The transport is everything that iotconnect.cpp needs from the network: HTTPS requests for discovery
+ * and identity, and an MQTT client that connects to the broker from iotcl_mqtt_get_config(), subscribes to
+ * the C2D topic and publishes messages.
+ *
+ * The platform provides the default transport at link time as iotc_default_transport.
+ * On the AVR-IoT Cellular board, it is the Sequans modem (see iotc_transport_avr.cpp).
+ * extras/host provides a POSIX implementation, so that the SDK can run on Linux against a local broker.
+ * A different transport can also be passed to iotconnect_sdk_init() with IotConnectClientConfig.
+ */
+
+#ifndef IOTC_TRANSPORT_H
+#define IOTC_TRANSPORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "iotcl.h"
+#include "iotc_http_request.h"
+#include "iotc_mqtt_client.h"
+
+// The functions have the same semantics as iotconnect_https_request() and the iotc_mqtt_client_* functions
+// of the AVR implementation. Received C2D messages are passed to IotConnectMqttClientConfig.c2d_msg_cb.
+struct IotConnectTransportTag {
+    // Optional. Sets the clock, so that the telemetry timestamps are correct.
+    void (*sync_time)(void);
+
+    // GET if send_str is NULL, POST otherwise. The response data should be freed with free_https_response().
+    int (*https_request)(IotConnectHttpResponse *response, const char *host, const char *path, const char *send_str);
+    void (*free_https_response)(IotConnectHttpResponse *response);
+    // Optional. See iotconnect_https_request_streamed(). Discovery and identity responses are parsed as they arrive
+    // if this is set, and are received whole with https_request() otherwise.
+    int (*https_request_streamed)(
+            const char *host,
+            const char *path,
+            const char *send_str,
+            IotConnectHttpBodySink sink_fn,
+            void *context
+    );
+    // Optional. See iotconnect_https_get_range(). Needed for OTA downloads (see iotc_ota.h).
+    int (*https_get_range)(
+            const char *host,
+            const char *path,
+            uint32_t offset,
+            uint32_t length,
+            IotConnectHttpBodySink sink_fn,
+            void *context,
+            IotConnectHttpRangeResponse *response
+    );
+
+    // Starts connecting without waiting. mqtt_loop() completes the connection.
+    bool (*mqtt_start)(IotConnectMqttClientConfig *c);
+    // Connects and subscribes before returning.
+    bool (*mqtt_init)(IotConnectMqttClientConfig *c);
+    void (*mqtt_disconnect)(void);
+    bool (*mqtt_is_connected)(void);
+    IotConnectConnectionStatus (*mqtt_get_status)(void);
+    // Advances the connection, receives messages and reports deliveries. Should not block for long.
+    void (*mqtt_loop)(void);
+    // Returns a publish ID that is passed to the delivery callback, or 0 if the message was not accepted.
+    uint16_t (*mqtt_publish)(const char *topic, const char *message, IotclDeliveryClass delivery_class);
+    // Optional. See iotc_mqtt_client_publish_streamed().
+    uint16_t (*mqtt_publish_streamed)(
+            const char *topic,
+            IotclMqttPayloadWriter writer_fn,
+            void *context,
+            IotclDeliveryClass delivery_class
+    );
+    uint16_t (*mqtt_get_last_publish_id)(void);
+};
+
+extern const IotConnectTransport iotc_default_transport;
+
+// The transport that iotconnect_sdk_init() was configured with
+const IotConnectTransport *iotconnect_sdk_get_transport(void);
+
+#endif // IOTC_TRANSPORT_H
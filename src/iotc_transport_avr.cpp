@@ -0,0 +1,31 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+#include "iotc_time.h"
+#include "iotc_http_request.h"
+#include "iotc_mqtt_client.h"
+#include "iotc_transport.h"
+
+static void iotc_transport_avr_sync_time(void) {
+    iotc_get_time_modem();
+}
+
+// The Sequans modem, through the AVR-IoT Cellular library
+const IotConnectTransport iotc_default_transport = {
+    iotc_transport_avr_sync_time,
+    iotconnect_https_request,
+    iotconnect_free_https_response,
+    iotconnect_https_request_streamed,
+    iotconnect_https_get_range,
+    iotc_mqtt_client_start,
+    iotc_mqtt_client_init,
+    iotc_mqtt_client_disconnect,
+    iotc_mqtt_client_is_connected,
+    iotc_mqtt_client_get_status,
+    iotc_mqtt_client_loop,
+    iotc_mqtt_client_publish,
+    iotc_mqtt_client_publish_streamed,
+    iotc_mqtt_client_get_last_publish_id
+};
@@ -37,14 +37,27 @@ static void print_value_if_not_null(const char* heading, const char* value) {
 }
 
 void *iotcl_malloc(size_t size) {
+    void *p = iotcl_arena_alloc(size);
+    if (p) {
+        return p;
+    }
+#if IOTCL_HEAP_STATS
+    return iotcl_heap_stats_malloc(cfg_malloc_fn, size);
+#else
     return cfg_malloc_fn(size);
+#endif
 }
 
 void iotcl_free(void *ptr) {
     // do an extra null check to make sure the behavior is defined for NULL
     // in case some odd custom implementation does not handle it.
-    if (ptr) {
+    // Arena memory is released all at once when the arena scope ends.
+    if (ptr && !iotcl_arena_owns(ptr)) {
+#if IOTCL_HEAP_STATS
+        iotcl_heap_stats_free(cfg_free_fn, ptr);
+#else
         cfg_free_fn(ptr);
+#endif
     }
 }
 
@@ -56,8 +69,14 @@ void iotcl_configure_dynamic_memory(IoTclMallocFunction malloc_fn, IoTclFreeFunc
     cfg_malloc_fn = malloc_fn;
     cfg_free_fn = free_fn;
     cJSON_Hooks cjson_hooks;
+#if IOTCL_HEAP_STATS
+    // cJSON allocations need to go through the instrumented allocator
+    cjson_hooks.malloc_fn = iotcl_malloc;
+    cjson_hooks.free_fn = iotcl_free;
+#else
     cjson_hooks.malloc_fn = malloc_fn;
     cjson_hooks.free_fn = free_fn;
+#endif
     cJSON_InitHooks(&cjson_hooks);
 }
 
@@ -69,6 +88,14 @@ int iotcl_init(IotclClientConfig *c) {
     int ret;
     iotcl_deinit();
 
+#if IOTCL_HEAP_STATS
+    // route cJSON allocations through the instrumented allocator, even if iotcl_configure_dynamic_memory() is not used
+    cJSON_Hooks cjson_hooks;
+    cjson_hooks.malloc_fn = iotcl_malloc;
+    cjson_hooks.free_fn = iotcl_free;
+    cJSON_InitHooks(&cjson_hooks);
+#endif
+
     if (NULL == c) {
         IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "iotcl_init: Client config is NULL");
         return IOTCL_ERR_MISSING_VALUE;
@@ -112,6 +139,7 @@ int iotcl_init(IotclClientConfig *c) {
     memcpy(&config.event_functions, &c->events, sizeof(config.event_functions));
     config.time_fn = c->time_fn;
     config.mqtt_send_cb = c->mqtt_send_cb;
+    config.mqtt_send_streamed_cb = c->mqtt_send_streamed_cb;
 
     // MQTT configuration is not processed for custom configs, so skip it altogether to simplify the logic below
     if (is_custom) {
@@ -232,6 +260,8 @@ int iotcl_init_and_print_config(IotclClientConfig *c) {
 
 void iotcl_deinit(void) {
 
+    iotcl_telemetry_release_pool();
+
     iotcl_free(config.mqtt_config.username);
     iotcl_free(config.mqtt_config.client_id);
     iotcl_free(config.mqtt_config.host);
@@ -279,7 +309,16 @@ void iotcl_mqtt_print_config(void) {
     print_value_if_not_null("CD       ", mc->cd);
 }
 
+static void iotcl_telemetry_payload_writer(IotclJsonWriter *w, void *context) {
+    // errors are reported through the writer overflow flag
+    iotcl_telemetry_write_serialized((IotclMessageHandle) context, w);
+}
+
 int iotcl_mqtt_send_telemetry(IotclMessageHandle msg, bool pretty) {
+    return iotcl_mqtt_send_telemetry_with_class(msg, pretty, IOTCL_DC_AT_LEAST_ONCE);
+}
+
+int iotcl_mqtt_send_telemetry_with_class(IotclMessageHandle msg, bool pretty, IotclDeliveryClass delivery_class) {
     if (!config.is_valid) {
         IOTCL_ERROR(IOTCL_ERR_CONFIG_MISSING, "iotcl_mqtt_send_telemetry: Library not configured!");
         return IOTCL_ERR_CONFIG_MISSING;
@@ -292,11 +331,23 @@ int iotcl_mqtt_send_telemetry(IotclMessageHandle msg, bool pretty) {
         IOTCL_ERROR(IOTCL_ERR_CONFIG_MISSING, "iotcl_mqtt_send_telemetry: mqtt_send_cb callback is not configured!");
         return IOTCL_ERR_CONFIG_MISSING;
     }
+    // messages created with iotcl_telemetry_create_in_buffer() can be sent directly from their buffer
+    const char *in_buffer_json_str = msg ? iotcl_telemetry_get_serialized_string(msg) : NULL;
+    if (in_buffer_json_str) {
+        config.mqtt_send_cb(config.mqtt_config.pub_rpt, in_buffer_json_str, delivery_class);
+        return IOTCL_SUCCESS;
+    }
+    if (msg && !pretty && config.mqtt_send_streamed_cb) {
+        if (IOTCL_SUCCESS == config.mqtt_send_streamed_cb(config.mqtt_config.pub_rpt, iotcl_telemetry_payload_writer, msg, delivery_class)) {
+            return IOTCL_SUCCESS;
+        }
+        // the transport cannot stream the message right now, so send it as a string
+    }
     char * json_str = iotcl_telemetry_create_serialized_string(msg, pretty);
     if (!json_str) {
         return IOTCL_ERR_FAILED; // called function will print the error
     }
-    config.mqtt_send_cb(config.mqtt_config.pub_rpt, json_str);
+    config.mqtt_send_cb(config.mqtt_config.pub_rpt, json_str, delivery_class);
     iotcl_telemetry_destroy_serialized_string(json_str);
     return IOTCL_SUCCESS;
 }
@@ -318,7 +369,7 @@ int iotcl_mqtt_send_ota_ack(const char *ack_id, int ota_status, const char *mess
     if (!json_str) {
         return IOTCL_ERR_FAILED; // called function will print the error
     }
-    config.mqtt_send_cb(config.mqtt_config.pub_ack, json_str);
+    config.mqtt_send_cb(config.mqtt_config.pub_ack, json_str, IOTCL_DC_CRITICAL);
     iotcl_c2d_destroy_ack_json(json_str);
     return IOTCL_SUCCESS;
 }
@@ -340,7 +391,7 @@ int iotcl_mqtt_send_cmd_ack(const char *ack_id, int cmd_status, const char *mess
     if (!json_str) {
         return IOTCL_ERR_FAILED; // called function will print the error
     }
-    config.mqtt_send_cb(config.mqtt_config.pub_ack, json_str);
+    config.mqtt_send_cb(config.mqtt_config.pub_ack, json_str, IOTCL_DC_CRITICAL);
     iotcl_c2d_destroy_ack_json(json_str);
     return IOTCL_SUCCESS;
 }
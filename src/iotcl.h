@@ -103,7 +103,30 @@ typedef void *(*IoTclMallocFunction)(size_t size);
 
 typedef void (*IoTclFreeFunction)(void *ptr);
 
-typedef void (*IotclMqttTransportSend)(const char *topic, const char *json_str);
+// How hard the transport should try to deliver a message. The transport can also schedule the classes differently,
+// for example send critical messages first, or drop fire-and-forget messages first when it runs out of room.
+typedef enum {
+    IOTCL_DC_AT_LEAST_ONCE = 0, // QoS 1. The transport reports the failure if the message is not acknowledged.
+    IOTCL_DC_AT_MOST_ONCE,      // QoS 0. Fire and forget. Suitable for frequent telemetry that can tolerate loss.
+    IOTCL_DC_CRITICAL           // QoS 1. The transport keeps the message and retries until it is delivered.
+} IotclDeliveryClass;
+
+typedef void (*IotclMqttTransportSend)(const char *topic, const char *json_str, IotclDeliveryClass delivery_class);
+
+// Writes an MQTT payload. See IotclMqttTransportSendStreamed.
+typedef void (*IotclMqttPayloadWriter)(IotclJsonWriter *w, void *context);
+
+// Optional transport that sends a payload as it is being written, so that it never needs to be held in RAM whole.
+// The transport should call writer_fn with a writer that only counts (see iotcl_json_writer_init_with_sink()) to learn
+// the payload length, and then once more with a writer that sends the output.
+// writer_fn produces the same output each time. The transport should return IOTCL_SUCCESS if the message was sent,
+// or an error if the message cannot be streamed right now, in which case it is sent with mqtt_send_cb instead.
+typedef int (*IotclMqttTransportSendStreamed)(
+        const char *topic,
+        IotclMqttPayloadWriter writer_fn,
+        void *context,
+        IotclDeliveryClass delivery_class
+);
 
 typedef time_t (*IotclTimeFunction)(void);
 
@@ -171,6 +194,10 @@ typedef struct {
     // Simply cast the pointer and run strlen() on the received string before forwarding.
     IotclMqttTransportSend mqtt_send_cb;
 
+    // Optional. If configured, telemetry messages created with iotcl_telemetry_create() are sent with this callback
+    // without serializing them into a string first. See IotclMqttTransportSendStreamed.
+    IotclMqttTransportSendStreamed mqtt_send_streamed_cb;
+
     // Optional. See TIME CONFIGURATION GUIDE at the header of this file.
     IotclTimeFunction time_fn;
 
@@ -213,10 +240,16 @@ IotclMqttConfig *iotcl_mqtt_get_config(void);
 // If value is null, it is not printed.
 void iotcl_mqtt_print_config(void);
 
-// Send a telemetry message constructed with iotcl_telemetry_create()
+// Send a telemetry message constructed with iotcl_telemetry_create() or iotcl_telemetry_create_in_buffer()
+// Messages created in buffer are sent without allocating any memory and the pretty argument is ignored.
+// The message is sent with IOTCL_DC_AT_LEAST_ONCE.
 // Call this only if mqtt_send_cb is configured. Otherwise parse the messages manually using the iotcl_event.h functions.
 int iotcl_mqtt_send_telemetry(IotclMessageHandle msg, bool pretty);
 
+// Same as iotcl_mqtt_send_telemetry(), but with the given delivery class.
+int iotcl_mqtt_send_telemetry_with_class(IotclMessageHandle msg, bool pretty, IotclDeliveryClass delivery_class);
+
+// Acks are sent with IOTCL_DC_CRITICAL, as a lost ack leaves the command or the OTA pending in IoTConnect.
 // Call this only if mqtt_send_cb is configured. Otherwise parse the messages manually using the iotcl_event.h functions.
 int iotcl_mqtt_send_ota_ack(
         const char *ack_id, // Required. Received in the OTA callback.
@@ -256,7 +289,8 @@ int iotcl_mqtt_receive_c2d_with_length(const uint8_t *data, size_t data_len);
 
 // The user should not generally call this function, but it is provided for convenience, and for internal use,
 // or custom configuration memory allocation.
-// This function will redirect to iotcl_configure_dynamic_memory() configured values, if provided.
+// This function will redirect to iotcl_configure_dynamic_memory() configured values, if provided,
+// or allocate from the arena while an arena scope is open. See iotcl_arena.h.
 void *iotcl_malloc(size_t size);
 
 // The user should not generally call this function, but it is provided for convenience, and for internal use,
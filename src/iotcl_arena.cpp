@@ -0,0 +1,107 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "cJSON.h"
+#include "iotcl_internal.h"
+#include "iotcl_log.h"
+#include "iotcl.h"
+#include "iotcl_arena.h"
+
+#define IOTCL_ARENA_ALIGN_UP(x) (((x) + IOTCL_MAX_ALIGNMENT - 1) & ~((size_t) IOTCL_MAX_ALIGNMENT - 1))
+
+typedef struct {
+    uint8_t *buffer;
+    IotclArenaStats stats;
+    unsigned int scope_depth;
+} IotclArena;
+
+static IotclArena arena = {0};
+
+int iotcl_arena_configure(void *buffer, size_t size) {
+    const char *FUNCTION_NAME = "iotcl_arena_configure";
+    if (arena.scope_depth) {
+        IOTCL_ERROR(IOTCL_ERR_FAILED, "%s: Cannot configure the arena while a scope is open!", FUNCTION_NAME);
+        return IOTCL_ERR_FAILED;
+    }
+    memset(&arena, 0, sizeof(arena));
+    if (!buffer) {
+        return IOTCL_SUCCESS;
+    }
+
+    size_t padding = IOTCL_ARENA_ALIGN_UP((uintptr_t) buffer) - (uintptr_t) buffer;
+    if (size <= padding) {
+        IOTCL_ERROR(IOTCL_ERR_BAD_VALUE, "%s: The buffer is too small!", FUNCTION_NAME);
+        return IOTCL_ERR_BAD_VALUE;
+    }
+    arena.buffer = (uint8_t *) buffer + padding;
+    arena.stats.size = size - padding;
+
+    // cJSON would otherwise keep using the functions that were passed to iotcl_configure_dynamic_memory()
+    cJSON_Hooks cjson_hooks;
+    cjson_hooks.malloc_fn = iotcl_malloc;
+    cjson_hooks.free_fn = iotcl_free;
+    cJSON_InitHooks(&cjson_hooks);
+    return IOTCL_SUCCESS;
+}
+
+void iotcl_arena_begin(void) {
+    if (arena.buffer) {
+        arena.scope_depth++;
+    }
+}
+
+void iotcl_arena_end(void) {
+    if (0 == arena.scope_depth) {
+        return;
+    }
+    arena.scope_depth--;
+    if (0 == arena.scope_depth) {
+        arena.stats.used = 0;
+    }
+}
+
+void iotcl_arena_get_stats(IotclArenaStats *stats) {
+    if (stats) {
+        *stats = arena.stats;
+    }
+}
+
+void *iotcl_arena_alloc(size_t size) {
+    if (0 == arena.scope_depth) {
+        return NULL;
+    }
+    size_t aligned_size = IOTCL_ARENA_ALIGN_UP(size);
+    if (aligned_size < size || aligned_size > arena.stats.size - arena.stats.used) {
+        arena.stats.num_fallbacks++;
+        return NULL;
+    }
+    void *p = arena.buffer + arena.stats.used;
+    arena.stats.used += aligned_size;
+    if (arena.stats.used > arena.stats.peak) {
+        arena.stats.peak = arena.stats.used;
+    }
+    return p;
+}
+
+bool iotcl_arena_owns(const void *ptr) {
+    // compare integers, as comparing pointers to different objects is undefined
+    uintptr_t p = (uintptr_t) ptr;
+    uintptr_t start = (uintptr_t) arena.buffer;
+    return arena.buffer && p >= start && p < start + arena.stats.size;
+}
+
+unsigned int iotcl_arena_suspend(void) {
+    unsigned int saved_depth = arena.scope_depth;
+    arena.scope_depth = 0;
+    return saved_depth;
+}
+
+void iotcl_arena_resume(unsigned int saved_depth) {
+    arena.scope_depth = saved_depth;
+}
@@ -0,0 +1,69 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * The arena is an optional bump allocator for short-lived library and cJSON allocations.
+ * Once configured with a user supplied buffer, all iotcl_malloc() calls (and cJSON allocations)
+ * made between iotcl_arena_begin() and iotcl_arena_end() come from the arena.
+ * Allocation is a pointer increment, iotcl_free() of arena memory does nothing,
+ * and iotcl_arena_end() releases everything at once, so building or parsing messages
+ * in a long-running loop does not fragment the heap.
+ *
+ * Typical use:
+ *
+ * static uint8_t arena_buffer[1024];
+ * iotcl_arena_configure(arena_buffer, sizeof(arena_buffer));
+ * ...
+ * iotcl_arena_begin();
+ * IotclMessageHandle msg = iotcl_telemetry_create();
+ * iotcl_telemetry_set_number(msg, "temperature", t);
+ * iotcl_mqtt_send_telemetry(msg, false);
+ * iotcl_telemetry_destroy(msg);
+ * iotcl_arena_end();
+ *
+ * Processing of received C2D messages is wrapped into an arena scope automatically (see IOTCL_C2D_USE_ARENA),
+ * so the command and OTA callbacks run inside the scope as well.
+ *
+ * IMPORTANT: Anything allocated inside the scope must not be used after iotcl_arena_end().
+ * Do not call iotcl_init() or store strings from iotcl_strdup() and similar functions for later use inside the scope.
+ * If the arena runs out of space, allocations fall back to the heap, and are freed normally.
+ * Use iotcl_arena_get_stats() to size the buffer so that this does not happen.
+ */
+
+#ifndef IOTCL_ARENA_H
+#define IOTCL_ARENA_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    size_t size;                // Size of the configured buffer, not counting the alignment padding at the start
+    size_t used;                // Bytes currently allocated from the arena
+    size_t peak;                // Highest "used" value since iotcl_arena_configure()
+    unsigned int num_fallbacks; // Number of allocations that did not fit and were allocated on the heap
+} IotclArenaStats;
+
+// Sets the buffer to allocate from and routes cJSON allocations through iotcl_malloc() and iotcl_free().
+// Pass NULL buffer to disable the arena. Must not be called while a scope is open.
+// If iotcl_configure_dynamic_memory() is used, call it before this function.
+int iotcl_arena_configure(void *buffer, size_t size);
+
+// Opens an allocation scope. Scopes can be nested, and the arena is reset when the outermost scope ends.
+// Does nothing if the arena is not configured.
+void iotcl_arena_begin(void);
+
+// Closes the scope opened by iotcl_arena_begin().
+void iotcl_arena_end(void);
+
+void iotcl_arena_get_stats(IotclArenaStats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTCL_ARENA_H
@@ -3,6 +3,7 @@
  * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
  */
 
+#include <stdlib.h>
 #include <string.h>
 
 #include "cJSON.h"
@@ -10,7 +11,9 @@
 #include "iotcl_internal.h"
 #include "iotcl_util.h"
 #include "iotcl.h"
+#include "iotcl_arena.h"
 #include "iotcl_c2d.h"
+#include "iotcl_json_tokenizer.h"
 #include "iotcl_cfg.h"
 
 #define HTTPS_PREFIX "https://"
@@ -37,12 +40,118 @@ typedef enum {
     IOTCL_C2D_ET_STOP_HEARTBEAT = 111,
 } IotclC2dEventType;
 
+#if IOTCL_C2D_MAX_TOKENS > 0
+// The in-place backend refers to JSON values by their token index
+typedef int IotclC2dNode;
+#define IOTCL_C2D_NO_NODE (-1)
+#else
+typedef cJSON *IotclC2dNode;
+#define IOTCL_C2D_NO_NODE NULL
+#endif
+
 struct IotclC2dEventDataTag {
+#if IOTCL_C2D_MAX_TOKENS > 0
+    char *json;         // The message, with string values terminated in place
+    char *json_copy;    // Allocated copy of the message, if it was not passed as modifiable
+    IotclJsonToken tokens[IOTCL_C2D_MAX_TOKENS];
+    unsigned int num_tokens;
+#else
     cJSON *root;
+#endif
     IotclC2dEventType type;
     char *hostname; // May ore may not be allocated. Temporary storage for parsed hostname string.
 };
 
+#if IOTCL_C2D_MAX_TOKENS > 0
+static IotclC2dNode c2d_root(IotclC2dEventData data) {
+    return data->num_tokens > 0 ? 0 : IOTCL_C2D_NO_NODE;
+}
+
+static IotclC2dNode c2d_get_item(IotclC2dEventData data, IotclC2dNode object, const char *name) {
+    if (IOTCL_C2D_NO_NODE == object || IOTCL_JSON_TOKEN_OBJECT != data->tokens[object].type) {
+        return IOTCL_C2D_NO_NODE;
+    }
+    unsigned int key = (unsigned int) object + 1;
+    for (unsigned int i = 0; i < data->tokens[object].size; i++) {
+        unsigned int value = key + 1;
+        if (0 == strcmp(&data->json[data->tokens[key].start], name)) {
+            return (IotclC2dNode) value;
+        }
+        key = iotcl_json_token_skip(data->tokens, data->num_tokens, value);
+    }
+    return IOTCL_C2D_NO_NODE;
+}
+
+static const char *c2d_get_string(IotclC2dEventData data, IotclC2dNode node) {
+    if (IOTCL_C2D_NO_NODE == node || IOTCL_JSON_TOKEN_STRING != data->tokens[node].type) {
+        return NULL;
+    }
+    return &data->json[data->tokens[node].start];
+}
+
+static bool c2d_get_int(IotclC2dEventData data, IotclC2dNode node, int *value) {
+    if (IOTCL_C2D_NO_NODE == node || IOTCL_JSON_TOKEN_PRIMITIVE != data->tokens[node].type) {
+        return false;
+    }
+    const char *str = &data->json[data->tokens[node].start];
+    char *end;
+    long l = strtol(str, &end, 10);
+    if (end == str || *end != '\0') {
+        return false;
+    }
+    *value = (int) l;
+    return true;
+}
+
+static int c2d_get_array_size(IotclC2dEventData data, IotclC2dNode node) {
+    if (IOTCL_C2D_NO_NODE == node || IOTCL_JSON_TOKEN_ARRAY != data->tokens[node].type) {
+        return -1;
+    }
+    return (int) data->tokens[node].size;
+}
+
+static IotclC2dNode c2d_get_array_item(IotclC2dEventData data, IotclC2dNode array, int index) {
+    unsigned int item = (unsigned int) array + 1;
+    for (int i = 0; i < index; i++) {
+        item = iotcl_json_token_skip(data->tokens, data->num_tokens, item);
+    }
+    return (IotclC2dNode) item;
+}
+#else
+static IotclC2dNode c2d_root(IotclC2dEventData data) {
+    return data->root;
+}
+
+static IotclC2dNode c2d_get_item(IotclC2dEventData data, IotclC2dNode object, const char *name) {
+    (void) data;
+    return cJSON_GetObjectItemCaseSensitive(object, name);
+}
+
+static const char *c2d_get_string(IotclC2dEventData data, IotclC2dNode node) {
+    (void) data;
+    return cJSON_GetStringValue(node);
+}
+
+static bool c2d_get_int(IotclC2dEventData data, IotclC2dNode node, int *value) {
+    (void) data;
+    if (!cJSON_IsNumber(node)) {
+        return false;
+    }
+    *value = (int) cJSON_GetNumberValue(node);
+    return true;
+}
+
+static int c2d_get_array_size(IotclC2dEventData data, IotclC2dNode node) {
+    (void) data;
+    return cJSON_IsArray(node) ? cJSON_GetArraySize(node) : -1;
+}
+
+static IotclC2dNode c2d_get_array_item(IotclC2dEventData data, IotclC2dNode array, int index) {
+    (void) data;
+    return cJSON_GetArrayItem(array, index);
+}
+#endif
+
 static int iotcl_c2d_process_callback(struct IotclC2dEventDataTag *event_data) {
     IotclGlobalConfig *config = iotcl_get_global_config();
     if (!config->is_valid) {
@@ -69,41 +178,33 @@ static int iotcl_c2d_process_callback(struct IotclC2dEventDataTag *event_data) {
     return IOTCL_SUCCESS;
 }
 
-static bool is_valid_string(const cJSON *json) {
-    return (NULL != json && cJSON_IsString(json) && json->valuestring != NULL);
-}
-
-static int iotcl_c2d_parse_json(cJSON *root) {
+// Processes the parsed message and destroys the event data
+static int iotcl_c2d_process_parsed_event(struct IotclC2dEventDataTag *event_data) {
     int status; // unknown in case someone forgot to set it
 
     // forward declare these variables to avoid permissive warnings due to goto-s.
-    struct IotclC2dEventDataTag event_data = {0};
-    char *version;
-    cJSON *j_v;
-    cJSON *j_ct;
+    IotclC2dNode root = c2d_root(event_data);
+    const char *version;
     int type;
 
     // parse version
-    j_v = cJSON_GetObjectItem(root, "v");
-    if (!is_valid_string(j_v)) {
+    version = c2d_get_string(event_data, c2d_get_item(event_data, root, "v"));
+    if (!version) {
         status = IOTCL_ERR_PARSING_ERROR;
         IOTCL_ERROR(status, "Unable to parse protocol version from the message");
         goto cleanup;
     }
-    version = cJSON_GetStringValue(j_v);
     if (strcmp(version, "2.1") != 0 && !is_protocol_version_warning_printed) {
         is_protocol_version_warning_printed = true;
         IOTCL_ERROR(IOTCL_ERR_PARSING_ERROR, "Encountered potentially unsupported protocol version %s!", version);
     }
 
     // parse event type
-    j_ct = cJSON_GetObjectItem(root, "ct");
-    if (!j_ct || !cJSON_IsNumber(j_ct)) {
+    if (!c2d_get_int(event_data, c2d_get_item(event_data, root, "ct"), &type)) {
         status = IOTCL_ERR_PARSING_ERROR;
         IOTCL_ERROR(status, "Unable to parse message type (\"ct\")");
         goto cleanup;
     }
-    type = (int) cJSON_GetNumberValue(j_ct);
 
     if (type != IOTCL_C2D_ET_DEVICE_COMMAND && type != IOTCL_C2D_ET_DEVICE_OTA) {
         status = IOTCL_ERR_PARSING_ERROR;
@@ -111,22 +212,21 @@ static int iotcl_c2d_parse_json(cJSON *root) {
         goto cleanup;
     }
 
-    event_data.root = root;
-    event_data.type = (IotclC2dEventType) type;
-
-    root = NULL; // Clear this pointer to avoid a double free in case some other step that can fail is added below
-
-    status = iotcl_c2d_process_callback(&event_data);
-    iotcl_c2d_destroy_event(&event_data);
-    return status;
+    event_data->type = (IotclC2dEventType) type;
+    status = iotcl_c2d_process_callback(event_data);
 
     cleanup:
-    cJSON_Delete(root);
+    iotcl_c2d_destroy_event(event_data);
     return status;
 }
 
-static const char *iotcl_c2d_get_string_value(cJSON *target_object, bool is_required, const char *name) {
-    const char *ret = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(target_object, name));
+static const char *iotcl_c2d_get_string_value(
+        IotclC2dEventData data,
+        IotclC2dNode target_object,
+        bool is_required,
+        const char *name
+) {
+    const char *ret = c2d_get_string(data, c2d_get_item(data, target_object, name));
     if (is_required && !ret) {
         IOTCL_ERROR(IOTCL_ERR_PARSING_ERROR, "\"%s\" was not found in c2d response", name);
     }
@@ -149,30 +249,32 @@ static int iotcl_c2d_validate_data_and_type(
     return IOTCL_SUCCESS;
 }
 
-static cJSON *iotcl_c2d_get_ota_url_array_item(IotclC2dEventData data, int index) {
+static IotclC2dNode iotcl_c2d_get_ota_url_array_item(IotclC2dEventData data, int index) {
     if (IOTCL_SUCCESS != iotcl_c2d_validate_data_and_type(data, IOTCL_C2D_ET_DEVICE_OTA, "download URL")) {
-        return NULL;
+        return IOTCL_C2D_NO_NODE;
     }
-    cJSON *urls = cJSON_GetObjectItemCaseSensitive(data->root, "urls");
-    if (NULL == urls || !cJSON_IsArray(urls)) {
+    IotclC2dNode urls = c2d_get_item(data, c2d_root(data), "urls");
+    int num_urls = c2d_get_array_size(data, urls);
+    if (num_urls < 0) {
         IOTCL_ERROR(IOTCL_ERR_PARSING_ERROR, "the \"urls\" array is not found in c2d response");
-        return NULL;
+        return IOTCL_C2D_NO_NODE;
     }
-    if (index < 0 || cJSON_GetArraySize(urls) > index) {
+    if (index >= 0 && index < num_urls) {
         // this URL should never be null...
-        return cJSON_GetArrayItem(urls, (int) index);
+        return c2d_get_array_item(data, urls, index);
     } else {
         IOTCL_ERROR(
                 IOTCL_ERR_BAD_VALUE,
                 "Attempting to access the OTA url item at index %d, but there are only %d items in the array",
                 (int) index,
-                cJSON_GetArraySize(urls)
+                num_urls
         );
-        return NULL;
+        return IOTCL_C2D_NO_NODE;
     }
 }
 
 static char *iotcl_c2d_create_ack(IotclC2dEventType type, const char *ack_id, int status, const char *message) {
+    IOTCL_HEAP_TAG_SCOPE(IOTCL_HEAP_TAG_C2D);
     char *result = NULL;
 
     // forward declare these variables to avoid permissive warnings due to goto-s.
@@ -204,22 +306,49 @@ static char *iotcl_c2d_create_ack(IotclC2dEventType type, const char *ack_id, in
     return NULL;
 }
 
-int iotcl_c2d_process_event(const char *str) {
-    cJSON *root = cJSON_Parse(str);
-    if (!root) {
-        IOTCL_ERROR(
-                IOTCL_ERR_PARSING_ERROR,
-                "JSON parsing error or possible out of memory error while parsing: \"%s\"",
-                str
-        );
-        return IOTCL_ERR_PARSING_ERROR;
+#if IOTCL_C2D_MAX_TOKENS > 0
+static int iotcl_c2d_parse_and_process(const char *data, size_t data_len, bool is_modifiable) {
+    struct IotclC2dEventDataTag event_data;
+    event_data.json_copy = NULL;
+    event_data.hostname = NULL;
+    event_data.num_tokens = 0;
+
+    if (is_modifiable) {
+        event_data.json = (char *) data;
+    } else {
+        // values are terminated in place, so we need a copy that we can modify
+        event_data.json = event_data.json_copy = (char *) iotcl_malloc(data_len + 1);
+        if (!event_data.json_copy) {
+            IOTCL_ERROR(IOTCL_ERR_OUT_OF_MEMORY, "Out of memory while copying the c2d message!");
+            return IOTCL_ERR_OUT_OF_MEMORY;
+        }
+        memcpy(event_data.json_copy, data, data_len);
+        event_data.json_copy[data_len] = '\0';
+    }
+
+    int status = iotcl_json_tokenize(event_data.json, data_len, event_data.tokens, IOTCL_C2D_MAX_TOKENS, &event_data.num_tokens);
+    if (IOTCL_SUCCESS == status && IOTCL_JSON_TOKEN_OBJECT != event_data.tokens[0].type) {
+        status = IOTCL_ERR_PARSING_ERROR;
     }
-    return iotcl_c2d_parse_json(root);
+    if (status) {
+        if (IOTCL_ERR_OVERFLOW == status) {
+            IOTCL_ERROR(status, "The c2d message has too many values. Increase IOTCL_C2D_MAX_TOKENS. Message: \"%.*s\"", (int) data_len, data);
+        } else {
+            IOTCL_ERROR(status, "jSON parsing error while parsing: \"%.*s\"", (int) data_len, data);
+        }
+        iotcl_free(event_data.json_copy);
+        return status;
+    }
+    // the root is an object, so the buffer always has room for the terminators
+    iotcl_json_tokens_to_strings(event_data.json, data_len, event_data.tokens, event_data.num_tokens);
+    return iotcl_c2d_process_parsed_event(&event_data);
 }
-
-int iotcl_c2d_process_event_with_length(const uint8_t *data, size_t data_len) {
-    cJSON *root = cJSON_ParseWithLength((const char *) data, data_len);
-    if (!root) {
+#else
+static int iotcl_c2d_parse_and_process(const char *data, size_t data_len, bool is_modifiable) {
+    (void) is_modifiable;
+    struct IotclC2dEventDataTag event_data = {0};
+    event_data.root = cJSON_ParseWithLength(data, data_len);
+    if (!event_data.root) {
         IOTCL_ERROR(
                 IOTCL_ERR_PARSING_ERROR,
                 "jSON parsing error or possible out of memory error while parsing: \"%.*s\"",
@@ -228,19 +357,170 @@ int iotcl_c2d_process_event_with_length(const uint8_t *data, size_t data_len) {
         );
         return IOTCL_ERR_PARSING_ERROR;
     }
-    return iotcl_c2d_parse_json(root);
+    return iotcl_c2d_process_parsed_event(&event_data);
+}
+#endif
+
+static int iotcl_c2d_process_buffer(const char *data, size_t data_len, bool is_modifiable) {
+    if (!data) {
+        IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "iotcl_c2d_process_event: The data argument is required!");
+        return IOTCL_ERR_MISSING_VALUE;
+    }
+    IOTCL_HEAP_TAG_SCOPE(IOTCL_HEAP_TAG_C2D);
+#if IOTCL_C2D_USE_ARENA
+    iotcl_arena_begin();
+    int status = iotcl_c2d_parse_and_process(data, data_len, is_modifiable);
+    iotcl_arena_end();
+    return status;
+#else
+    return iotcl_c2d_parse_and_process(data, data_len, is_modifiable);
+#endif
+}
+
+int iotcl_c2d_process_event(const char *str) {
+    return iotcl_c2d_process_buffer(str, str ? strlen(str) : 0, false);
+}
+
+int iotcl_c2d_process_event_with_length(const uint8_t *data, size_t data_len) {
+    return iotcl_c2d_process_buffer((const char *) data, data_len, false);
+}
+
+int iotcl_c2d_process_event_in_place(char *data, size_t data_len) {
+    return iotcl_c2d_process_buffer(data, data_len, true);
+}
+
+static bool c2d_filter_is_kept_name(const char *name, const char *const *kept_names) {
+    if (!name) {
+        return false;
+    }
+    for (; *kept_names; kept_names++) {
+        if (0 == strcmp(name, *kept_names)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Writes the key before the first fragment of a value, the value fragment, and the closing quote of a string
+static void c2d_filter_write_member(IotclJsonWriter *w, bool *has_members, const char *name, const IotclJsonStreamEvent *event) {
+    bool is_string = (IOTCL_JSON_STREAM_STRING == event->type);
+    if (event->is_first) {
+        if (*has_members) {
+            iotcl_json_writer_char(w, ',');
+        }
+        iotcl_json_writer_char(w, '\"');
+        iotcl_json_writer_raw(w, name);
+        iotcl_json_writer_raw(w, is_string ? "\":\"" : "\":");
+        *has_members = true;
+    }
+    if (event->data_length) {
+        // strings are still escaped, so they can be copied as they are
+        iotcl_json_writer_raw_with_length(w, event->data, event->data_length);
+    }
+    if (is_string && event->is_last) {
+        iotcl_json_writer_char(w, '\"');
+    }
+}
+
+static int c2d_filter_on_event(void *context, const IotclJsonStream *stream, const IotclJsonStreamEvent *event) {
+    static const char *const message_names[] = {"v", "ct", "cmd", "ack", "sw", "hw", NULL};
+    static const char *const url_names[] = {"url", "fileName", NULL};
+    IotclC2dFilter *f = (IotclC2dFilter *) context;
+    IotclJsonWriter *w = &f->writer;
+    bool is_scalar = (IOTCL_JSON_STREAM_STRING == event->type || IOTCL_JSON_STREAM_PRIMITIVE == event->type);
+
+    switch (event->depth) {
+        case 0: // the message object
+            if (IOTCL_JSON_STREAM_OBJECT_START == event->type) {
+                iotcl_json_writer_char(w, '{');
+            } else if (IOTCL_JSON_STREAM_OBJECT_END == event->type) {
+                iotcl_json_writer_char(w, '}');
+            }
+            break;
+        case 1: {
+            const char *name = iotcl_json_stream_get_key(stream, 1);
+            if (is_scalar && c2d_filter_is_kept_name(name, message_names)) {
+                c2d_filter_write_member(w, &f->has_members, name, event);
+            } else if (IOTCL_JSON_STREAM_ARRAY_START == event->type && name && 0 == strcmp(name, "urls")) {
+                if (f->has_members) {
+                    iotcl_json_writer_char(w, ',');
+                }
+                iotcl_json_writer_raw(w, "\"urls\":[");
+                f->has_members = true;
+                f->has_urls = false;
+                f->is_in_urls = true;
+            } else if (IOTCL_JSON_STREAM_ARRAY_END == event->type && f->is_in_urls) {
+                iotcl_json_writer_char(w, ']');
+                f->is_in_urls = false;
+            }
+            break;
+        }
+        case 2: // OTA URL objects
+            if (!f->is_in_urls) {
+                break;
+            }
+            if (IOTCL_JSON_STREAM_OBJECT_START == event->type) {
+                iotcl_json_writer_raw(w, f->has_urls ? ",{" : "{");
+                f->has_urls = true;
+                f->has_url_members = false;
+                f->is_in_url = true;
+            } else if (IOTCL_JSON_STREAM_OBJECT_END == event->type) {
+                iotcl_json_writer_char(w, '}');
+                f->is_in_url = false;
+            }
+            break;
+        case 3: {
+            const char *name = iotcl_json_stream_get_key(stream, 3);
+            if (f->is_in_url && is_scalar && c2d_filter_is_kept_name(name, url_names)) {
+                c2d_filter_write_member(w, &f->has_url_members, name, event);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    // no point in parsing the rest if the result does not fit
+    return w->overflow ? IOTCL_ERR_OVERFLOW : IOTCL_SUCCESS;
+}
+
+void iotcl_c2d_filter_init(IotclC2dFilter *filter, char *buffer, size_t buffer_size) {
+    memset(filter, 0, sizeof(IotclC2dFilter));
+    iotcl_json_stream_init(&filter->parser, c2d_filter_on_event, filter);
+    iotcl_json_writer_init(&filter->writer, buffer, buffer_size);
+}
+
+int iotcl_c2d_filter_feed(IotclC2dFilter *filter, const char *data, size_t data_len) {
+    return iotcl_json_stream_feed(&filter->parser, data, data_len);
+}
+
+int iotcl_c2d_filter_finish(IotclC2dFilter *filter, size_t *length) {
+    int status = iotcl_json_stream_finish(&filter->parser);
+    if (IOTCL_SUCCESS == status && 0 == filter->writer.length) {
+        status = IOTCL_ERR_PARSING_ERROR; // valid JSON, but not an object
+    }
+    if (filter->writer.overflow) {
+        IOTCL_ERROR(status, "The c2d message values do not fit into the %lu byte buffer!", (unsigned long) filter->writer.size);
+    } else if (IOTCL_ERR_OVERFLOW == status) {
+        IOTCL_ERROR(status, "The c2d message is nested too deeply or has a number that is too long!");
+    } else if (status) {
+        IOTCL_ERROR(status, "jSON parsing error while filtering the c2d message!");
+    }
+    if (length) {
+        *length = status ? 0 : filter->writer.length;
+    }
+    return status;
 }
 
 const char *iotcl_c2d_get_ota_url(IotclC2dEventData data, int index) {
     if (IOTCL_SUCCESS != iotcl_c2d_validate_data_and_type(data, IOTCL_C2D_ET_DEVICE_OTA, "OTA URL")) {
         return NULL;
     }
-    cJSON *url_array_item = iotcl_c2d_get_ota_url_array_item(data, index);
-    if (!url_array_item) {
+    IotclC2dNode url_array_item = iotcl_c2d_get_ota_url_array_item(data, index);
+    if (IOTCL_C2D_NO_NODE == url_array_item) {
         // called function logs the error
         return NULL;
     }
-    return iotcl_c2d_get_string_value(url_array_item, true, "url");
+    return iotcl_c2d_get_string_value(data, url_array_item, true, "url");
 }
 
 const char *iotcl_c2d_get_ota_url_hostname(IotclC2dEventData data, int index) {
@@ -251,12 +531,12 @@ const char *iotcl_c2d_get_ota_url_hostname(IotclC2dEventData data, int index) {
     if (data->hostname) {
         return data->hostname;
     }
-    cJSON *url_array_item = iotcl_c2d_get_ota_url_array_item(data, index);
-    if (!url_array_item) {
+    IotclC2dNode url_array_item = iotcl_c2d_get_ota_url_array_item(data, index);
+    if (IOTCL_C2D_NO_NODE == url_array_item) {
         // called function logs the error
         return NULL;
     }
-    const char *url = iotcl_c2d_get_string_value(url_array_item, true, "url");
+    const char *url = iotcl_c2d_get_string_value(data, url_array_item, true, "url");
     if (!url) {
         // called function logs the error
         return NULL;
@@ -287,13 +567,13 @@ const char *iotcl_c2d_get_ota_url_resource(IotclC2dEventData data, int index) {
     if (IOTCL_SUCCESS != iotcl_c2d_validate_data_and_type(data, IOTCL_C2D_ET_DEVICE_OTA, "OTA URL resource")) {
         return NULL;
     }
-    cJSON *url_array_item = iotcl_c2d_get_ota_url_array_item(data, index);
-    if (!url_array_item) {
+    IotclC2dNode url_array_item = iotcl_c2d_get_ota_url_array_item(data, index);
+    if (IOTCL_C2D_NO_NODE == url_array_item) {
         // called function logs the error
         return NULL;
     }
 
-    const char *url = iotcl_c2d_get_string_value(url_array_item, true, "url");
+    const char *url = iotcl_c2d_get_string_value(data, url_array_item, true, "url");
     if (!url) {
         // called function logs the error
         return NULL;
@@ -315,45 +595,45 @@ const char *iotcl_c2d_get_ota_original_filename(IotclC2dEventData data, int inde
     if (IOTCL_SUCCESS != iotcl_c2d_validate_data_and_type(data, IOTCL_C2D_ET_DEVICE_OTA, "OTA original filename")) {
         return NULL;
     }
-    cJSON *url_array_item = iotcl_c2d_get_ota_url_array_item(data, index);
-    if (!url_array_item) {
+    IotclC2dNode url_array_item = iotcl_c2d_get_ota_url_array_item(data, index);
+    if (IOTCL_C2D_NO_NODE == url_array_item) {
         // called function logs the error
         return NULL;
     }
-    return iotcl_c2d_get_string_value(url_array_item, true, "fileName");
+    return iotcl_c2d_get_string_value(data, url_array_item, true, "fileName");
 }
 
 const char *iotcl_c2d_get_command(IotclC2dEventData data) {
     if (IOTCL_SUCCESS != iotcl_c2d_validate_data_and_type(data, IOTCL_C2D_ET_DEVICE_COMMAND, "command")) {
         return NULL;
     }
-    return iotcl_c2d_get_string_value(data->root, true, "cmd");
+    return iotcl_c2d_get_string_value(data, c2d_root(data), true, "cmd");
 }
 
 int iotcl_c2d_get_ota_url_count(IotclC2dEventData data) {
     if (IOTCL_SUCCESS != iotcl_c2d_validate_data_and_type(data, IOTCL_C2D_ET_DEVICE_OTA, "URL count")) {
         return 0;
     }
-    cJSON *urls = cJSON_GetObjectItemCaseSensitive(data->root, "urls");
-    if (NULL == urls || !cJSON_IsArray(urls)) {
+    int num_urls = c2d_get_array_size(data, c2d_get_item(data, c2d_root(data), "urls"));
+    if (num_urls < 0) {
         IOTCL_ERROR(IOTCL_ERR_PARSING_ERROR, "the \"urls\" array is not found in c2d response");
         return 0;
     }
-    return cJSON_GetArraySize(urls);
+    return num_urls;
 }
 
 const char *iotcl_c2d_get_ota_sw_version(IotclC2dEventData data) {
     if (IOTCL_SUCCESS != iotcl_c2d_validate_data_and_type(data, IOTCL_C2D_ET_DEVICE_OTA, "sw version")) {
         return NULL;
     }
-    return iotcl_c2d_get_string_value(data->root, true, "sw");
+    return iotcl_c2d_get_string_value(data, c2d_root(data), true, "sw");
 }
 
 const char *iotcl_c2d_get_ota_hw_version(IotclC2dEventData data) {
     if (IOTCL_SUCCESS != iotcl_c2d_validate_data_and_type(data, IOTCL_C2D_ET_DEVICE_OTA, "hw version")) {
         return NULL;
     }
-    return iotcl_c2d_get_string_value(data->root, true, "hw");
+    return iotcl_c2d_get_string_value(data, c2d_root(data), true, "hw");
 }
 
 const char *iotcl_c2d_get_ack_id(IotclC2dEventData data) {
@@ -362,7 +642,7 @@ const char *iotcl_c2d_get_ack_id(IotclC2dEventData data) {
         IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "c2d event data null while attempting to get the \"%s\" value", "ack ID");
         return NULL;
     }
-    return iotcl_c2d_get_string_value(data->root, false, "ack");
+    return iotcl_c2d_get_string_value(data, c2d_root(data), false, "ack");
 }
 
 
@@ -389,8 +669,14 @@ void iotcl_c2d_destroy_ack_json(char *ack_json_ptr) {
 }
 
 void iotcl_c2d_destroy_event(IotclC2dEventData data) {
+#if IOTCL_C2D_MAX_TOKENS > 0
+    data->num_tokens = 0;
+    iotcl_free(data->json_copy);
+    data->json_copy = NULL;
+#else
     cJSON_Delete(data->root);
     data->root = NULL;
+#endif
     iotcl_free(data->hostname); // in case it was created
     data->hostname = NULL;
 }
@@ -27,7 +27,12 @@
 #ifndef IOTCL_C2D_H
 #define IOTCL_C2D_H
 
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+
+#include "iotcl_json_stream.h"
+#include "iotcl_json_writer.h"
 
 // MBEDTLS config file style - include your own to override the config. See iotcl_example_config.h
 #if defined(IOTCL_USER_CONFIG_FILE)
@@ -82,6 +87,42 @@ int iotcl_c2d_process_event(const char *str);
 //  received on the c2d topic. The buffer contents should be a JSON string.
 int iotcl_c2d_process_event_with_length(const uint8_t *data, size_t data_len);
 
+// Same as iotcl_c2d_process_event_with_length(), but the buffer can be modified while processing the event.
+// With IOTCL_C2D_MAX_TOKENS set, the message is tokenized over this buffer and string values are terminated in place,
+// so the getters return pointers into the buffer and processing the message does not allocate.
+// The buffer contents are not valid JSON afterwards. Without IOTCL_C2D_MAX_TOKENS, the buffer is not modified.
+int iotcl_c2d_process_event_in_place(char *data, size_t data_len);
+
+// The filter reduces a C2D message that arrives in chunks to only the values that this library uses
+// (event type, command, ack ID, OTA versions and URLs), written as compact JSON into a fixed buffer.
+// The buffer can then be passed to iotcl_c2d_process_event_in_place().
+// This way, a message does not need to be received whole and only the size of the kept values matters.
+// Example:
+//  IotclC2dFilter filter;
+//  iotcl_c2d_filter_init(&filter, buffer, sizeof(buffer));
+//  while (there is more data) iotcl_c2d_filter_feed(&filter, chunk, chunk_len);
+//  if (IOTCL_SUCCESS == iotcl_c2d_filter_finish(&filter, &length)) iotcl_c2d_process_event_in_place(buffer, length);
+typedef struct {
+    IotclJsonStream parser;
+    IotclJsonWriter writer;
+    bool is_in_urls;        // in the OTA URL array
+    bool is_in_url;         // in an object of the OTA URL array
+    bool has_members;       // a value was written into the message object
+    bool has_urls;          // an object was written into the URL array
+    bool has_url_members;   // a value was written into the current URL object
+} IotclC2dFilter;
+
+// The buffer should be large enough to hold the kept values of the largest expected message.
+void iotcl_c2d_filter_init(IotclC2dFilter *filter, char *buffer, size_t buffer_size);
+
+// Parses the next chunk of the message. Once an error is returned, all further calls will return the same error.
+int iotcl_c2d_filter_feed(IotclC2dFilter *filter, const char *data, size_t data_len);
+
+// Should be called after the last chunk. Returns the length of the filtered null-terminated JSON in the buffer.
+// Returns IOTCL_ERR_OVERFLOW if the kept values did not fit into the buffer,
+// and IOTCL_ERR_PARSING_ERROR if the message is not a valid JSON object.
+int iotcl_c2d_filter_finish(IotclC2dFilter *filter, size_t *length);
+
 // Returns a malloc-ed copy of the command line message parameter.
 // The user must manually free the returned string when it is no longer needed.
 const char *iotcl_c2d_get_command(IotclC2dEventData data);
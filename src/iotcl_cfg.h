@@ -38,6 +38,54 @@ extern "C" {
 #define IOTCL_ISO_TIMESTAMP_FORMAT "%Y-%m-%dT%H:%M:%S.000Z"
 #define IOTCL_ISO_TIMESTAMP_STR_LEN (sizeof("2024-01-02T03:04:05.006Z") - 1)
 
+// -------  TELEMETRY NUMBER FORMATTING -------
+// Set this to a number of decimal places (0-9) to have iotcl_telemetry_set_number() and the telemetry schema
+// write numbers with the fast fixed point formatter, which avoids printf. Numbers are rounded to this precision.
+// The default (-1) formats numbers the same way as cJSON, with up to 17 significant digits.
+#ifndef IOTCL_TELEMETRY_DECIMAL_PRECISION
+#define IOTCL_TELEMETRY_DECIMAL_PRECISION (-1)
+#endif
+
+// -------  TELEMETRY MESSAGE POOL -------
+// Number of message handles that iotcl_telemetry_create() takes from a static pool instead of the heap.
+// Pooled handles keep their JSON skeleton when destroyed, so only the telemetry values are allocated each time.
+// If all pooled handles are in use, the handles are allocated on the heap as usual. Set to 0 to disable the pool.
+#ifndef IOTCL_TELEMETRY_POOL_SIZE
+#define IOTCL_TELEMETRY_POOL_SIZE 0
+#endif
+
+// -------  C2D PARSING -------
+// If set to a non-zero value, received C2D messages are parsed with a non-allocating tokenizer
+// into an array of this many tokens (about 9 bytes each) on the stack instead of with cJSON.
+// Each key, value, object and array is one token. A command uses around 10 tokens and an OTA event
+// around 20 tokens, plus 5 for each additional file. Messages with more tokens are rejected.
+// See iotcl_c2d_process_event_in_place() for parsing without any allocations.
+#ifndef IOTCL_C2D_MAX_TOKENS
+#define IOTCL_C2D_MAX_TOKENS 0
+#endif
+
+// The deepest nesting of objects and arrays that the incremental JSON parser (see iotcl_json_stream.h) accepts.
+// C2D messages need 3: the message object, the OTA URL array and the URL objects in it.
+// Identity responses need 4: the response, "d", "p" and the "topics" object in it.
+// Each level takes about 20 bytes in the parser state.
+#ifndef IOTCL_JSON_STREAM_MAX_DEPTH
+#define IOTCL_JSON_STREAM_MAX_DEPTH 4
+#endif
+
+// -------  ARENA -------
+// If an arena is configured with iotcl_arena_configure(), process each received C2D message inside an arena scope,
+// so that the parsed message and everything allocated by the C2D callbacks is released at once.
+#ifndef IOTCL_C2D_USE_ARENA
+#define IOTCL_C2D_USE_ARENA 1
+#endif
+
+// -------  HEAP STATISTICS -------
+// Set to 1 to track the memory allocated by iotcl_malloc() and cJSON per subsystem. See iotcl_heap_stats.h.
+// This adds a small header to each allocation.
+#ifndef IOTCL_HEAP_STATS
+#define IOTCL_HEAP_STATS 0
+#endif
+
 // -------  MQTT TOPIC FORMATS AND DEFINES -------
 // Always use secure MQTT port
 #define IOTCL_MQTT_PORT 8883
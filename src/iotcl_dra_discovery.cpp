@@ -4,8 +4,6 @@
  */
 #include <string.h>
 
-#include "cJSON.h"
-
 #include "iotcl_internal.h"
 #include "iotcl_cfg.h"
 #include "iotcl_log.h"
@@ -15,71 +13,58 @@
 // NOTE: We assume that v2.1 in the API is not directly tied to the protocol version
 #define IOTCL_DRA_DISCOVERY_URL_FORMAT "https://%s/api/v2.1/dsdk/cpId/%s/env/%s"
 
-static int iotcl_dra_parse_discovery_json(IotclDraUrlContext *base_url_context, size_t base_url_slack, cJSON *json_root) {
-    const char *f = "UNKNOWN";
-
-    // forward declare these variables to avoid permissive warnings due to goto-s.
-    cJSON *j_status;
-    cJSON *j_message;
-    cJSON *j_d;
-    cJSON *j_ec;
-    cJSON *j_bu;
-    char *message;
-    int response_status;
-    int status;
-    int ec;
-
-
-    if (!json_root) {
-        IOTCL_ERROR(IOTCL_ERR_PARSING_ERROR, "DRA Discovery: Parsing error or ran out of memory while parsing response!");
-        return IOTCL_ERR_PARSING_ERROR;
+static int iotcl_dra_discovery_on_event(void *context, const IotclJsonStream *stream, const IotclJsonStreamEvent *event) {
+    IotclDraDiscoveryStream *ds = (IotclDraDiscoveryStream *) context;
+    if (IOTCL_JSON_STREAM_PRIMITIVE == event->type) {
+        if (iotcl_json_stream_is_at_path(stream, event, "status")) {
+            ds->has_status = iotcl_json_stream_get_int(event, &ds->status);
+        } else if (iotcl_json_stream_is_at_path(stream, event, "d.ec")) {
+            ds->has_ec = iotcl_json_stream_get_int(event, &ds->ec);
+        }
+    } else if (IOTCL_JSON_STREAM_STRING == event->type) {
+        if (iotcl_json_stream_is_at_path(stream, event, "message")) {
+            return iotcl_json_stream_collect_string(event, &ds->message);
+        } else if (iotcl_json_stream_is_at_path(stream, event, "d.bu")) {
+            return iotcl_json_stream_collect_string(event, &ds->bu);
+        }
     }
+    return IOTCL_SUCCESS;
+}
 
-    f = "status";
-    j_status = cJSON_GetObjectItem(json_root, f);
-    if (!j_status || !cJSON_IsNumber(j_status)) goto cleanup;
+static int iotcl_dra_discovery_check(IotclDraDiscoveryStream *ds, IotclDraUrlContext *base_url_context, size_t base_url_slack) {
+    const char *f;
+    int status;
 
-    response_status = (int) cJSON_GetNumberValue(j_status);
-    if (200 != response_status) {
-        IOTCL_ERROR(IOTCL_ERR_BAD_VALUE, "DRA Discovery: Received status %d! Incorrect environment name?", response_status);
+    f = "status";
+    if (!ds->has_status) goto cleanup;
+    if (200 != ds->status) {
+        IOTCL_ERROR(IOTCL_ERR_BAD_VALUE, "DRA Discovery: Received status %d! Incorrect environment name?", (int) ds->status);
         return IOTCL_ERR_BAD_VALUE;
     }
 
     f = "message";
-    j_message = cJSON_GetObjectItem(json_root, f);
-    if (!j_message || !cJSON_IsString(j_message)) {
-        goto cleanup;
-    } else {
-        message = cJSON_GetStringValue(j_message);
-    }
-
-    f = "d";
-    j_d = cJSON_GetObjectItem(json_root, f);
-    if (!j_d || !cJSON_IsObject(j_d)) goto cleanup;
+    if (!ds->message) goto cleanup;
 
     f = "ec";
-    j_ec = cJSON_GetObjectItem(j_d, f);
-    if (!j_ec || !cJSON_IsNumber(j_ec)) goto cleanup;
-    ec = (int) cJSON_GetNumberValue(j_ec);
+    if (!ds->has_ec) goto cleanup;
 
 #ifdef IOTCL_DRA_DISCOVERY_IGNORE_SUBSCRIPTION_EXPIRED
     // Related service ticket https://awspoc.iotconnect.io/support-info/2024031415124727
-    if (3 == ec) {
-        IOTCL_WARN(IOTCL_ERR_FAILED, "DRA Discovery: Received error %d! Server message was: \"%s\". Ignoring...", ec, message);
-        ec = 0; // ignore this error
+    if (3 == ds->ec) {
+        IOTCL_WARN(IOTCL_ERR_FAILED, "DRA Discovery: Received error %d! Server message was: \"%s\". Ignoring...", (int) ds->ec, ds->message);
+        ds->ec = 0; // ignore this error
     }
 #endif
 
-    if (0 != ec) {
-        IOTCL_ERROR(IOTCL_ERR_FAILED, "DRA Discovery: Received error %d! Server message was: \"%s\"", ec, message);
+    if (0 != ds->ec) {
+        IOTCL_ERROR(IOTCL_ERR_FAILED, "DRA Discovery: Received error %d! Server message was: \"%s\"", (int) ds->ec, ds->message);
         return IOTCL_ERR_BAD_VALUE;
     }
 
     f = "bu";
-    j_bu = cJSON_GetObjectItem(j_d, f);
-    if (!j_bu || !cJSON_IsString(j_bu)) goto cleanup;
+    if (!ds->bu) goto cleanup;
 
-    status = iotcl_dra_url_init_with_slack(base_url_context, base_url_slack, cJSON_GetStringValue(j_bu));
+    status = iotcl_dra_url_init_with_slack(base_url_context, base_url_slack, ds->bu);
     if (IOTCL_SUCCESS != status) {
         // the called function will print the error, but we need to be more specific, though return the original cause
         IOTCL_ERROR(IOTCL_ERR_FAILED, "DRA: Unable to initialize base URL from discovery response!");
@@ -91,10 +76,41 @@ static int iotcl_dra_parse_discovery_json(IotclDraUrlContext *base_url_context,
     cleanup:
     IOTCL_ERROR(IOTCL_ERR_PARSING_ERROR, "DRA: Error encountered while parsing the discovery response field \"%s\"", f);
     return IOTCL_ERR_PARSING_ERROR;
+}
+
+void iotcl_dra_discovery_stream_init(IotclDraDiscoveryStream *ds) {
+    memset(ds, 0, sizeof(IotclDraDiscoveryStream));
+    iotcl_json_stream_init(&ds->parser, iotcl_dra_discovery_on_event, ds);
+}
+
+int iotcl_dra_discovery_stream_feed(IotclDraDiscoveryStream *ds, const char *data, size_t data_len) {
+    IOTCL_HEAP_TAG_SCOPE(IOTCL_HEAP_TAG_DRA);
+    return iotcl_json_stream_feed(&ds->parser, data, data_len);
+}
+
+int iotcl_dra_discovery_stream_finish(IotclDraDiscoveryStream *ds, IotclDraUrlContext *base_url, int base_url_slack) {
+    IOTCL_HEAP_TAG_SCOPE(IOTCL_HEAP_TAG_DRA);
+    int status = iotcl_json_stream_finish(&ds->parser);
+    if (IOTCL_ERR_OUT_OF_MEMORY == status) {
+        IOTCL_ERROR(status, "DRA Discovery: Ran out of memory while parsing the response!");
+    } else if (status) {
+        IOTCL_ERROR(IOTCL_ERR_PARSING_ERROR, "DRA Discovery: Parsing error while parsing the response!");
+        status = IOTCL_ERR_PARSING_ERROR;
+    } else {
+        status = iotcl_dra_discovery_check(ds, base_url, (size_t) base_url_slack);
+    }
+    return status;
+}
 
+void iotcl_dra_discovery_stream_deinit(IotclDraDiscoveryStream *ds) {
+    iotcl_free(ds->message);
+    iotcl_free(ds->bu);
+    ds->message = NULL;
+    ds->bu = NULL;
 }
 
 int iotcl_dra_discovery_init_url_with_host(IotclDraUrlContext *c, const char *host, const char *cpid, const char *env) {
+    IOTCL_HEAP_TAG_SCOPE(IOTCL_HEAP_TAG_DRA);
     if (!host || !cpid || !env || 0 == strlen(host) || 0 == strlen(cpid) || 0 == strlen(env)) {
         IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "DRA: Host, cpid and env arguments are required.");
         return IOTCL_ERR_MISSING_VALUE;
@@ -120,15 +136,16 @@ int iotcl_dra_discovery_init_url_azure(IotclDraUrlContext *c, const char *cpid,
 }
 
 int iotcl_dra_discovery_parse(IotclDraUrlContext *c, int base_url_slack, const char *response_str) {
-    cJSON *root = cJSON_Parse(response_str);
-    int status = iotcl_dra_parse_discovery_json(c, (size_t) base_url_slack, root);
-    cJSON_Delete(root);
-    return status;
+    return iotcl_dra_discovery_parse_with_length(c, base_url_slack, (const uint8_t *) response_str, response_str ? strlen(response_str) : 0);
 }
 
 int iotcl_dra_discovery_parse_with_length(IotclDraUrlContext *c, int base_url_slack, const uint8_t *response_data, size_t response_data_size) {
-    cJSON *root = cJSON_ParseWithLength((const char *)response_data, response_data_size);
-    int status = iotcl_dra_parse_discovery_json(c, (size_t) base_url_slack, root);
-    cJSON_Delete(root);
+    IotclDraDiscoveryStream ds;
+    iotcl_dra_discovery_stream_init(&ds);
+    if (response_data) {
+        iotcl_dra_discovery_stream_feed(&ds, (const char *) response_data, response_data_size);
+    }
+    int status = iotcl_dra_discovery_stream_finish(&ds, c, base_url_slack);
+    iotcl_dra_discovery_stream_deinit(&ds);
     return status;
 }
@@ -11,9 +11,11 @@
 #ifndef ITOCL_DRA_DISCOVERY_H
 #define ITOCL_DRA_DISCOVERY_H
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <stddef.h>
 #include "iotcl_dra_url.h"
+#include "iotcl_json_stream.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -53,6 +55,38 @@ int iotcl_dra_discovery_parse_with_length(
         size_t response_data_size
 );
 
+// Parses a discovery response that arrives in chunks, for example as it is read from the modem,
+// so that the response never needs to be held in memory whole. Only the values that are used are kept.
+// iotcl_dra_discovery_parse() uses the same parser.
+// Example:
+//  IotclDraDiscoveryStream ds;
+//  iotcl_dra_discovery_stream_init(&ds);
+//  while (there is more data && IOTCL_SUCCESS == iotcl_dra_discovery_stream_feed(&ds, chunk, chunk_len));
+//  status = iotcl_dra_discovery_stream_finish(&ds, &base_url, 0);
+//  iotcl_dra_discovery_stream_deinit(&ds);
+// Always call iotcl_dra_discovery_stream_deinit() once done, even if the response was not finished,
+// so that the kept values are freed.
+// The members are private, but are declared here so that the structure can be placed on the stack.
+typedef struct {
+    IotclJsonStream parser;
+    bool has_status;
+    bool has_ec;
+    int32_t status;
+    int32_t ec;
+    char *message;
+    char *bu;
+} IotclDraDiscoveryStream;
+
+void iotcl_dra_discovery_stream_init(IotclDraDiscoveryStream *ds);
+
+// Returns IOTCL_SUCCESS, or the error that stopped parsing, which will also be returned by further calls.
+int iotcl_dra_discovery_stream_feed(IotclDraDiscoveryStream *ds, const char *data, size_t data_len);
+
+// Checks the response and initializes base_url as iotcl_dra_discovery_parse() would.
+int iotcl_dra_discovery_stream_finish(IotclDraDiscoveryStream *ds, IotclDraUrlContext *base_url, int base_url_slack);
+
+void iotcl_dra_discovery_stream_deinit(IotclDraDiscoveryStream *ds);
+
 
 #ifdef __cplusplus
 }
@@ -3,10 +3,9 @@
  * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
  */
 
+#include <stddef.h>
 #include <string.h>
 
-#include "cJSON.h"
-
 #include "iotcl.h"
 #include "iotcl_internal.h"
 #include "iotcl_util.h"
@@ -36,7 +35,7 @@ static void iotcl_dra_clear_and_free_mqtt_config(IotclMqttConfig* c) {
     iotcl_free(c->pub_ack);
     iotcl_free(c->sub_c2d);
     iotcl_free(c->cd);
-    // version is a constant
+    iotcl_free(c->version); // allocated by iotcl_init() and by the identity response
     c->username = NULL;
     c->host = NULL;
     c->client_id = NULL;
@@ -46,96 +45,85 @@ static void iotcl_dra_clear_and_free_mqtt_config(IotclMqttConfig* c) {
     c->cd = NULL;
     c->version = NULL;
 }
-static int iotcl_dra_parse_response_and_configure_iotcl(cJSON *json_root) {
-    const char *f;
-    IotclMqttConfig* c = NULL;
-
-    // forward declare these variables to avoid permissive warnings due to goto-s.
-    int response_status;
-    cJSON *j_status = NULL;
-    cJSON *j_d = NULL;
-    cJSON *j_ec = NULL;
-    cJSON *j_meta = NULL;
-    cJSON *j_cd = NULL;
-    cJSON *j_topics = NULL;
-    cJSON *j_p = NULL;
-    int ec;
-
-
-    if (!json_root) {
-        IOTCL_ERROR(IOTCL_ERR_PARSING_ERROR, "DRA Identity: Parsing error or ran out of memory while parsing the response!");
-        return IOTCL_ERR_PARSING_ERROR;
-    }
 
-    f = "status";
-    j_status = cJSON_GetObjectItem(json_root, f);
-    if (!j_status || !cJSON_IsNumber(j_status)) goto cleanup;
+// The string values of the response and where they are kept
+static const struct {
+    const char *path;
+    size_t offset;
+} iotcl_dra_identity_strings[] = {
+    {"d.meta.cd", offsetof(IotclMqttConfig, cd)},
+    {"d.p.un", offsetof(IotclMqttConfig, username)},
+    {"d.p.h", offsetof(IotclMqttConfig, host)},
+    {"d.p.id", offsetof(IotclMqttConfig, client_id)},
+    {"d.p.topics.rpt", offsetof(IotclMqttConfig, pub_rpt)},
+    {"d.p.topics.ack", offsetof(IotclMqttConfig, pub_ack)},
+    {"d.p.topics.c2d", offsetof(IotclMqttConfig, sub_c2d)},
+};
 
-    response_status = (int) cJSON_GetNumberValue(j_status);
-    if (200 != response_status) {
-        IOTCL_ERROR(IOTCL_ERR_BAD_VALUE, "DRA Identity: Bad response status %d!", response_status);
-        return IOTCL_ERR_BAD_VALUE;
+static int iotcl_dra_identity_on_event(void *context, const IotclJsonStream *stream, const IotclJsonStreamEvent *event) {
+    IotclDraIdentityStream *is = (IotclDraIdentityStream *) context;
+    if (IOTCL_JSON_STREAM_PRIMITIVE == event->type) {
+        if (iotcl_json_stream_is_at_path(stream, event, "status")) {
+            is->has_status = iotcl_json_stream_get_int(event, &is->status);
+        } else if (iotcl_json_stream_is_at_path(stream, event, "d.ec")) {
+            is->has_ec = iotcl_json_stream_get_int(event, &is->ec);
+        }
+    } else if (IOTCL_JSON_STREAM_STRING == event->type && event->depth >= 2) {
+        for (size_t i = 0; i < sizeof(iotcl_dra_identity_strings) / sizeof(iotcl_dra_identity_strings[0]); i++) {
+            if (iotcl_json_stream_is_at_path(stream, event, iotcl_dra_identity_strings[i].path)) {
+                char **value = (char **) ((char *) &is->values + iotcl_dra_identity_strings[i].offset);
+                return iotcl_json_stream_collect_string(event, value);
+            }
+        }
     }
+    return IOTCL_SUCCESS;
+}
 
-    f = "d";
-    j_d = cJSON_GetObjectItem(json_root, f);
-    if (!j_d || !cJSON_IsObject(j_d)) goto cleanup;
+static int iotcl_dra_identity_check_and_configure(IotclDraIdentityStream *is) {
+    const char *f;
+    IotclMqttConfig *v = &is->values;
+    IotclMqttConfig *c;
 
+    f = "status";
+    if (!is->has_status) goto cleanup;
+    if (200 != is->status) {
+        IOTCL_ERROR(IOTCL_ERR_BAD_VALUE, "DRA Identity: Bad response status %d!", (int) is->status);
+        return IOTCL_ERR_BAD_VALUE;
+    }
 
     f = "ec";
-    j_ec = cJSON_GetObjectItem(j_d, f);
-    if (!j_ec || !cJSON_IsNumber(j_ec)) goto cleanup;
-    ec = (int)cJSON_GetNumberValue(j_ec);
-
-    if (0 != ec) {
+    if (!is->has_ec) goto cleanup;
+    if (0 != is->ec) {
         const char* ec_message;
-        if (ec > 0 && ec < (int) sizeof(iotcl_dra_ec_error_mapping)) {
-            ec_message = iotcl_dra_ec_error_mapping[ec];
+        if (is->ec > 0 && is->ec < (int32_t) (sizeof(iotcl_dra_ec_error_mapping) / sizeof(iotcl_dra_ec_error_mapping[0]))) {
+            ec_message = iotcl_dra_ec_error_mapping[is->ec];
         } else {
             ec_message = "<Unknown Error>";
         }
-        IOTCL_ERROR(IOTCL_ERR_FAILED, "DRA Identity: Identity error received %d. Message: %s", ec, ec_message);
+        IOTCL_ERROR(IOTCL_ERR_FAILED, "DRA Identity: Identity error received %d. Message: %s", (int) is->ec, ec_message);
         return IOTCL_ERR_BAD_VALUE;
     }
 
-    j_meta = cJSON_GetObjectItem(j_d, "meta");
-    if (!j_meta || !cJSON_IsObject(j_meta)) goto cleanup;
-
-    j_cd = cJSON_GetObjectItem(j_meta, "cd");
-    if (!j_cd || !cJSON_IsString(j_cd)) goto cleanup;
-
-    // NOTE: Consider a safe way to get meta.v without potentially running into floating point precision issues.
-    // and compare to a number like 2.1. We could use that to report that the back end version is different than the protocol version.
-
-    f = "p";
-    j_p = cJSON_GetObjectItem(j_d, f);
-    if (!j_p || !cJSON_IsObject(j_p)) goto cleanup;
+    // username is optional
+    for (size_t i = 0; i < sizeof(iotcl_dra_identity_strings) / sizeof(iotcl_dra_identity_strings[0]); i++) {
+        f = iotcl_dra_identity_strings[i].path;
+        if (offsetof(IotclMqttConfig, username) != iotcl_dra_identity_strings[i].offset
+            && !*(char **) ((char *) v + iotcl_dra_identity_strings[i].offset)) {
+            goto cleanup;
+        }
+    }
 
-    f = "topics"; // inside "p"
-    j_topics = cJSON_GetObjectItem(j_p, f);
-    if (!j_topics || !cJSON_IsObject(j_topics)) goto cleanup;
+    v->version = iotcl_strdup(IOTCL_PROTOCOL_VERSION_DEFAULT);
+    if (!v->version) {
+        IOTCL_ERROR(IOTCL_ERR_OUT_OF_MEMORY, "DRA Identity: Ran out of memory while configuring the library");
+        return IOTCL_ERR_OUT_OF_MEMORY;
+    }
 
     c = iotcl_mqtt_get_config();
     // in case custom config was not used, free everything up
     iotcl_dra_clear_and_free_mqtt_config(c);
-
-    c->username = iotcl_strdup_json_string(j_p, "un");
-    c->host = iotcl_strdup_json_string(j_p, "h");
-    c->client_id = iotcl_strdup_json_string(j_p, "id");
-    c->pub_rpt = iotcl_strdup_json_string(j_topics, "rpt");
-    c->pub_ack = iotcl_strdup_json_string(j_topics, "ack");
-    c->sub_c2d = iotcl_strdup_json_string(j_topics, "c2d");
-    c->cd = iotcl_strdup_json_string(j_meta, "cd");
-    c->version = iotcl_strdup(IOTCL_PROTOCOL_VERSION_DEFAULT);
-
-    // NOTE: username should be null for aws, but currently identity returns one
-    // We don't know whether this is aws or not just based on identity response
-    if (!c->host || !c->client_id || !c->pub_rpt || !c->pub_ack || !c->sub_c2d || !c->cd) {
-        iotcl_dra_clear_and_free_mqtt_config(c);
-        IOTCL_ERROR(IOTCL_ERR_OUT_OF_MEMORY, "DRA Identity: One or more response fields was not found or ran out of memory");
-        return IOTCL_ERR_OUT_OF_MEMORY;
-    }
-
+    *c = *v; // the library now owns the values
+    memset(v, 0, sizeof(IotclMqttConfig));
     return IOTCL_SUCCESS;
 
     cleanup:
@@ -159,6 +147,7 @@ static int iotcl_dra_identity_validate_config(void) {
 
 // Formats an input base url URL to use to call identity REST API
 int iotcl_dra_identity_build_url(IotclDraUrlContext *base_url_context, const char *duid) {
+    IOTCL_HEAP_TAG_SCOPE(IOTCL_HEAP_TAG_DRA);
     if (!base_url_context || !iotcl_dra_url_get_url(base_url_context)) {
         IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "DRA Identity: Base URL is required.");
         return IOTCL_ERR_MISSING_VALUE;
@@ -177,24 +166,49 @@ int iotcl_dra_identity_build_url(IotclDraUrlContext *base_url_context, const cha
 
 // Parse an identity response and configure IoTConnect library mqtt settings with the response result
 int iotcl_dra_identity_configure_library_mqtt(const char *response_str) {
-    int status = iotcl_dra_identity_validate_config();
-    if (IOTCL_SUCCESS != status) {
-        return status; // the called function will print the error
-    }
-    cJSON *root = cJSON_Parse(response_str);
-    status = iotcl_dra_parse_response_and_configure_iotcl(root);
-    cJSON_Delete(root);
-    return status;
+    return iotcl_dra_identity_configure_library_mqtt_with_length((const uint8_t *) response_str, response_str ? strlen(response_str) : 0);
 }
 
 // Parse an identity response and configure IoTConnect library mqtt settings with the response result
 int iotcl_dra_identity_configure_library_mqtt_with_length(const uint8_t *response_data, size_t response_data_size) {
-    int status = iotcl_dra_identity_validate_config();
-    if (IOTCL_SUCCESS != status) {
-        return status; // the called function will print the error
+    IotclDraIdentityStream is;
+    int status = iotcl_dra_identity_stream_init(&is); // the called function will print the error
+    if (IOTCL_SUCCESS == status) {
+        if (response_data) {
+            iotcl_dra_identity_stream_feed(&is, (const char *) response_data, response_data_size);
+        }
+        status = iotcl_dra_identity_stream_finish(&is);
     }
-    cJSON *root = cJSON_ParseWithLength((const char *)response_data, response_data_size);
-    status = iotcl_dra_parse_response_and_configure_iotcl(root);
-    cJSON_Delete(root);
+    iotcl_dra_identity_stream_deinit(&is);
     return status;
 }
+
+int iotcl_dra_identity_stream_init(IotclDraIdentityStream *is) {
+    memset(is, 0, sizeof(IotclDraIdentityStream));
+    iotcl_json_stream_init(&is->parser, iotcl_dra_identity_on_event, is);
+    return iotcl_dra_identity_validate_config();
+}
+
+int iotcl_dra_identity_stream_feed(IotclDraIdentityStream *is, const char *data, size_t data_len) {
+    IOTCL_HEAP_TAG_SCOPE(IOTCL_HEAP_TAG_DRA);
+    return iotcl_json_stream_feed(&is->parser, data, data_len);
+}
+
+int iotcl_dra_identity_stream_finish(IotclDraIdentityStream *is) {
+    IOTCL_HEAP_TAG_SCOPE(IOTCL_HEAP_TAG_DRA);
+    int status = iotcl_json_stream_finish(&is->parser);
+    if (IOTCL_ERR_OUT_OF_MEMORY == status) {
+        IOTCL_ERROR(status, "DRA Identity: Ran out of memory while parsing the response!");
+    } else if (status) {
+        IOTCL_ERROR(IOTCL_ERR_PARSING_ERROR, "DRA Identity: Parsing error while parsing the response!");
+        status = IOTCL_ERR_PARSING_ERROR;
+    } else {
+        status = iotcl_dra_identity_check_and_configure(is);
+    }
+    return status;
+}
+
+void iotcl_dra_identity_stream_deinit(IotclDraIdentityStream *is) {
+    // whatever was not moved into the library configuration
+    iotcl_dra_clear_and_free_mqtt_config(&is->values);
+}
@@ -11,8 +11,12 @@
 #ifndef ITOCL_DRA_IDENTITY_H
 #define ITOCL_DRA_IDENTITY_H
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
+#include "iotcl.h"
 #include "iotcl_dra_url.h"
+#include "iotcl_json_stream.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -30,6 +34,39 @@ int iotcl_dra_identity_configure_library_mqtt(const char *response_str);
 // Parse an identity response and configure IoTConnect library mqtt settings with the response result
 int iotcl_dra_identity_configure_library_mqtt_with_length(const uint8_t *response_data, size_t response_data_size);
 
+// Parses an identity response that arrives in chunks, for example as it is read from the modem,
+// so that the response never needs to be held in memory whole. Only the values that are used are kept.
+// The identity functions above use the same parser. The response can be nested at most IOTCL_JSON_STREAM_MAX_DEPTH deep.
+// Example:
+//  IotclDraIdentityStream is;
+//  status = iotcl_dra_identity_stream_init(&is);
+//  if (IOTCL_SUCCESS == status) {
+//      while (there is more data && IOTCL_SUCCESS == iotcl_dra_identity_stream_feed(&is, chunk, chunk_len));
+//      status = iotcl_dra_identity_stream_finish(&is);
+//  }
+//  iotcl_dra_identity_stream_deinit(&is);
+// Always call iotcl_dra_identity_stream_deinit() once done, even if the response was not finished,
+// so that the kept values are freed.
+// The members are private, but are declared here so that the structure can be placed on the stack.
+typedef struct {
+    IotclJsonStream parser;
+    bool has_status;
+    bool has_ec;
+    int32_t status;
+    int32_t ec;
+    IotclMqttConfig values; // collected from the response and moved into the library configuration on success
+} IotclDraIdentityStream;
+
+// Returns an error if the library is not configured in custom mode, or if its MQTT configuration is already set.
+int iotcl_dra_identity_stream_init(IotclDraIdentityStream *is);
+
+// Returns IOTCL_SUCCESS, or the error that stopped parsing, which will also be returned by further calls.
+int iotcl_dra_identity_stream_feed(IotclDraIdentityStream *is, const char *data, size_t data_len);
+
+// Checks the response and configures the library MQTT settings as iotcl_dra_identity_configure_library_mqtt() would.
+int iotcl_dra_identity_stream_finish(IotclDraIdentityStream *is);
+
+void iotcl_dra_identity_stream_deinit(IotclDraIdentityStream *is);
 
 
 #ifdef __cplusplus
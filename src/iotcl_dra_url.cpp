@@ -18,6 +18,7 @@
 #include "iotcl_dra_url.h"
 
 int iotcl_dra_url_init_with_slack(IotclDraUrlContext* c, size_t slack, const char *url) {
+    IOTCL_HEAP_TAG_SCOPE(IOTCL_HEAP_TAG_DRA);
     const char *const HTTPS_HEADER = "https://";
     const char *const HTTP_HEADER = "http://";
 
@@ -111,6 +112,7 @@ bool iotcl_dra_url_is_https(const IotclDraUrlContext *c) {
 }
 
 int iotcl_dra_url_use_suffix_path(IotclDraUrlContext *c, const char *suffix) {
+    IOTCL_HEAP_TAG_SCOPE(IOTCL_HEAP_TAG_DRA);
     if (!c || !c->url || !suffix) {
         IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "DRA URL: Context and suffix are required!");
         return IOTCL_ERR_MISSING_VALUE;
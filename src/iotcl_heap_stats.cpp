@@ -0,0 +1,174 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__AVR__)
+#include <avr/io.h>
+#include <stdlib.h>
+#endif
+
+#include "iotcl_internal.h"
+#include "iotcl_log.h"
+#include "iotcl.h"
+#include "iotcl_heap_stats.h"
+
+// The longest path is "<object_name>.<field name>"
+#define IOTCL_HEAP_STATS_PATH_MAX_LEN 40
+
+#if IOTCL_HEAP_STATS
+// The header is a union with IotclMaxAlignType, so that the memory following it stays aligned
+typedef union {
+    struct {
+        size_t size;
+        uint8_t tag;
+    } info;
+    IotclMaxAlignType align;
+} IotclHeapBlockHeader;
+
+static IotclHeapStats heap_stats = {0};
+static IotclHeapTag current_tag = IOTCL_HEAP_TAG_CORE;
+
+IotclHeapTag iotcl_heap_stats_set_tag(IotclHeapTag tag) {
+    IotclHeapTag previous_tag = current_tag;
+    current_tag = tag;
+    return previous_tag;
+}
+
+void *iotcl_heap_stats_malloc(IoTclMallocFunction malloc_fn, size_t size) {
+    IotclHeapBlockHeader *header = NULL;
+    if (size <= SIZE_MAX - sizeof(IotclHeapBlockHeader)) {
+        header = (IotclHeapBlockHeader *) malloc_fn(sizeof(IotclHeapBlockHeader) + size);
+    }
+    if (!header) {
+        heap_stats.num_failed++;
+        return NULL;
+    }
+    header->info.size = size;
+    header->info.tag = (uint8_t) current_tag;
+
+    heap_stats.num_allocations++;
+    heap_stats.current_blocks++;
+    heap_stats.current_bytes += size;
+    if (heap_stats.current_bytes > heap_stats.peak_bytes) {
+        heap_stats.peak_bytes = heap_stats.current_bytes;
+    }
+    heap_stats.tag_current_bytes[current_tag] += size;
+    if (heap_stats.tag_current_bytes[current_tag] > heap_stats.tag_peak_bytes[current_tag]) {
+        heap_stats.tag_peak_bytes[current_tag] = heap_stats.tag_current_bytes[current_tag];
+    }
+    return header + 1;
+}
+
+void iotcl_heap_stats_free(IoTclFreeFunction free_fn, void *ptr) {
+    IotclHeapBlockHeader *header = (IotclHeapBlockHeader *) ptr - 1;
+    heap_stats.current_blocks--;
+    heap_stats.current_bytes -= header->info.size;
+    heap_stats.tag_current_bytes[header->info.tag] -= header->info.size;
+    free_fn(header);
+}
+#endif // IOTCL_HEAP_STATS
+
+int iotcl_heap_stats_get(IotclHeapStats *stats) {
+    if (NULL == stats) {
+        IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "iotcl_heap_stats_get: The stats argument is required!");
+        return IOTCL_ERR_MISSING_VALUE;
+    }
+#if IOTCL_HEAP_STATS
+    *stats = heap_stats;
+    stats->largest_free_block = iotcl_heap_get_largest_free_block();
+    return IOTCL_SUCCESS;
+#else
+    memset(stats, 0, sizeof(IotclHeapStats));
+    stats->largest_free_block = iotcl_heap_get_largest_free_block();
+    return IOTCL_ERR_CONFIG_MISSING;
+#endif
+}
+
+void iotcl_heap_stats_reset_peak(void) {
+#if IOTCL_HEAP_STATS
+    heap_stats.peak_bytes = heap_stats.current_bytes;
+    memcpy(heap_stats.tag_peak_bytes, heap_stats.tag_current_bytes, sizeof(heap_stats.tag_peak_bytes));
+#endif
+}
+
+#if defined(__AVR__)
+// avr-libc malloc internals. See avr-libc stdlib_private.h
+struct __freelist {
+    size_t sz;
+    struct __freelist *nx;
+};
+extern struct __freelist *__flp;
+extern char *__brkval;
+
+size_t iotcl_heap_get_largest_free_block(void) {
+    size_t largest = 0;
+    for (struct __freelist *fp = __flp; fp; fp = fp->nx) {
+        if (fp->sz > largest) {
+            largest = fp->sz;
+        }
+    }
+
+    // The heap can also grow up to __malloc_heap_end, or up to the stack, minus the safety margin
+    char *heap_top = __malloc_heap_end ? __malloc_heap_end : (char *) SP - __malloc_margin;
+    char *heap_break = __brkval ? __brkval : __malloc_heap_start;
+    if (heap_top > heap_break + sizeof(size_t)) {
+        size_t unused = (size_t) (heap_top - heap_break) - sizeof(size_t); // each block has a size header
+        if (unused > largest) {
+            largest = unused;
+        }
+    }
+    return largest;
+}
+#else
+size_t iotcl_heap_get_largest_free_block(void) {
+    return 0;
+}
+#endif
+
+int iotcl_heap_stats_add_to_telemetry(IotclMessageHandle message, const char *object_name) {
+    static const char *const tag_names[IOTCL_HEAP_TAG_COUNT] = {"core", "tel", "c2d", "dra", "http"};
+    const char *FUNCTION_NAME = "iotcl_heap_stats_add_to_telemetry";
+    char path[IOTCL_HEAP_STATS_PATH_MAX_LEN + 1];
+    IotclHeapStats stats;
+    int status;
+
+    if (NULL == object_name || strlen(object_name) + sizeof(".fail") > sizeof(path)) {
+        IOTCL_ERROR(IOTCL_ERR_BAD_VALUE, "%s: The object name is missing or too long!", FUNCTION_NAME);
+        return IOTCL_ERR_BAD_VALUE;
+    }
+    status = iotcl_heap_stats_get(&stats);
+    if (status) {
+        return status; // called function will print the error
+    }
+
+    const struct {
+        const char *name;
+        uint32_t value;
+    } counters[] = {
+            {"cur", (uint32_t) stats.current_bytes},
+            {"peak", (uint32_t) stats.peak_bytes},
+            {"n", stats.num_allocations},
+            {"fail", stats.num_failed},
+            {"lfb", (uint32_t) stats.largest_free_block},
+    };
+    for (size_t i = 0; i < sizeof(counters) / sizeof(counters[0]); i++) {
+        snprintf(path, sizeof(path), "%s.%s", object_name, counters[i].name);
+        status = iotcl_telemetry_set_number(message, path, (double) counters[i].value);
+        if (status) {
+            return status; // called function will print the error
+        }
+    }
+    for (int i = 0; i < IOTCL_HEAP_TAG_COUNT; i++) {
+        snprintf(path, sizeof(path), "%s.%s", object_name, tag_names[i]);
+        status = iotcl_telemetry_set_number(message, path, (double) stats.tag_current_bytes[i]);
+        if (status) {
+            return status; // called function will print the error
+        }
+    }
+    return IOTCL_SUCCESS;
+}
@@ -0,0 +1,68 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * Optional heap instrumentation for iotcl_malloc() and iotcl_free(), which includes the cJSON allocations.
+ * Enable it by defining IOTCL_HEAP_STATS to 1 (see iotcl_cfg.h). Each allocation is then prefixed
+ * by a small header that records its size and the subsystem that allocated it, so that
+ * the current and peak usage can be tracked per subsystem.
+ *
+ * Memory allocated from the arena (see iotcl_arena.h) is not counted here.
+ * When enabled, cJSON allocations are routed through iotcl_malloc() from iotcl_init() onwards,
+ * so cJSON objects created before iotcl_init() must not be freed after it.
+ */
+
+#ifndef IOTCL_HEAP_STATS_H
+#define IOTCL_HEAP_STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "iotcl_telemetry.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    IOTCL_HEAP_TAG_CORE = 0, // Library configuration and anything not listed below
+    IOTCL_HEAP_TAG_TELEMETRY,
+    IOTCL_HEAP_TAG_C2D,
+    IOTCL_HEAP_TAG_DRA,
+    IOTCL_HEAP_TAG_HTTP,
+    IOTCL_HEAP_TAG_COUNT
+} IotclHeapTag;
+
+typedef struct {
+    size_t current_bytes;
+    size_t peak_bytes;
+    size_t current_blocks;
+    uint32_t num_allocations;   // Successful allocations since boot
+    uint32_t num_failed;        // Allocations that returned NULL
+    size_t largest_free_block;  // The largest block that can currently be allocated. 0 if not supported by the platform.
+    size_t tag_current_bytes[IOTCL_HEAP_TAG_COUNT];
+    size_t tag_peak_bytes[IOTCL_HEAP_TAG_COUNT];
+} IotclHeapStats;
+
+// Takes a snapshot of the counters. Returns IOTCL_ERR_CONFIG_MISSING if IOTCL_HEAP_STATS is not enabled.
+int iotcl_heap_stats_get(IotclHeapStats *stats);
+
+// Sets the peak values to the current values, so that the peak of a specific operation can be measured.
+void iotcl_heap_stats_reset_peak(void);
+
+// Returns the largest block that malloc() can currently allocate, or 0 if not supported by the platform.
+// Available even if IOTCL_HEAP_STATS is not enabled.
+size_t iotcl_heap_get_largest_free_block(void);
+
+// Adds the counters to the current data set of the message as numbers in a nested object with the given name.
+// For example "heap.cur", "heap.peak", "heap.n", "heap.fail", "heap.lfb"
+// and the current bytes of each subsystem as "heap.core", "heap.tel", "heap.c2d", "heap.dra" and "heap.http".
+int iotcl_heap_stats_add_to_telemetry(IotclMessageHandle message, const char *object_name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTCL_HEAP_STATS_H
@@ -9,9 +9,13 @@
 #define IOTCL_INTERNAL_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <time.h>
 #include "cJSON.h"
 #include "iotcl.h"
+#include "iotcl_cfg.h"
+#include "iotcl_heap_stats.h"
+#include "iotcl_telemetry_schema.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -29,10 +33,26 @@ extern "C" {
 #error "cJSON version must be 1.7.13 or newer"
 #endif
 
+// A type with the strictest alignment of the types that cJSON and the library store in allocated memory
+typedef union {
+    void *p;
+    double d;
+    long l;
+} IotclMaxAlignType;
+
+typedef struct {
+    char c;
+    IotclMaxAlignType value;
+} IotclMaxAlignTypeProbe;
+
+// Alignment of memory returned by the library allocators
+#define IOTCL_MAX_ALIGNMENT (offsetof(IotclMaxAlignTypeProbe, value))
+
 typedef struct {
     bool is_valid;
     IotclMqttConfig mqtt_config;
     IotclMqttTransportSend mqtt_send_cb;
+    IotclMqttTransportSendStreamed mqtt_send_streamed_cb;
     IotclEventConfig event_functions;
     IotclTimeFunction time_fn;
     bool disable_printable_check;
@@ -46,8 +66,60 @@ IotclGlobalConfig *iotcl_get_global_config(void);
 // A helper function to clone a string from cJSON structure and return NULL if type is invalid etc.
 char *iotcl_strdup_json_string(cJSON *cjson, const char *value_name);
 
+// Sets the value into the current data set of the message without parsing a path.
+// object_name is the name of the nested object (like "light" of "light.red") or NULL for top level values.
+// Used by the telemetry schema serializer.
+int iotcl_telemetry_set_value_with_object(
+        IotclMessageHandle message,
+        const char *object_name,
+        const char *leaf_name,
+        IotclTelemetryFieldType type,
+        const IotclTelemetryValue *value
+);
+
+// Moves the last data set of the "from" message into the "to" message, making it the current data set there.
+// Both messages must be created with iotcl_telemetry_create(). Used by telemetry batching.
+int iotcl_telemetry_move_last_data_set(IotclMessageHandle from, IotclMessageHandle to);
+
+// Returns memory from the arena if an arena scope is open, or NULL if the scope is not open or the arena is full.
+void *iotcl_arena_alloc(size_t size);
+
+// Returns true if ptr points into the arena buffer, in which case it must not be passed to the free function.
+bool iotcl_arena_owns(const void *ptr);
+
+// Temporarily closes all arena scopes for allocations that need to outlive the scope.
+// Returns the value that needs to be passed to iotcl_arena_resume().
+unsigned int iotcl_arena_suspend(void);
+void iotcl_arena_resume(unsigned int saved_depth);
+
+// Frees the skeletons of the pooled message handles that are not in use. Called by iotcl_deinit().
+void iotcl_telemetry_release_pool(void);
+
+#if IOTCL_HEAP_STATS
+// Sets the subsystem that the following allocations are counted against. Returns the previous tag.
+IotclHeapTag iotcl_heap_stats_set_tag(IotclHeapTag tag);
+
+// Allocate and free with a header that records the size and the tag of the allocation. Used by iotcl_malloc/free.
+void *iotcl_heap_stats_malloc(IoTclMallocFunction malloc_fn, size_t size);
+void iotcl_heap_stats_free(IoTclFreeFunction free_fn, void *ptr);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
 
+#if IOTCL_HEAP_STATS && defined(__cplusplus)
+// Counts the allocations against the tag until the end of the enclosing block
+class IotclHeapTagScope {
+public:
+    explicit IotclHeapTagScope(IotclHeapTag tag) : previous_tag(iotcl_heap_stats_set_tag(tag)) {}
+    ~IotclHeapTagScope() { iotcl_heap_stats_set_tag(previous_tag); }
+private:
+    IotclHeapTag previous_tag;
+};
+#define IOTCL_HEAP_TAG_SCOPE(tag) IotclHeapTagScope iotcl_heap_tag_scope(tag)
+#else
+#define IOTCL_HEAP_TAG_SCOPE(tag)
+#endif
+
 #endif // IOTCL_INTERNAL_H
\ No newline at end of file
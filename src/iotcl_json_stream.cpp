@@ -0,0 +1,398 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "iotcl.h"
+#include "iotcl_json_tokenizer.h"
+#include "iotcl_json_stream.h"
+
+#if IOTCL_JSON_STREAM_MAX_DEPTH < 1 || IOTCL_JSON_STREAM_MAX_DEPTH > 255
+#error "IOTCL_JSON_STREAM_MAX_DEPTH must be between 1 and 255"
+#endif
+
+// What the parser can accept next
+typedef enum {
+    STREAM_EXPECT_VALUE = 0,
+    STREAM_EXPECT_VALUE_OR_CLOSE,   // after [
+    STREAM_EXPECT_KEY,              // after a comma in an object
+    STREAM_EXPECT_KEY_OR_CLOSE,     // after {
+    STREAM_EXPECT_COLON,
+    STREAM_EXPECT_COMMA_OR_CLOSE,   // after a value in an object or array
+    STREAM_EXPECT_END,              // after the top level value
+    STREAM_IN_STRING,
+    STREAM_IN_STRING_ESCAPE,        // after a backslash
+    STREAM_IN_STRING_UNICODE,       // in the hex digits of \u
+    STREAM_IN_PRIMITIVE
+} IotclJsonStreamState;
+
+static bool is_whitespace(char c) {
+    return ' ' == c || '\t' == c || '\n' == c || '\r' == c;
+}
+
+static bool is_primitive_char(char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || '-' == c || '+' == c || '.' == c || 'E' == c;
+}
+
+static bool is_hex_char(char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+static bool is_valid_primitive(const char *p, size_t length) {
+    if ((4 == length && 0 == strncmp(p, "true", 4))
+        || (5 == length && 0 == strncmp(p, "false", 5))
+        || (4 == length && 0 == strncmp(p, "null", 4))) {
+        return true;
+    }
+    // A loose check for numbers, same as the tokenizer's
+    return '-' == p[0] || (p[0] >= '0' && p[0] <= '9');
+}
+
+static int stream_fail(IotclJsonStream *s, int status) {
+    s->status = status;
+    return status;
+}
+
+static int stream_emit(IotclJsonStream *s, IotclJsonStreamEventType type, const char *data, size_t data_length, bool is_first, bool is_last) {
+    IotclJsonStreamEvent event;
+    event.type = (uint8_t) type;
+    event.depth = s->depth;
+    event.data = data;
+    event.data_length = data_length;
+    event.is_first = is_first;
+    event.is_last = is_last;
+    int status = s->callback ? s->callback(s->context, s, &event) : IOTCL_SUCCESS;
+    if (status) {
+        s->status = status;
+    }
+    return status;
+}
+
+static void stream_value_done(IotclJsonStream *s) {
+    s->state = (0 == s->depth) ? STREAM_EXPECT_END : STREAM_EXPECT_COMMA_OR_CLOSE;
+}
+
+static int stream_finish_primitive(IotclJsonStream *s) {
+    if (!is_valid_primitive(s->primitive, s->primitive_length)) {
+        return stream_fail(s, IOTCL_ERR_PARSING_ERROR);
+    }
+    int status = stream_emit(s, IOTCL_JSON_STREAM_PRIMITIVE, s->primitive, s->primitive_length, true, true);
+    stream_value_done(s);
+    return status;
+}
+
+static void stream_add_key_char(IotclJsonStream *s, char c) {
+    uint8_t *length = &s->levels[s->depth - 1].key_length;
+    if (*length < IOTCL_JSON_STREAM_KEY_MAX_LEN) {
+        s->levels[s->depth - 1].key[*length] = c;
+    }
+    if (*length <= IOTCL_JSON_STREAM_KEY_MAX_LEN) {
+        (*length)++; // stops one past the maximum, which marks the key as too long
+    }
+}
+
+// Handles a character outside of strings and primitives
+static int stream_structure_char(IotclJsonStream *s, char c) {
+    switch (c) {
+        case ':':
+            if (STREAM_EXPECT_COLON != s->state) {
+                return stream_fail(s, IOTCL_ERR_PARSING_ERROR);
+            }
+            s->state = STREAM_EXPECT_VALUE;
+            return IOTCL_SUCCESS;
+        case ',':
+            if (STREAM_EXPECT_COMMA_OR_CLOSE != s->state) {
+                return stream_fail(s, IOTCL_ERR_PARSING_ERROR);
+            }
+            if (s->levels[s->depth - 1].is_object) {
+                s->state = STREAM_EXPECT_KEY;
+            } else {
+                s->levels[s->depth - 1].index++;
+                s->state = STREAM_EXPECT_VALUE;
+            }
+            return IOTCL_SUCCESS;
+        case '}':
+        case ']': {
+            bool is_object = ('}' == c);
+            bool can_close = (STREAM_EXPECT_COMMA_OR_CLOSE == s->state)
+                             || (STREAM_EXPECT_KEY_OR_CLOSE == s->state && is_object)
+                             || (STREAM_EXPECT_VALUE_OR_CLOSE == s->state && !is_object);
+            if (0 == s->depth || s->levels[s->depth - 1].is_object != is_object || !can_close) {
+                return stream_fail(s, IOTCL_ERR_PARSING_ERROR);
+            }
+            s->depth--;
+            int status = stream_emit(s, is_object ? IOTCL_JSON_STREAM_OBJECT_END : IOTCL_JSON_STREAM_ARRAY_END, NULL, 0, true, true);
+            stream_value_done(s);
+            return status;
+        }
+        default:
+            break;
+    }
+
+    // Everything else starts a new key or value
+    bool is_key = (STREAM_EXPECT_KEY == s->state || STREAM_EXPECT_KEY_OR_CLOSE == s->state);
+    if (!is_key && STREAM_EXPECT_VALUE != s->state && STREAM_EXPECT_VALUE_OR_CLOSE != s->state) {
+        return stream_fail(s, IOTCL_ERR_PARSING_ERROR);
+    }
+    if (is_key && '"' != c) {
+        return stream_fail(s, IOTCL_ERR_PARSING_ERROR);
+    }
+
+    if ('{' == c || '[' == c) {
+        bool is_object = ('{' == c);
+        if (s->depth >= IOTCL_JSON_STREAM_MAX_DEPTH) {
+            return stream_fail(s, IOTCL_ERR_OVERFLOW);
+        }
+        int status = stream_emit(s, is_object ? IOTCL_JSON_STREAM_OBJECT_START : IOTCL_JSON_STREAM_ARRAY_START, NULL, 0, true, true);
+        s->levels[s->depth].is_object = is_object;
+        s->levels[s->depth].key_length = 0;
+        s->levels[s->depth].index = 0;
+        s->depth++;
+        s->state = is_object ? STREAM_EXPECT_KEY_OR_CLOSE : STREAM_EXPECT_VALUE_OR_CLOSE;
+        return status;
+    }
+    if ('"' == c) {
+        s->is_key = is_key;
+        s->is_first_fragment = true;
+        if (is_key) {
+            s->levels[s->depth - 1].key_length = 0;
+        }
+        s->state = STREAM_IN_STRING;
+        return IOTCL_SUCCESS;
+    }
+    if (!is_primitive_char(c)) {
+        return stream_fail(s, IOTCL_ERR_PARSING_ERROR);
+    }
+    s->primitive[0] = c;
+    s->primitive_length = 1;
+    s->state = STREAM_IN_PRIMITIVE;
+    return IOTCL_SUCCESS;
+}
+
+void iotcl_json_stream_init(IotclJsonStream *stream, IotclJsonStreamCallback callback, void *context) {
+    memset(stream, 0, sizeof(IotclJsonStream));
+    stream->callback = callback;
+    stream->context = context;
+    stream->state = STREAM_EXPECT_VALUE;
+}
+
+int iotcl_json_stream_feed(IotclJsonStream *stream, const char *data, size_t data_length) {
+    IotclJsonStream *s = stream;
+    if (s->status) {
+        return s->status;
+    }
+    if (!data) {
+        return stream_fail(s, IOTCL_ERR_MISSING_VALUE);
+    }
+
+    // start of the string contents that were not reported yet
+    const char *fragment = (STREAM_IN_STRING <= s->state && s->state <= STREAM_IN_STRING_UNICODE) ? data : NULL;
+
+    for (size_t pos = 0; pos < data_length; pos++) {
+        char c = data[pos];
+        int status = IOTCL_SUCCESS;
+
+        switch (s->state) {
+            case STREAM_IN_STRING:
+                if ((unsigned char) c < 0x20) {
+                    return stream_fail(s, IOTCL_ERR_PARSING_ERROR);
+                }
+                if ('\\' == c) {
+                    s->state = STREAM_IN_STRING_ESCAPE;
+                } else if ('"' == c) {
+                    if (s->is_key) {
+                        uint8_t key_length = s->levels[s->depth - 1].key_length;
+                        s->levels[s->depth - 1].key[key_length > IOTCL_JSON_STREAM_KEY_MAX_LEN ? 0 : key_length] = '\0';
+                        s->state = STREAM_EXPECT_COLON;
+                    } else {
+                        status = stream_emit(s, IOTCL_JSON_STREAM_STRING, fragment, (size_t) (&data[pos] - fragment), s->is_first_fragment, true);
+                        stream_value_done(s);
+                    }
+                    fragment = NULL;
+                    break;
+                }
+                if (s->is_key) {
+                    stream_add_key_char(s, c);
+                }
+                break;
+            case STREAM_IN_STRING_ESCAPE:
+                if (!strchr("\"\\/bfnrtu", c) || '\0' == c) {
+                    return stream_fail(s, IOTCL_ERR_PARSING_ERROR);
+                }
+                s->unicode_remaining = 4;
+                s->state = ('u' == c) ? STREAM_IN_STRING_UNICODE : STREAM_IN_STRING;
+                if (s->is_key) {
+                    stream_add_key_char(s, c);
+                }
+                break;
+            case STREAM_IN_STRING_UNICODE:
+                if (!is_hex_char(c)) {
+                    return stream_fail(s, IOTCL_ERR_PARSING_ERROR);
+                }
+                s->unicode_remaining--;
+                if (0 == s->unicode_remaining) {
+                    s->state = STREAM_IN_STRING;
+                }
+                if (s->is_key) {
+                    stream_add_key_char(s, c);
+                }
+                break;
+            case STREAM_IN_PRIMITIVE:
+                if (is_primitive_char(c)) {
+                    if (s->primitive_length >= sizeof(s->primitive)) {
+                        return stream_fail(s, IOTCL_ERR_OVERFLOW);
+                    }
+                    s->primitive[s->primitive_length++] = c;
+                    break;
+                }
+                status = stream_finish_primitive(s);
+                if (status) {
+                    return status;
+                }
+                // the character that ended the primitive is handled as any other
+                pos--;
+                break;
+            default:
+                if (STREAM_EXPECT_END == s->state) {
+                    return IOTCL_SUCCESS; // anything after the document is ignored, as cJSON_Parse() does
+                }
+                if (is_whitespace(c)) {
+                    break;
+                }
+                status = stream_structure_char(s, c);
+                if (STREAM_IN_STRING == s->state) {
+                    fragment = &data[pos + 1];
+                }
+                break;
+        }
+        if (status) {
+            return status;
+        }
+    }
+
+    // report what we have of a string that continues in the next chunk
+    if (fragment && !s->is_key && &data[data_length] > fragment) {
+        int status = stream_emit(s, IOTCL_JSON_STREAM_STRING, fragment, (size_t) (&data[data_length] - fragment), s->is_first_fragment, false);
+        s->is_first_fragment = false;
+        if (status) {
+            return status;
+        }
+    }
+    return IOTCL_SUCCESS;
+}
+
+int iotcl_json_stream_finish(IotclJsonStream *stream) {
+    if (stream->status) {
+        return stream->status;
+    }
+    // a top level primitive does not have a delimiter that would end it
+    if (STREAM_IN_PRIMITIVE == stream->state && 0 == stream->depth) {
+        int status = stream_finish_primitive(stream);
+        if (status) {
+            return status;
+        }
+    }
+    if (STREAM_EXPECT_END != stream->state) {
+        return stream_fail(stream, IOTCL_ERR_PARSING_ERROR); // empty or incomplete
+    }
+    return IOTCL_SUCCESS;
+}
+
+const char *iotcl_json_stream_get_key(const IotclJsonStream *stream, unsigned int depth) {
+    if (0 == depth || depth > stream->depth || !stream->levels[depth - 1].is_object) {
+        return NULL;
+    }
+    if (stream->levels[depth - 1].key_length > IOTCL_JSON_STREAM_KEY_MAX_LEN) {
+        return NULL;
+    }
+    return stream->levels[depth - 1].key;
+}
+
+int iotcl_json_stream_get_index(const IotclJsonStream *stream, unsigned int depth) {
+    if (0 == depth || depth > stream->depth || stream->levels[depth - 1].is_object) {
+        return -1;
+    }
+    return (int) stream->levels[depth - 1].index;
+}
+
+bool iotcl_json_stream_is_at_path(const IotclJsonStream *stream, const IotclJsonStreamEvent *event, const char *path) {
+    const char *p = path;
+    for (unsigned int depth = 1; depth <= event->depth; depth++) {
+        const char *key = iotcl_json_stream_get_key(stream, depth);
+        if (!key) {
+            return false;
+        }
+        // the key must match the path up to the next dot or the end of the path,
+        // ignoring the case as cJSON_GetObjectItem() does
+        while (*key && tolower((unsigned char) *key) == tolower((unsigned char) *p)) {
+            key++;
+            p++;
+        }
+        if (*key) {
+            return false;
+        }
+        if ('\0' == *p) {
+            return depth == event->depth;
+        }
+        if ('.' != *p) {
+            return false;
+        }
+        p++;
+    }
+    return false; // the path is deeper than the value
+}
+
+bool iotcl_json_stream_get_int(const IotclJsonStreamEvent *event, int32_t *value) {
+    char number[IOTCL_JSON_STREAM_PRIMITIVE_MAX_LEN + 1];
+    if (IOTCL_JSON_STREAM_PRIMITIVE != event->type || 0 == event->data_length || event->data_length >= sizeof(number)) {
+        return false;
+    }
+    if ('-' != event->data[0] && (event->data[0] < '0' || event->data[0] > '9')) {
+        return false; // true, false or null
+    }
+    memcpy(number, event->data, event->data_length);
+    number[event->data_length] = '\0';
+    char *end = NULL;
+    long result = strtol(number, &end, 10);
+    if ('\0' != *end && '.' != *end) {
+        return false;
+    }
+    *value = (int32_t) result;
+    return true;
+}
+
+int iotcl_json_stream_collect_string(const IotclJsonStreamEvent *event, char **str) {
+    if (IOTCL_JSON_STREAM_STRING != event->type) {
+        return IOTCL_ERR_BAD_VALUE;
+    }
+    if (event->is_first) {
+        iotcl_free(*str);
+        *str = NULL;
+    }
+    // the fragments are appended still escaped, as an escape sequence can be split between two of them
+    size_t length = *str ? strlen(*str) : 0;
+    char *grown = (char *) iotcl_malloc(length + event->data_length + 1);
+    if (!grown) {
+        iotcl_free(*str);
+        *str = NULL;
+        return IOTCL_ERR_OUT_OF_MEMORY;
+    }
+    if (length) {
+        memcpy(grown, *str, length);
+    }
+    if (event->data_length) {
+        memcpy(&grown[length], event->data, event->data_length);
+        length += event->data_length;
+    }
+    grown[length] = '\0';
+    iotcl_free(*str);
+    *str = grown;
+    if (event->is_last) {
+        iotcl_json_unescape_in_place(grown, length);
+    }
+    return IOTCL_SUCCESS;
+}
@@ -0,0 +1,122 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * An incremental (push) JSON parser that does not need the whole document in memory.
+ * The JSON is fed in chunks of any size and the parser reports each value to a callback as soon as it is parsed.
+ * The state between the chunks is kept in the IotclJsonStream structure, which has a fixed size,
+ * so the memory needed to parse a document does not depend on its length.
+ *
+ * String values are reported in one or more fragments, as they arrive, with escape sequences left as they are.
+ * Keys and primitives (numbers, true, false, null) are short and are collected internally,
+ * so they are always reported whole. The key of a value and its index in an array can be obtained
+ * from within the callback with iotcl_json_stream_get_key() and iotcl_json_stream_get_index().
+ * Like cJSON_Parse(), the parser ignores anything that follows the top level value, such as a null terminator.
+ */
+
+#ifndef IOTCL_JSON_STREAM_H
+#define IOTCL_JSON_STREAM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "iotcl_cfg.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Keys longer than this are not kept and iotcl_json_stream_get_key() will return NULL for them.
+#define IOTCL_JSON_STREAM_KEY_MAX_LEN 15
+
+// Longer numbers are rejected with IOTCL_ERR_OVERFLOW.
+#define IOTCL_JSON_STREAM_PRIMITIVE_MAX_LEN 24
+
+typedef enum {
+    IOTCL_JSON_STREAM_OBJECT_START = 0,
+    IOTCL_JSON_STREAM_OBJECT_END,
+    IOTCL_JSON_STREAM_ARRAY_START,
+    IOTCL_JSON_STREAM_ARRAY_END,
+    IOTCL_JSON_STREAM_STRING,       // A fragment of the string contents, without quotes and still escaped
+    IOTCL_JSON_STREAM_PRIMITIVE     // A whole number, true, false or null
+} IotclJsonStreamEventType;
+
+typedef struct {
+    uint8_t type;           // IotclJsonStreamEventType
+    uint8_t depth;          // The top level value is at depth 0, its members or items at depth 1 and so on
+    const char *data;       // String fragment or primitive. Not null terminated. NULL for objects and arrays.
+    size_t data_length;
+    bool is_first;          // Set on the first fragment of a string, and on all other events
+    bool is_last;           // Set on the last fragment of a string, and on all other events
+} IotclJsonStreamEvent;
+
+typedef struct IotclJsonStreamTag IotclJsonStream;
+
+// Return IOTCL_SUCCESS to continue parsing. Any other value stops the parser
+// and is returned from the current and all further iotcl_json_stream_feed() calls.
+typedef int (*IotclJsonStreamCallback)(void *context, const IotclJsonStream *stream, const IotclJsonStreamEvent *event);
+
+// The members are private to the parser, but are declared here so that the parser can be placed on the stack.
+struct IotclJsonStreamTag {
+    IotclJsonStreamCallback callback;
+    void *context;
+    int status;
+    uint8_t state;
+    uint8_t depth;              // Number of open objects and arrays
+    uint8_t unicode_remaining;  // Hex digits left in a \u escape sequence
+    uint8_t primitive_length;
+    bool is_key;                // The string being parsed is a key
+    bool is_first_fragment;
+    char primitive[IOTCL_JSON_STREAM_PRIMITIVE_MAX_LEN];
+    struct {
+        char key[IOTCL_JSON_STREAM_KEY_MAX_LEN + 1]; // Key of the current member, if this is an object
+        uint8_t key_length;     // IOTCL_JSON_STREAM_KEY_MAX_LEN + 1 if the key is too long
+        bool is_object;
+        uint16_t index;         // Index of the current item, if this is an array
+    } levels[IOTCL_JSON_STREAM_MAX_DEPTH];
+};
+
+void iotcl_json_stream_init(IotclJsonStream *stream, IotclJsonStreamCallback callback, void *context);
+
+// Parses the next chunk of the document.
+// Returns IOTCL_ERR_PARSING_ERROR if the JSON is not valid, IOTCL_ERR_OVERFLOW if objects and arrays
+// are nested deeper than IOTCL_JSON_STREAM_MAX_DEPTH or a number is too long,
+// or the status returned by the callback if it stopped the parser.
+int iotcl_json_stream_feed(IotclJsonStream *stream, const char *data, size_t data_length);
+
+// Should be called after the last chunk. Returns IOTCL_ERR_PARSING_ERROR if the document is empty or incomplete.
+int iotcl_json_stream_finish(IotclJsonStream *stream);
+
+// Returns the key of the value at the given depth (1 or more) on the path to the current value,
+// or NULL if that value is an array item or the key is longer than IOTCL_JSON_STREAM_KEY_MAX_LEN.
+// The key is returned as it appears in the JSON, with escape sequences not decoded.
+const char *iotcl_json_stream_get_key(const IotclJsonStream *stream, unsigned int depth);
+
+// Returns the index of the value at the given depth (1 or more) on the path to the current value,
+// or -1 if that value is an object member.
+int iotcl_json_stream_get_index(const IotclJsonStream *stream, unsigned int depth);
+
+// Returns true if the value of the event is at the dot separated path of keys, like "d.p.topics.rpt",
+// where the first key is a member of the top level object. Array items never match.
+// The keys are compared ignoring the case, like cJSON_GetObjectItem() does.
+bool iotcl_json_stream_is_at_path(const IotclJsonStream *stream, const IotclJsonStreamEvent *event, const char *path);
+
+// Converts a primitive that is an integer, like the status codes in the IoTConnect responses.
+// Fractions are truncated. Returns false if the event is not a number or if the number has an exponent.
+bool iotcl_json_stream_get_int(const IotclJsonStreamEvent *event, int32_t *value);
+
+// Collects the fragments of a string value into a string allocated with iotcl_malloc(), so that values
+// can be kept whole regardless of how the document is split into chunks. The escape sequences are decoded
+// once the last fragment arrives. *str is replaced on the first fragment, so a key that appears twice keeps
+// its last value. The caller frees *str with iotcl_free().
+// Returns IOTCL_ERR_OUT_OF_MEMORY, with *str freed and set to NULL, if the string cannot be grown.
+int iotcl_json_stream_collect_string(const IotclJsonStreamEvent *event, char **str);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTCL_JSON_STREAM_H
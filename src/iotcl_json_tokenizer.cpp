@@ -0,0 +1,293 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+#include <string.h>
+
+#include "iotcl_cfg.h"
+#include "iotcl_json_tokenizer.h"
+
+// What the tokenizer can accept next
+typedef enum {
+    EXPECT_VALUE,
+    EXPECT_VALUE_OR_CLOSE,  // after [
+    EXPECT_KEY,             // after a comma in an object
+    EXPECT_KEY_OR_CLOSE,    // after {
+    EXPECT_COLON,
+    EXPECT_COMMA_OR_CLOSE,  // after a value in an object or array
+    EXPECT_END              // after the top level value
+} IotclJsonTokenizerExpect;
+
+static bool is_whitespace(char c) {
+    return ' ' == c || '\t' == c || '\n' == c || '\r' == c;
+}
+
+static bool is_primitive_char(char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || '-' == c || '+' == c || '.' == c || 'E' == c;
+}
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static bool is_valid_primitive(const char *p, size_t length) {
+    if ((4 == length && 0 == strncmp(p, "true", 4))
+        || (5 == length && 0 == strncmp(p, "false", 5))
+        || (4 == length && 0 == strncmp(p, "null", 4))) {
+        return true;
+    }
+    // A loose check for numbers. Conversion functions will reject anything odd that passes it.
+    return '-' == p[0] || (p[0] >= '0' && p[0] <= '9');
+}
+
+// Returns the length of the string contents, or 0 with is_valid set to false if the string is not valid
+static size_t scan_string(const char *json, size_t json_length, size_t start, bool *is_valid) {
+    *is_valid = false;
+    for (size_t i = start; i < json_length; i++) {
+        char c = json[i];
+        if ('"' == c) {
+            *is_valid = true;
+            return i - start;
+        }
+        if ((unsigned char) c < 0x20) {
+            return 0;
+        }
+        if ('\\' == c) {
+            i++;
+            if (i >= json_length || !strchr("\"\\/bfnrtu", json[i])) {
+                return 0;
+            }
+            if ('u' == json[i]) {
+                if (i + 4 >= json_length) {
+                    return 0;
+                }
+                for (int j = 1; j <= 4; j++) {
+                    if (hex_value(json[i + j]) < 0) {
+                        return 0;
+                    }
+                }
+                i += 4;
+            }
+        }
+    }
+    return 0;
+}
+
+int iotcl_json_tokenize(
+        const char *json,
+        size_t json_length,
+        IotclJsonToken *tokens,
+        unsigned int max_tokens,
+        unsigned int *num_tokens
+) {
+    IotclJsonTokenizerExpect expect = EXPECT_VALUE;
+    int container = IOTCL_JSON_TOKEN_NO_PARENT;
+    unsigned int count = 0;
+
+    *num_tokens = 0;
+    if (!json || !tokens || json_length > IOTCL_JSON_TOKENIZER_MAX_LENGTH) {
+        return IOTCL_ERR_OVERFLOW;
+    }
+
+    for (size_t pos = 0; pos < json_length; pos++) {
+        char c = json[pos];
+        if (is_whitespace(c)) {
+            continue;
+        }
+        if ('\0' == c) {
+            break; // allow the length to include the null terminator
+        }
+
+        switch (c) {
+            case ':':
+                if (EXPECT_COLON != expect) {
+                    return IOTCL_ERR_PARSING_ERROR;
+                }
+                expect = EXPECT_VALUE;
+                continue;
+            case ',':
+                if (EXPECT_COMMA_OR_CLOSE != expect) {
+                    return IOTCL_ERR_PARSING_ERROR;
+                }
+                expect = (IOTCL_JSON_TOKEN_OBJECT == tokens[container].type) ? EXPECT_KEY : EXPECT_VALUE;
+                continue;
+            case '}':
+            case ']': {
+                IotclJsonTokenType type = ('}' == c) ? IOTCL_JSON_TOKEN_OBJECT : IOTCL_JSON_TOKEN_ARRAY;
+                bool can_close = (EXPECT_COMMA_OR_CLOSE == expect)
+                                 || (EXPECT_KEY_OR_CLOSE == expect && IOTCL_JSON_TOKEN_OBJECT == type)
+                                 || (EXPECT_VALUE_OR_CLOSE == expect && IOTCL_JSON_TOKEN_ARRAY == type);
+                if (IOTCL_JSON_TOKEN_NO_PARENT == container || tokens[container].type != type || !can_close) {
+                    return IOTCL_ERR_PARSING_ERROR;
+                }
+                tokens[container].end = (uint16_t) (pos + 1);
+                container = tokens[container].parent;
+                expect = (IOTCL_JSON_TOKEN_NO_PARENT == container) ? EXPECT_END : EXPECT_COMMA_OR_CLOSE;
+                continue;
+            }
+            default:
+                break;
+        }
+
+        // Everything else starts a new token
+        bool is_key = (EXPECT_KEY == expect || EXPECT_KEY_OR_CLOSE == expect);
+        if (!is_key && EXPECT_VALUE != expect && EXPECT_VALUE_OR_CLOSE != expect) {
+            return IOTCL_ERR_PARSING_ERROR;
+        }
+        if (is_key && '"' != c) {
+            return IOTCL_ERR_PARSING_ERROR;
+        }
+        if (count >= max_tokens) {
+            return IOTCL_ERR_OVERFLOW;
+        }
+        IotclJsonToken *t = &tokens[count];
+        t->parent = (int16_t) container;
+        t->size = 0;
+
+        if ('{' == c || '[' == c) {
+            t->type = ('{' == c) ? IOTCL_JSON_TOKEN_OBJECT : IOTCL_JSON_TOKEN_ARRAY;
+            t->start = (uint16_t) pos;
+            t->end = 0; // set when closed
+        } else if ('"' == c) {
+            bool is_valid;
+            size_t length = scan_string(json, json_length, pos + 1, &is_valid);
+            if (!is_valid) {
+                return IOTCL_ERR_PARSING_ERROR;
+            }
+            t->type = IOTCL_JSON_TOKEN_STRING;
+            t->start = (uint16_t) (pos + 1);
+            t->end = (uint16_t) (pos + 1 + length);
+            pos = t->end; // the closing quote
+        } else {
+            size_t end = pos;
+            while (end < json_length && is_primitive_char(json[end])) {
+                end++;
+            }
+            if (end == pos || !is_valid_primitive(&json[pos], end - pos)) {
+                return IOTCL_ERR_PARSING_ERROR;
+            }
+            t->type = IOTCL_JSON_TOKEN_PRIMITIVE;
+            t->start = (uint16_t) pos;
+            t->end = (uint16_t) end;
+            pos = end - 1;
+        }
+
+        if (IOTCL_JSON_TOKEN_NO_PARENT != container
+            && (is_key || IOTCL_JSON_TOKEN_ARRAY == tokens[container].type)) {
+            tokens[container].size++;
+        }
+        count++;
+
+        if (IOTCL_JSON_TOKEN_OBJECT == t->type || IOTCL_JSON_TOKEN_ARRAY == t->type) {
+            container = (int) (count - 1);
+            expect = (IOTCL_JSON_TOKEN_OBJECT == t->type) ? EXPECT_KEY_OR_CLOSE : EXPECT_VALUE_OR_CLOSE;
+        } else if (is_key) {
+            expect = EXPECT_COLON;
+        } else {
+            expect = (IOTCL_JSON_TOKEN_NO_PARENT == container) ? EXPECT_END : EXPECT_COMMA_OR_CLOSE;
+        }
+    }
+
+    if (EXPECT_END != expect) {
+        return IOTCL_ERR_PARSING_ERROR; // empty or incomplete
+    }
+    *num_tokens = count;
+    return IOTCL_SUCCESS;
+}
+
+// Writes the code point as UTF-8 and returns the number of bytes written
+static size_t write_utf8(char *out, uint32_t code_point) {
+    if (code_point < 0x80) {
+        out[0] = (char) code_point;
+        return 1;
+    }
+    if (code_point < 0x800) {
+        out[0] = (char) (0xC0 | (code_point >> 6));
+        out[1] = (char) (0x80 | (code_point & 0x3F));
+        return 2;
+    }
+    if (code_point < 0x10000) {
+        out[0] = (char) (0xE0 | (code_point >> 12));
+        out[1] = (char) (0x80 | ((code_point >> 6) & 0x3F));
+        out[2] = (char) (0x80 | (code_point & 0x3F));
+        return 3;
+    }
+    out[0] = (char) (0xF0 | (code_point >> 18));
+    out[1] = (char) (0x80 | ((code_point >> 12) & 0x3F));
+    out[2] = (char) (0x80 | ((code_point >> 6) & 0x3F));
+    out[3] = (char) (0x80 | (code_point & 0x3F));
+    return 4;
+}
+
+static uint32_t read_hex4(const char *p) {
+    return (uint32_t) ((hex_value(p[0]) << 12) | (hex_value(p[1]) << 8) | (hex_value(p[2]) << 4) | hex_value(p[3]));
+}
+
+// The decoded string is never longer than the escaped one, so it can be written over it.
+void iotcl_json_unescape_in_place(char *s, size_t length) {
+    size_t in = 0;
+    size_t out = 0;
+    while (in < length) {
+        char c = s[in++];
+        if ('\\' != c) {
+            s[out++] = c;
+            continue;
+        }
+        c = s[in++];
+        switch (c) {
+            case 'b': s[out++] = '\b'; break;
+            case 'f': s[out++] = '\f'; break;
+            case 'n': s[out++] = '\n'; break;
+            case 'r': s[out++] = '\r'; break;
+            case 't': s[out++] = '\t'; break;
+            case 'u': {
+                uint32_t code_point = read_hex4(&s[in]);
+                in += 4;
+                // combine a surrogate pair, if it is complete
+                if (code_point >= 0xD800 && code_point < 0xDC00 && in + 6 <= length && '\\' == s[in] && 'u' == s[in + 1]) {
+                    uint32_t low = read_hex4(&s[in + 2]);
+                    if (low >= 0xDC00 && low < 0xE000) {
+                        code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+                        in += 6;
+                    }
+                }
+                out += write_utf8(&s[out], code_point);
+                break;
+            }
+            default: // quote, backslash and slash
+                s[out++] = c;
+                break;
+        }
+    }
+    s[out] = '\0';
+}
+
+int iotcl_json_tokens_to_strings(char *json, size_t json_length, IotclJsonToken *tokens, unsigned int num_tokens) {
+    for (unsigned int i = 0; i < num_tokens; i++) {
+        IotclJsonToken *t = &tokens[i];
+        if (IOTCL_JSON_TOKEN_STRING == t->type) {
+            // the closing quote is replaced with the terminator, or an earlier character if the string shrinks
+            iotcl_json_unescape_in_place(&json[t->start], (size_t) (t->end - t->start));
+        } else if (IOTCL_JSON_TOKEN_PRIMITIVE == t->type) {
+            if (t->end >= json_length) {
+                return IOTCL_ERR_OVERFLOW;
+            }
+            json[t->end] = '\0'; // replaces a delimiter that follows the primitive
+        }
+    }
+    return IOTCL_SUCCESS;
+}
+
+unsigned int iotcl_json_token_skip(const IotclJsonToken *tokens, unsigned int num_tokens, unsigned int index) {
+    unsigned int next = index + 1;
+    if (IOTCL_JSON_TOKEN_OBJECT == tokens[index].type || IOTCL_JSON_TOKEN_ARRAY == tokens[index].type) {
+        while (next < num_tokens && tokens[next].start < tokens[index].end) {
+            next++;
+        }
+    }
+    return next;
+}
@@ -0,0 +1,78 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * A minimal non-allocating JSON tokenizer, in the spirit of jsmn.
+ * The JSON is split into an array of tokens that point into the original buffer, in document order.
+ * Objects contain their keys and values as consecutive tokens and their size is the number of keys.
+ * Arrays contain their values and their size is the number of values.
+ *
+ * After iotcl_json_tokens_to_strings(), the string and primitive tokens of a modifiable buffer
+ * become null-terminated C strings at (json + token.start), with escape sequences decoded,
+ * so that values can be used without copying.
+ */
+
+#ifndef IOTCL_JSON_TOKENIZER_H
+#define IOTCL_JSON_TOKENIZER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Token offsets are 16 bit to keep the token array small, so the JSON cannot be longer than this.
+#define IOTCL_JSON_TOKENIZER_MAX_LENGTH 0xFFFFU
+
+// The parent of a top level token
+#define IOTCL_JSON_TOKEN_NO_PARENT (-1)
+
+typedef enum {
+    IOTCL_JSON_TOKEN_UNDEFINED = 0,
+    IOTCL_JSON_TOKEN_OBJECT,
+    IOTCL_JSON_TOKEN_ARRAY,
+    IOTCL_JSON_TOKEN_STRING,    // start and end exclude the quotes
+    IOTCL_JSON_TOKEN_PRIMITIVE  // number, true, false or null
+} IotclJsonTokenType;
+
+typedef struct {
+    uint8_t type;   // IotclJsonTokenType
+    uint16_t start; // Offset of the first character
+    uint16_t end;   // Offset past the last character
+    uint16_t size;  // Number of keys of an object or values of an array
+    int16_t parent; // Index of the containing object or array, or IOTCL_JSON_TOKEN_NO_PARENT
+} IotclJsonToken;
+
+// Splits the JSON into tokens. The JSON does not need to be null-terminated.
+// Returns IOTCL_ERR_OVERFLOW if there are more than max_tokens tokens, or if the JSON is too long,
+// and IOTCL_ERR_PARSING_ERROR if the JSON is not valid or is incomplete.
+int iotcl_json_tokenize(
+        const char *json,
+        size_t json_length,
+        IotclJsonToken *tokens,
+        unsigned int max_tokens,
+        unsigned int *num_tokens
+);
+
+// Null-terminates the string and primitive tokens in the buffer and decodes escape sequences in strings.
+// The structure of the JSON in the buffer is lost, so this should be called after iotcl_json_tokenize().
+// Returns IOTCL_ERR_OVERFLOW if a primitive ends at the end of the buffer, so it cannot be terminated.
+int iotcl_json_tokens_to_strings(char *json, size_t json_length, IotclJsonToken *tokens, unsigned int num_tokens);
+
+// Decodes the escape sequences of the JSON string contents (without quotes) of length bytes
+// and null-terminates the result at s, which takes at most length bytes plus the terminator.
+// The escape sequences must be valid, as checked by iotcl_json_tokenize() or the parser in iotcl_json_stream.h.
+void iotcl_json_unescape_in_place(char *s, size_t length);
+
+// Returns the index of the token that follows the token and all of its children.
+unsigned int iotcl_json_token_skip(const IotclJsonToken *tokens, unsigned int num_tokens, unsigned int index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTCL_JSON_TOKENIZER_H
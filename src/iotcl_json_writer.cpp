@@ -0,0 +1,318 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+#include "iotcl_pgmspace.h"
+#include "iotcl_json_writer.h"
+
+// Enough to hold "%1.17g" of a double. Same as cJSON uses.
+#define IOTCL_JSON_NUMBER_BUFFER_SIZE 26
+
+// PROGMEM strings are copied in chunks of this size when writing to a sink
+#define IOTCL_JSON_PROGMEM_CHUNK_SIZE 16
+
+// Writes the escaped form of ch into out (at least 6 bytes) and returns the number of bytes written.
+// Follows the same rules as cJSON's print_string_ptr().
+static size_t iotcl_json_escape_char(char ch, char *out) {
+    switch (ch) {
+        case '\"':
+            out[0] = '\\';
+            out[1] = '\"';
+            return 2;
+        case '\\':
+            out[0] = '\\';
+            out[1] = '\\';
+            return 2;
+        case '\b':
+            out[0] = '\\';
+            out[1] = 'b';
+            return 2;
+        case '\f':
+            out[0] = '\\';
+            out[1] = 'f';
+            return 2;
+        case '\n':
+            out[0] = '\\';
+            out[1] = 'n';
+            return 2;
+        case '\r':
+            out[0] = '\\';
+            out[1] = 'r';
+            return 2;
+        case '\t':
+            out[0] = '\\';
+            out[1] = 't';
+            return 2;
+        default:
+            if ((unsigned char) ch < 32) {
+                const char *const HEX_DIGITS = "0123456789abcdef";
+                out[0] = '\\';
+                out[1] = 'u';
+                out[2] = '0';
+                out[3] = '0';
+                out[4] = HEX_DIGITS[((unsigned char) ch >> 4) & 0x0F];
+                out[5] = HEX_DIGITS[(unsigned char) ch & 0x0F];
+                return 6;
+            }
+            out[0] = ch;
+            return 1;
+    }
+}
+
+void iotcl_json_writer_init(IotclJsonWriter *w, char *buffer, size_t buffer_size) {
+    w->buffer = buffer;
+    w->size = buffer_size;
+    w->length = 0;
+    w->overflow = (!buffer || 0 == buffer_size);
+    w->has_sink = false;
+    w->sink = NULL;
+    w->sink_context = NULL;
+    w->sink_length = 0;
+    if (!w->overflow) {
+        buffer[0] = '\0';
+    }
+}
+
+void iotcl_json_writer_init_with_sink(IotclJsonWriter *w, char *buffer, size_t buffer_size, IotclJsonWriterSink sink, void *context) {
+    w->buffer = buffer;
+    w->size = buffer ? buffer_size : 0;
+    w->length = 0;
+    w->overflow = false;
+    w->has_sink = true;
+    w->sink = sink;
+    w->sink_context = context;
+    w->sink_length = 0;
+    if (w->size > 0) {
+        buffer[0] = '\0';
+    }
+}
+
+static bool iotcl_json_writer_to_sink(IotclJsonWriter *w, const char *data, size_t data_len) {
+    if (w->sink && !w->sink(w->sink_context, data, data_len)) {
+        w->overflow = true;
+        return false;
+    }
+    w->sink_length += data_len;
+    return true;
+}
+
+bool iotcl_json_writer_flush(IotclJsonWriter *w) {
+    if (w->overflow) {
+        return false;
+    }
+    if (!w->has_sink || 0 == w->length) {
+        return true;
+    }
+    if (!iotcl_json_writer_to_sink(w, w->buffer, w->length)) {
+        return false;
+    }
+    w->length = 0;
+    w->buffer[0] = '\0';
+    return true;
+}
+
+size_t iotcl_json_writer_get_total_length(const IotclJsonWriter *w) {
+    return w->sink_length + w->length;
+}
+
+void iotcl_json_writer_rewind(IotclJsonWriter *w, size_t length) {
+    if (!w->buffer || 0 == w->size || length >= w->size) {
+        return;
+    }
+    w->length = length;
+    w->buffer[length] = '\0';
+    w->overflow = false;
+}
+
+bool iotcl_json_writer_raw_with_length(IotclJsonWriter *w, const char *data, size_t data_len) {
+    if (w->overflow) {
+        return false;
+    }
+    // leave room for the null terminator
+    if (w->length + data_len >= w->size) {
+        if (!w->has_sink) {
+            w->overflow = true;
+            return false;
+        }
+        if (!iotcl_json_writer_flush(w)) {
+            return false;
+        }
+        if (data_len >= w->size) {
+            return iotcl_json_writer_to_sink(w, data, data_len);
+        }
+    }
+    memcpy(&w->buffer[w->length], data, data_len);
+    w->length += data_len;
+    w->buffer[w->length] = '\0';
+    return true;
+}
+
+bool iotcl_json_writer_raw(IotclJsonWriter *w, const char *str) {
+    return iotcl_json_writer_raw_with_length(w, str, strlen(str));
+}
+
+bool iotcl_json_writer_raw_P(IotclJsonWriter *w, const char *str) {
+    size_t str_len = strlen_P(str);
+    if (w->overflow) {
+        return false;
+    }
+    if (w->has_sink) {
+        char chunk[IOTCL_JSON_PROGMEM_CHUNK_SIZE];
+        for (size_t offset = 0; offset < str_len; offset += sizeof(chunk)) {
+            size_t chunk_len = (str_len - offset < sizeof(chunk)) ? str_len - offset : sizeof(chunk);
+            memcpy_P(chunk, &str[offset], chunk_len);
+            if (!iotcl_json_writer_raw_with_length(w, chunk, chunk_len)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    if (w->length + str_len >= w->size) {
+        w->overflow = true;
+        return false;
+    }
+    memcpy_P(&w->buffer[w->length], str, str_len);
+    w->length += str_len;
+    w->buffer[w->length] = '\0';
+    return true;
+}
+
+bool iotcl_json_writer_char(IotclJsonWriter *w, char ch) {
+    return iotcl_json_writer_raw_with_length(w, &ch, 1);
+}
+
+bool iotcl_json_writer_string_with_length(IotclJsonWriter *w, const char *str, size_t str_len) {
+    char escaped[6];
+    if (!iotcl_json_writer_char(w, '\"')) {
+        return false;
+    }
+    for (size_t i = 0; i < str_len; i++) {
+        size_t escaped_len = iotcl_json_escape_char(str[i], escaped);
+        if (!iotcl_json_writer_raw_with_length(w, escaped, escaped_len)) {
+            return false;
+        }
+    }
+    return iotcl_json_writer_char(w, '\"');
+}
+
+bool iotcl_json_writer_string(IotclJsonWriter *w, const char *str) {
+    if (!str) {
+        return iotcl_json_writer_null(w);
+    }
+    return iotcl_json_writer_string_with_length(w, str, strlen(str));
+}
+
+bool iotcl_json_writer_number(IotclJsonWriter *w, double value) {
+    char number_buffer[IOTCL_JSON_NUMBER_BUFFER_SIZE];
+    double test = 0.0;
+
+    if (isnan(value) || isinf(value)) {
+        return iotcl_json_writer_null(w);
+    }
+
+    // Same approach as cJSON: Try 15 decimal places of precision to avoid nonsignificant nonzero digits
+    int length = snprintf(number_buffer, sizeof(number_buffer), "%1.15g", value);
+
+    // Check whether the original double can be recovered, and if not, print with 17 decimal places of precision
+    bool is_recovered = (sscanf(number_buffer, "%lg", &test) == 1);
+    if (is_recovered) {
+        double max_value = (fabs(test) > fabs(value)) ? fabs(test) : fabs(value);
+        is_recovered = (fabs(test - value) <= max_value * DBL_EPSILON);
+    }
+    if (!is_recovered) {
+        length = snprintf(number_buffer, sizeof(number_buffer), "%1.17g", value);
+    }
+
+    if (length < 0 || length >= (int) sizeof(number_buffer)) {
+        w->overflow = true;
+        return false;
+    }
+
+    // replace the locale dependent decimal point with '.'
+    for (int i = 0; i < length; i++) {
+        if (number_buffer[i] == ',') {
+            number_buffer[i] = '.';
+        }
+    }
+    return iotcl_json_writer_raw_with_length(w, number_buffer, (size_t) length);
+}
+
+bool iotcl_json_writer_int32(IotclJsonWriter *w, int32_t value) {
+    return iotcl_json_writer_fixed(w, value, 0);
+}
+
+bool iotcl_json_writer_fixed(IotclJsonWriter *w, int32_t value, uint8_t decimals) {
+    char digits[sizeof("-2147483648") + IOTCL_JSON_WRITER_MAX_DECIMALS + 1];
+    size_t pos = sizeof(digits);
+    // avoid overflow when negating INT32_MIN
+    uint32_t magnitude = (value < 0) ? (uint32_t) 0 - (uint32_t) value : (uint32_t) value;
+
+    if (decimals > IOTCL_JSON_WRITER_MAX_DECIMALS) {
+        w->overflow = true;
+        return false;
+    }
+    if (decimals > 0) {
+        for (uint8_t i = 0; i < decimals; i++) {
+            digits[--pos] = (char) ('0' + magnitude % 10);
+            magnitude /= 10;
+        }
+        digits[--pos] = '.';
+    }
+    do {
+        digits[--pos] = (char) ('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude);
+    if (value < 0) {
+        digits[--pos] = '-';
+    }
+    return iotcl_json_writer_raw_with_length(w, &digits[pos], sizeof(digits) - pos);
+}
+
+bool iotcl_json_writer_decimal(IotclJsonWriter *w, double value, uint8_t decimals) {
+    static const int32_t POWERS_OF_10[IOTCL_JSON_WRITER_MAX_DECIMALS + 1] = {
+            1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+    };
+    if (isnan(value) || isinf(value)) {
+        return iotcl_json_writer_null(w);
+    }
+    if (decimals > IOTCL_JSON_WRITER_MAX_DECIMALS) {
+        decimals = IOTCL_JSON_WRITER_MAX_DECIMALS;
+    }
+    double scaled = value * POWERS_OF_10[decimals];
+    if (scaled >= 2147483647.0 || scaled <= -2147483647.0) {
+        return iotcl_json_writer_number(w, value);
+    }
+    int32_t fixed = (int32_t) (scaled < 0 ? scaled - 0.5 : scaled + 0.5);
+    while (decimals > 0 && fixed % 10 == 0) {
+        fixed /= 10;
+        decimals--;
+    }
+    return iotcl_json_writer_fixed(w, fixed, decimals);
+}
+
+bool iotcl_json_writer_bool(IotclJsonWriter *w, bool value) {
+    return iotcl_json_writer_raw(w, value ? "true" : "false");
+}
+
+bool iotcl_json_writer_null(IotclJsonWriter *w) {
+    return iotcl_json_writer_raw(w, "null");
+}
+
+bool iotcl_json_writer_escaped_equals(const char *json_data, size_t json_len, const char *str, size_t str_len) {
+    char escaped[6];
+    size_t pos = 0;
+    for (size_t i = 0; i < str_len; i++) {
+        size_t escaped_len = iotcl_json_escape_char(str[i], escaped);
+        if (pos + escaped_len > json_len || 0 != memcmp(&json_data[pos], escaped, escaped_len)) {
+            return false;
+        }
+        pos += escaped_len;
+    }
+    return pos == json_len;
+}
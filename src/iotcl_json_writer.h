@@ -0,0 +1,114 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * This file provides a minimal JSON output writer that writes directly into a fixed, caller supplied buffer.
+ * It is used by the streaming telemetry messages (see iotcl_telemetry_create_in_buffer()) and can be used
+ * by custom serializers that need to produce IoTConnect JSON without allocating any memory on the heap.
+ *
+ * The writer does not track the JSON structure. The caller is responsible for writing the punctuation
+ * (braces, commas, colons) in the correct order.
+ * Once a write does not fit, the writer is marked as overflowed and all subsequent writes will fail.
+ * The caller can record the length before a sequence of writes and roll back with iotcl_json_writer_rewind().
+ *
+ * A writer initialized with iotcl_json_writer_init_with_sink() passes the output to a sink function instead,
+ * so that the output can be sent or measured without holding all of it in RAM.
+ */
+
+#ifndef IOTCL_JSON_WRITER_H
+#define IOTCL_JSON_WRITER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Receives the output of a writer initialized with iotcl_json_writer_init_with_sink().
+// Should return false if the data cannot be accepted, which will fail the current and all subsequent writes.
+typedef bool (*IotclJsonWriterSink)(void *context, const char *data, size_t data_len);
+
+typedef struct {
+    char *buffer;       // Output buffer. The output is always kept null terminated.
+    size_t size;        // Size of the buffer, including the space for the null terminator.
+    size_t length;      // Number of bytes written so far, not including the null terminator.
+    bool overflow;      // Set once a write did not fit into the buffer.
+    bool has_sink;      // The buffer only collects the output for the sink, and a full buffer is not an overflow.
+    IotclJsonWriterSink sink;
+    void *sink_context;
+    size_t sink_length; // Number of bytes passed to the sink so far
+} IotclJsonWriter;
+
+// Initializes the writer to write into the buffer of buffer_size bytes.
+// The buffer needs to be at least one byte long, to accommodate the null terminator.
+void iotcl_json_writer_init(IotclJsonWriter *w, char *buffer, size_t buffer_size);
+
+// Initializes the writer to pass its output to the sink, collected in the (optional) buffer, so that the sink is
+// called with larger chunks. Output that does not fit into the buffer is passed to the sink directly.
+// If the sink is NULL, the output is discarded and only counted. See iotcl_json_writer_get_total_length().
+// Rewinding is only possible within the output that was not passed to the sink yet.
+void iotcl_json_writer_init_with_sink(IotclJsonWriter *w, char *buffer, size_t buffer_size, IotclJsonWriterSink sink, void *context);
+
+// Passes the output collected in the buffer to the sink. Call this once done writing.
+bool iotcl_json_writer_flush(IotclJsonWriter *w);
+
+// Returns the number of bytes written so far, including the ones passed to the sink.
+size_t iotcl_json_writer_get_total_length(const IotclJsonWriter *w);
+
+// Rolls back the output to the given length (previously obtained from w->length) and clears the overflow flag.
+void iotcl_json_writer_rewind(IotclJsonWriter *w, size_t length);
+
+// Appends raw JSON text (punctuation, pre-formatted values etc.) without any escaping.
+bool iotcl_json_writer_raw(IotclJsonWriter *w, const char *str);
+
+// Same as iotcl_json_writer_raw(), but with data and data length.
+bool iotcl_json_writer_raw_with_length(IotclJsonWriter *w, const char *data, size_t data_len);
+
+// Same as iotcl_json_writer_raw(), but str is located in PROGMEM.
+bool iotcl_json_writer_raw_P(IotclJsonWriter *w, const char *str);
+
+// Appends a single raw character.
+bool iotcl_json_writer_char(IotclJsonWriter *w, char ch);
+
+// Appends a quoted and escaped JSON string.
+bool iotcl_json_writer_string(IotclJsonWriter *w, const char *str);
+
+// Same as iotcl_json_writer_string(), but with data and data length.
+bool iotcl_json_writer_string_with_length(IotclJsonWriter *w, const char *str, size_t str_len);
+
+// Appends a number formatted the same way as cJSON would print it. NaN and infinity will be written as null.
+bool iotcl_json_writer_number(IotclJsonWriter *w, double value);
+
+// Appends an integer number. Unlike iotcl_json_writer_number(), this one does not lose precision on platforms
+// where double is only 32 bits wide, like AVR.
+bool iotcl_json_writer_int32(IotclJsonWriter *w, int32_t value);
+
+// Maximum number of decimal places supported by iotcl_json_writer_fixed() and iotcl_json_writer_decimal()
+#define IOTCL_JSON_WRITER_MAX_DECIMALS 9
+
+// Appends a fixed point number value / 10^decimals. For example, value 2345 with 2 decimals is written as 23.45.
+// All decimal places are written, including trailing zeros. Does not use printf.
+bool iotcl_json_writer_fixed(IotclJsonWriter *w, int32_t value, uint8_t decimals);
+
+// Appends the number rounded to the given number of decimal places, without trailing zeros.
+// This is several times faster than iotcl_json_writer_number() as it does not use printf,
+// unless the scaled value does not fit into 32 bits, in which case iotcl_json_writer_number() is used.
+bool iotcl_json_writer_decimal(IotclJsonWriter *w, double value, uint8_t decimals);
+
+bool iotcl_json_writer_bool(IotclJsonWriter *w, bool value);
+
+bool iotcl_json_writer_null(IotclJsonWriter *w);
+
+// Returns true if the escaped JSON string contents (without quotes) in json_data of json_len bytes
+// matches str of str_len bytes once str is escaped. Useful for looking up keys that were already written.
+bool iotcl_json_writer_escaped_equals(const char *json_data, size_t json_len, const char *str, size_t str_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTCL_JSON_WRITER_H
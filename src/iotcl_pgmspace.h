@@ -0,0 +1,33 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * Allows the library code that keeps constant tables and strings in flash (PROGMEM) to compile
+ * on platforms that have a single address space, where flash data can be accessed directly.
+ */
+
+#ifndef IOTCL_PGMSPACE_H
+#define IOTCL_PGMSPACE_H
+
+#if defined(__AVR__)
+#include <avr/pgmspace.h>
+#else
+#include <string.h>
+#include <stdint.h>
+
+// If the platform defines PROGMEM, assume that it provides the rest of the pgmspace functions as well
+#ifndef PROGMEM
+#define PROGMEM
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#define pgm_read_ptr(addr) (*(void *const *)(addr))
+#define memcpy_P(dest, src, n) memcpy((dest), (src), (n))
+#define strlen_P(s) strlen((s))
+#define strcpy_P(dest, src) strcpy((dest), (src))
+#define strncmp_P(s1, s2, n) strncmp((s1), (s2), (n))
+#endif
+
+#endif // __AVR__
+
+#endif // IOTCL_PGMSPACE_H
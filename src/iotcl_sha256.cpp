@@ -0,0 +1,123 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+#include <string.h>
+#include "iotcl_pgmspace.h"
+#include "iotcl_sha256.h"
+
+// The round constants are kept in flash on the AVR
+static const uint32_t sha256_k[64] PROGMEM = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static uint32_t ror(uint32_t x, uint8_t n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+static uint32_t read_k(uint8_t i) {
+    uint32_t k;
+    memcpy_P(&k, &sha256_k[i], sizeof(k));
+    return k;
+}
+
+static void sha256_transform(IotclSha256 *ctx, const uint8_t *block) {
+    // the message schedule is kept in a 16 word window, which saves 192 bytes of stack over the full one
+    uint32_t w[16];
+    uint32_t s[8];
+
+    for (uint8_t i = 0; i < 16; i++) {
+        w[i] = ((uint32_t) block[i * 4] << 24)
+            | ((uint32_t) block[i * 4 + 1] << 16)
+            | ((uint32_t) block[i * 4 + 2] << 8)
+            | (uint32_t) block[i * 4 + 3];
+    }
+    memcpy(s, ctx->state, sizeof(s));
+    for (uint8_t i = 0; i < 64; i++) {
+        if (i >= 16) {
+            uint32_t w15 = w[(i - 15) & 15];
+            uint32_t w2 = w[(i - 2) & 15];
+            uint32_t s0 = ror(w15, 7) ^ ror(w15, 18) ^ (w15 >> 3);
+            uint32_t s1 = ror(w2, 17) ^ ror(w2, 19) ^ (w2 >> 10);
+            w[i & 15] += s0 + w[(i - 7) & 15] + s1;
+        }
+        uint32_t t1 = s[7]
+            + (ror(s[4], 6) ^ ror(s[4], 11) ^ ror(s[4], 25))
+            + ((s[4] & s[5]) ^ (~s[4] & s[6]))
+            + read_k(i)
+            + w[i & 15];
+        uint32_t t2 = (ror(s[0], 2) ^ ror(s[0], 13) ^ ror(s[0], 22))
+            + ((s[0] & s[1]) ^ (s[0] & s[2]) ^ (s[1] & s[2]));
+        memmove(&s[1], &s[0], sizeof(s[0]) * 7);
+        s[4] += t1;
+        s[0] = t1 + t2;
+    }
+    for (uint8_t i = 0; i < 8; i++) {
+        ctx->state[i] += s[i];
+    }
+}
+
+void iotcl_sha256_init(IotclSha256 *ctx) {
+    static const uint32_t initial_state[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    memset(ctx, 0, sizeof(*ctx));
+    memcpy(ctx->state, initial_state, sizeof(initial_state));
+}
+
+void iotcl_sha256_update(IotclSha256 *ctx, const void *data, size_t data_length) {
+    const uint8_t *p = (const uint8_t *) data;
+    size_t used = (size_t) (ctx->length % IOTCL_SHA256_BLOCK_SIZE);
+
+    ctx->length += data_length;
+    if (used) {
+        size_t fill = IOTCL_SHA256_BLOCK_SIZE - used;
+        if (data_length < fill) {
+            memcpy(&ctx->block[used], p, data_length);
+            return;
+        }
+        memcpy(&ctx->block[used], p, fill);
+        sha256_transform(ctx, ctx->block);
+        p += fill;
+        data_length -= fill;
+    }
+    // whole blocks are hashed from where they are
+    for (; data_length >= IOTCL_SHA256_BLOCK_SIZE; data_length -= IOTCL_SHA256_BLOCK_SIZE) {
+        sha256_transform(ctx, p);
+        p += IOTCL_SHA256_BLOCK_SIZE;
+    }
+    if (data_length) {
+        memcpy(ctx->block, p, data_length);
+    }
+}
+
+void iotcl_sha256_finish(IotclSha256 *ctx, uint8_t digest[IOTCL_SHA256_DIGEST_SIZE]) {
+    uint64_t bit_length = ctx->length * 8;
+    size_t used = (size_t) (ctx->length % IOTCL_SHA256_BLOCK_SIZE);
+
+    ctx->block[used++] = 0x80;
+    if (used > IOTCL_SHA256_BLOCK_SIZE - 8) {
+        memset(&ctx->block[used], 0, IOTCL_SHA256_BLOCK_SIZE - used);
+        sha256_transform(ctx, ctx->block);
+        used = 0;
+    }
+    memset(&ctx->block[used], 0, IOTCL_SHA256_BLOCK_SIZE - 8 - used);
+    for (uint8_t i = 0; i < 8; i++) {
+        ctx->block[IOTCL_SHA256_BLOCK_SIZE - 1 - i] = (uint8_t) (bit_length >> (i * 8));
+    }
+    sha256_transform(ctx, ctx->block);
+    for (uint8_t i = 0; i < 8; i++) {
+        digest[i * 4] = (uint8_t) (ctx->state[i] >> 24);
+        digest[i * 4 + 1] = (uint8_t) (ctx->state[i] >> 16);
+        digest[i * 4 + 2] = (uint8_t) (ctx->state[i] >> 8);
+        digest[i * 4 + 3] = (uint8_t) ctx->state[i];
+    }
+}
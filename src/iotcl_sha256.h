@@ -0,0 +1,42 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * SHA-256 (FIPS 180-4) for data that arrives in pieces, like a firmware image that is being downloaded.
+ * The context is a plain struct without pointers, so it can be saved with the data that was hashed
+ * and restored later to continue hashing from there.
+ */
+
+#ifndef IOTCL_SHA256_H
+#define IOTCL_SHA256_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define IOTCL_SHA256_DIGEST_SIZE 32
+#define IOTCL_SHA256_BLOCK_SIZE 64
+
+typedef struct {
+    uint32_t state[8];
+    uint64_t length;                            // Bytes hashed so far
+    uint8_t block[IOTCL_SHA256_BLOCK_SIZE];     // The part of the next block that was received so far
+} IotclSha256;
+
+void iotcl_sha256_init(IotclSha256 *ctx);
+
+void iotcl_sha256_update(IotclSha256 *ctx, const void *data, size_t data_length);
+
+// Completes the hash. The context needs to be initialized again to be reused.
+void iotcl_sha256_finish(IotclSha256 *ctx, uint8_t digest[IOTCL_SHA256_DIGEST_SIZE]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTCL_SHA256_H
@@ -4,22 +4,64 @@
  */
 
 #include <stddef.h>
+#include <stdint.h>
 #include <string.h>
 
 #include "cJSON.h"
 
+#include "iotcl_json_writer.h"
 #include "iotcl_util.h"
 #include "iotcl_internal.h"
 #include "iotcl_log.h"
 #include "iotcl.h"
 #include "iotcl_telemetry.h"
 
+// Written at the start of messages created with iotcl_telemetry_create_in_buffer()
+#define IOTCL_TELEMETRY_STREAM_PREFIX "{\"d\":["
+
+// Space reserved at the end of the buffer so that we can always close the nested object,
+// the data set object and its "d" object, the data set array and the root object: }}}]}
+#define IOTCL_TELEMETRY_STREAM_SUFFIX_MAX 5
+
+// State of the messages created with iotcl_telemetry_create_in_buffer()
+typedef struct {
+    IotclJsonWriter writer;
+    size_t data_set_offset;     // Where the contents of the current data set "d" object start in the buffer
+    size_t object_name_offset;  // Where the escaped name of the currently open nested object starts in the buffer
+    size_t object_name_length;  // Length of the escaped name of the currently open nested object
+    bool has_data_set;          // At least one data set was written. The last one is always left open.
+    bool is_data_set_empty;     // No values were written into the current data set yet
+    bool is_object_open;        // A nested object (like "coordinate" of "coordinate.x") is open and can take more values
+} IotclTelemetryStream;
+
 struct IotclMessageHandleTag {
     cJSON *root_value;       // The root of the message. Only this one needs to be JSON_Delete-d
     cJSON *data_set_array;   // Convenience: The "d" array of data points.
     cJSON *current_data_set; // Convenience: Current data set object inside the "d" array containing current data values.
+    IotclTelemetryStream *stream; // Set only if the message was created with iotcl_telemetry_create_in_buffer()
+    bool is_pool_in_use;          // Only used by handles in message_pool
 };
 
+#if IOTCL_TELEMETRY_POOL_SIZE > 0
+static struct IotclMessageHandleTag message_pool[IOTCL_TELEMETRY_POOL_SIZE];
+
+static bool is_pooled(IotclMessageHandle message) {
+    return message >= &message_pool[0] && message < &message_pool[IOTCL_TELEMETRY_POOL_SIZE];
+}
+#endif
+
+// This is what gets placed at the start of the buffer passed to iotcl_telemetry_create_in_buffer()
+typedef struct {
+    struct IotclMessageHandleTag handle;
+    IotclTelemetryStream stream;
+} IotclTelemetryInBufferMessage;
+
+static_assert(
+        sizeof(IotclTelemetryInBufferMessage) + (sizeof(void *) - 1) + IOTCL_TELEMETRY_STREAM_SUFFIX_MAX + 1
+            <= IOTCL_TELEMETRY_IN_BUFFER_OVERHEAD,
+        "IOTCL_TELEMETRY_IN_BUFFER_OVERHEAD needs to be updated"
+);
+
 static int setup_data_set_object(const char *function_name, IotclMessageHandle message, const char *iso_timestamp) {
     cJSON *current_data_set = NULL;
     cJSON *array_item = cJSON_CreateObject();
@@ -66,6 +108,285 @@ static int setup_data_set_object(const char *function_name, IotclMessageHandle m
     return IOTCL_ERR_OUT_OF_MEMORY;
 }
 
+#define IOTCL_TELEMETRY_DOT_INDEX_NONE (-1)
+
+// Validates the path and finds the dot that separates the object name from the leaf name (like "coordinate.x").
+// dot_index will be set to IOTCL_TELEMETRY_DOT_INDEX_NONE if the path has no dot.
+static int iotcl_telemetry_parse_path(const char *function_name, const char *path, int *dot_index) {
+    *dot_index = IOTCL_TELEMETRY_DOT_INDEX_NONE;
+    size_t path_len = strlen(path);
+    // walk the string and look for dots
+    for (size_t i = 0; i < path_len; i++) {
+        char ch = path[i];
+        if (ch == '.') {
+            if (i == 0) {
+                IOTCL_ERROR(IOTCL_ERR_BAD_VALUE, "%s: Path \"%s\" cannot start with \".\"!", function_name, path);
+                return IOTCL_ERR_BAD_VALUE;
+            } else if (*dot_index == IOTCL_TELEMETRY_DOT_INDEX_NONE) {
+                *dot_index = (int) i;
+            } else {
+                IOTCL_ERROR(IOTCL_ERR_BAD_VALUE, "%s: Path \"%s\" cannot cannot have more than one \".\"!", function_name, path);
+                return IOTCL_ERR_BAD_VALUE;
+            }
+        }
+    }
+    if (*dot_index != IOTCL_TELEMETRY_DOT_INDEX_NONE && path[*dot_index + 1] == '\0') {
+        IOTCL_ERROR(IOTCL_ERR_BAD_VALUE, "%s: Path \"%s\" cannot end with \".\"!", function_name, path);
+        return IOTCL_ERR_BAD_VALUE;
+    }
+    return IOTCL_SUCCESS;
+}
+
+// Writes the closing braces of the nested object (if open) and the data set (if any) and the document into the
+// space reserved at the end of the buffer. Does not modify the writer length, so more values can be appended later.
+static const char *stream_terminate(IotclTelemetryStream *stream) {
+    char *end = &stream->writer.buffer[stream->writer.length];
+    if (stream->is_object_open) {
+        *end++ = '}';
+    }
+    if (stream->has_data_set) {
+        *end++ = '}'; // the "d" object
+        *end++ = '}'; // the data set
+    }
+    *end++ = ']';
+    *end++ = '}';
+    *end = '\0';
+    return stream->writer.buffer;
+}
+
+// Closes the current data set (if any) and opens a new one with the timestamp.
+// The caller is responsible for rolling back the stream in case of a failure.
+static int stream_open_data_set(const char *function_name, IotclTelemetryStream *stream, const char *iso_timestamp) {
+    IotclJsonWriter *w = &stream->writer;
+
+    // used if time_fn is configured
+    char time_str_buffer[IOTCL_ISO_TIMESTAMP_STR_LEN + 1] = {0};
+
+    // If the user didn't pass the timestamp and time function is configured
+    if (!iso_timestamp && iotcl_get_global_config()->time_fn) {
+        int status = iotcl_iso_timestamp_now(time_str_buffer, sizeof(time_str_buffer));
+        if (IOTCL_SUCCESS == status) {
+            iso_timestamp = time_str_buffer;
+        } else {
+            // The called function will print the error.
+            return status;
+        }
+    }
+
+    if (stream->is_object_open) {
+        iotcl_json_writer_char(w, '}');
+        stream->is_object_open = false;
+    }
+    if (stream->has_data_set) {
+        iotcl_json_writer_raw(w, "}},");
+    }
+    iotcl_json_writer_char(w, '{');
+    if (iso_timestamp) {
+        iotcl_json_writer_raw(w, "\"dt\":");
+        iotcl_json_writer_string(w, iso_timestamp);
+        iotcl_json_writer_char(w, ',');
+    }
+    if (!iotcl_json_writer_raw(w, "\"d\":{")) {
+        IOTCL_ERROR(IOTCL_ERR_OVERFLOW, "%s: The message buffer is full!", function_name);
+        return IOTCL_ERR_OVERFLOW;
+    }
+    stream->has_data_set = true;
+    stream->is_data_set_empty = true;
+    stream->data_set_offset = w->length;
+    return IOTCL_SUCCESS;
+}
+
+// Returns true if the data set already contains the object whose "name":{ was just written
+// at key_offset up to the current end of the buffer.
+static bool stream_has_duplicate_object(const IotclTelemetryStream *stream, size_t key_offset) {
+    const char *buffer = stream->writer.buffer;
+    size_t key_length = stream->writer.length - key_offset;
+    for (size_t i = stream->data_set_offset; i + key_length <= key_offset; i++) {
+        // an escaped quote can only be a part of a string value
+        if (buffer[i] == '\"' && (i == 0 || buffer[i - 1] != '\\')
+            && 0 == memcmp(&buffer[i], &buffer[key_offset], key_length)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Writes everything up to the point where the value for leaf_name can be written, opening the data set
+// and closing or opening nested objects as needed. object_name of object_name_len bytes is the name of the nested object
+// or NULL for top level values. The stream state before the call is saved into saved_stream,
+// so that stream_end_value() can roll back in case the value does not fit.
+static int stream_begin_value_with_object(
+        const char *function_name,
+        IotclTelemetryStream *stream,
+        const char *object_name,
+        size_t object_name_len,
+        const char *leaf_name,
+        IotclTelemetryStream *saved_stream
+) {
+    IotclJsonWriter *w = &stream->writer;
+    int status;
+
+    *saved_stream = *stream;
+
+    if (!stream->has_data_set) {
+        status = stream_open_data_set(function_name, stream, NULL);
+        if (status) {
+            goto rollback; // the called function will print the error
+        }
+    }
+
+    if (!object_name) {
+        if (stream->is_object_open) {
+            iotcl_json_writer_char(w, '}');
+            stream->is_object_open = false;
+        }
+        if (!stream->is_data_set_empty) {
+            iotcl_json_writer_char(w, ',');
+        }
+    } else if (stream->is_object_open && iotcl_json_writer_escaped_equals(
+            &w->buffer[stream->object_name_offset],
+            stream->object_name_length,
+            object_name,
+            object_name_len
+    )) {
+        // continuing with the same object
+        iotcl_json_writer_char(w, ',');
+    } else {
+        if (stream->is_object_open) {
+            iotcl_json_writer_char(w, '}');
+            stream->is_object_open = false;
+        }
+        if (!stream->is_data_set_empty) {
+            iotcl_json_writer_char(w, ',');
+        }
+        size_t key_offset = w->length;
+        iotcl_json_writer_string_with_length(w, object_name, object_name_len);
+        iotcl_json_writer_raw(w, ":{");
+        if (!w->overflow && stream_has_duplicate_object(stream, key_offset)) {
+            IOTCL_ERROR(IOTCL_ERR_BAD_VALUE,
+                        "%s: Values of object \"%.*s\" must be set one after another within a data set!",
+                        function_name, (int) object_name_len, object_name);
+            status = IOTCL_ERR_BAD_VALUE;
+            goto rollback;
+        }
+        stream->object_name_offset = key_offset + 1; // skip the quote
+        stream->object_name_length = w->length - key_offset - 4; // minus quotes, colon and brace
+        stream->is_object_open = true;
+    }
+    iotcl_json_writer_string(w, leaf_name);
+    stream->is_data_set_empty = false;
+
+    if (!iotcl_json_writer_char(w, ':')) {
+        IOTCL_ERROR(IOTCL_ERR_OVERFLOW, "%s: The message buffer is full!", function_name);
+        status = IOTCL_ERR_OVERFLOW;
+        goto rollback;
+    }
+    return IOTCL_SUCCESS;
+
+    rollback:
+    *stream = *saved_stream;
+    iotcl_json_writer_rewind(&stream->writer, saved_stream->writer.length);
+    return status;
+}
+
+// Same as stream_begin_value_with_object(), but with the object and leaf name given as a path like "coordinate.x".
+static int stream_begin_value(
+        const char *function_name,
+        IotclTelemetryStream *stream,
+        const char *path,
+        IotclTelemetryStream *saved_stream
+) {
+    int dot_index;
+
+    if (NULL == path || 0 == strlen(path)) {
+        IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "%s: The path argument is required!", function_name);
+        return IOTCL_ERR_MISSING_VALUE;
+    }
+    int status = iotcl_telemetry_parse_path(function_name, path, &dot_index);
+    if (status) {
+        // the called function will print the error
+        return status;
+    }
+    if (dot_index == IOTCL_TELEMETRY_DOT_INDEX_NONE) {
+        return stream_begin_value_with_object(function_name, stream, NULL, 0, path, saved_stream);
+    }
+    return stream_begin_value_with_object(
+            function_name,
+            stream,
+            path,
+            (size_t) dot_index,
+            &path[dot_index + 1],
+            saved_stream
+    );
+}
+
+// Checks whether the value written after stream_begin_value() fit into the buffer and rolls back if it did not.
+static int stream_end_value(const char *function_name, IotclTelemetryStream *stream, const IotclTelemetryStream *saved_stream) {
+    if (stream->writer.overflow) {
+        *stream = *saved_stream;
+        iotcl_json_writer_rewind(&stream->writer, saved_stream->writer.length);
+        IOTCL_ERROR(IOTCL_ERR_OVERFLOW, "%s: The message buffer is full!", function_name);
+        return IOTCL_ERR_OVERFLOW;
+    }
+    return IOTCL_SUCCESS;
+}
+
+// Finds the nested object with object_name in the current data set, or creates a new one at data top level.
+static int tree_get_object(const char *function_name, IotclMessageHandle message, const char *object_name, cJSON **object) {
+    cJSON *object_ptr = cJSON_GetObjectItem(message->current_data_set, object_name);
+    if (object_ptr) {
+        if (!cJSON_IsObject(object_ptr)) {
+            IOTCL_ERROR(IOTCL_ERR_BAD_VALUE, "%s: Error: \"%s\" must be an object type and not a value!", function_name, object_name);
+            return IOTCL_ERR_BAD_VALUE;
+        }
+        *object = object_ptr;
+    } else {
+        *object = cJSON_AddObjectToObject(message->current_data_set, object_name);
+    }
+    if (!*object) {
+        IOTCL_ERROR(IOTCL_ERR_OUT_OF_MEMORY, "%s: Out of memory!", function_name);
+        return IOTCL_ERR_OUT_OF_MEMORY;
+    }
+    return IOTCL_SUCCESS;
+}
+
+// Enough for any number written by iotcl_json_writer_number() and iotcl_json_writer_fixed()
+#define IOTCL_TELEMETRY_NUMBER_STR_MAX 32
+
+// Writes the number with IOTCL_TELEMETRY_DECIMAL_PRECISION if configured
+static bool stream_write_number(IotclJsonWriter *w, double value) {
+#if IOTCL_TELEMETRY_DECIMAL_PRECISION >= 0
+    return iotcl_json_writer_decimal(w, value, IOTCL_TELEMETRY_DECIMAL_PRECISION);
+#else
+    return iotcl_json_writer_number(w, value);
+#endif
+}
+
+// Adds a pre-formatted number as a raw value, so that cJSON does not need to format it with printf
+static cJSON *tree_add_fixed(cJSON *parent_object, const char *leaf_name, int32_t value, uint8_t decimals) {
+    char number_str[IOTCL_TELEMETRY_NUMBER_STR_MAX];
+    IotclJsonWriter w;
+    iotcl_json_writer_init(&w, number_str, sizeof(number_str));
+    if (!iotcl_json_writer_fixed(&w, value, decimals)) {
+        return NULL;
+    }
+    return cJSON_AddRawToObject(parent_object, leaf_name, number_str);
+}
+
+static cJSON *tree_add_number(cJSON *parent_object, const char *leaf_name, double value) {
+#if IOTCL_TELEMETRY_DECIMAL_PRECISION >= 0
+    char number_str[IOTCL_TELEMETRY_NUMBER_STR_MAX];
+    IotclJsonWriter w;
+    iotcl_json_writer_init(&w, number_str, sizeof(number_str));
+    if (!iotcl_json_writer_decimal(&w, value, IOTCL_TELEMETRY_DECIMAL_PRECISION)) {
+        return NULL;
+    }
+    return cJSON_AddRawToObject(parent_object, leaf_name, number_str);
+#else
+    return cJSON_AddNumberToObject(parent_object, leaf_name, value);
+#endif
+}
+
 // Common functionality for all set functions.
 // Lazy creates message->current_data_set and sets it up with timestamp (if available).
 // Prints common errors and returns the error if one is encountered.
@@ -80,7 +401,6 @@ static int iotcl_telemetry_set_functions_common(
         IotclMessageHandle message,
         const char *path
 ) {
-    const int DOT_INDEX_NONE = -1;
     int status;
 
     *parent_object = NULL;
@@ -108,34 +428,19 @@ static int iotcl_telemetry_set_functions_common(
     }
     *parent_object = message->current_data_set;
 
-    int dot_index = DOT_INDEX_NONE;
-    size_t path_len = strlen(path);
-    // walk the string and look for dots
-    for (size_t i = 0; i < path_len; i++) {
-        char ch = path[i];
-        if (ch == '.') {
-            if (i == 0) {
-                IOTCL_ERROR(IOTCL_ERR_BAD_VALUE, "%s: Path \"%s\" cannot start with \".\"!", function_name, path);
-                return IOTCL_ERR_BAD_VALUE;
-            } else if (dot_index == DOT_INDEX_NONE) {
-                dot_index = (int) i;
-            } else {
-                IOTCL_ERROR(IOTCL_ERR_BAD_VALUE, "%s: Path \"%s\" cannot cannot have more than one \".\"!", function_name, path);
-                return IOTCL_ERR_BAD_VALUE;
-            }
-        }
+    int dot_index;
+    status = iotcl_telemetry_parse_path(function_name, path, &dot_index);
+    if (status) {
+        // the called function will print the error
+        return status;
     }
 
-    if (dot_index == DOT_INDEX_NONE) {
+    if (dot_index == IOTCL_TELEMETRY_DOT_INDEX_NONE) {
         *parent_object = message->current_data_set;
         *leaf_name = path;
         return  IOTCL_SUCCESS;
     } else {
         const char *leaf_name_str = &path[dot_index + 1];
-        if (*leaf_name_str == '\0') {
-            IOTCL_ERROR(IOTCL_ERR_BAD_VALUE, "%s: Path \"%s\" cannot end with \".\"!", function_name, path);
-            return IOTCL_ERR_BAD_VALUE;
-        }
         char *object_name = iotcl_strdup(path);
         if (!object_name) {
             IOTCL_ERROR(IOTCL_ERR_OUT_OF_MEMORY, "%s: Out of memory!", function_name);
@@ -146,29 +451,35 @@ static int iotcl_telemetry_set_functions_common(
         // truncate the duplicate here so we can nest with the object name
         object_name[dot_index] = '\0';
 
-        cJSON *parent_obj_ptr = cJSON_GetObjectItem(message->current_data_set, object_name);
-        if (parent_obj_ptr) {
-            if (!cJSON_IsObject(parent_obj_ptr)) {
-                iotcl_free(object_name);
-                IOTCL_ERROR(IOTCL_ERR_BAD_VALUE, "%s: Error: \"%s\" must be an object type and not a value!", function_name, object_name);
-                return IOTCL_ERR_BAD_VALUE;
-            }
-            *parent_object = parent_obj_ptr;
-        } else {
-            *parent_object = cJSON_AddObjectToObject(message->current_data_set, object_name);
-        }
+        status = tree_get_object(function_name, message, object_name, parent_object);
         iotcl_free(object_name);
-        if (!*parent_object) {
-            IOTCL_ERROR(IOTCL_ERR_OUT_OF_MEMORY, "%s: Out of memory!", function_name);
-            return IOTCL_ERR_BAD_VALUE;
+        if (status) {
+            // the called function will print the error
+            return status;
         }
         *leaf_name = leaf_name_str;
     }
     return IOTCL_SUCCESS;
 }
 
+// Creates the root object and the "d" array of a message created with iotcl_telemetry_create()
+static bool tree_create_skeleton(IotclMessageHandle message) {
+    message->root_value = cJSON_CreateObject();
+    if (!message->root_value) {
+        return false;
+    }
+    message->data_set_array = cJSON_AddArrayToObject(message->root_value, "d");
+    if (!message->data_set_array) {
+        cJSON_Delete(message->root_value);
+        message->root_value = NULL;
+        return false;
+    }
+    return true;
+}
+
 IotclMessageHandle iotcl_telemetry_create(void) {
-    const char * FUNCTION_NAME = "iotcl_telemetry_set_null";
+    const char * FUNCTION_NAME = "iotcl_telemetry_create";
+    IOTCL_HEAP_TAG_SCOPE(IOTCL_HEAP_TAG_TELEMETRY);
 
     // check early in the call sequence that the config is valid, so it is safe to assume it is configured
     // in subsequent calls to other iotcl_telemetry_* functions.
@@ -176,6 +487,28 @@ IotclMessageHandle iotcl_telemetry_create(void) {
         return NULL; // called function will print the error
     }
 
+#if IOTCL_TELEMETRY_POOL_SIZE > 0
+    for (int i = 0; i < IOTCL_TELEMETRY_POOL_SIZE; i++) {
+        struct IotclMessageHandleTag *pooled_message = &message_pool[i];
+        if (pooled_message->is_pool_in_use) {
+            continue;
+        }
+        // the skeleton is created on first use and kept afterwards, so it cannot come from the arena
+        if (!pooled_message->root_value) {
+            unsigned int arena_depth = iotcl_arena_suspend();
+            bool is_created = tree_create_skeleton(pooled_message);
+            iotcl_arena_resume(arena_depth);
+            if (!is_created) {
+                IOTCL_ERROR(IOTCL_ERR_OUT_OF_MEMORY, "%s: Out of memory error!", FUNCTION_NAME);
+                return NULL;
+            }
+        }
+        pooled_message->is_pool_in_use = true;
+        return pooled_message;
+    }
+    // else all pooled handles are in use, so allocate a new one
+#endif
+
     struct IotclMessageHandleTag *message = (IotclMessageHandleTag *) iotcl_malloc(sizeof(struct IotclMessageHandleTag));
 
     if (!message) {
@@ -184,25 +517,56 @@ IotclMessageHandle iotcl_telemetry_create(void) {
     }
     memset(message, 0, sizeof(struct IotclMessageHandleTag));
 
-    message->root_value = cJSON_CreateObject();
-    if (!message->root_value) goto cleanup;
+    if (!tree_create_skeleton(message)) {
+        IOTCL_ERROR(IOTCL_ERR_OUT_OF_MEMORY, "%s: Out of memory error!", FUNCTION_NAME);
+        iotcl_free(message);
+        return NULL;
+    }
+    return message;
+}
 
-    message->data_set_array = cJSON_AddArrayToObject(message->root_value, "d");
-    if (!message->data_set_array) goto cleanup;
+IotclMessageHandle iotcl_telemetry_create_in_buffer(char *buffer, size_t buffer_size) {
+    const char *FUNCTION_NAME = "iotcl_telemetry_create_in_buffer";
 
-    return message;
+    // check early in the call sequence that the config is valid, so it is safe to assume it is configured
+    // in subsequent calls to other iotcl_telemetry_* functions.
+    if (!iotcl_get_global_config()->is_valid) {
+        return NULL; // called function will print the error
+    }
 
-    cleanup:
-    IOTCL_ERROR(IOTCL_ERR_OUT_OF_MEMORY, "%s: Out of memory error!", FUNCTION_NAME);
-    cJSON_Delete(message->root_value);
-    message->root_value = NULL;
-    message->data_set_array = NULL;
-    iotcl_free(message);
-    return NULL;
+    if (!buffer) {
+        IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "%s: The buffer argument is required!", FUNCTION_NAME);
+        return NULL;
+    }
+
+    // The handle is placed at the start of the buffer, so align it for the pointers it contains
+    const size_t alignment = sizeof(void *);
+    size_t padding = (alignment - ((uintptr_t) buffer % alignment)) % alignment;
+    size_t json_offset = padding + sizeof(IotclTelemetryInBufferMessage);
+    size_t min_size = json_offset + strlen(IOTCL_TELEMETRY_STREAM_PREFIX) + IOTCL_TELEMETRY_STREAM_SUFFIX_MAX + 1;
+    if (buffer_size < min_size) {
+        IOTCL_ERROR(IOTCL_ERR_OVERFLOW, "%s: The buffer needs to be at least %u bytes long!", FUNCTION_NAME, (unsigned int) min_size);
+        return NULL;
+    }
+
+    IotclTelemetryInBufferMessage *message = (IotclTelemetryInBufferMessage *) (void *) &buffer[padding];
+    memset(message, 0, sizeof(IotclTelemetryInBufferMessage));
+    message->handle.stream = &message->stream;
+
+    // Hide the space for closing braces from the writer, so that stream_terminate() can always use it
+    iotcl_json_writer_init(
+            &message->stream.writer,
+            &buffer[json_offset],
+            buffer_size - json_offset - IOTCL_TELEMETRY_STREAM_SUFFIX_MAX
+    );
+    iotcl_json_writer_raw(&message->stream.writer, IOTCL_TELEMETRY_STREAM_PREFIX); // the size was checked above
+
+    return &message->handle;
 }
 
 int iotcl_telemetry_add_new_data_set(IotclMessageHandle message, const char *iso_timestamp) {
     const char *FUNCTION_NAME = "iotcl_telemetry_add_new_data_set";
+    IOTCL_HEAP_TAG_SCOPE(IOTCL_HEAP_TAG_TELEMETRY);
     if (NULL == message) {
         IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "%s: The message handle argument is required!", FUNCTION_NAME);
         return IOTCL_ERR_MISSING_VALUE;
@@ -211,6 +575,16 @@ int iotcl_telemetry_add_new_data_set(IotclMessageHandle message, const char *iso
         IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "%s: The iso_timestamp argument is required!", FUNCTION_NAME);
         return IOTCL_ERR_MISSING_VALUE;
     }
+    if (message->stream) {
+        IotclTelemetryStream saved_stream = *message->stream;
+        int status = stream_open_data_set(FUNCTION_NAME, message->stream, iso_timestamp);
+        if (status) {
+            // called function should print the error message
+            *message->stream = saved_stream;
+            iotcl_json_writer_rewind(&message->stream->writer, saved_stream.writer.length);
+        }
+        return status;
+    }
     int status = setup_data_set_object("iotcl_telemetry_add_with_iso_time", message, iso_timestamp);
     if (status) {
         // called function should print the error message
@@ -221,12 +595,24 @@ int iotcl_telemetry_add_new_data_set(IotclMessageHandle message, const char *iso
 
 int iotcl_telemetry_set_number(IotclMessageHandle message, const char *path, double value) {
     const char *FUNCTION_NAME = "iotcl_telemetry_set_number";
+    IOTCL_HEAP_TAG_SCOPE(IOTCL_HEAP_TAG_TELEMETRY);
 
     if (NULL == message) {
         IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "%s: The message handle argument is required!", FUNCTION_NAME);
         return IOTCL_ERR_MISSING_VALUE;
     }
 
+    if (message->stream) {
+        IotclTelemetryStream saved_stream;
+        int status = stream_begin_value(FUNCTION_NAME, message->stream, path, &saved_stream);
+        if (status) {
+            // called function will print the error
+            return status;
+        }
+        stream_write_number(&message->stream->writer, value);
+        return stream_end_value(FUNCTION_NAME, message->stream, &saved_stream);
+    }
+
     cJSON *parent_object = NULL;
     const char *leaf_name = NULL;
     int status = iotcl_telemetry_set_functions_common(
@@ -241,7 +627,7 @@ int iotcl_telemetry_set_number(IotclMessageHandle message, const char *path, dou
         return status;
     }
 
-    if (!cJSON_AddNumberToObject(parent_object, leaf_name, value)) {
+    if (!tree_add_number(parent_object, leaf_name, value)) {
         IOTCL_ERROR(IOTCL_ERR_OUT_OF_MEMORY, "%s: Out of memory error!", FUNCTION_NAME);
         return IOTCL_ERR_OUT_OF_MEMORY;
     }
@@ -249,13 +635,83 @@ int iotcl_telemetry_set_number(IotclMessageHandle message, const char *path, dou
     return IOTCL_SUCCESS;
 }
 
+static int iotcl_telemetry_set_fixed_common(
+        const char *function_name,
+        IotclMessageHandle message,
+        const char *path,
+        int32_t value,
+        uint8_t decimals
+) {
+    IOTCL_HEAP_TAG_SCOPE(IOTCL_HEAP_TAG_TELEMETRY);
+    if (NULL == message) {
+        IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "%s: The message handle argument is required!", function_name);
+        return IOTCL_ERR_MISSING_VALUE;
+    }
+    if (decimals > IOTCL_JSON_WRITER_MAX_DECIMALS) {
+        IOTCL_ERROR(IOTCL_ERR_BAD_VALUE, "%s: Too many decimal places!", function_name);
+        return IOTCL_ERR_BAD_VALUE;
+    }
+
+    if (message->stream) {
+        IotclTelemetryStream saved_stream;
+        int status = stream_begin_value(function_name, message->stream, path, &saved_stream);
+        if (status) {
+            // called function will print the error
+            return status;
+        }
+        iotcl_json_writer_fixed(&message->stream->writer, value, decimals);
+        return stream_end_value(function_name, message->stream, &saved_stream);
+    }
+
+    cJSON *parent_object = NULL;
+    const char *leaf_name = NULL;
+    int status = iotcl_telemetry_set_functions_common(
+            function_name,
+            &parent_object,
+            &leaf_name,
+            message,
+            path
+    );
+    if (status) {
+        // called function will print the error
+        return status;
+    }
+
+    if (!tree_add_fixed(parent_object, leaf_name, value, decimals)) {
+        IOTCL_ERROR(IOTCL_ERR_OUT_OF_MEMORY, "%s: Out of memory error!", function_name);
+        return IOTCL_ERR_OUT_OF_MEMORY;
+    }
+
+    return IOTCL_SUCCESS;
+}
+
+int iotcl_telemetry_set_int32(IotclMessageHandle message, const char *path, int32_t value) {
+    return iotcl_telemetry_set_fixed_common("iotcl_telemetry_set_int32", message, path, value, 0);
+}
+
+int iotcl_telemetry_set_fixed(IotclMessageHandle message, const char *path, int32_t value, uint8_t decimals) {
+    return iotcl_telemetry_set_fixed_common("iotcl_telemetry_set_fixed", message, path, value, decimals);
+}
+
 int iotcl_telemetry_set_string(IotclMessageHandle message, const char *path, const char *value) {
     const char *FUNCTION_NAME = "iotcl_telemetry_set_string";
+    IOTCL_HEAP_TAG_SCOPE(IOTCL_HEAP_TAG_TELEMETRY);
     if (NULL == message) {
         IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "%s: The message handle argument is required!", FUNCTION_NAME);
         return IOTCL_ERR_MISSING_VALUE;
     }
 
+    if (message->stream) {
+        IotclTelemetryStream saved_stream;
+        int status = stream_begin_value(FUNCTION_NAME, message->stream, path, &saved_stream);
+        if (status) {
+            // called function will print the error
+            return status;
+        }
+        iotcl_json_writer_string(&message->stream->writer, value);
+        return stream_end_value(FUNCTION_NAME, message->stream, &saved_stream);
+    }
+
     const char *leaf_name = NULL;
     cJSON *parent_object = NULL;
 
@@ -281,6 +737,23 @@ int iotcl_telemetry_set_string(IotclMessageHandle message, const char *path, con
 
 int iotcl_telemetry_set_bool(IotclMessageHandle message, const char *path, bool value) {
     const char *FUNCTION_NAME = "iotcl_telemetry_set_bool";
+    IOTCL_HEAP_TAG_SCOPE(IOTCL_HEAP_TAG_TELEMETRY);
+    if (NULL == message) {
+        IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "%s: The message handle argument is required!", FUNCTION_NAME);
+        return IOTCL_ERR_MISSING_VALUE;
+    }
+
+    if (message->stream) {
+        IotclTelemetryStream saved_stream;
+        int status = stream_begin_value(FUNCTION_NAME, message->stream, path, &saved_stream);
+        if (status) {
+            // called function will print the error
+            return status;
+        }
+        iotcl_json_writer_bool(&message->stream->writer, value);
+        return stream_end_value(FUNCTION_NAME, message->stream, &saved_stream);
+    }
+
     const char *leaf_name = NULL;
     cJSON *parent_object = NULL;
     int status = iotcl_telemetry_set_functions_common(
@@ -306,6 +779,23 @@ int iotcl_telemetry_set_bool(IotclMessageHandle message, const char *path, bool
 
 int iotcl_telemetry_set_null(IotclMessageHandle message, const char *path) {
     const char *FUNCTION_NAME = "iotcl_telemetry_set_null";
+    IOTCL_HEAP_TAG_SCOPE(IOTCL_HEAP_TAG_TELEMETRY);
+    if (NULL == message) {
+        IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "%s: The message handle argument is required!", FUNCTION_NAME);
+        return IOTCL_ERR_MISSING_VALUE;
+    }
+
+    if (message->stream) {
+        IotclTelemetryStream saved_stream;
+        int status = stream_begin_value(FUNCTION_NAME, message->stream, path, &saved_stream);
+        if (status) {
+            // called function will print the error
+            return status;
+        }
+        iotcl_json_writer_null(&message->stream->writer);
+        return stream_end_value(FUNCTION_NAME, message->stream, &saved_stream);
+    }
+
     const char *leaf_name = NULL;
     cJSON *parent_object = NULL;
     int status = iotcl_telemetry_set_functions_common(
@@ -330,34 +820,339 @@ int iotcl_telemetry_set_null(IotclMessageHandle message, const char *path) {
 
 char *iotcl_telemetry_create_serialized_string(IotclMessageHandle message, bool pretty) {
     const char *FUNCTION_NAME = "iotcl_create_serialized_string";
+    IOTCL_HEAP_TAG_SCOPE(IOTCL_HEAP_TAG_TELEMETRY);
 
     if (NULL == message) {
         IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "%s: The message handle argument is required!", FUNCTION_NAME);
         return NULL;
     }
 
+    if (message->stream) {
+        // pretty printing is not supported for messages created in buffer
+        char *serialized_string = iotcl_strdup(stream_terminate(message->stream));
+        if (!serialized_string) {
+            IOTCL_ERROR(IOTCL_ERR_OUT_OF_MEMORY, "%s: Out of memory error!", FUNCTION_NAME);
+        }
+        return serialized_string;
+    }
+
     if (NULL == message->root_value) {
         IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "%s: The message is empty!", FUNCTION_NAME);
         return NULL;
     }
 
-    char *serialized_string = (pretty) ?
-                              cJSON_Print(message->root_value) : cJSON_PrintUnformatted(message->root_value);
+    if (pretty) {
+        char *serialized_string = cJSON_Print(message->root_value);
+        if (!serialized_string) {
+            IOTCL_ERROR(IOTCL_ERR_OUT_OF_MEMORY, "%s: Out of memory error!", FUNCTION_NAME);
+        }
+        return serialized_string;
+    }
 
+    // Allocate the exact size at once rather than growing the buffer while printing like cJSON does
+    size_t size;
+    if (iotcl_telemetry_get_serialized_size(message, &size)) {
+        return NULL; // called function will print the error
+    }
+    char *serialized_string = (char *) cJSON_malloc(size + 1);
     if (!serialized_string) {
         IOTCL_ERROR(IOTCL_ERR_OUT_OF_MEMORY, "%s: Out of memory error!", FUNCTION_NAME);
         return NULL;
     }
+    IotclJsonWriter w;
+    iotcl_json_writer_init(&w, serialized_string, size + 1);
+    if (iotcl_telemetry_write_serialized(message, &w)) {
+        cJSON_free(serialized_string);
+        return NULL; // called function will print the error
+    }
     return serialized_string;
 }
 
+// Writes the item the same way as cJSON_PrintUnformatted() would print it
+static bool tree_write_item(IotclJsonWriter *w, const cJSON *item) {
+    switch (item->type & 0xFF) {
+        case cJSON_False:
+            return iotcl_json_writer_bool(w, false);
+        case cJSON_True:
+            return iotcl_json_writer_bool(w, true);
+        case cJSON_NULL:
+            return iotcl_json_writer_null(w);
+        case cJSON_Number:
+            return iotcl_json_writer_number(w, item->valuedouble);
+        case cJSON_String:
+            return iotcl_json_writer_string(w, item->valuestring ? item->valuestring : "");
+        case cJSON_Raw:
+            return item->valuestring && iotcl_json_writer_raw(w, item->valuestring);
+        case cJSON_Array:
+        case cJSON_Object: {
+            bool is_object = (cJSON_Object == (item->type & 0xFF));
+            if (!iotcl_json_writer_char(w, is_object ? '{' : '[')) {
+                return false;
+            }
+            for (const cJSON *child = item->child; child; child = child->next) {
+                if (child != item->child && !iotcl_json_writer_char(w, ',')) {
+                    return false;
+                }
+                if (is_object) {
+                    if (!iotcl_json_writer_string(w, child->string ? child->string : "")
+                        || !iotcl_json_writer_char(w, ':')) {
+                        return false;
+                    }
+                }
+                if (!tree_write_item(w, child)) {
+                    return false;
+                }
+            }
+            return iotcl_json_writer_char(w, is_object ? '}' : ']');
+        }
+        default:
+            return false;
+    }
+}
+
+int iotcl_telemetry_write_serialized(IotclMessageHandle message, IotclJsonWriter *w) {
+    const char *FUNCTION_NAME = "iotcl_telemetry_write_serialized";
+    if (NULL == message || NULL == w) {
+        IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "%s: The message handle and writer arguments are required!", FUNCTION_NAME);
+        return IOTCL_ERR_MISSING_VALUE;
+    }
+    bool is_written;
+    if (message->stream) {
+        is_written = iotcl_json_writer_raw(w, stream_terminate(message->stream));
+    } else if (message->root_value) {
+        is_written = tree_write_item(w, message->root_value);
+    } else {
+        IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "%s: The message is empty!", FUNCTION_NAME);
+        return IOTCL_ERR_MISSING_VALUE;
+    }
+    if (!is_written || w->overflow) {
+        IOTCL_ERROR(IOTCL_ERR_OVERFLOW, "%s: The writer did not accept the message!", FUNCTION_NAME);
+        return IOTCL_ERR_OVERFLOW;
+    }
+    return IOTCL_SUCCESS;
+}
+
+int iotcl_telemetry_get_serialized_size(IotclMessageHandle message, size_t *size) {
+    const char *FUNCTION_NAME = "iotcl_telemetry_get_serialized_size";
+    if (NULL == size) {
+        IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "%s: The size argument is required!", FUNCTION_NAME);
+        return IOTCL_ERR_MISSING_VALUE;
+    }
+    *size = 0;
+    if (message && message->stream) {
+        *size = strlen(stream_terminate(message->stream));
+        return IOTCL_SUCCESS;
+    }
+    IotclJsonWriter w;
+    iotcl_json_writer_init_with_sink(&w, NULL, 0, NULL, NULL); // only count
+    int status = iotcl_telemetry_write_serialized(message, &w);
+    if (status) {
+        return status; // called function will print the error
+    }
+    *size = iotcl_json_writer_get_total_length(&w);
+    return IOTCL_SUCCESS;
+}
+
+int iotcl_telemetry_set_value_with_object(
+        IotclMessageHandle message,
+        const char *object_name,
+        const char *leaf_name,
+        IotclTelemetryFieldType type,
+        const IotclTelemetryValue *value
+) {
+    const char *FUNCTION_NAME = "iotcl_telemetry_set_value_with_object";
+    IOTCL_HEAP_TAG_SCOPE(IOTCL_HEAP_TAG_TELEMETRY);
+    bool is_null = (IOTCL_TELEMETRY_VALUE_NULL == value->state);
+
+    if (message->stream) {
+        IotclTelemetryStream saved_stream;
+        IotclJsonWriter *w = &message->stream->writer;
+        int status = stream_begin_value_with_object(
+                FUNCTION_NAME,
+                message->stream,
+                object_name,
+                object_name ? strlen(object_name) : 0,
+                leaf_name,
+                &saved_stream
+        );
+        if (status) {
+            // called function will print the error
+            return status;
+        }
+        if (is_null) {
+            iotcl_json_writer_null(w);
+        } else if (IOTCL_TELEMETRY_FIELD_NUMBER == type) {
+            stream_write_number(w, value->data.number);
+        } else if (IOTCL_TELEMETRY_FIELD_STRING == type) {
+            iotcl_json_writer_string(w, value->data.string);
+        } else {
+            iotcl_json_writer_bool(w, value->data.boolean);
+        }
+        return stream_end_value(FUNCTION_NAME, message->stream, &saved_stream);
+    }
+
+    if (NULL == message->current_data_set) {
+        int status = setup_data_set_object(FUNCTION_NAME, message, NULL);
+        if (status) {
+            // the called function will print the error and clean up
+            return status;
+        }
+    }
+    cJSON *parent_object = message->current_data_set;
+    if (object_name) {
+        int status = tree_get_object(FUNCTION_NAME, message, object_name, &parent_object);
+        if (status) {
+            // the called function will print the error
+            return status;
+        }
+    }
+
+    cJSON *item;
+    if (is_null) {
+        item = cJSON_AddNullToObject(parent_object, leaf_name);
+    } else if (IOTCL_TELEMETRY_FIELD_NUMBER == type) {
+        item = tree_add_number(parent_object, leaf_name, value->data.number);
+    } else if (IOTCL_TELEMETRY_FIELD_STRING == type) {
+        item = cJSON_AddStringToObject(parent_object, leaf_name, value->data.string);
+    } else {
+        item = cJSON_AddBoolToObject(parent_object, leaf_name, value->data.boolean);
+    }
+    if (!item) {
+        IOTCL_ERROR(IOTCL_ERR_OUT_OF_MEMORY, "%s: Out of memory error!", FUNCTION_NAME);
+        return IOTCL_ERR_OUT_OF_MEMORY;
+    }
+    return IOTCL_SUCCESS;
+}
+
+int iotcl_telemetry_move_last_data_set(IotclMessageHandle from, IotclMessageHandle to) {
+    const char *FUNCTION_NAME = "iotcl_telemetry_move_last_data_set";
+    if (NULL == from || NULL == to || from->stream || to->stream) {
+        IOTCL_ERROR(IOTCL_ERR_BAD_VALUE, "%s: Both messages must be created with iotcl_telemetry_create()!", FUNCTION_NAME);
+        return IOTCL_ERR_BAD_VALUE;
+    }
+    int count = cJSON_GetArraySize(from->data_set_array);
+    if (0 == count) {
+        IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "%s: The message has no data sets!", FUNCTION_NAME);
+        return IOTCL_ERR_MISSING_VALUE;
+    }
+    cJSON *data_set = cJSON_DetachItemFromArray(from->data_set_array, count - 1);
+    // cannot fail, as both the array and the item are valid
+    cJSON_AddItemToArray(to->data_set_array, data_set);
+    to->current_data_set = cJSON_GetObjectItem(data_set, "d");
+    from->current_data_set = (count > 1) ?
+                             cJSON_GetObjectItem(cJSON_GetArrayItem(from->data_set_array, count - 2), "d") : NULL;
+    return IOTCL_SUCCESS;
+}
+
+int iotcl_telemetry_write_raw_values(IotclMessageHandle message, IotclTelemetryRawValuesWriter writer_fn, void *context) {
+    const char *FUNCTION_NAME = "iotcl_telemetry_write_raw_values";
+    if (NULL == message || NULL == writer_fn) {
+        IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "%s: The message handle and writer_fn arguments are required!", FUNCTION_NAME);
+        return IOTCL_ERR_MISSING_VALUE;
+    }
+    if (!message->stream) {
+        IOTCL_ERROR(IOTCL_ERR_BAD_VALUE, "%s: The message must be created with iotcl_telemetry_create_in_buffer()!", FUNCTION_NAME);
+        return IOTCL_ERR_BAD_VALUE;
+    }
+
+    IotclTelemetryStream *stream = message->stream;
+    IotclJsonWriter *w = &stream->writer;
+    IotclTelemetryStream saved_stream = *stream;
+
+    if (!stream->has_data_set) {
+        int status = stream_open_data_set(FUNCTION_NAME, stream, NULL);
+        if (status) {
+            // the called function will print the error
+            *stream = saved_stream;
+            iotcl_json_writer_rewind(w, saved_stream.writer.length);
+            return status;
+        }
+    }
+    if (stream->is_object_open) {
+        iotcl_json_writer_char(w, '}');
+        stream->is_object_open = false;
+    }
+    size_t separator_offset = w->length;
+    if (!stream->is_data_set_empty) {
+        iotcl_json_writer_char(w, ',');
+    }
+    size_t values_offset = w->length;
+
+    writer_fn(w, context);
+
+    if (w->overflow) {
+        *stream = saved_stream;
+        iotcl_json_writer_rewind(w, saved_stream.writer.length);
+        IOTCL_ERROR(IOTCL_ERR_OVERFLOW, "%s: The message buffer is full!", FUNCTION_NAME);
+        return IOTCL_ERR_OVERFLOW;
+    }
+    if (w->length == values_offset) {
+        // nothing was written, so don't leave a dangling comma
+        iotcl_json_writer_rewind(w, separator_offset);
+    } else {
+        stream->is_data_set_empty = false;
+    }
+    return IOTCL_SUCCESS;
+}
+
 void iotcl_telemetry_destroy_serialized_string(char *serialized_string) {
     cJSON_free(serialized_string);
 }
 
+const char *iotcl_telemetry_get_serialized_string(IotclMessageHandle message) {
+    if (NULL == message) {
+        IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "iotcl_telemetry_get_serialized_string: The message handle argument is required!");
+        return NULL;
+    }
+    if (!message->stream) {
+        return NULL;
+    }
+    return stream_terminate(message->stream);
+}
+
 void iotcl_telemetry_destroy(IotclMessageHandle message) {
-    if (message) {
-        cJSON_Delete(message->root_value);
-        iotcl_free(message);
+    // messages created in buffer are owned by the user
+    if (!message || message->stream) {
+        return;
+    }
+#if IOTCL_TELEMETRY_POOL_SIZE > 0
+    if (is_pooled(message)) {
+        iotcl_telemetry_reset(message);
+        message->is_pool_in_use = false;
+        return;
+    }
+#endif
+    cJSON_Delete(message->root_value);
+    iotcl_free(message);
+}
+
+int iotcl_telemetry_reset(IotclMessageHandle message) {
+    if (NULL == message) {
+        IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "iotcl_telemetry_reset: The message handle argument is required!");
+        return IOTCL_ERR_MISSING_VALUE;
+    }
+    if (message->stream) {
+        IotclTelemetryStream *stream = message->stream;
+        iotcl_json_writer_rewind(&stream->writer, strlen(IOTCL_TELEMETRY_STREAM_PREFIX));
+        stream->has_data_set = false;
+        stream->is_data_set_empty = false;
+        stream->is_object_open = false;
+        return IOTCL_SUCCESS;
+    }
+    while (message->data_set_array->child) {
+        cJSON_Delete(cJSON_DetachItemViaPointer(message->data_set_array, message->data_set_array->child));
+    }
+    message->current_data_set = NULL;
+    return IOTCL_SUCCESS;
+}
+
+void iotcl_telemetry_release_pool(void) {
+#if IOTCL_TELEMETRY_POOL_SIZE > 0
+    for (int i = 0; i < IOTCL_TELEMETRY_POOL_SIZE; i++) {
+        if (!message_pool[i].is_pool_in_use) {
+            cJSON_Delete(message_pool[i].root_value);
+            memset(&message_pool[i], 0, sizeof(struct IotclMessageHandleTag));
+        }
     }
+#endif
 }
@@ -7,8 +7,12 @@
 #define IOTCL_TELEMETRY_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <time.h>
 
+#include "iotcl_json_writer.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -16,6 +20,17 @@ extern "C" {
 
 typedef struct IotclMessageHandleTag *IotclMessageHandle;
 
+// See iotcl_telemetry_write_raw_values()
+typedef void (*IotclTelemetryRawValuesWriter)(IotclJsonWriter *w, void *context);
+
+// Upper bound of the number of bytes of the iotcl_telemetry_create_in_buffer() buffer used by the message handle itself
+// and by the space reserved for closing the JSON document. Add this to the expected JSON size when sizing the buffer.
+// It is the JSON writer, the other fields of the handle (4 pointers and a bool) and of the stream state (3 size_t
+// and 3 bools), the padding that aligns the handle, and the closing braces with the NUL.
+// iotcl_telemetry.cpp checks that it holds.
+#define IOTCL_TELEMETRY_IN_BUFFER_OVERHEAD \
+    (sizeof(IotclJsonWriter) + 5 * sizeof(void *) + 4 * sizeof(size_t) + (sizeof(void *) - 1) + 5 + 1)
+
 /*
  * Create a message handle given IoTConnect configuration.
  * This handle needs to be passed to all function in this module.
@@ -23,11 +38,34 @@ typedef struct IotclMessageHandleTag *IotclMessageHandle;
  */
 IotclMessageHandle iotcl_telemetry_create(void);
 
+/*
+ * Create a message handle that writes the JSON directly into the supplied buffer as values are set,
+ * instead of building a cJSON tree on the heap. No heap allocations are made by any of the functions in this module
+ * (other than iotcl_telemetry_create_serialized_string()) when a message handle is created this way.
+ * The message handle itself is placed at the start of the buffer, so the buffer needs to be somewhat larger than
+ * the expected JSON. See IOTCL_TELEMETRY_IN_BUFFER_OVERHEAD.
+ * The buffer must remain valid until iotcl_telemetry_destroy() is called. Destroying the message will not free the buffer.
+ * The path semantics are the same as with iotcl_telemetry_create(), with this limitation:
+ * Values of the same nested object (for example "accelerometer.x" and "accelerometer.y")
+ * must be set one after another within a data set. Interleaving them with other values will return IOTCL_ERR_BAD_VALUE.
+ * If a value does not fit into the buffer, IOTCL_ERR_OVERFLOW is returned and the message is left unchanged,
+ * so it can still be sent.
+ */
+IotclMessageHandle iotcl_telemetry_create_in_buffer(char *buffer, size_t buffer_size);
+
 /*
  * Destroys the IoTConnect message handle.
+ * Handles that come from the pool (see IOTCL_TELEMETRY_POOL_SIZE) are returned to the pool instead.
  */
 void iotcl_telemetry_destroy(IotclMessageHandle message);
 
+/*
+ * Removes all data sets from the message, so that the same message handle can be reused for the next message.
+ * The message skeleton (or the buffer of messages created with iotcl_telemetry_create_in_buffer()) is kept,
+ * which avoids the allocations of iotcl_telemetry_create() and the frees of iotcl_telemetry_destroy().
+ */
+int iotcl_telemetry_reset(IotclMessageHandle message);
+
 /*
  * Call this optional function to add more than one data set to your message, or use custom timestamps.
  * You can also call this function before setting any telemetry values to define the time and date corresponding
@@ -50,6 +88,14 @@ int iotcl_telemetry_add_new_data_set(IotclMessageHandle message, const char *iso
  */
 int iotcl_telemetry_set_number(IotclMessageHandle message, const char *path, double value);
 
+// Same as iotcl_telemetry_set_number(), but avoids the floating point formatting and does not lose precision
+// on platforms where double is only 32 bits wide.
+int iotcl_telemetry_set_int32(IotclMessageHandle message, const char *path, int32_t value);
+
+// Sets a fixed point number value / 10^decimals. For example, value 2345 with 2 decimals will be sent as 23.45.
+// decimals can be between 0 and 9. The number is formatted without printf, which is much faster on small MCUs.
+int iotcl_telemetry_set_fixed(IotclMessageHandle message, const char *path, int32_t value, uint8_t decimals);
+
 // Use this function to set STRING, DATE, TIME, DATETIME and similar IoTConnect types that use JSON string.
 int iotcl_telemetry_set_string(IotclMessageHandle message, const char *path, const char *value);
 
@@ -63,9 +109,34 @@ int iotcl_telemetry_set_null(IotclMessageHandle message, const char *path);
 // The user must call iotcl_telemetry_destroy_serialized_string() when done.
 char *iotcl_telemetry_create_serialized_string(IotclMessageHandle message, bool pretty);
 
+// Writes the same JSON as iotcl_telemetry_create_serialized_string() (without pretty printing) with the writer.
+// With a writer that has a sink (see iotcl_json_writer_init_with_sink()), the message can be sent or measured
+// without allocating the whole JSON string.
+// Returns IOTCL_ERR_OVERFLOW if the writer overflowed or its sink did not accept the output.
+int iotcl_telemetry_write_serialized(IotclMessageHandle message, IotclJsonWriter *w);
+
+// Computes the exact length of the JSON that iotcl_telemetry_create_serialized_string() would return
+// (without pretty printing, and not including the null terminator) without allocating any memory.
+// Strings are measured escaped and numbers as they would be formatted.
+// This walks the whole message, so it takes about as long as serializing it.
+int iotcl_telemetry_get_serialized_size(IotclMessageHandle message, size_t *size);
+
+// Allows custom serializers (like the ones generated by scripts/generate-template-binding.py) to write the values
+// directly into the current data set of a message created with iotcl_telemetry_create_in_buffer().
+// writer_fn should write comma separated "name":value pairs, without the surrounding braces.
+// If the values do not fit into the buffer, IOTCL_ERR_OVERFLOW is returned and the message is left unchanged.
+int iotcl_telemetry_write_raw_values(IotclMessageHandle message, IotclTelemetryRawValuesWriter writer_fn, void *context);
+
 // Frees the JSON string created by iotcl_telemetry_create_serialized_string(). Call this once the data is shipped via MQTT.
 void iotcl_telemetry_destroy_serialized_string(char *serialized_string);
 
+// Returns the JSON string of a message created with iotcl_telemetry_create_in_buffer().
+// The returned string is located in the message buffer, so the user should not free it.
+// The message is terminated in place, so more values can still be set after this call,
+// but the returned string is only valid until then.
+// Returns NULL if the message was created with iotcl_telemetry_create().
+const char *iotcl_telemetry_get_serialized_string(IotclMessageHandle message);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,192 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+#include <string.h>
+
+#include "iotcl_internal.h"
+#include "iotcl_log.h"
+#include "iotcl_util.h"
+#include "iotcl.h"
+#include "iotcl_telemetry_batch.h"
+
+static unsigned long batch_now(const IotclTelemetryBatch *batch) {
+    return batch->config.clock_fn ? batch->config.clock_fn() : 0;
+}
+
+static bool batch_is_too_old(const IotclTelemetryBatch *batch) {
+    if (0 == batch->num_samples || 0 == batch->config.max_age_ms) {
+        return false;
+    }
+    // unsigned subtraction handles the clock wrapping around
+    return (unsigned long) (batch_now(batch) - batch->oldest_sample_ms) >= batch->config.max_age_ms;
+}
+
+// Sends the completed samples, if any, and resets the message so that it can be reused for the next batch
+static int batch_send(IotclTelemetryBatch *batch) {
+    int status = IOTCL_SUCCESS;
+    if (!batch->message) {
+        return IOTCL_SUCCESS;
+    }
+    if (batch->num_samples > 0) {
+        status = iotcl_mqtt_send_telemetry_with_class(batch->message, false, batch->config.delivery_class);
+    }
+    batch->num_samples = 0;
+    if (iotcl_telemetry_reset(batch->message) || iotcl_telemetry_get_serialized_size(batch->message, &batch->size)) {
+        // begin_sample will create a new one
+        iotcl_telemetry_destroy(batch->message);
+        batch->message = NULL;
+        batch->size = 0;
+    }
+    return status;
+}
+
+int iotcl_telemetry_batch_init(IotclTelemetryBatch *batch, const IotclTelemetryBatchConfig *config) {
+    const char *FUNCTION_NAME = "iotcl_telemetry_batch_init";
+    if (NULL == batch || NULL == config) {
+        IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "%s: The batch and config arguments are required!", FUNCTION_NAME);
+        return IOTCL_ERR_MISSING_VALUE;
+    }
+    if (0 == config->max_payload_size) {
+        IOTCL_ERROR(IOTCL_ERR_CONFIG_ERROR, "%s: max_payload_size is required!", FUNCTION_NAME);
+        return IOTCL_ERR_CONFIG_ERROR;
+    }
+    if (config->max_age_ms && !config->clock_fn) {
+        IOTCL_ERROR(IOTCL_ERR_CONFIG_MISSING, "%s: clock_fn is required when max_age_ms is set!", FUNCTION_NAME);
+        return IOTCL_ERR_CONFIG_MISSING;
+    }
+    memset(batch, 0, sizeof(IotclTelemetryBatch));
+    batch->config = *config;
+    return IOTCL_SUCCESS;
+}
+
+IotclMessageHandle iotcl_telemetry_batch_begin_sample(IotclTelemetryBatch *batch, const char *iso_timestamp) {
+    const char *FUNCTION_NAME = "iotcl_telemetry_batch_begin_sample";
+    char time_str_buffer[IOTCL_ISO_TIMESTAMP_STR_LEN + 1] = {0};
+
+    if (NULL == batch) {
+        IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "%s: The batch argument is required!", FUNCTION_NAME);
+        return NULL;
+    }
+    if (batch->is_sample_open) {
+        IOTCL_ERROR(IOTCL_ERR_BAD_VALUE, "%s: The previous sample was not ended!", FUNCTION_NAME);
+        return NULL;
+    }
+    if (!iso_timestamp) {
+        // samples in a batch can only be told apart by their timestamps
+        if (iotcl_iso_timestamp_now(time_str_buffer, sizeof(time_str_buffer))) {
+            return NULL; // called function will print the error
+        }
+        iso_timestamp = time_str_buffer;
+    }
+    if (!batch->message) {
+        batch->message = iotcl_telemetry_create();
+        if (!batch->message) {
+            return NULL; // called function will print the error
+        }
+        if (iotcl_telemetry_get_serialized_size(batch->message, &batch->size)) {
+            iotcl_telemetry_destroy(batch->message);
+            batch->message = NULL;
+            return NULL; // called function will print the error
+        }
+    }
+    if (iotcl_telemetry_add_new_data_set(batch->message, iso_timestamp)) {
+        return NULL; // called function will print the error
+    }
+
+    batch->sample_start_ms = batch_now(batch);
+    if (0 == batch->num_samples) {
+        batch->oldest_sample_ms = batch->sample_start_ms;
+    }
+    batch->is_sample_open = true;
+    return batch->message;
+}
+
+int iotcl_telemetry_batch_end_sample(IotclTelemetryBatch *batch) {
+    const char *FUNCTION_NAME = "iotcl_telemetry_batch_end_sample";
+    size_t new_size;
+
+    if (NULL == batch || !batch->is_sample_open) {
+        IOTCL_ERROR(IOTCL_ERR_BAD_VALUE, "%s: No sample was started!", FUNCTION_NAME);
+        return IOTCL_ERR_BAD_VALUE;
+    }
+    batch->is_sample_open = false;
+
+    int status = iotcl_telemetry_get_serialized_size(batch->message, &new_size);
+    if (status) {
+        return status; // called function will print the error
+    }
+
+    if (new_size > batch->config.max_payload_size && batch->num_samples > 0) {
+        // Send the previous samples and start a new batch with this one
+        IotclMessageHandle next_message = iotcl_telemetry_create();
+        if (!next_message || iotcl_telemetry_move_last_data_set(batch->message, next_message)) {
+            // try to send everything at once then, as it may still be accepted
+            IOTCL_WARN(IOTCL_ERR_OUT_OF_MEMORY, "%s: Unable to split the batch!", FUNCTION_NAME);
+            iotcl_telemetry_destroy(next_message);
+            batch->num_samples++;
+            return batch_send(batch);
+        }
+        status = batch_send(batch);
+        iotcl_telemetry_destroy(batch->message);
+        batch->message = next_message;
+        batch->oldest_sample_ms = batch->sample_start_ms;
+        if (iotcl_telemetry_get_serialized_size(batch->message, &new_size)) {
+            batch_send(batch); // we can't tell the size, so just send it
+            return IOTCL_ERR_FAILED;
+        }
+        if (status) {
+            // keep the new sample, but report that the previous batch was not sent
+            batch->num_samples = 1;
+            batch->size = new_size;
+            return status;
+        }
+    }
+
+    batch->last_sample_size = new_size - batch->size;
+    batch->size = new_size;
+    batch->num_samples++;
+
+    // Send now if another sample of the same size would not fit
+    if (batch->size + batch->last_sample_size > batch->config.max_payload_size || batch_is_too_old(batch)) {
+        return batch_send(batch);
+    }
+    return IOTCL_SUCCESS;
+}
+
+int iotcl_telemetry_batch_poll(IotclTelemetryBatch *batch) {
+    if (NULL == batch) {
+        IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "iotcl_telemetry_batch_poll: The batch argument is required!");
+        return IOTCL_ERR_MISSING_VALUE;
+    }
+    // the message contains a partial sample while a sample is open, so wait for it to end
+    if (!batch->is_sample_open && batch_is_too_old(batch)) {
+        return batch_send(batch);
+    }
+    return IOTCL_SUCCESS;
+}
+
+int iotcl_telemetry_batch_flush(IotclTelemetryBatch *batch) {
+    const char *FUNCTION_NAME = "iotcl_telemetry_batch_flush";
+    if (NULL == batch) {
+        IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "%s: The batch argument is required!", FUNCTION_NAME);
+        return IOTCL_ERR_MISSING_VALUE;
+    }
+    if (batch->is_sample_open) {
+        IOTCL_ERROR(IOTCL_ERR_BAD_VALUE, "%s: Cannot flush while a sample is open!", FUNCTION_NAME);
+        return IOTCL_ERR_BAD_VALUE;
+    }
+    return batch_send(batch);
+}
+
+unsigned int iotcl_telemetry_batch_get_sample_count(const IotclTelemetryBatch *batch) {
+    return batch ? batch->num_samples : 0;
+}
+
+void iotcl_telemetry_batch_deinit(IotclTelemetryBatch *batch) {
+    if (batch) {
+        iotcl_telemetry_destroy(batch->message);
+        memset(batch, 0, sizeof(IotclTelemetryBatch));
+    }
+}
@@ -0,0 +1,95 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * Telemetry batching records multiple timestamped samples as separate data sets of the same message
+ * and sends them with a single MQTT publish. The batch is sent when the serialized message nears
+ * the configured payload size, or when the oldest sample in the batch reaches the configured maximum age.
+ *
+ * Typical use:
+ *
+ * IotclMessageHandle msg = iotcl_telemetry_batch_begin_sample(&batch, NULL);
+ * iotcl_telemetry_set_number(msg, "temperature", t);
+ * iotcl_telemetry_batch_end_sample(&batch);
+ * ...
+ * iotcl_telemetry_batch_poll(&batch); // periodically, to enforce the maximum age
+ *
+ * Messages are sent with iotcl_mqtt_send_telemetry(), so the library needs to be configured with mqtt_send_cb.
+ * Each sample needs a timestamp, so either pass it to iotcl_telemetry_batch_begin_sample()
+ * or configure the time_fn in the library configuration.
+ */
+
+#ifndef IOTCL_TELEMETRY_BATCH_H
+#define IOTCL_TELEMETRY_BATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "iotcl.h"
+#include "iotcl_telemetry.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Should return a millisecond counter, like Arduino's millis(). Wrapping around is handled.
+typedef unsigned long (*IotclBatchClockFunction)(void);
+
+typedef struct {
+    // The batch is sent before its serialized size would exceed this value.
+    // A single sample that is larger than this value will be sent on its own.
+    size_t max_payload_size;
+
+    // Optional. If non-zero, the batch is sent once the oldest sample is this old, when
+    // iotcl_telemetry_batch_end_sample() or iotcl_telemetry_batch_poll() is called.
+    unsigned long max_age_ms;
+
+    // Required if max_age_ms is set.
+    IotclBatchClockFunction clock_fn;
+
+    // The delivery class of the batch messages. Defaults to IOTCL_DC_AT_LEAST_ONCE.
+    IotclDeliveryClass delivery_class;
+} IotclTelemetryBatchConfig;
+
+typedef struct {
+    IotclTelemetryBatchConfig config;
+    IotclMessageHandle message;     // The message holding the samples of the current batch. Can be NULL.
+    size_t size;                    // Serialized size of the message with the completed samples
+    size_t last_sample_size;        // How much the last sample added to the serialized size
+    unsigned long oldest_sample_ms; // clock_fn time when the first sample of the current batch was started
+    unsigned long sample_start_ms;  // clock_fn time when the current sample was started
+    unsigned int num_samples;       // Completed samples in the current batch
+    bool is_sample_open;            // Between iotcl_telemetry_batch_begin_sample() and iotcl_telemetry_batch_end_sample()
+} IotclTelemetryBatch;
+
+int iotcl_telemetry_batch_init(IotclTelemetryBatch *batch, const IotclTelemetryBatchConfig *config);
+
+// Starts a new sample as a new data set with the given timestamp (or the current time, if iso_timestamp is NULL).
+// Set the sample values on the returned message with the iotcl_telemetry_set_* functions.
+// The returned message handle is owned by the batch and is only valid until iotcl_telemetry_batch_end_sample().
+IotclMessageHandle iotcl_telemetry_batch_begin_sample(IotclTelemetryBatch *batch, const char *iso_timestamp);
+
+// Completes the sample. If the sample does not fit into the payload size budget, the samples recorded before it
+// are sent and this sample starts the next batch. The batch is also sent if the next sample of a similar size
+// would not fit, or if the oldest sample reached the maximum age.
+int iotcl_telemetry_batch_end_sample(IotclTelemetryBatch *batch);
+
+// Sends the batch if the oldest sample reached the maximum age. Call this periodically.
+int iotcl_telemetry_batch_poll(IotclTelemetryBatch *batch);
+
+// Sends all completed samples now.
+int iotcl_telemetry_batch_flush(IotclTelemetryBatch *batch);
+
+// Number of completed samples waiting to be sent.
+unsigned int iotcl_telemetry_batch_get_sample_count(const IotclTelemetryBatch *batch);
+
+// Discards any samples that were not sent and frees the resources.
+void iotcl_telemetry_batch_deinit(IotclTelemetryBatch *batch);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTCL_TELEMETRY_BATCH_H
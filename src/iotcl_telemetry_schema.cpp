@@ -0,0 +1,182 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include "iotcl_internal.h"
+#include "iotcl_log.h"
+#include "iotcl.h"
+#include "iotcl_telemetry_schema.h"
+
+// Returns the value for the slot if the field is of expected_type.
+// Any value type is accepted if any_value_type is true, like when setting a null value.
+static int iotcl_telemetry_schema_get_value(
+        const char *function_name,
+        IotclTelemetrySchema *schema,
+        uint8_t slot,
+        IotclTelemetryFieldType expected_type,
+        bool any_value_type,
+        IotclTelemetryValue **value
+) {
+    if (NULL == schema || NULL == schema->values) {
+        IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "%s: The schema is not initialized!", function_name);
+        return IOTCL_ERR_MISSING_VALUE;
+    }
+    if (slot >= schema->num_fields) {
+        IOTCL_ERROR(IOTCL_ERR_BAD_VALUE, "%s: Slot %u is out of range!", function_name, (unsigned int) slot);
+        return IOTCL_ERR_BAD_VALUE;
+    }
+    uint8_t type = pgm_read_byte(&schema->fields[slot].type);
+    if (any_value_type ? (IOTCL_TELEMETRY_FIELD_OBJECT == type) : (type != expected_type)) {
+        IOTCL_ERROR(IOTCL_ERR_BAD_VALUE, "%s: Slot %u is of a different type!", function_name, (unsigned int) slot);
+        return IOTCL_ERR_BAD_VALUE;
+    }
+    *value = &schema->values[slot];
+    return IOTCL_SUCCESS;
+}
+
+int iotcl_telemetry_schema_init(
+        IotclTelemetrySchema *schema,
+        const IotclTelemetryField *fields,
+        uint8_t num_fields,
+        IotclTelemetryValue *values
+) {
+    const char *FUNCTION_NAME = "iotcl_telemetry_schema_init";
+    if (NULL == schema || NULL == fields || NULL == values) {
+        IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "%s: The schema, fields and values arguments are required!", FUNCTION_NAME);
+        return IOTCL_ERR_MISSING_VALUE;
+    }
+    if (IOTCL_TELEMETRY_NO_PARENT == num_fields) {
+        IOTCL_ERROR(IOTCL_ERR_OVERFLOW, "%s: Too many fields!", FUNCTION_NAME);
+        return IOTCL_ERR_OVERFLOW;
+    }
+
+    // Fields of a nested object need to follow the object field, so that the serializer can write each object at once
+    uint8_t open_object = IOTCL_TELEMETRY_NO_PARENT;
+    for (uint8_t i = 0; i < num_fields; i++) {
+        IotclTelemetryField field;
+        memcpy_P(&field, &fields[i], sizeof(IotclTelemetryField));
+        if (NULL == field.name || 0 == strlen_P(field.name) || strlen_P(field.name) > IOTCL_TELEMETRY_SCHEMA_NAME_MAX_LEN) {
+            IOTCL_ERROR(IOTCL_ERR_BAD_VALUE, "%s: Field %u has an empty or too long name!", FUNCTION_NAME, (unsigned int) i);
+            return IOTCL_ERR_BAD_VALUE;
+        }
+        if (field.type > IOTCL_TELEMETRY_FIELD_BOOL) {
+            IOTCL_ERROR(IOTCL_ERR_BAD_VALUE, "%s: Field %u has an invalid type!", FUNCTION_NAME, (unsigned int) i);
+            return IOTCL_ERR_BAD_VALUE;
+        }
+        if (IOTCL_TELEMETRY_FIELD_OBJECT == field.type) {
+            if (IOTCL_TELEMETRY_NO_PARENT != field.parent) {
+                IOTCL_ERROR(IOTCL_ERR_BAD_VALUE, "%s: Object field %u cannot be nested!", FUNCTION_NAME, (unsigned int) i);
+                return IOTCL_ERR_BAD_VALUE;
+            }
+            open_object = i;
+        } else if (IOTCL_TELEMETRY_NO_PARENT == field.parent) {
+            open_object = IOTCL_TELEMETRY_NO_PARENT;
+        } else if (field.parent != open_object) {
+            IOTCL_ERROR(IOTCL_ERR_BAD_VALUE,
+                        "%s: Field %u must immediately follow its object field or its siblings!",
+                        FUNCTION_NAME, (unsigned int) i);
+            return IOTCL_ERR_BAD_VALUE;
+        }
+    }
+
+    schema->fields = fields;
+    schema->values = values;
+    schema->num_fields = num_fields;
+    iotcl_telemetry_schema_clear(schema);
+    return IOTCL_SUCCESS;
+}
+
+void iotcl_telemetry_schema_clear(IotclTelemetrySchema *schema) {
+    if (schema && schema->values) {
+        memset(schema->values, 0, sizeof(IotclTelemetryValue) * schema->num_fields);
+    }
+}
+
+int iotcl_telemetry_schema_set_number(IotclTelemetrySchema *schema, uint8_t slot, double value) {
+    IotclTelemetryValue *v;
+    int status = iotcl_telemetry_schema_get_value("iotcl_telemetry_schema_set_number", schema, slot, IOTCL_TELEMETRY_FIELD_NUMBER, false, &v);
+    if (status) {
+        return status; // called function will print the error
+    }
+    v->data.number = value;
+    v->state = IOTCL_TELEMETRY_VALUE_SET;
+    return IOTCL_SUCCESS;
+}
+
+int iotcl_telemetry_schema_set_string(IotclTelemetrySchema *schema, uint8_t slot, const char *value) {
+    IotclTelemetryValue *v;
+    int status = iotcl_telemetry_schema_get_value("iotcl_telemetry_schema_set_string", schema, slot, IOTCL_TELEMETRY_FIELD_STRING, false, &v);
+    if (status) {
+        return status; // called function will print the error
+    }
+    v->data.string = value;
+    v->state = value ? IOTCL_TELEMETRY_VALUE_SET : IOTCL_TELEMETRY_VALUE_NULL;
+    return IOTCL_SUCCESS;
+}
+
+int iotcl_telemetry_schema_set_bool(IotclTelemetrySchema *schema, uint8_t slot, bool value) {
+    IotclTelemetryValue *v;
+    int status = iotcl_telemetry_schema_get_value("iotcl_telemetry_schema_set_bool", schema, slot, IOTCL_TELEMETRY_FIELD_BOOL, false, &v);
+    if (status) {
+        return status; // called function will print the error
+    }
+    v->data.boolean = value;
+    v->state = IOTCL_TELEMETRY_VALUE_SET;
+    return IOTCL_SUCCESS;
+}
+
+int iotcl_telemetry_schema_set_null(IotclTelemetrySchema *schema, uint8_t slot) {
+    IotclTelemetryValue *v;
+    int status = iotcl_telemetry_schema_get_value("iotcl_telemetry_schema_set_null", schema, slot, IOTCL_TELEMETRY_FIELD_OBJECT, true, &v);
+    if (status) {
+        return status; // called function will print the error
+    }
+    v->state = IOTCL_TELEMETRY_VALUE_NULL;
+    return IOTCL_SUCCESS;
+}
+
+int iotcl_telemetry_schema_serialize(const IotclTelemetrySchema *schema, IotclMessageHandle message) {
+    const char *FUNCTION_NAME = "iotcl_telemetry_schema_serialize";
+    char object_name[IOTCL_TELEMETRY_SCHEMA_NAME_MAX_LEN + 1];
+    char leaf_name[IOTCL_TELEMETRY_SCHEMA_NAME_MAX_LEN + 1];
+
+    if (NULL == schema || NULL == schema->values) {
+        IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "%s: The schema is not initialized!", FUNCTION_NAME);
+        return IOTCL_ERR_MISSING_VALUE;
+    }
+    if (NULL == message) {
+        IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "%s: The message handle argument is required!", FUNCTION_NAME);
+        return IOTCL_ERR_MISSING_VALUE;
+    }
+
+    object_name[0] = '\0';
+    for (uint8_t i = 0; i < schema->num_fields; i++) {
+        IotclTelemetryField field;
+        memcpy_P(&field, &schema->fields[i], sizeof(IotclTelemetryField));
+        if (IOTCL_TELEMETRY_FIELD_OBJECT == field.type) {
+            // the length was validated by iotcl_telemetry_schema_init()
+            strcpy_P(object_name, field.name);
+            continue;
+        }
+        const IotclTelemetryValue *value = &schema->values[i];
+        if (IOTCL_TELEMETRY_VALUE_UNSET == value->state) {
+            continue;
+        }
+        strcpy_P(leaf_name, field.name);
+        int status = iotcl_telemetry_set_value_with_object(
+                message,
+                IOTCL_TELEMETRY_NO_PARENT == field.parent ? NULL : object_name,
+                leaf_name,
+                (IotclTelemetryFieldType) field.type,
+                value
+        );
+        if (status) {
+            return status; // called function will print the error
+        }
+    }
+    return IOTCL_SUCCESS;
+}
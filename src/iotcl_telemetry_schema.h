@@ -0,0 +1,127 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * Telemetry schema allows the application to declare the telemetry fields once, as a constant table in flash,
+ * and then set the values by slot index (the index of the field in the table) into a preallocated value array.
+ * Serializing the schema into a message walks the table, so there is no path parsing,
+ * key duplication or object lookup while the values are being set.
+ *
+ * Example:
+ *
+ * static const char NAME_TEMPERATURE[] PROGMEM = "temperature";
+ * static const char NAME_LIGHT[] PROGMEM = "light";
+ * static const char NAME_RED[] PROGMEM = "red";
+ * static const char NAME_GREEN[] PROGMEM = "green";
+ *
+ * enum { SLOT_TEMPERATURE, SLOT_LIGHT, SLOT_LIGHT_RED, SLOT_LIGHT_GREEN, SLOT_COUNT };
+ *
+ * static const IotclTelemetryField telemetry_fields[SLOT_COUNT] PROGMEM = {
+ *     {NAME_TEMPERATURE, IOTCL_TELEMETRY_FIELD_NUMBER, IOTCL_TELEMETRY_NO_PARENT},
+ *     {NAME_LIGHT, IOTCL_TELEMETRY_FIELD_OBJECT, IOTCL_TELEMETRY_NO_PARENT},
+ *     {NAME_RED, IOTCL_TELEMETRY_FIELD_NUMBER, SLOT_LIGHT},
+ *     {NAME_GREEN, IOTCL_TELEMETRY_FIELD_NUMBER, SLOT_LIGHT},
+ * };
+ * static IotclTelemetryValue telemetry_values[SLOT_COUNT];
+ * static IotclTelemetrySchema schema;
+ *
+ * iotcl_telemetry_schema_init(&schema, telemetry_fields, SLOT_COUNT, telemetry_values);
+ * ...
+ * iotcl_telemetry_schema_set_number(&schema, SLOT_LIGHT_RED, red);
+ * ...
+ * iotcl_telemetry_schema_serialize(&schema, msg);
+ * iotcl_mqtt_send_telemetry(msg, false);
+ */
+
+#ifndef IOTCL_TELEMETRY_SCHEMA_H
+#define IOTCL_TELEMETRY_SCHEMA_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "iotcl_pgmspace.h"
+#include "iotcl_telemetry.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Longest field name supported, not including the null terminator.
+// Names are copied from flash into a buffer of this size on the stack when serializing.
+#ifndef IOTCL_TELEMETRY_SCHEMA_NAME_MAX_LEN
+#define IOTCL_TELEMETRY_SCHEMA_NAME_MAX_LEN 31
+#endif
+
+// Parent value of top level fields
+#define IOTCL_TELEMETRY_NO_PARENT 0xFF
+
+typedef enum {
+    IOTCL_TELEMETRY_FIELD_OBJECT = 0, // A nested object like "light" in "light.red". Does not hold a value.
+    IOTCL_TELEMETRY_FIELD_NUMBER,
+    IOTCL_TELEMETRY_FIELD_STRING,
+    IOTCL_TELEMETRY_FIELD_BOOL
+} IotclTelemetryFieldType;
+
+typedef enum {
+    IOTCL_TELEMETRY_VALUE_UNSET = 0, // The field will be omitted from the message
+    IOTCL_TELEMETRY_VALUE_SET,
+    IOTCL_TELEMETRY_VALUE_NULL      // The field will be sent as null
+} IotclTelemetryValueState;
+
+// An entry of the schema table. The table and the names need to be stored in PROGMEM.
+// Fields of a nested object must immediately follow their IOTCL_TELEMETRY_FIELD_OBJECT field.
+typedef struct {
+    const char *name;   // PROGMEM string with the name of the field. Only the leaf name, like "red" in "light.red".
+    uint8_t type;       // One of IotclTelemetryFieldType
+    uint8_t parent;     // Index of the IOTCL_TELEMETRY_FIELD_OBJECT field in the table, or IOTCL_TELEMETRY_NO_PARENT
+} IotclTelemetryField;
+
+typedef struct {
+    union {
+        double number;
+        const char *string; // Not copied. Must remain valid until the schema is serialized.
+        bool boolean;
+    } data;
+    uint8_t state;          // One of IotclTelemetryValueState
+} IotclTelemetryValue;
+
+typedef struct {
+    const IotclTelemetryField *fields; // PROGMEM table
+    IotclTelemetryValue *values;       // One value for each field. Values of IOTCL_TELEMETRY_FIELD_OBJECT are not used.
+    uint8_t num_fields;
+} IotclTelemetrySchema;
+
+// Sets up the schema with the fields table in PROGMEM and a values array with num_fields entries.
+// The table is validated once here, so that it does not need to be validated while setting and serializing the values.
+// All values will be initially unset.
+int iotcl_telemetry_schema_init(
+        IotclTelemetrySchema *schema,
+        const IotclTelemetryField *fields,
+        uint8_t num_fields,
+        IotclTelemetryValue *values
+);
+
+// Marks all values as unset, so that they will be omitted from the next message.
+void iotcl_telemetry_schema_clear(IotclTelemetrySchema *schema);
+
+int iotcl_telemetry_schema_set_number(IotclTelemetrySchema *schema, uint8_t slot, double value);
+
+// The string is not copied and must remain valid until iotcl_telemetry_schema_serialize() is called.
+int iotcl_telemetry_schema_set_string(IotclTelemetrySchema *schema, uint8_t slot, const char *value);
+
+int iotcl_telemetry_schema_set_bool(IotclTelemetrySchema *schema, uint8_t slot, bool value);
+
+int iotcl_telemetry_schema_set_null(IotclTelemetrySchema *schema, uint8_t slot);
+
+// Adds all values that are set into the current data set of the message.
+// Works with messages created with both iotcl_telemetry_create() and iotcl_telemetry_create_in_buffer().
+// The values remain set after this call.
+int iotcl_telemetry_schema_serialize(const IotclTelemetrySchema *schema, IotclMessageHandle message);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTCL_TELEMETRY_SCHEMA_H
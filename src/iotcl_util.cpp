@@ -98,4 +98,15 @@ bool iotcl_is_printable(const char *what, const char *str, size_t length) {
         }
     }
     return true;
-}
\ No newline at end of file
+}
+
+uint16_t iotcl_crc16_update(uint16_t crc, const void *data, size_t size) {
+    const uint8_t *p = (const uint8_t *) data;
+    for (size_t i = 0; i < size; i++) {
+        crc ^= (uint16_t) ((uint16_t) p[i] << 8);
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? (uint16_t) ((crc << 1) ^ 0x1021) : (uint16_t) (crc << 1);
+        }
+    }
+    return crc;
+}
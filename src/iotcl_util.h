@@ -6,6 +6,8 @@
 #define IOTCL_UTIL_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <time.h>
 
 #ifdef __cplusplus
@@ -30,6 +32,9 @@ int iotcl_iso_timestamp_now(char *buffer, size_t buffer_size);
 // Length should not include the null string terminator.
 bool iotcl_is_printable(const char* what, const char* str, size_t length);
 
+// CRC-16/CCITT-FALSE of data, continuing from crc. Start with 0xFFFF.
+uint16_t iotcl_crc16_update(uint16_t crc, const void *data, size_t size);
+
 
 #ifdef __cplusplus
 }
@@ -11,15 +11,29 @@
 #include "iotcl_util.h"
 #include "iotcl_dra_discovery.h"
 #include "iotcl_dra_identity.h"
-#include "iotc_time.h"
 #include "iotc_http_request.h"
+#include "iotc_identity_cache.h"
 #include "iotc_mqtt_client.h"
+#include "iotc_transport.h"
 #include "iotconnect.h"
 
 // #define AWS_QUALIFICATION
 
 static bool is_verbose = false;
+static const IotConnectTransport *transport = &iotc_default_transport;
 static IotConnectMqttClientConfig mqtt_config = {0};
+static IotConnectStatusCallback status_cb = NULL;
+// The MQTT settings came from the identity cache and the client has not connected with them yet
+static bool is_cached_config_unconfirmed = false;
+
+// Kept for running discovery again when the MQTT connection keeps failing
+static struct {
+    IotConnectConnectionType connection_type;
+    char *duid;
+    char *cpid;
+    char *env;
+    uint32_t identity_cache_ttl;
+} discovery_params = {IOTC_CT_UNDEFINED, NULL, NULL, NULL, 0};
 
 static void dump_response(const char *message, IotConnectHttpResponse *response) {
     if (message) {
@@ -48,10 +62,51 @@ static int validate_response(IotConnectHttpResponse *response) {
     return IOTCL_SUCCESS;
 }
 
-static int run_http_identity(IotConnectConnectionType ct, const char* duid, const char *cpid, const char *env) {
+static int discovery_sink(void *context, const char *data, size_t data_length) {
+    return iotcl_dra_discovery_stream_feed((IotclDraDiscoveryStream *) context, data, data_length);
+}
+
+static int identity_sink(void *context, const char *data, size_t data_length) {
+    return iotcl_dra_identity_stream_feed((IotclDraIdentityStream *) context, data, data_length);
+}
+
+// Passes the response to the parser as it arrives if the transport can stream it, or whole otherwise
+static int https_get_parsed(const IotclDraUrlContext *url, IotConnectHttpBodySink sink_fn, void *context) {
+    if (transport->https_request_streamed) {
+        return transport->https_request_streamed(
+            iotcl_dra_url_get_hostname(url),
+            iotcl_dra_url_get_resource(url),
+            NULL,
+            sink_fn,
+            context
+        );
+    }
+
     IotConnectHttpResponse response = {0};
+    int status = transport->https_request(&response,
+        iotcl_dra_url_get_hostname(url),
+        iotcl_dra_url_get_resource(url),
+        NULL
+    );
+    if (!status) {
+        status = validate_response(&response); // called function will print the error
+    }
+    if (!status) {
+        status = sink_fn(context, response.data, strlen(response.data));
+        if (status) {
+            dump_response(NULL, &response);
+        }
+    }
+    transport->free_https_response(&response);
+    return status;
+}
+
+static int run_http_identity(IotConnectConnectionType ct, const char* duid, const char *cpid, const char *env) {
     IotclDraUrlContext discovery_url = {0};
     IotclDraUrlContext identity_url = {0};
+    // the streams are cleared, so that they can be deinitialized whether they were used or not
+    IotclDraDiscoveryStream discovery = {0};
+    IotclDraIdentityStream identity = {0};
     int status;
     switch (ct) {
         case IOTC_CT_AWS:
@@ -80,27 +135,16 @@ static int run_http_identity(IotConnectConnectionType ct, const char* duid, cons
 
     if (status) goto cleanup; // called function will print the error
 
-
-    status = iotconnect_https_request(&response,
-        iotcl_dra_url_get_hostname(&discovery_url),
-        iotcl_dra_url_get_resource(&discovery_url),
-        NULL
-    );
+    iotcl_dra_discovery_stream_init(&discovery);
+    status = https_get_parsed(&discovery_url, discovery_sink, &discovery);
     if (status) goto cleanup; // called function will print the error
 
-    status = validate_response(&response);
-    if (status) goto cleanup; // called function will print the error
-
-    status = iotcl_dra_discovery_parse(&identity_url, 0, response.data);
+    status = iotcl_dra_discovery_stream_finish(&discovery, &identity_url, 0);
     if (status) {
         Log.errorf(F("Error while parsing discovery response from %s\n"), iotcl_dra_url_get_url(&discovery_url));
-        dump_response(NULL, &response);
         goto cleanup;
     }
 
-    iotconnect_free_https_response(&response);
-    memset(&response, 0, sizeof(response));
-
     status = iotcl_dra_identity_build_url(&identity_url, duid);
     if (status) goto cleanup; // called function will print the error
 
@@ -108,20 +152,15 @@ static int run_http_identity(IotConnectConnectionType ct, const char* duid, cons
         Log.infof(F("Using identity URL %s\n"), iotcl_dra_url_get_url(&identity_url));
     }
 
-    status = iotconnect_https_request(&response,
-        iotcl_dra_url_get_hostname(&identity_url),
-        iotcl_dra_url_get_resource(&identity_url),
-        NULL
-    );
+    status = iotcl_dra_identity_stream_init(&identity);
     if (status) goto cleanup; // called function will print the error
 
-    status = validate_response(&response);
+    status = https_get_parsed(&identity_url, identity_sink, &identity);
     if (status) goto cleanup; // called function will print the error
 
-    status = iotcl_dra_identity_configure_library_mqtt(response.data);
+    status = iotcl_dra_identity_stream_finish(&identity);
     if (status) {
         Log.errorf(F("Error while parsing identity response from %s\n"), iotcl_dra_url_get_url(&identity_url));
-        dump_response(NULL, &response);
         goto cleanup;
     }
 
@@ -133,38 +172,146 @@ static int run_http_identity(IotConnectConnectionType ct, const char* duid, cons
     }
 
     cleanup:
+    iotcl_dra_discovery_stream_deinit(&discovery);
+    iotcl_dra_identity_stream_deinit(&identity);
     iotcl_dra_url_deinit(&discovery_url);
     iotcl_dra_url_deinit(&identity_url);
-    iotconnect_free_https_response(&response);
     return status;
 }
 
-static void iotconnect_sdk_mqtt_send_cb(const char *topic, const char *json_str) {
+static void free_discovery_params(void) {
+    iotcl_free(discovery_params.duid);
+    iotcl_free(discovery_params.cpid);
+    iotcl_free(discovery_params.env);
+    memset(&discovery_params, 0, sizeof(discovery_params));
+}
+
+static void free_mqtt_config(IotclMqttConfig *mc) {
+    iotcl_free(mc->client_id);
+    iotcl_free(mc->username);
+    iotcl_free(mc->host);
+    iotcl_free(mc->pub_rpt);
+    iotcl_free(mc->pub_ack);
+    iotcl_free(mc->sub_c2d);
+    iotcl_free(mc->cd);
+    iotcl_free(mc->version);
+    memset(mc, 0, sizeof(IotclMqttConfig));
+}
+
+// Replaces the MQTT settings with the ones from a new discovery and identity run.
+// The previous settings are kept if that fails.
+static bool on_mqtt_rediscovery(void) {
+    IotclMqttConfig *mc = iotcl_mqtt_get_config();
+    IotclMqttConfig previous = *mc;
+
+    if (discovery_params.identity_cache_ttl) {
+        iotc_identity_cache_invalidate(); // the cached settings may be the ones that keep failing
+    }
+    memset(mc, 0, sizeof(IotclMqttConfig)); // identity expects an empty configuration
+    int status = run_http_identity(
+        discovery_params.connection_type,
+        discovery_params.duid,
+        discovery_params.cpid,
+        discovery_params.env
+    );
+    if (status) {
+        free_mqtt_config(mc); // in case it was partially configured
+        *mc = previous;
+        return false;
+    }
+    free_mqtt_config(&previous);
+    if (discovery_params.identity_cache_ttl) {
+        iotc_identity_cache_store(
+            discovery_params.connection_type,
+            discovery_params.cpid,
+            discovery_params.env,
+            discovery_params.duid
+        );
+    }
+    return true;
+}
+
+static void on_mqtt_status(IotConnectConnectionStatus status) {
+    if (IOTC_CS_MQTT_CONNECTED == status) {
+        is_cached_config_unconfirmed = false;
+    } else if (IOTC_CS_MQTT_DISCONNECTED == status && is_cached_config_unconfirmed) {
+        // The client gave up before it could connect with the cached settings. They may have changed,
+        // so discovery will be run at the next iotconnect_sdk_init().
+        iotc_identity_cache_invalidate();
+        is_cached_config_unconfirmed = false;
+    }
+    if (status_cb) {
+        status_cb(status);
+    }
+}
+
+// Runs discovery and identity, and caches the result if the cache is enabled
+static int run_http_identity_and_cache(IotConnectClientConfig *c) {
+    int status = run_http_identity(c->connection_type, c->duid, c->cpid, c->env);
+    if (status) {
+        return status;
+    }
+    if (is_verbose) {
+        Log.info(F("Identity response parsing successful."));
+    }
+    if (c->identity_cache_ttl) {
+        iotc_identity_cache_store(c->connection_type, c->cpid, c->env, c->duid);
+    }
+    return IOTCL_SUCCESS;
+}
+
+static void iotconnect_sdk_mqtt_send_cb(const char *topic, const char *json_str, IotclDeliveryClass delivery_class) {
     if (is_verbose) {
         Log.infof(F(">: %s\n"), json_str);
     }
-    iotc_mqtt_client_send_message(topic, json_str);
+    transport->mqtt_publish(topic, json_str, delivery_class);
 }
 
-static void on_mqtt_message(const char* message) {
+static int iotconnect_sdk_mqtt_send_streamed_cb(
+        const char *topic,
+        IotclMqttPayloadWriter writer_fn,
+        void *context,
+        IotclDeliveryClass delivery_class
+) {
+    if (is_verbose || !transport->mqtt_publish_streamed) {
+        return IOTCL_ERR_IGNORED; // send the message as a string, so that it can be logged
+    }
+    return transport->mqtt_publish_streamed(topic, writer_fn, context, delivery_class) ? IOTCL_SUCCESS : IOTCL_ERR_FAILED;
+}
+
+static void on_mqtt_message(char* message, size_t message_length) {
     if (is_verbose) {
         Log.infof(F("event>>> %s"), message);
     }
-    iotcl_c2d_process_event(message);
+    // the message buffer is discarded after this call, so it can be parsed in place
+    iotcl_c2d_process_event_in_place(message, message_length);
 }
 
 void iotconnect_sdk_disconnect(void) {
-    iotc_mqtt_client_disconnect();
+    is_cached_config_unconfirmed = false; // the settings did not fail
+    transport->mqtt_disconnect();
     Log.info(F("Disconnected."));
 }
 
 bool iotconnect_sdk_is_connected(void) {
-    return iotc_mqtt_client_is_connected();
+    return transport->mqtt_is_connected();
+}
+
+IotConnectConnectionStatus iotconnect_sdk_get_status(void) {
+    return transport->mqtt_get_status();
+}
+
+uint16_t iotconnect_sdk_get_last_publish_id(void) {
+    return transport->mqtt_get_last_publish_id();
+}
+
+const IotConnectTransport *iotconnect_sdk_get_transport(void) {
+    return transport;
 }
 
 
 void iotconnect_sdk_loop(void) {
-    iotc_mqtt_client_loop();
+    transport->mqtt_loop();
 }
 
 #ifdef AWS_QUALIFICATION
@@ -181,7 +328,7 @@ void iotc_qualification_start(const char* host) {
     while(true) {
         if (!iotconnect_sdk_is_connected()) {
             delay(10000);
-            if (!iotc_mqtt_client_init(&mqtt_config)) {
+            if (!transport->mqtt_init(&mqtt_config)) {
                 Log.error(F("Failed to connect!"));
                 continue;
             }
@@ -213,6 +360,7 @@ bool iotconnect_sdk_init(IotConnectClientConfig *c) {
     }
 
     is_verbose = c->verbose;
+    transport = c->transport ? c->transport : &iotc_default_transport;
 
     IotclClientConfig iotcl_cfg;
     iotcl_init_client_config(&iotcl_cfg);
@@ -220,29 +368,49 @@ bool iotconnect_sdk_init(IotConnectClientConfig *c) {
     iotcl_cfg.device.duid = c->duid;
     iotcl_cfg.device.instance_type = IOTCL_DCT_CUSTOM; //we will use discovery, so CUSTOM
     iotcl_cfg.mqtt_send_cb = iotconnect_sdk_mqtt_send_cb;
+    iotcl_cfg.mqtt_send_streamed_cb = iotconnect_sdk_mqtt_send_streamed_cb;
     iotcl_cfg.events.cmd_cb = c->cmd_cb;
     iotcl_cfg.events.ota_cb = c->ota_cb;
 
     status = iotcl_init(&iotcl_cfg);
 
-    iotc_get_time_modem();
+    if (transport->sync_time) {
+        transport->sync_time();
+    }
 
     if (status) {
         // called function will print the error
         return false;
     }
 
-	status = run_http_identity(c->connection_type, c->duid, c->cpid, c->env);
-    if (status) {
+    is_cached_config_unconfirmed = c->identity_cache_ttl
+        && iotc_identity_cache_load(c->connection_type, c->cpid, c->env, c->duid, c->identity_cache_ttl);
+    if (is_cached_config_unconfirmed) {
+        Log.info(F("Using the cached MQTT settings."));
+    } else if (run_http_identity_and_cache(c)) {
 		iotcl_deinit();
         return false;
     }
-    if (is_verbose) {
-        Log.info(F("Identity response parsing successful."));
-    }
 
-    mqtt_config.status_cb = c->status_cb;
+    status_cb = c->status_cb;
+    mqtt_config.status_cb = on_mqtt_status;
     mqtt_config.c2d_msg_cb = on_mqtt_message;
+    mqtt_config.delivery_cb = c->delivery_cb;
+    mqtt_config.auto_reconnect = c->auto_reconnect;
+    mqtt_config.rediscovery_cb = NULL;
+    if (c->auto_reconnect) {
+        free_discovery_params();
+        discovery_params.connection_type = c->connection_type;
+        discovery_params.duid = iotcl_strdup(c->duid);
+        discovery_params.cpid = iotcl_strdup(c->cpid);
+        discovery_params.env = iotcl_strdup(c->env);
+        discovery_params.identity_cache_ttl = c->identity_cache_ttl;
+        if (discovery_params.duid && discovery_params.cpid && discovery_params.env) {
+            mqtt_config.rediscovery_cb = on_mqtt_rediscovery;
+        } else {
+            Log.warn(F("Out of memory. Discovery will not be repeated when the MQTT connection keeps failing."));
+        }
+    }
 
 #ifdef AWS_QUALIFICATION
     iotc_qualification_start("your-example-host.deviceadvisor.iot.eu-west-1.amazonaws.com");
@@ -250,7 +418,22 @@ bool iotconnect_sdk_init(IotConnectClientConfig *c) {
     return true;
 #endif
 
-    if (!iotc_mqtt_client_init(&mqtt_config)) {
+    if (c->async_connect) {
+        // iotconnect_sdk_loop() will do the rest
+        return transport->mqtt_start(&mqtt_config);
+    }
+    bool is_cached = is_cached_config_unconfirmed; // the status callback clears it
+    bool is_connected = transport->mqtt_init(&mqtt_config);
+    if (!is_connected && is_cached) {
+        // the status callback has invalidated the cache as well
+        Log.warn(F("Unable to connect with the cached MQTT settings. Running discovery again..."));
+        free_mqtt_config(iotcl_mqtt_get_config()); // identity expects an empty configuration
+        if (run_http_identity_and_cache(c)) {
+            return false;
+        }
+        is_connected = transport->mqtt_init(&mqtt_config);
+    }
+    if (!is_connected) {
         Log.error(F("Failed to connect!"));
         return false;
     }
@@ -15,7 +15,12 @@
 typedef enum {
     IOTC_CS_UNDEFINED,
     IOTC_CS_MQTT_CONNECTED,
-    IOTC_CS_MQTT_DISCONNECTED
+    IOTC_CS_MQTT_DISCONNECTED,
+    // The steps of a connection attempt, reported as iotconnect_sdk_loop() advances the connection
+    IOTC_CS_MQTT_TLS,           // TLS is being set up and the connection requested from the modem
+    IOTC_CS_MQTT_CONNECTING,    // Waiting for the broker to accept the connection
+    IOTC_CS_MQTT_SUBSCRIBING,   // Subscribing to the C2D topic
+    IOTC_CS_MQTT_BACKOFF        // Waiting before the next connection attempt
 } IotConnectConnectionStatus;
 
 typedef enum {
@@ -24,8 +29,21 @@ typedef enum {
     IOTC_CT_AZURE
 } IotConnectConnectionType;
 
+typedef enum {
+    IOTC_DS_DELIVERED = 0,  // The broker acknowledged the message
+    IOTC_DS_FAILED,         // The modem or the broker rejected the message, or the connection was lost while sending it
+    IOTC_DS_TIMED_OUT,      // The acknowledgement was not received in time. The message may still have been delivered.
+    IOTC_DS_DISCARDED       // The message was never sent, because the client disconnected or gave up connecting
+} IotConnectDeliveryStatus;
+
+// See iotc_transport.h
+typedef struct IotConnectTransportTag IotConnectTransport;
+
 typedef void (*IotConnectStatusCallback)(IotConnectConnectionStatus data);
 
+// Reports the delivery of a message with the ID returned by iotconnect_sdk_get_last_publish_id() after sending it.
+typedef void (*IotConnectDeliveryCallback)(uint16_t publish_id, IotConnectDeliveryStatus status);
+
 
 typedef struct {
     char *env;    // Settings -> Key Vault -> CPID.
@@ -35,7 +53,15 @@ typedef struct {
     IotclOtaCallback ota_cb; // callback for OTA events.
     IotclCommandCallback cmd_cb; // callback for command events.
     IotConnectStatusCallback status_cb; // callback for connection status
+    IotConnectDeliveryCallback delivery_cb; // optional callback for the delivery status of sent messages
     bool verbose; // If true, we will output extra info and sent and received MQTT json data to standard out
+    bool async_connect; // If true, iotconnect_sdk_init() only starts the MQTT connection and iotconnect_sdk_loop() completes it
+    bool auto_reconnect; // If true, iotconnect_sdk_loop() reconnects with backoff whenever the MQTT connection is lost
+    const IotConnectTransport *transport; // Optional. The platform's default transport is used if NULL.
+    // Optional. If not zero, the MQTT settings from discovery and identity are kept in persistent storage
+    // and used for this many seconds, so that the device can connect without the HTTPS requests at boot.
+    // See iotc_identity_cache.h.
+    uint32_t identity_cache_ttl;
 } IotConnectClientConfig;
 
 // call iotconnect_sdk_init_and_get_config first and configure the SDK before calling iotconnect_sdk_init()
@@ -43,11 +69,18 @@ bool iotconnect_sdk_init(IotConnectClientConfig *c);
 
 bool iotconnect_sdk_is_connected(void);
 
+// Returns the state of the MQTT connection, which is also reported to the status callback as it changes.
+IotConnectConnectionStatus iotconnect_sdk_get_status(void);
+
 // Will check if there are inbound messages and call adequate callbacks if there are any
 // This is technically not required for the Paho implementation.
 void iotconnect_sdk_receive(void);
 
-// allow mqtt to do work (keepalive and c2d message processing)
+// Telemetry and acks are queued and sent in the background, so sending does not wait for the broker.
+// Returns the ID of the last message that was queued, which will be passed to the delivery callback.
+uint16_t iotconnect_sdk_get_last_publish_id(void);
+
+// allow mqtt to do work (connecting, keepalive and c2d message processing)
 void iotconnect_sdk_loop(void);
 
 void iotconnect_sdk_disconnect(void);